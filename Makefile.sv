@@ -12,7 +12,7 @@ MAKEFILE      = Makefile.sv
 
 CC            = /Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/bin/clang
 CXX           = /Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/bin/clang++
-DEFINES       = -DNDEBUG -DBUILD_RELEASE -DNO_TIMING -DNO_HIT_COUNTS -DHAVE_PIPER -DHAVE_PLUGIN_CHECKER_HELPER -DHAVE_BZ2 -DHAVE_FFTW3 -DHAVE_FFTW3F -DHAVE_SNDFILE -DHAVE_SAMPLERATE -DHAVE_RUBBERBAND -DHAVE_LIBLO -DHAVE_MAD -DHAVE_ID3TAG -DHAVE_PORTAUDIO -DHAVE_COREAUDIO -DHAVE_VDSP -D__MACOSX_CORE__ -DUSE_SORD -DQT_NO_DEBUG -DQT_SVG_LIB -DQT_WIDGETS_LIB -DQT_GUI_LIB -DQT_NETWORK_LIB -DQT_XML_LIB -DQT_CORE_LIB
+DEFINES       = -DNDEBUG -DBUILD_RELEASE -DNO_HIT_COUNTS -DHAVE_PIPER -DHAVE_PLUGIN_CHECKER_HELPER -DHAVE_BZ2 -DHAVE_FFTW3 -DHAVE_FFTW3F -DHAVE_SNDFILE -DHAVE_SAMPLERATE -DHAVE_RUBBERBAND -DHAVE_LIBLO -DHAVE_MAD -DHAVE_ID3TAG -DHAVE_PORTAUDIO -DHAVE_COREAUDIO -DHAVE_VDSP -D__MACOSX_CORE__ -DUSE_SORD -DQT_NO_DEBUG -DQT_SVG_LIB -DQT_WIDGETS_LIB -DQT_GUI_LIB -DQT_NETWORK_LIB -DQT_XML_LIB -DQT_CORE_LIB
 CFLAGS        = -pipe -O2 $(EXPORT_ARCH_ARGS) -isysroot /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX10.13.sdk -mmacosx-version-min=10.10 -Wall -W -fPIC $(DEFINES)
 CXXFLAGS      = -pipe -stdlib=libc++ -O2 -O3 -ffast-math -std=gnu++11 $(EXPORT_ARCH_ARGS) -isysroot /Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX10.13.sdk -mmacosx-version-min=10.10 -Wall -W -fPIC $(DEFINES)
 INCPATH       = -I. -Isv-dependency-builds/osx/include -I. -Ibqvec -Ibqvec/bqvec -Ibqfft -Ibqresample -Ibqaudioio -Ibqaudioio/bqaudioio -Ipiper-cpp -Ichecker -Ichecker/checker -Idataquay -Idataquay/dataquay -Isvcore -Isvcore/data -Isvcore/plugin/api/alsa -Isvgui -Isvapp -Ivamp-plugin-sdk -I../Qt/5.9.1/clang_64/lib/QtSvg.framework/Headers -I../Qt/5.9.1/clang_64/lib/QtWidgets.framework/Headers -I../Qt/5.9.1/clang_64/lib/QtGui.framework/Headers -I../Qt/5.9.1/clang_64/lib/QtNetwork.framework/Headers -I../Qt/5.9.1/clang_64/lib/QtXml.framework/Headers -I../Qt/5.9.1/clang_64/lib/QtCore.framework/Headers -Io -I/Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX10.13.sdk/System/Library/Frameworks/OpenGL.framework/Headers -I/Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX10.13.sdk/System/Library/Frameworks/AGL.framework/Headers -I../Qt/5.9.1/clang_64/mkspecs/macx-clang -F/Users/harshverma/Qt/5.9.1/clang_64/lib
@@ -0,0 +1,38 @@
+
+TEMPLATE = app
+
+exists(config.pri) {
+    include(config.pri)
+}
+
+!exists(config.pri) {
+    include(noconfig.pri)
+}
+
+include(base.pri)
+
+CONFIG += console
+QT += network xml
+QT -= gui
+
+win32-x-g++:QMAKE_LFLAGS += -Wl,-subsystem,console
+macx*: CONFIG -= app_bundle
+
+TARGET = benchmark-svcore
+
+OBJECTS_DIR = o
+MOC_DIR = o
+
+include(svcore/benchmark/files.pri)
+
+for (file, BENCHMARK_SOURCES) { SOURCES += $$sprintf("svcore/benchmark/%1", $$file) }
+for (file, BENCHMARK_HEADERS) { HEADERS += $$sprintf("svcore/benchmark/%1", $$file) }
+
+# The mock model from the data model tests provides synthetic input
+SOURCES += svcore/data/model/test/MockWaveModel.cpp
+HEADERS += svcore/data/model/test/MockWaveModel.h
+
+# Unlike the tests, this is not run automatically after linking. Run
+# it from the top of the source tree, redirecting stdout to a file to
+# keep the JSON results, e.g.
+#   ./benchmark-svcore > benchmark-results.json
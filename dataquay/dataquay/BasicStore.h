@@ -94,6 +94,21 @@ public:
      */
     void addPrefix(QString prefix, Uri uri);
 
+    /**
+     * Add all of the given triples to the store, taking the store
+     * lock once for the whole set.  Triples that are already in the
+     * store (or that appear more than once in the list) are added
+     * only once.  Return the number of triples actually added.
+     *
+     * This is atomic: if any triple can not be added (e.g. because
+     * it is incomplete), RDFException is thrown and the store is left
+     * unchanged.
+     *
+     * This is much faster than calling add() repeatedly when adding
+     * many triples.
+     */
+    int addAll(Triples triples);
+
     // Store interface
 
     bool add(Triple t);
@@ -132,6 +132,24 @@ public:
         return doAdd(t);
     }
 
+    int addAll(Triples tt) {
+        QMutexLocker locker(&m_librdfLock);
+        DQ_DEBUG << "BasicStore::addAll: " << tt.size() << " triple(s)" << endl;
+        Triples added;
+        try {
+            for (int i = 0; i < tt.size(); ++i) {
+                if (doAdd(tt[i])) added.push_back(tt[i]);
+            }
+        } catch (...) {
+            // Leave the store as we found it
+            for (int i = 0; i < added.size(); ++i) {
+                doRemove(added[i]);
+            }
+            throw;
+        }
+        return added.size();
+    }
+
     bool remove(Triple t) {
         QMutexLocker locker(&m_librdfLock);
         DQ_DEBUG << "BasicStore::remove: " << t << endl;
@@ -870,6 +888,12 @@ BasicStore::add(Triple t)
     return m_d->add(t);
 }
 
+int
+BasicStore::addAll(Triples tt)
+{
+    return m_d->addAll(tt);
+}
+
 bool
 BasicStore::remove(Triple t)
 {
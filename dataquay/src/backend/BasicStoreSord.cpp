@@ -45,6 +45,7 @@
 #include <QFile>
 #include <QCryptographicHash>
 #include <QReadWriteLock>
+#include <QVector>
 
 #include "../Debug.h"
 
@@ -66,6 +67,7 @@ public:
 
     ~D() {
         QMutexLocker locker(&m_backendLock);
+        clearUriCache();
         if (m_model) sord_free(m_model);
     }
 
@@ -128,6 +130,53 @@ public:
         return doAdd(t);
     }
 
+    int addAll(Triples tt) {
+        QMutexLocker locker(&m_backendLock);
+        DQ_DEBUG << "BasicStore::addAll: " << tt.size() << " triple(s)" << endl;
+
+        // Convert and check everything before adding anything, so
+        // that an incomplete triple leaves the store unchanged
+        
+        int n = tt.size();
+        QVector<SordNode *> nodes(n * 3, 0);
+        bool good = true;
+
+        try {
+            for (int i = 0; i < n; ++i) {
+                SordQuad q;
+                tripleToStatement(tt[i], q);
+                for (int j = 0; j < 3; ++j) {
+                    nodes[i*3 + j] = (SordNode *)q[j];
+                }
+                if (!checkComplete(q)) {
+                    good = false;
+                    break;
+                }
+            }
+        } catch (...) {
+            freeNodes(nodes);
+            throw;
+        }
+
+        if (!good) {
+            freeNodes(nodes);
+            throw RDFException("Failed to add triples (a statement is incomplete)");
+        }
+
+        int added = 0;
+        for (int i = 0; i < n; ++i) {
+            SordQuad q = { nodes[i*3], nodes[i*3 + 1], nodes[i*3 + 2], 0 };
+            if (!sord_contains(m_model, q)) {
+                sord_add(m_model, q);
+                ++added;
+            }
+        }
+
+        freeNodes(nodes);
+        DQ_DEBUG << "BasicStore::addAll: added " << added << endl;
+        return added;
+    }
+
     bool remove(Triple t) {
         QMutexLocker locker(&m_backendLock);
         DQ_DEBUG << "BasicStore::remove: " << t << endl;
@@ -152,42 +201,63 @@ public:
     void change(ChangeSet cs) {
         QMutexLocker locker(&m_backendLock);
         DQ_DEBUG << "BasicStore::change: " << cs.size() << " changes" << endl;
-        for (int i = 0; i < cs.size(); ++i) {
-            ChangeType type = cs[i].first;
-            Triple triple = cs[i].second;
-            switch (type) {
-            case AddTriple:
-                if (!doAdd(triple)) {
-                    throw RDFException("Change add failed: triple is already in store", triple);
-                }
-                break;
-            case RemoveTriple:
-                if (!doRemove(cs[i].second)) {
-                    throw RDFException("Change remove failed: triple is not in store", triple);
+        int i = 0;
+        try {
+            for (i = 0; i < cs.size(); ++i) {
+                ChangeType type = cs[i].first;
+                Triple triple = cs[i].second;
+                switch (type) {
+                case AddTriple:
+                    if (!doAdd(triple)) {
+                        throw RDFException("Change add failed: triple is already in store", triple);
+                    }
+                    break;
+                case RemoveTriple:
+                    if (!doRemove(cs[i].second)) {
+                        throw RDFException("Change remove failed: triple is not in store", triple);
+                    }
+                    break;
                 }
-                break;
             }
+        } catch (...) {
+            // Undo the changes already applied, so that the change
+            // set is applied atomically or not at all
+            for (int j = i-1; j >= 0; --j) {
+                if (cs[j].first == AddTriple) doRemove(cs[j].second);
+                else doAdd(cs[j].second);
+            }
+            throw;
         }
     }
 
     void revert(ChangeSet cs) {
         QMutexLocker locker(&m_backendLock);
         DQ_DEBUG << "BasicStore::revert: " << cs.size() << " changes" << endl;
-        for (int i = cs.size()-1; i >= 0; --i) {
-            ChangeType type = cs[i].first;
-            Triple triple = cs[i].second;
-            switch (type) {
-            case AddTriple:
-                if (!doRemove(triple)) {
-                    throw RDFException("Revert of add failed: triple is not in store", triple);
-                }
-                break;
-            case RemoveTriple:
-                if (!doAdd(triple)) {
-                    throw RDFException("Revert of remove failed: triple is already in store", triple);
+        int i = cs.size()-1;
+        try {
+            for (i = cs.size()-1; i >= 0; --i) {
+                ChangeType type = cs[i].first;
+                Triple triple = cs[i].second;
+                switch (type) {
+                case AddTriple:
+                    if (!doRemove(triple)) {
+                        throw RDFException("Revert of add failed: triple is not in store", triple);
+                    }
+                    break;
+                case RemoveTriple:
+                    if (!doAdd(triple)) {
+                        throw RDFException("Revert of remove failed: triple is already in store", triple);
+                    }
+                    break;
                 }
-                break;
             }
+        } catch (...) {
+            // As in change(), undo what we have done so far
+            for (int j = i+1; j < cs.size(); ++j) {
+                if (cs[j].first == AddTriple) doAdd(cs[j].second);
+                else doRemove(cs[j].second);
+            }
+            throw;
         }
     }
 
@@ -197,13 +267,12 @@ public:
         SordQuad statement;
         tripleToStatement(t, statement);
         if (!checkComplete(statement)) {
+            freeStatement(statement);
             throw RDFException("Failed to test for triple (statement is incomplete)");
         }
-        if (!sord_contains(m_model, statement)) {
-            return false;
-        }
+        bool found = sord_contains(m_model, statement);
         freeStatement(statement);
-        return true;
+        return found;
     }
     
     Triples match(Triple t) const {
@@ -625,6 +694,18 @@ private:
     SordModel *m_model;
     static QMutex m_backendLock; // assume the worst
 
+    // Cache of URI nodes, so that repeatedly used URIs (predicates,
+    // types, expanded prefixes) are neither rebuilt as Sord nodes nor
+    // revalidated as Uris each time they pass through. Each cached
+    // node holds a reference, so its address stays unique to its URI
+    // for as long as it is cached. Accessed only with m_backendLock
+    // held.
+    typedef QHash<QString, SordNode *> UriNodeMap;
+    typedef QHash<const SordNode *, Uri> NodeUriMap;
+    mutable UriNodeMap m_uriNodes;
+    mutable NodeUriMap m_nodeUris;
+    static const int m_uriCacheLimit = 65536;
+
     typedef QHash<QString, Uri> PrefixMap;
     Uri m_baseUri;
     PrefixMap m_prefixes;
@@ -634,35 +715,69 @@ private:
         SordQuad statement;
         tripleToStatement(t, statement);
         if (!checkComplete(statement)) {
+            freeStatement(statement);
             throw RDFException("Failed to add triple (statement is incomplete)");
         }
-        if (sord_contains(m_model, statement)) {
-            return false;
+        bool added = false;
+        if (!sord_contains(m_model, statement)) {
+            sord_add(m_model, statement);
+            added = true;
         }
-        sord_add(m_model, statement);
         freeStatement(statement);
-        return true;
+        return added;
     }
 
     bool doRemove(Triple t) {
         SordQuad statement;
         tripleToStatement(t, statement);
         if (!checkComplete(statement)) {
+            freeStatement(statement);
             throw RDFException("Failed to remove triple (statement is incomplete)");
         }
-        if (!sord_contains(m_model, statement)) {
-            return false;
+        bool removed = false;
+        if (sord_contains(m_model, statement)) {
+            sord_remove(m_model, statement);
+            removed = true;
         }
-        sord_remove(m_model, statement);
         freeStatement(statement);
-        return true;
+        return removed;
+    }
+
+    SordNode *cachedUriNode(const QString &s) const {
+        // Return a new reference to the cached node, or 0
+        UriNodeMap::const_iterator i = m_uriNodes.constFind(s);
+        if (i == m_uriNodes.constEnd()) return 0;
+        return sord_node_copy(i.value());
+    }
+
+    void cacheUriNode(const QString &s, const SordNode *node, Uri uri) const {
+        if (m_uriNodes.contains(s)) return;
+        if (m_uriNodes.size() >= m_uriCacheLimit) {
+            clearUriCache();
+        }
+        SordNode *ref = sord_node_copy(node);
+        m_uriNodes[s] = ref;
+        m_nodeUris[ref] = uri;
+    }
+
+    void clearUriCache() const {
+        for (UriNodeMap::iterator i = m_uriNodes.begin();
+             i != m_uriNodes.end(); ++i) {
+            sord_node_free(m_w.getWorld(), i.value());
+        }
+        m_uriNodes.clear();
+        m_nodeUris.clear();
     }
 
     SordNode *uriToSordNode(Uri uri) const {
-        SordNode *node = sord_new_uri
+        QString s = uri.toString();
+        SordNode *node = cachedUriNode(s);
+        if (node) return node;
+        node = sord_new_uri
             (m_w.getWorld(), 
-             (const unsigned char *)uri.toString().toUtf8().data());
+             (const unsigned char *)s.toUtf8().data());
         if (!node) throw RDFInternalError("Failed to convert URI to internal representation", uri);
+        cacheUriNode(s, node, uri);
         return node;
     }
 
@@ -671,9 +786,14 @@ private:
         if (!n || sord_node_get_type(n) != SORD_URI) {
             return Uri();
         }
+        NodeUriMap::const_iterator i = m_nodeUris.constFind(n);
+        if (i != m_nodeUris.constEnd()) return i.value();
         const uint8_t *s = sord_node_get_string(n);
-        if (s) return Uri(QString::fromUtf8((char *)s));
-        else return Uri();
+        if (!s) return Uri();
+        QString str = QString::fromUtf8((char *)s);
+        Uri uri(str);
+        cacheUriNode(str, n, uri);
+        return uri;
     }
 
     SordNode *nodeToSordNode(Node v) const { // called with m_backendLock held
@@ -691,7 +811,10 @@ private:
         }
             break;
         case Node::URI: {
-            node = uriToSordNode(Uri(v.value));
+            // Look up the string first, to avoid revalidating it as a
+            // Uri when it has been seen before
+            node = cachedUriNode(v.value);
+            if (!node) node = uriToSordNode(Uri(v.value));
             if (!node) throw RDFException("Failed to construct node from URI");
         }
             break;
@@ -760,6 +883,12 @@ private:
         }
     }
 
+    void freeNodes(const QVector<SordNode *> &nodes) const {
+        for (int i = 0; i < nodes.size(); ++i) {
+            sord_node_free(m_w.getWorld(), nodes[i]);
+        }
+    }
+
     Triple statementToTriple(const SordQuad q) const {
         Triple triple(sordNodeToNode(q[0]),
                       sordNodeToNode(q[1]),
@@ -875,6 +1004,12 @@ BasicStore::add(Triple t)
     return m_d->add(t);
 }
 
+int
+BasicStore::addAll(Triples tt)
+{
+    return m_d->addAll(tt);
+}
+
 bool
 BasicStore::remove(Triple t)
 {
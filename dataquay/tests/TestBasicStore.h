@@ -361,7 +361,69 @@ private slots:
 	} catch (const RDFException &) {
 	    QVERIFY(1);
 	}
-    
+
+    }
+
+    void addAll() {
+        // bulk add, including one triple already in the store and
+        // one repeated within the list, neither of which is counted
+        Triples tt;
+        tt.push_back(Triple(store.expand(":harry"),
+                            store.expand("foaf:name"),
+                            Node("Harry Trotter")));
+        tt.push_back(Triple(store.expand(":harry"),
+                            store.expand("foaf:knows"),
+                            store.expand(":alice")));
+        tt.push_back(Triple(store.expand(":harry"),
+                            store.expand("foaf:name"),
+                            Node("Harry Trotter")));
+        tt.push_back(Triple(store.expand(":fred"),
+                            Uri("http://xmlns.com/foaf/0.1/name"),
+                            Node("Fred Jenkins")));
+        QCOMPARE(store.addAll(tt), 2);
+        count += 2;
+        ++usingKnows;
+        ++toAlice;
+    }
+
+    void addAllIncompleteFail() {
+        // bulk add with an incomplete triple should add nothing
+        Triples tt;
+        tt.push_back(Triple(store.expand(":ivy"),
+                            store.expand("foaf:name"),
+                            Node("Ivy Leaguer")));
+        tt.push_back(Triple(store.expand(":ivy"),
+                            store.addBlankNode(),
+                            Node("this_statement_is_incomplete")));
+        try {
+            store.addAll(tt);
+            QVERIFY(0);
+        } catch (const RDFException &) {
+            QVERIFY(1);
+        }
+        QCOMPARE(store.match
+                 (Triple(store.expand(":ivy"), Node(), Node())).size(), 0);
+    }
+
+    void changeRollsBackOnFailure() {
+        // a change set that fails part-way should leave nothing behind
+        ChangeSet cs;
+        cs.push_back(Change(AddTriple,
+                            Triple(store.expand(":ivy"),
+                                   store.expand("foaf:name"),
+                                   Node("Ivy Leaguer"))));
+        cs.push_back(Change(AddTriple,
+                            Triple(store.expand(":harry"),
+                                   store.expand("foaf:name"),
+                                   Node("Harry Trotter"))));
+        try {
+            store.change(cs);
+            QVERIFY(0);
+        } catch (const RDFException &) {
+            QVERIFY(1);
+        }
+        QCOMPARE(store.match
+                 (Triple(store.expand(":ivy"), Node(), Node())).size(), 0);
     }
 
     void matchCounts() {
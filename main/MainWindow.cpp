@@ -374,7 +374,6 @@ MainWindow::~MainWindow()
     delete m_layerTreeDialog;
     delete m_versionTester;
     delete m_surveyer;
-    Profiles::getInstance()->dump();
 //    SVDEBUG << "MainWindow::~MainWindow finishing" << endl;
 }
 
@@ -2164,6 +2163,23 @@ MainWindow::setupToolbars()
     menu->addAction(m_ffwdEndAction);
     menu->addSeparator();
     menu->addAction(m_recordAction);
+
+    Preferences *prefs = Preferences::getInstance();
+
+    QAction *action = new QAction(tr("Live Spectrogram While Recording"), this);
+    action->setStatusTip(tr("Show a spectrogram of the incoming audio in a new pane while recording"));
+    connect(action, SIGNAL(triggered()), this, SLOT(toggleLiveSpectrogram()));
+    action->setCheckable(true);
+    action->setChecked(prefs->getLiveSpectrogramWhileRecording());
+    menu->addAction(action);
+
+    action = new QAction(tr("Live Recent Transform While Recording"), this);
+    action->setStatusTip(tr("Run the most recently used transform over the incoming audio while recording"));
+    connect(action, SIGNAL(triggered()), this, SLOT(toggleLiveRecentTransform()));
+    action->setCheckable(true);
+    action->setChecked(prefs->getLiveRecentTransformWhileRecording());
+    menu->addAction(action);
+
     menu->addSeparator();
 
     m_rightButtonPlaybackMenu->addAction(m_playAction);
@@ -293,6 +293,9 @@ protected:
     virtual bool shouldCreateNewSessionForRDFAudio(bool *cancel);
     
     virtual void connectLayerEditDialog(ModelDataTableDialog *);
+
+    virtual bool isOSCMessageSupersededBy(const OSCMessage &earlier,
+                                          const OSCMessage &later) const;
 };
 
 
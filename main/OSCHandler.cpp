@@ -25,6 +25,7 @@
 #include "audio/AudioCallbackPlaySource.h"
 #include "framework/Document.h"
 #include "data/fileio/WavFileWriter.h"
+#include "base/Metrics.h"
 #include "transform/TransformFactory.h"
 #include "widgets/LevelPanWidget.h"
 #include "widgets/LevelPanToolButton.h"
@@ -234,6 +235,19 @@ MainWindow::handleOSCMessage(const OSCMessage &message)
             }
         }
 
+    } else if (message.getMethod() == "pipeline") {
+
+        if (message.getArgCount() == 1 &&
+            message.getArg(0).canConvert(QVariant::String)) {
+
+            QString str = message.getArg(0).toString();
+            if (str == "on") {
+                m_oscPipelined = true;
+            } else if (str == "off") {
+                m_oscPipelined = false;
+            }
+        }
+
     } else if (message.getMethod() == "solo") {
 
         if (message.getArgCount() == 1 &&
@@ -589,9 +603,101 @@ MainWindow::handleOSCMessage(const OSCMessage &message)
             }
         }
 
+    } else if (message.getMethod() == "metrics") {
+
+        // Metrics dumps are meant to be taken repeatedly while tuning,
+        // so unlike save and export this does overwrite the file
+
+        std::string prefix;
+        if (message.getArgCount() == 2 &&
+            message.getArg(1).canConvert(QVariant::String)) {
+            prefix = message.getArg(1).toString().toStdString();
+        }
+
+        if (message.getArgCount() >= 1 &&
+            message.getArg(0).canConvert(QVariant::String)) {
+            QString path = message.getArg(0).toString();
+            MetricsRegistry::getInstance()->dump(path, prefix);
+        } else {
+            cerr << MetricsRegistry::getInstance()->toText(prefix);
+        }
+
     } else {
         cerr << "WARNING: OSCHandler: Unknown or unsupported "
                   << "method \"" << message.getMethod()
                   << "\"" << endl;
     }
 }
+
+bool
+MainWindow::isOSCMessageSupersededBy(const OSCMessage &earlier,
+                                     const OSCMessage &later) const
+{
+    // Only methods that set something outright, rather than
+    // adjusting it from its current state, can supersede. Both
+    // messages act on the same current pane and layer, as only a
+    // setcurrent can change those and it would come between them.
+
+    QString method = later.getMethod();
+
+    if (method == "jump") {
+
+        // A jump with no argument stays where the previous one went,
+        // and so may a jump to the selection, if there is none
+        return (earlier.getMethod() == "jump" &&
+                later.getArgCount() == 1 &&
+                later.getArg(0).toString() != "selection");
+
+    } else if (method == "select") {
+
+        // Replaces (or clears) all selections, however they were made
+        return (earlier.getMethod() == "select" ||
+                earlier.getMethod() == "addselect");
+
+    } else if (method == "zoom") {
+
+        if (earlier.getMethod() != "zoom" ||
+            later.getArgCount() != 1) return false;
+        QString str = later.getArg(0).toString();
+        return (str != "in" && str != "out");
+
+    } else if (method == "zoomvertical") {
+
+        if (earlier.getMethod() != "zoomvertical") return false;
+        return (later.getArgCount() == 2 ||
+                (later.getArgCount() == 1 &&
+                 later.getArg(0).toString() == "default"));
+
+    } else if (method == "set") {
+
+        // The same control, with only the value differing
+        if (earlier.getMethod() != "set" ||
+            later.getArgCount() < 2 ||
+            earlier.getArgCount() != later.getArgCount()) return false;
+        for (int i = 0; i + 1 < later.getArgCount(); ++i) {
+            if (earlier.getArg(i).toString() != later.getArg(i).toString()) {
+                return false;
+            }
+        }
+        return true;
+
+    } else if (method == "setcurrent") {
+
+        // The earlier one may also have chosen a current layer on its
+        // pane, which is only undone if the later one chooses another
+        // layer on the same pane
+        if (earlier.getMethod() != "setcurrent" ||
+            later.getArgCount() < 1 ||
+            !later.getArg(0).canConvert(QVariant::Int)) return false;
+        int pane = later.getArg(0).toInt() - 1;
+        if (pane < 0 || pane >= m_paneStack->getPaneCount()) return false;
+        if (earlier.getArgCount() < 2) return true;
+        if (later.getArgCount() < 2 ||
+            earlier.getArg(0).toInt() - 1 != pane) return false;
+        int layer = later.getArg(1).toInt() - 1;
+        return (layer >= -1 &&
+                layer < m_paneStack->getPane(pane)->getLayerCount());
+    }
+
+    return false;
+}
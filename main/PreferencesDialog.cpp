@@ -284,6 +284,13 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     connect(showSplash, SIGNAL(stateChanged(int)),
             this, SLOT(showSplashChanged(int)));
 
+    QCheckBox *binaryDatasets = new QCheckBox;
+    m_binaryDatasets = prefs->getUseBinaryDatasets();
+    binaryDatasets->setCheckState(m_binaryDatasets ? Qt::Checked :
+                                  Qt::Unchecked);
+    connect(binaryDatasets, SIGNAL(stateChanged(int)),
+            this, SLOT(binaryDatasetsChanged(int)));
+
 #ifdef NOT_DEFINED // This no longer works correctly on any platform AFAICS
     QComboBox *bgMode = new QComboBox;
     int bg = prefs->getPropertyRangeAndValue("Background Mode", &min, &max,
@@ -597,6 +604,11 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
                        row, 0);
     subgrid->addWidget(showSplash, row++, 1, 1, 1);
 
+    subgrid->addWidget(new QLabel(tr("%1:").arg(prefs->getPropertyLabel
+                                                ("Use Binary Datasets"))),
+                       row, 0);
+    subgrid->addWidget(binaryDatasets, row++, 1, 1, 1);
+
     subgrid->addWidget(new QLabel(tr("%1:").arg(prefs->getPropertyLabel
                                                 ("Temporary Directory Root"))),
                        row, 0);
@@ -833,6 +845,13 @@ PreferencesDialog::showSplashChanged(int state)
     m_changesOnRestart = true;
 }
 
+void
+PreferencesDialog::binaryDatasetsChanged(int state)
+{
+    m_binaryDatasets = (state == Qt::Checked);
+    m_applyButton->setEnabled(true);
+}
+
 void
 PreferencesDialog::defaultTemplateChanged(int i)
 {
@@ -926,6 +945,7 @@ PreferencesDialog::applyClicked()
     prefs->setUseGaplessMode(m_gapless);
     prefs->setRunPluginsInProcess(m_runPluginsInProcess);
     prefs->setShowSplash(m_showSplash);
+    prefs->setUseBinaryDatasets(m_binaryDatasets);
     prefs->setTemporaryDirectoryRoot(m_tempDirRoot);
     prefs->setBackgroundMode(Preferences::BackgroundMode(m_backgroundMode));
     prefs->setTimeToTextMode(Preferences::TimeToTextMode(m_timeToTextMode));
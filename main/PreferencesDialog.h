@@ -75,6 +75,7 @@ protected slots:
     void octaveSystemChanged(int system);
     void viewFontSizeChanged(int sz);
     void showSplashChanged(int state);
+    void binaryDatasetsChanged(int state);
     void defaultTemplateChanged(int);
     void localeChanged(int);
     void networkPermissionChanged(int state);
@@ -129,6 +130,7 @@ protected:
     int m_octaveSystem;
     int m_viewFontSize;
     bool m_showSplash;
+    bool m_binaryDatasets;
 
     bool m_audioDeviceChanged;
     bool m_coloursChanged;
@@ -0,0 +1,234 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+   Command-line tool to render audio files as waveform, spectrogram
+   and other layer images without a display, using HeadlessRenderer.
+   See usage() below.
+*/
+
+#include "view/HeadlessRenderer.h"
+#include "view/ViewManager.h"
+#include "layer/Layer.h"
+#include "layer/LayerFactory.h"
+
+#include "data/model/ReadOnlyWaveFileModel.h"
+#include "data/fileio/FileSource.h"
+#include "system/Init.h"
+#include "base/Debug.h"
+
+#include <QApplication>
+#include <QFileInfo>
+#include <QDir>
+
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+
+static void
+usage(QString name)
+{
+    cerr << "\nRender audio files to images, without needing a display.\n\n"
+         << "Usage: " << name << " [options] <audiofile> ...\n\n"
+         << "  -l, --layer <type>    Layer to draw, from the bottom up; may be given more\n"
+         << "                        than once. One of waveform, spectrogram,\n"
+         << "                        melodicrange, peakfrequency, timeruler.\n"
+         << "                        Default is waveform.\n"
+         << "  -z, --zoom <n>        Zoom level in audio frames per pixel (default 1024)\n"
+         << "  --height <n>          Image height in pixels (default 256)\n"
+         << "  -o, --output <dir>    Directory to write images to (default current)\n"
+         << "  -f, --format <ext>    Image file format extension (default png)\n"
+         << "  -j, --threads <n>     Number of rendering threads (default one per core)\n"
+         << "  --strip-width <n>     Width of each rendered strip in pixels (default 1024)\n"
+         << "  --strips              Write each strip to its own numbered file as it is\n"
+         << "                        rendered, instead of one image per audio file\n"
+         << "  --dark                Use a dark background where the layers allow it\n\n"
+         << "Each audio file is written to <dir>/<name>.<ext>, or to\n"
+         << "<dir>/<name>-0000.<ext> and so on with --strips. Layer properties\n"
+         << "are taken from the layer defaults saved by Sonic Visualiser.\n"
+         << endl;
+}
+
+static LayerFactory::LayerType
+getLayerType(QString name)
+{
+    // The factory's own name lookup doesn't know the spectrogram
+    // presets, as they are saved as ordinary spectrograms
+    LayerFactory *factory = LayerFactory::getInstance();
+    LayerFactory::LayerType types[] = {
+        LayerFactory::Waveform,
+        LayerFactory::Spectrogram,
+        LayerFactory::MelodicRangeSpectrogram,
+        LayerFactory::PeakFrequencySpectrogram,
+        LayerFactory::TimeRuler
+    };
+    for (int i = 0; i < int(sizeof(types)/sizeof(types[0])); ++i) {
+        if (factory->getLayerTypeName(types[i]) == name) return types[i];
+    }
+    return LayerFactory::UnknownLayer;
+}
+
+int
+main(int argc, char **argv)
+{
+    svSystemSpecificInitialisation();
+
+    // No display is needed to paint into images, so don't insist on
+    // one unless the caller has chosen a platform explicitly
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication application(argc, argv);
+
+    QApplication::setOrganizationName("sonic-visualiser");
+    QApplication::setOrganizationDomain("sonicvisualiser.org");
+    QApplication::setApplicationName("Sonic Visualiser");
+
+    QStringList args = application.arguments();
+    QString name = QFileInfo(args[0]).fileName();
+
+    std::vector<LayerFactory::LayerType> types;
+    int zoom = 1024;
+    int height = 256;
+    QString outdir = ".";
+    QString format = "png";
+    int threads = 0;
+    int stripWidth = 0;
+    bool strips = false;
+    bool dark = false;
+    QStringList files;
+
+    for (int i = 1; i < args.size(); ++i) {
+
+        QString arg = args[i];
+        bool haveValue = (i + 1 < args.size());
+        bool ok = true;
+
+        if (arg == "-h" || arg == "--help" || arg == "-?") {
+            usage(name);
+            return 0;
+        } else if ((arg == "-l" || arg == "--layer") && haveValue) {
+            LayerFactory::LayerType type = getLayerType(args[++i]);
+            if (type == LayerFactory::UnknownLayer) {
+                cerr << name << ": Unknown layer type \"" << args[i] << "\""
+                     << endl;
+                return 2;
+            }
+            types.push_back(type);
+        } else if ((arg == "-z" || arg == "--zoom") && haveValue) {
+            zoom = args[++i].toInt(&ok);
+        } else if (arg == "--height" && haveValue) {
+            height = args[++i].toInt(&ok);
+        } else if ((arg == "-o" || arg == "--output") && haveValue) {
+            outdir = args[++i];
+        } else if ((arg == "-f" || arg == "--format") && haveValue) {
+            format = args[++i];
+        } else if ((arg == "-j" || arg == "--threads") && haveValue) {
+            threads = args[++i].toInt(&ok);
+        } else if (arg == "--strip-width" && haveValue) {
+            stripWidth = args[++i].toInt(&ok);
+        } else if (arg == "--strips") {
+            strips = true;
+        } else if (arg == "--dark") {
+            dark = true;
+        } else if (arg.startsWith("-")) {
+            usage(name);
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+
+        if (!ok || zoom < 1 || height < 1) {
+            cerr << name << ": Invalid value for option " << arg << endl;
+            return 2;
+        }
+    }
+
+    if (files.empty()) {
+        usage(name);
+        return 2;
+    }
+
+    if (types.empty()) {
+        types.push_back(LayerFactory::Waveform);
+    }
+
+    if (!QDir(outdir).exists()) {
+        cerr << name << ": Output directory \"" << outdir
+             << "\" does not exist" << endl;
+        return 1;
+    }
+
+    LayerFactory *factory = LayerFactory::getInstance();
+
+    ViewManager manager;
+    manager.setGlobalDarkBackground(dark);
+
+    int failures = 0;
+
+    for (int f = 0; f < files.size(); ++f) {
+
+        QString file = files[f];
+
+        ReadOnlyWaveFileModel *model =
+            new ReadOnlyWaveFileModel(FileSource(file));
+
+        if (!model->isOK()) {
+            cerr << name << ": Failed to open audio file \"" << file
+                 << "\"" << endl;
+            delete model;
+            ++failures;
+            continue;
+        }
+
+        manager.setMainModelSampleRate(model->getSampleRate());
+
+        std::vector<Layer *> layers;
+        for (int i = 0; i < int(types.size()); ++i) {
+            Layer *layer = factory->createLayer(types[i]);
+            if (!layer) continue;
+            factory->setLayerDefaultProperties(types[i], layer);
+            factory->setModel(layer, model);
+            layers.push_back(layer);
+        }
+
+        HeadlessRenderer renderer(&manager, layers, zoom, height);
+        if (threads > 0) renderer.setThreadCount(threads);
+        if (stripWidth > 0) renderer.setStripWidth(stripWidth);
+
+        QString out = QDir(outdir).filePath
+            (QFileInfo(file).completeBaseName() + "." + format);
+
+        bool ok;
+        if (strips) ok = renderer.renderToStripFiles(out);
+        else ok = renderer.renderToImageFile(out);
+
+        if (ok) {
+            cerr << file << " -> " << out << endl;
+        } else {
+            cerr << name << ": Failed to render \"" << file << "\"" << endl;
+            ++failures;
+        }
+
+        for (int i = 0; i < int(layers.size()); ++i) {
+            delete layers[i];
+        }
+        delete model;
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -5,7 +5,7 @@ CONFIG += release
 #CONFIG += debug
 
 DEFINES += NDEBUG BUILD_RELEASE
-DEFINES += NO_TIMING NO_HIT_COUNTS
+DEFINES += NO_HIT_COUNTS
 
 DEFINES += HAVE_PIPER HAVE_PLUGIN_CHECKER_HELPER
 
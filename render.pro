@@ -0,0 +1,38 @@
+
+TEMPLATE = app
+
+exists(config.pri) {
+    include(config.pri)
+}
+
+!exists(config.pri) {
+    include(noconfig.pri)
+}
+
+include(base.pri)
+
+CONFIG += console
+QT += network xml gui widgets svg
+
+win32-x-g++:QMAKE_LFLAGS += -Wl,-subsystem,console
+macx*: CONFIG -= app_bundle
+
+TARGET = sonic-visualiser-render
+
+linux* {
+    render_bins.path = /usr/local/bin/
+    render_bins.files = sonic-visualiser-render
+    INSTALLS += render_bins
+}
+
+OBJECTS_DIR = o
+MOC_DIR = o
+
+include(svgui/files.pri)
+
+for (file, SVGUI_SOURCES)    { SOURCES += $$sprintf("svgui/%1",    $$file) }
+for (file, SVGUI_HEADERS)    { HEADERS += $$sprintf("svgui/%1",    $$file) }
+
+SOURCES += \
+	main/render.cpp
+
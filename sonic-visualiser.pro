@@ -8,20 +8,32 @@ TEMPLATE = subdirs
 SUBDIRS += \
         sub_test_svcore_base \
         sub_test_svcore_data_fileio \
-        sub_test_svcore_data_model
+        sub_test_svcore_data_model \
+        sub_test_svapp_framework \
+        sub_test_svapp_audio
+
+# The benchmarks are built along with the tests, but never run
+# automatically
+SUBDIRS += \
+        sub_benchmark_svcore
 
 SUBDIRS += \
 	checker \
 	sub_server \
         sub_convert \
+        sub_render \
 	sub_sv
 
 sub_test_svcore_base.file = test-svcore-base.pro
 sub_test_svcore_data_fileio.file = test-svcore-data-fileio.pro
 sub_test_svcore_data_model.file = test-svcore-data-model.pro
+sub_test_svapp_framework.file = test-svapp-framework.pro
+sub_test_svapp_audio.file = test-svapp-audio.pro
+sub_benchmark_svcore.file = benchmark-svcore.pro
 
 sub_server.file = server.pro
 sub_convert.file = convert.pro
+sub_render.file = render.pro
 sub_sv.file = sv.pro
 
 CONFIG += ordered
@@ -21,6 +21,7 @@
 #include "base/ViewManagerBase.h"
 #include "base/PlayParameterRepository.h"
 #include "base/Preferences.h"
+#include "base/Metrics.h"
 #include "data/model/DenseTimeValueModel.h"
 #include "data/model/WaveFileModel.h"
 #include "data/model/ReadOnlyWaveFileModel.h"
@@ -32,24 +33,53 @@
 
 #include "bqvec/VectorOps.h"
 
+#include <QThread>
+
 #include <rubberband/RubberBandStretcher.h>
 using namespace RubberBand;
 
 using breakfastquay::v_zero_channels;
+using breakfastquay::v_zero;
+using breakfastquay::v_add;
+using breakfastquay::v_copy;
 
 #include <iostream>
 #include <cassert>
+#include <cmath>
 
 //#define DEBUG_AUDIO_PLAY_SOURCE 1
 //#define DEBUG_AUDIO_PLAY_SOURCE_PLAYING 1
 
 static const int DEFAULT_RING_BUFFER_SIZE = 131071;
 
+// Upper limit on the number of threads (including the fill thread
+// itself) that mix models in parallel
+static const int MAX_MIX_SHARES = 4;
+
+// Room either side of each parallel mix buffer. AudioGenerator writes
+// up to half the fade length outside the requested range, and fades
+// are never more than 50 frames (see mixModels)
+static const sv_frame_t MIX_BUFFER_MARGIN = 64;
+
+// Upper limit on the size of the time-stretch loop cache, in samples
+// across all channels (64MB). Longer loops are stretched every time
+static const sv_frame_t MAX_STRETCH_CACHE_SAMPLES = 16 * 1024 * 1024;
+
+// Looked up here rather than on first use, as they are updated from
+// the audio callback, which must not take the registry lock
+static MetricsRegistry::Gauge &readBufferFill =
+    MetricsRegistry::getInstance()->getGauge
+    ("AudioCallbackPlaySource: read buffer fill proportion");
+static MetricsRegistry::Counter &shortReads =
+    MetricsRegistry::getInstance()->getCounter
+    ("AudioCallbackPlaySource: short reads");
+
 AudioCallbackPlaySource::AudioCallbackPlaySource(ViewManagerBase *manager,
                                                  QString clientName) :
     m_viewManager(manager),
     m_audioGenerator(new AudioGenerator()),
     m_clientName(clientName.toUtf8().data()),
+    m_playingModels(new ModelList),
     m_readBuffers(0),
     m_writeBuffers(0),
     m_readBufferFill(0),
@@ -84,6 +114,19 @@ AudioCallbackPlaySource::AudioCallbackPlaySource(ViewManagerBase *manager,
     m_stretcherInputCount(0),
     m_stretcherInputs(0),
     m_stretcherInputSizes(0),
+    m_stretchCacheEnabled(true),
+    m_stretchCache(0),
+    m_stretchCacheGeneration(0),
+    m_stretcherResetCount(0),
+    m_stretchCacheInUse(0),
+    m_stretchCacheStretcher(0),
+    m_stretcherResetsSeen(0),
+    m_stretchOutputCount(0),
+    m_stretchHead(0),
+    m_stretchHeadKnown(false),
+    m_stretchInputDebt(0.0),
+    m_stretchReplaying(false),
+    m_writeBufferGeneration(0),
     m_fillThread(0),
     m_resamplerWrapper(0)
 {
@@ -124,6 +167,8 @@ AudioCallbackPlaySource::~AudioCallbackPlaySource()
 	delete m_fillThread;
     }
 
+    stopMixThreads();
+
     clearModels();
     
     if (m_readBuffers != m_writeBuffers) {
@@ -143,8 +188,13 @@ AudioCallbackPlaySource::~AudioCallbackPlaySource()
     delete m_timeStretcher;
     delete m_monoStretcher;
 
+    delete m_playingModels.load();
+    delete m_stretchCache.load();
+
     m_bufferScavenger.scavenge(true);
     m_pluginScavenger.scavenge(true);
+    m_modelListScavenger.scavenge(true);
+    m_stretchCacheScavenger.scavenge(true);
 #ifdef DEBUG_AUDIO_PLAY_SOURCE
     SVDEBUG << "AudioCallbackPlaySource::~AudioCallbackPlaySource finishing" << endl;
 #endif
@@ -160,6 +210,9 @@ AudioCallbackPlaySource::addModel(Model *model)
     m_mutex.lock();
 
     m_models.insert(model);
+    publishPlayingModels();
+    invalidateStretchCache();
+    
     if (model->getEndFrame() > m_lastModelEndFrame) {
 	m_lastModelEndFrame = model->getEndFrame();
     }
@@ -283,6 +336,7 @@ AudioCallbackPlaySource::addModel(Model *model)
     }
     
     if (!m_fillThread) {
+        startMixThreads();
 	m_fillThread = new FillThread(*this);
 	m_fillThread->start();
     }
@@ -311,6 +365,7 @@ AudioCallbackPlaySource::modelChangedWithin(sv_frame_t
 #ifdef DEBUG_AUDIO_PLAY_SOURCE
     SVDEBUG << "AudioCallbackPlaySource::modelChangedWithin(" << startFrame << "," << endFrame << ")" << endl;
 #endif
+    invalidateStretchCache();
     if (endFrame > m_lastModelEndFrame) {
         m_lastModelEndFrame = endFrame;
         rebuildRangeLists();
@@ -330,6 +385,8 @@ AudioCallbackPlaySource::removeModel(Model *model)
                this, SLOT(modelChangedWithin(sv_frame_t, sv_frame_t)));
 
     m_models.erase(model);
+    publishPlayingModels();
+    invalidateStretchCache();
 
     // I don't think we have to do this any more: if a new model is
     // loaded at a different rate, we'll hit the non-conflicting path
@@ -356,10 +413,14 @@ AudioCallbackPlaySource::removeModel(Model *model)
     }
     m_lastModelEndFrame = lastEnd;
 
-    m_audioGenerator->removeModel(model);
-
     m_mutex.unlock();
 
+    // The fill thread mixes without holding m_mutex, so it may still
+    // be working from a snapshot that includes this model
+    waitForMixToComplete();
+    
+    m_audioGenerator->removeModel(model);
+
     clearRingBuffers();
 }
 
@@ -373,6 +434,8 @@ AudioCallbackPlaySource::clearModels()
 #endif
 
     m_models.clear();
+    publishPlayingModels();
+    invalidateStretchCache();
 
     m_lastModelEndFrame = 0;
 
@@ -380,11 +443,30 @@ AudioCallbackPlaySource::clearModels()
 
     m_mutex.unlock();
 
+    waitForMixToComplete();
+    
     m_audioGenerator->clearModels();
 
     clearRingBuffers();
 }    
 
+void
+AudioCallbackPlaySource::publishPlayingModels()
+{
+    // Called from the GUI thread. The list is built in set order, so
+    // that the fill thread mixes models in the same order as before
+    ModelList *list = new ModelList(m_models.begin(), m_models.end());
+    ModelList *old = m_playingModels.exchange(list);
+    m_modelListScavenger.claim(old);
+}
+
+void
+AudioCallbackPlaySource::waitForMixToComplete()
+{
+    m_mixMutex.lock();
+    m_mixMutex.unlock();
+}
+
 void
 AudioCallbackPlaySource::clearRingBuffers(bool haveLock, int count)
 {
@@ -417,6 +499,7 @@ AudioCallbackPlaySource::clearRingBuffers(bool haveLock, int count)
     }
 
     m_writeBuffers = new RingBufferVector;
+    ++m_writeBufferGeneration;
 
     for (int i = 0; i < count; ++i) {
 	m_writeBuffers->push_back(new RingBuffer<float>(m_ringBufferSize));
@@ -487,8 +570,10 @@ AudioCallbackPlaySource::play(sv_frame_t startFrame)
     if (m_monoStretcher) {
         m_monoStretcher->reset();
     }
+    ++m_stretcherResetCount;
 
     m_readBufferFill = m_writeBufferFill = startFrame;
+    ++m_writeBufferGeneration;
     if (m_readBuffers) {
         for (int c = 0; c < getTargetChannelCount(); ++c) {
             RingBuffer<float> *rb = getReadRingBuffer(c);
@@ -555,6 +640,7 @@ AudioCallbackPlaySource::stop()
 void
 AudioCallbackPlaySource::selectionChanged()
 {
+    invalidateStretchCache();
     if (m_viewManager->getPlaySelectionMode()) {
 	clearRingBuffers();
     }
@@ -563,12 +649,14 @@ AudioCallbackPlaySource::selectionChanged()
 void
 AudioCallbackPlaySource::playLoopModeChanged()
 {
+    invalidateStretchCache();
     clearRingBuffers();
 }
 
 void
 AudioCallbackPlaySource::playSelectionModeChanged()
 {
+    invalidateStretchCache();
     if (!m_viewManager->getSelections().empty()) {
 	clearRingBuffers();
     }
@@ -577,6 +665,7 @@ AudioCallbackPlaySource::playSelectionModeChanged()
 void
 AudioCallbackPlaySource::playParametersChanged(PlayParameters *)
 {
+    invalidateStretchCache();
     clearRingBuffers();
 }
 
@@ -1013,6 +1102,7 @@ void
 AudioCallbackPlaySource::setSoloModelSet(std::set<Model *> s)
 {
     m_audioGenerator->setSoloModelSet(s);
+    invalidateStretchCache();
     clearRingBuffers();
 }
 
@@ -1020,6 +1110,7 @@ void
 AudioCallbackPlaySource::clearSoloModelSet()
 {
     m_audioGenerator->clearSoloModelSet();
+    invalidateStretchCache();
     clearRingBuffers();
 }
 
@@ -1089,6 +1180,13 @@ AudioCallbackPlaySource::setTimeStretch(double factor)
     emit activity(tr("Change time-stretch factor to %1").arg(factor));
 }
 
+void
+AudioCallbackPlaySource::setTimeStretchCacheEnabled(bool enabled)
+{
+    m_stretchCacheEnabled = enabled;
+    invalidateStretchCache();
+}
+
 int
 AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
                                           int requestedChannels,
@@ -1162,6 +1260,8 @@ AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
     // Ensure that all buffers have at least the amount of data we
     // need -- else reduce the size of our requests correspondingly
 
+    int requested = count;
+    
     for (int ch = 0; ch < channels; ++ch) {
 
         RingBuffer<float> *rb = getReadRingBuffer(ch);
@@ -1186,6 +1286,14 @@ AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
 #endif
             count = rs;
         }
+
+        if (ch == 0 && rb->getSize() > 0) {
+            readBufferFill.set(double(rs) / double(rb->getSize()));
+        }
+    }
+
+    if (count < requested) {
+        shortReads.add();
     }
 
     if (count == 0) return 0;
@@ -1265,6 +1373,19 @@ AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
 	return got;
     }
 
+    StretchCache *cache = getStretchCache(ts, channels);
+
+    if (cache && cache->state == StretchCache::Ready) {
+
+        replayStretchCache(cache, buffer, count);
+
+        applyAuditioningEffect(count, buffer);
+
+        m_condition.wakeAll();
+
+        return count;
+    }
+
     sv_frame_t available;
     sv_frame_t fedToStretcher = 0;
     int warned = 0;
@@ -1341,6 +1462,8 @@ AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
 
     v_zero_channels(buffer + stretchChannels, channels - stretchChannels, count);
 
+    stretcherOutputRetrieved(cache, buffer, count, fedToStretcher);
+
     applyAuditioningEffect(count, buffer);
 
 #ifdef DEBUG_AUDIO_PLAY_SOURCE
@@ -1352,6 +1475,288 @@ AudioCallbackPlaySource::getSourceSamples(float *const *buffer,
     return count;
 }
 
+AudioCallbackPlaySource::StretchCache::StretchCache(sv_frame_t start_,
+                                                   sv_frame_t end_,
+                                                   double ratio_,
+                                                   int generation_,
+                                                   int channels_) :
+    start(start_),
+    end(end_),
+    ratio(ratio_),
+    generation(generation_),
+    channels(channels_),
+    period(sv_frame_t(ceil(double(end_ - start_) * ratio_))),
+    data(channels_, std::vector<float>(period, 0.f)),
+    state(Waiting),
+    startOutput(0),
+    recorded(0)
+{
+}
+
+bool
+AudioCallbackPlaySource::StretchCache::matches(sv_frame_t start_,
+                                               sv_frame_t end_,
+                                               double ratio_,
+                                               int generation_,
+                                               int channels_) const
+{
+    return (start == start_ && end == end_ && ratio == ratio_ &&
+            generation == generation_ && channels == channels_);
+}
+
+bool
+AudioCallbackPlaySource::getLoopRange(sv_frame_t &start, sv_frame_t &end)
+{
+    if (!m_viewManager->getPlayLoopMode()) return false;
+
+    if (m_viewManager->getPlaySelectionMode() &&
+        !m_viewManager->getSelections().empty()) {
+
+        // With more than one selection, playback visits each in turn
+        // and the stretcher input is not a simple repeat
+        const MultiSelection::SelectionList &selections =
+            m_viewManager->getSelections();
+        if (selections.size() != 1) return false;
+
+        start = m_viewManager->alignReferenceToPlaybackFrame
+            (selections.begin()->getStartFrame());
+        end = m_viewManager->alignReferenceToPlaybackFrame
+            (selections.begin()->getEndFrame());
+
+    } else {
+        start = 0;
+        end = m_lastModelEndFrame;
+    }
+
+    return end > start;
+}
+
+void
+AudioCallbackPlaySource::updateStretchCache()
+{
+    StretchCache *current = m_stretchCache;
+
+    sv_frame_t start = 0, end = 0;
+    double ratio = m_stretchRatio;
+    int generation = m_stretchCacheGeneration;
+    int channels = getTargetChannelCount();
+
+    bool wanted = (m_stretchCacheEnabled &&
+                   m_timeStretcher &&
+                   ratio != 1.0 &&
+                   getLoopRange(start, end));
+
+    if (wanted) {
+        double samples = double(end - start) * ratio * channels;
+        if (samples > double(MAX_STRETCH_CACHE_SAMPLES)) {
+            wanted = false;
+        }
+    }
+
+    if (wanted) {
+        if (current &&
+            current->matches(start, end, ratio, generation, channels)) {
+            return;
+        }
+    } else if (!current) {
+        return;
+    }
+
+#ifdef DEBUG_AUDIO_PLAY_SOURCE
+    cout << "AudioCallbackPlaySource::updateStretchCache: ";
+    if (wanted) {
+        cout << "caching " << start << " -> " << end << " at ratio "
+             << ratio << endl;
+    } else {
+        cout << "discarding cache" << endl;
+    }
+#endif
+
+    StretchCache *replacement = 0;
+    if (wanted) {
+        replacement = new StretchCache(start, end, ratio, generation, channels);
+    }
+
+    m_stretchCache = replacement;
+    if (current) m_stretchCacheScavenger.claim(current);
+}
+
+AudioCallbackPlaySource::StretchCache *
+AudioCallbackPlaySource::getStretchCache(RubberBandStretcher *ts,
+                                         int channels)
+{
+    StretchCache *cache = m_stretchCache;
+
+    int resets = m_stretcherResetCount;
+
+    if (resets != m_stretcherResetsSeen || ts != m_stretchCacheStretcher) {
+        // Output count restarts with the stretcher (or with the other
+        // one, if we have switched between mono and multichannel)
+        m_stretcherResetsSeen = resets;
+        m_stretchCacheStretcher = ts;
+        m_stretchOutputCount = 0;
+        m_stretchHeadKnown = false;
+        m_stretchReplaying = false;
+        if (cache) {
+            if (cache->state == StretchCache::Recording) {
+                cache->state = StretchCache::Waiting;
+            } else if (cache->state == StretchCache::Ready) {
+                cache->state = StretchCache::Aligning;
+            }
+        }
+    }
+
+    if (cache != m_stretchCacheInUse) {
+        m_stretchCacheInUse = cache;
+        m_stretchHeadKnown = false;
+    }
+
+    // The fill thread will replace a stale cache soon enough, but we
+    // shouldn't replay from it in the meantime
+    if (cache && (cache->ratio != m_stretchRatio ||
+                  cache->generation != m_stretchCacheGeneration ||
+                  cache->channels != channels)) {
+        cache = 0;
+    }
+
+    if (m_stretchReplaying &&
+        !(cache && cache->state == StretchCache::Ready)) {
+        // The stretcher has not been fed while we were replaying, so
+        // what it holds is out of date
+        ts->reset();
+        m_stretchOutputCount = 0;
+        m_stretchHeadKnown = false;
+        m_stretchReplaying = false;
+    }
+
+    if (!cache) return 0;
+
+    if (cache->state != StretchCache::Waiting &&
+        cache->state != StretchCache::Aligning) {
+        return cache;
+    }
+
+    RingBuffer<float> *rb = getReadRingBuffer(0);
+    if (!rb) return cache;
+
+    // The frame about to be fed to the stretcher, worked out from
+    // the ring buffer. The fill thread may be updating the buffer
+    // and fill position as we look, so we only trust this if it
+    // agrees with where we expected to be after the previous block
+
+    sv_frame_t length = cache->end - cache->start;
+    sv_frame_t head = (m_readBufferFill - rb->getReadSpace() - cache->start)
+        % length;
+    if (head < 0) head += length;
+    head += cache->start;
+
+    if (!m_stretchHeadKnown || head != m_stretchHead) {
+        m_stretchHead = head;
+        m_stretchHeadKnown = true;
+        return cache;
+    }
+
+    // The head frame will emerge once the output already waiting and
+    // the stretcher's latency have been retrieved; the loop start
+    // follows it after the remainder of the current pass
+
+    sv_frame_t toLoopStart = (cache->start - head) % length;
+    if (toLoopStart < 0) toLoopStart += length;
+
+    cache->startOutput = m_stretchOutputCount
+        + sv_frame_t(ts->available())
+        + sv_frame_t(ts->getLatency())
+        + sv_frame_t(lrint(double(toLoopStart) * cache->ratio));
+
+    if (cache->state == StretchCache::Waiting) {
+        cache->recorded = 0;
+        cache->state = StretchCache::Recording;
+    } else {
+        m_stretchInputDebt = 0.0;
+        cache->state = StretchCache::Ready;
+    }
+
+    return cache;
+}
+
+void
+AudioCallbackPlaySource::stretcherOutputRetrieved(StretchCache *cache,
+                                                  float *const *buffer,
+                                                  sv_frame_t count,
+                                                  sv_frame_t fed)
+{
+    sv_frame_t from = m_stretchOutputCount;
+    m_stretchOutputCount += count;
+
+    if (!cache) return;
+
+    if (m_stretchHeadKnown) {
+        sv_frame_t length = cache->end - cache->start;
+        m_stretchHead = cache->start +
+            (m_stretchHead - cache->start + fed) % length;
+    }
+
+    if (cache->state != StretchCache::Recording) return;
+
+    sv_frame_t s0 = std::max(from, cache->startOutput + cache->recorded);
+    sv_frame_t s1 = std::min(from + count, cache->startOutput + cache->period);
+
+    if (s1 > s0) {
+        for (int c = 0; c < cache->channels; ++c) {
+            v_copy(cache->data[c].data() + (s0 - cache->startOutput),
+                   buffer[c] + (s0 - from),
+                   int(s1 - s0));
+        }
+        cache->recorded += s1 - s0;
+    }
+
+    if (cache->recorded == cache->period) {
+#ifdef DEBUG_AUDIO_PLAY_SOURCE
+        cout << "AudioCallbackPlaySource: stretch cache recorded "
+             << cache->period << " frames, replaying" << endl;
+#endif
+        m_stretchInputDebt = 0.0;
+        cache->state = StretchCache::Ready;
+    }
+}
+
+void
+AudioCallbackPlaySource::replayStretchCache(StretchCache *cache,
+                                            float *const *buffer,
+                                            sv_frame_t count)
+{
+    sv_frame_t offset = (m_stretchOutputCount - cache->startOutput)
+        % cache->period;
+    if (offset < 0) offset += cache->period;
+
+    sv_frame_t done = 0;
+    while (done < count) {
+        sv_frame_t n = std::min(count - done, cache->period - offset);
+        for (int c = 0; c < cache->channels; ++c) {
+            v_copy(buffer[c] + done, cache->data[c].data() + offset, int(n));
+        }
+        done += n;
+        offset = 0;
+    }
+
+    m_stretchOutputCount += count;
+    m_stretchReplaying = true;
+
+    // Carry on consuming input at the rate the stretcher would have
+    // done, so that the ring buffers and play position advance as
+    // usual
+
+    m_stretchInputDebt += double(count) / cache->ratio;
+    int skip = int(m_stretchInputDebt);
+    m_stretchInputDebt -= skip;
+
+    for (int c = 0; c < cache->channels; ++c) {
+        if (c >= m_stretcherInputCount) continue;
+        RingBuffer<float> *rb = getReadRingBuffer(c);
+        if (rb) rb->skip(std::min(skip, rb->getReadSpace()));
+    }
+}
+
 void
 AudioCallbackPlaySource::applyAuditioningEffect(sv_frame_t count, float *const *buffers)
 {
@@ -1477,8 +1882,30 @@ AudioCallbackPlaySource::fillBuffers()
         }
     }
 
+    // Mix without holding m_mutex, so that the GUI thread can carry
+    // on adding models, changing selections etc while we work. If
+    // the write buffers are reset meanwhile, the result is stale and
+    // we throw it away.
+
+    int generation = m_writeBufferGeneration;
+
+    m_mutex.unlock();
+    m_mixMutex.lock();
+    
     sv_frame_t got = mixModels(f, space, bufferPtrs); // also modifies f
 
+    m_mixMutex.unlock();
+    m_mutex.lock();
+
+    if (generation != m_writeBufferGeneration) {
+#ifdef DEBUG_AUDIO_PLAY_SOURCE
+        cout << "AudioCallbackPlaySourceFillThread: buffers reset during mix, discarding" << endl;
+#endif
+        return true;
+    }
+
+    readWriteEqual = (m_readBuffers == m_writeBuffers);
+    
     for (int c = 0; c < channels; ++c) {
 
         RingBuffer<float> *wb = getWriteRingBuffer(c);
@@ -1525,6 +1952,10 @@ AudioCallbackPlaySource::mixModels(sv_frame_t &frame, sv_frame_t count, float **
 
     int channels = getTargetChannelCount();
 
+    // Called with m_mixMutex held, so this snapshot cannot contain
+    // any model whose removal has already completed
+    const ModelList *models = m_playingModels.load();
+
 #ifdef DEBUG_AUDIO_PLAY_SOURCE
     cout << "mixModels: start " << frame << ", size " << count << ", channels " << channels << endl;
 #endif
@@ -1660,13 +2091,21 @@ AudioCallbackPlaySource::mixModels(sv_frame_t &frame, sv_frame_t count, float **
 	    }
 	}
 
-	for (std::set<Model *>::iterator mi = m_models.begin();
-	     mi != m_models.end(); ++mi) {
+        if (m_mixThreads.empty() || models->size() < 2) {
+
+            for (ModelList::const_iterator mi = models->begin();
+                 mi != models->end(); ++mi) {
 	    
-	    (void) m_audioGenerator->mixModel(*mi, chunkStart, 
-                                              chunkSize, chunkBufferPtrs,
-                                              fadeIn, fadeOut);
-	}
+                (void) m_audioGenerator->mixModel(*mi, chunkStart, 
+                                                  chunkSize, chunkBufferPtrs,
+                                                  fadeIn, fadeOut);
+            }
+
+        } else {
+
+            mixModelsParallel(models, chunkStart, chunkSize,
+                              chunkBufferPtrs, channels, fadeIn, fadeOut);
+        }
 
 	for (int c = 0; c < channels; ++c) {
 	    chunkBufferPtrs[c] += chunkSize;
@@ -1684,6 +2123,131 @@ AudioCallbackPlaySource::mixModels(sv_frame_t &frame, sv_frame_t count, float **
     return processed;
 }
 
+void
+AudioCallbackPlaySource::MixBuffer::prepare(int channels, sv_frame_t count)
+{
+    sv_frame_t size = count + 2 * MIX_BUFFER_MARGIN;
+    
+    if (channels > m_channels || size > m_size) {
+        if (channels < m_channels) channels = m_channels;
+        if (size < m_size) size = m_size;
+        m_storage.resize(size_t(channels) * size_t(size));
+        m_ptrs.resize(channels);
+        m_channels = channels;
+        m_size = size;
+    }
+
+    for (int c = 0; c < m_channels; ++c) {
+        float *base = m_storage.data() + c * m_size;
+        v_zero(base, int(count + 2 * MIX_BUFFER_MARGIN));
+        m_ptrs[c] = base + MIX_BUFFER_MARGIN;
+    }
+}
+
+void
+AudioCallbackPlaySource::startMixThreads()
+{
+    int shares = QThread::idealThreadCount() / 2;
+    if (shares > MAX_MIX_SHARES) shares = MAX_MIX_SHARES;
+    if (shares < 1) shares = 1;
+
+    SVDEBUG << "AudioCallbackPlaySource::startMixThreads: mixing in "
+            << shares << " share(s)" << endl;
+    
+    for (int i = 0; i < shares; ++i) {
+        m_mixBuffers.push_back(new MixBuffer);
+    }
+    
+    for (int i = 1; i < shares; ++i) {
+        MixThread *t = new MixThread(*this, i);
+        t->start();
+        m_mixThreads.push_back(t);
+    }
+}
+
+void
+AudioCallbackPlaySource::stopMixThreads()
+{
+    // m_exiting must already be set, and the fill thread finished
+    for (MixThread *t: m_mixThreads) {
+        t->kick();
+        t->wait();
+        delete t;
+    }
+    m_mixThreads.clear();
+
+    for (MixBuffer *b: m_mixBuffers) {
+        delete b;
+    }
+    m_mixBuffers.clear();
+}
+
+void
+AudioCallbackPlaySource::mixModelsParallel(const ModelList *models,
+                                           sv_frame_t start, sv_frame_t count,
+                                           float **buffers, int channels,
+                                           sv_frame_t fadeIn, sv_frame_t fadeOut)
+{
+    int shares = int(m_mixBuffers.size());
+
+    for (int i = 0; i < shares; ++i) {
+        m_mixBuffers[i]->prepare(channels, count);
+    }
+
+    m_mixJob.models = models;
+    m_mixJob.start = start;
+    m_mixJob.count = count;
+    m_mixJob.fadeIn = fadeIn;
+    m_mixJob.fadeOut = fadeOut;
+
+    for (MixThread *t: m_mixThreads) {
+        t->kick();
+    }
+
+    mixModelShare(0);
+
+    m_mixDone.acquire(int(m_mixThreads.size()));
+
+    // Fades spill outside [0, count), into space that the caller has
+    // already allowed for in buffers (see mixModels)
+    sv_frame_t from = -(fadeIn/2);
+    sv_frame_t to = count + fadeOut/2;
+    
+    for (int i = 0; i < shares; ++i) {
+        float **mixed = m_mixBuffers[i]->getChannels();
+        for (int c = 0; c < channels; ++c) {
+            v_add(buffers[c] + from, mixed[c] + from, int(to - from));
+        }
+    }
+}
+
+void
+AudioCallbackPlaySource::mixModelShare(int share)
+{
+    const MixJob &job = m_mixJob;
+    float **buffers = m_mixBuffers[share]->getChannels();
+    int shares = int(m_mixBuffers.size());
+    int n = int(job.models->size());
+
+    // Fixed assignment of models to shares, for deterministic output
+    for (int i = share; i < n; i += shares) {
+        (void) m_audioGenerator->mixModel((*job.models)[i], job.start,
+                                          job.count, buffers,
+                                          job.fadeIn, job.fadeOut);
+    }
+}
+
+void
+AudioCallbackPlaySource::MixThread::run()
+{
+    while (true) {
+        m_start.acquire();
+        if (m_source.m_exiting) break;
+        m_source.mixModelShare(m_share);
+        m_source.m_mixDone.release();
+    }
+}
+
 void
 AudioCallbackPlaySource::unifyRingBuffers()
 {
@@ -1772,6 +2336,8 @@ AudioCallbackPlaySource::FillThread::run()
 	s.unifyRingBuffers();
 	s.m_bufferScavenger.scavenge();
         s.m_pluginScavenger.scavenge();
+        s.m_modelListScavenger.scavenge();
+        s.m_stretchCacheScavenger.scavenge();
 
 	if (work && s.m_playing && s.getSourceSampleRate()) {
 	    
@@ -1825,6 +2391,8 @@ AudioCallbackPlaySource::FillThread::run()
 	}
 	previouslyPlaying = playing;
 
+        s.updateStretchCache();
+
 	work = s.fillBuffers();
     }
 
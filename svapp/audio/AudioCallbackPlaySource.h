@@ -26,6 +26,7 @@
 #include <QObject>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QSemaphore>
 
 #include "base/Thread.h"
 #include "base/RealTime.h"
@@ -34,6 +35,8 @@
 
 #include <set>
 #include <map>
+#include <vector>
+#include <atomic>
 
 namespace RubberBand {
     class RubberBandStretcher;
@@ -272,6 +275,17 @@ public:
      */
     void setTimeStretch(double factor);
 
+    /**
+     * Enable or disable caching of time-stretched output when looping
+     * a single selection (or the whole of the material). When
+     * enabled, the first complete pass through the loop is recorded
+     * as it comes out of the time stretcher, and later passes are
+     * replayed from that recording instead of being stretched again,
+     * for as long as the loop range, stretch factor and models remain
+     * unchanged. Enabled by default.
+     */
+    void setTimeStretchCacheEnabled(bool enabled);
+
     /**
      * Set a single real-time plugin as a processing effect for
      * auditioning during playback.
@@ -344,7 +358,15 @@ protected:
 	}
     };
 
+    typedef std::vector<Model *> ModelList;
+
+    // m_models is the authoritative set, used only from the GUI
+    // thread. The fill thread instead mixes from m_playingModels, an
+    // immutable snapshot that is replaced wholesale (and the old one
+    // scavenged) whenever a model is added or removed.
     std::set<Model *>                 m_models;
+    std::atomic<ModelList *>          m_playingModels;
+    Scavenger<ModelList>              m_modelListScavenger;
     RingBufferVector                 *m_readBuffers;
     RingBufferVector                 *m_writeBuffers;
     sv_frame_t                        m_readBufferFill;
@@ -395,6 +417,13 @@ protected:
     void clearRingBuffers(bool haveLock = false, int count = 0);
     void unifyRingBuffers();
 
+    // Publish a new snapshot of m_models for the fill thread
+    void publishPlayingModels();
+
+    // Return only when the fill thread is not mixing from a snapshot
+    // older than the current one
+    void waitForMixToComplete();
+
     RubberBand::RubberBandStretcher *m_timeStretcher;
     RubberBand::RubberBandStretcher *m_monoStretcher;
     double m_stretchRatio;
@@ -404,8 +433,95 @@ protected:
     float **m_stretcherInputs;
     sv_frame_t *m_stretcherInputSizes;
 
-    // Called from fill thread, m_playing true, mutex held
-    // Return true if work done
+    /**
+     * One pass of a looped range as it came out of the time
+     * stretcher. Allocated (and discarded) by the fill thread; its
+     * contents and state are then written and read only by the audio
+     * thread.
+     */
+    class StretchCache
+    {
+    public:
+        StretchCache(sv_frame_t start, sv_frame_t end, double ratio,
+                     int generation, int channels);
+
+        bool matches(sv_frame_t start, sv_frame_t end, double ratio,
+                     int generation, int channels) const;
+
+        enum State {
+            Waiting,   // for the loop start to reach the stretcher
+            Recording, // the first complete pass
+            Aligning,  // recorded, but the stretcher has been reset
+            Ready      // replaying
+        };
+
+        const sv_frame_t start;
+        const sv_frame_t end;
+        const double ratio;
+        const int generation;
+        const int channels;
+        const sv_frame_t period; // output frames in one pass
+
+        std::vector<std::vector<float> > data; // one per channel
+        State state;
+        sv_frame_t startOutput; // output count at which a pass begins
+        sv_frame_t recorded;
+    };
+
+    bool m_stretchCacheEnabled;
+    std::atomic<StretchCache *> m_stretchCache;
+    Scavenger<StretchCache> m_stretchCacheScavenger;
+
+    // Incremented whenever anything that would change the stretcher
+    // input for a given loop range changes
+    std::atomic<int> m_stretchCacheGeneration;
+
+    // Incremented whenever the stretchers are reset
+    std::atomic<int> m_stretcherResetCount;
+
+    // Audio thread only
+    StretchCache *m_stretchCacheInUse;
+    RubberBand::RubberBandStretcher *m_stretchCacheStretcher;
+    int m_stretcherResetsSeen;
+    sv_frame_t m_stretchOutputCount; // output frames since reset
+    sv_frame_t m_stretchHead; // next input frame to feed the stretcher
+    bool m_stretchHeadKnown;
+    double m_stretchInputDebt; // input frames owed while replaying
+    bool m_stretchReplaying;
+
+    void invalidateStretchCache() { ++m_stretchCacheGeneration; }
+
+    // Called from the fill thread with m_mutex held. Discard the
+    // stretch cache if it no longer matches the loop range, stretch
+    // factor and models, and allocate a new one if appropriate
+    void updateStretchCache();
+
+    // Return true and the playback-frame range in start and end if
+    // playback will loop continuously over a single range
+    bool getLoopRange(sv_frame_t &start, sv_frame_t &end);
+
+    // Called from getSourceSamples. Return the stretch cache if it
+    // is applicable to the current stretcher state, or null. If the
+    // cache is waiting to record or to realign, and the position of
+    // the stretcher input within the loop is known, schedule the
+    // output frame at which a pass begins
+    StretchCache *getStretchCache(RubberBand::RubberBandStretcher *ts,
+                                  int channels);
+
+    // Called from getSourceSamples after fed input frames have gone
+    // into the stretcher and count output frames have come out
+    void stretcherOutputRetrieved(StretchCache *cache,
+                                  float *const *buffer,
+                                  sv_frame_t count, sv_frame_t fed);
+
+    // Called from getSourceSamples in place of the stretcher when the
+    // cache is ready
+    void replayStretchCache(StretchCache *cache,
+                            float *const *buffer, sv_frame_t count);
+
+    // Called from fill thread, m_playing true, mutex held. The mutex
+    // is released while the models are actually being mixed, and
+    // regained before returning. Return true if work done
     bool fillBuffers();
     
     // Called from fillBuffers.  Return the number of frames written,
@@ -437,7 +553,80 @@ protected:
 	AudioCallbackPlaySource &m_source;
     };
 
+    /**
+     * Scratch output for one share of a parallel mix: one buffer per
+     * channel, with room either side of the nominal range for the
+     * fade-in and fade-out spill that AudioGenerator writes.
+     */
+    class MixBuffer
+    {
+    public:
+        MixBuffer() : m_channels(0), m_size(0) { }
+
+        // Make room for count frames on each of the given channels,
+        // and zero the whole lot. Grows but never shrinks.
+        void prepare(int channels, sv_frame_t count);
+
+        float **getChannels() { return m_ptrs.data(); }
+
+    private:
+        std::vector<float> m_storage;
+        std::vector<float *> m_ptrs;
+        int m_channels;
+        sv_frame_t m_size;
+    };
+
+    struct MixJob {
+        MixJob() : models(0), start(0), count(0), fadeIn(0), fadeOut(0) { }
+        const ModelList *models;
+        sv_frame_t start;
+        sv_frame_t count;
+        sv_frame_t fadeIn;
+        sv_frame_t fadeOut;
+    };
+
+    class MixThread : public Thread
+    {
+    public:
+        MixThread(AudioCallbackPlaySource &source, int share) :
+            Thread(Thread::NonRTThread),
+            m_source(source),
+            m_share(share) { }
+
+        // Called from the fill thread to start one share of m_mixJob
+        void kick() { m_start.release(); }
+
+        virtual void run();
+
+    protected:
+        AudioCallbackPlaySource &m_source;
+        int m_share;
+        QSemaphore m_start;
+    };
+
+    // Called from mixModels. Mix one chunk by dividing the models
+    // among the fill thread (share 0) and the mix threads, then sum
+    // the shares into buffers in share order, so that the output is
+    // the same however the threads happen to be scheduled
+    void mixModelsParallel(const ModelList *models,
+                           sv_frame_t start, sv_frame_t count,
+                           float **buffers, int channels,
+                           sv_frame_t fadeIn, sv_frame_t fadeOut);
+
+    // Called from the fill thread and the mix threads
+    void mixModelShare(int share);
+
+    void startMixThreads();
+    void stopMixThreads();
+
+    std::vector<MixThread *> m_mixThreads;
+    std::vector<MixBuffer *> m_mixBuffers; // one per share
+    MixJob m_mixJob;
+    QSemaphore m_mixDone;
+
     QMutex m_mutex;
+    QMutex m_mixMutex; // held by the fill thread only while mixing
+    int m_writeBufferGeneration; // changes whenever write buffers are reset
     QWaitCondition m_condition;
     FillThread *m_fillThread;
     breakfastquay::ResamplerWrapper *m_resamplerWrapper; // I don't own this
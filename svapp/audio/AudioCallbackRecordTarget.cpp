@@ -13,6 +13,7 @@
 */
 
 #include "AudioCallbackRecordTarget.h"
+#include "RecordAnalyser.h"
 
 #include "base/ViewManagerBase.h"
 #include "base/TempDirectory.h"
@@ -35,7 +36,9 @@ AudioCallbackRecordTarget::AudioCallbackRecordTarget(ViewManagerBase *manager,
     m_bufferCount(0),
     m_inputLeft(0.f),
     m_inputRight(0.f),
-    m_levelsSet(false)
+    m_levelsSet(false),
+    m_liveSpectrogram(false),
+    m_analyser(0)
 {
     m_viewManager->setAudioRecordTarget(this);
 
@@ -49,6 +52,8 @@ AudioCallbackRecordTarget::~AudioCallbackRecordTarget()
 {
     m_viewManager->setAudioRecordTarget(0);
 
+    delete m_analyser;
+
     QMutexLocker locker(&m_bufPtrMutex);
     for (int c = 0; c < m_bufferCount; ++c) {
         delete m_buffers[c];
@@ -160,6 +165,10 @@ AudioCallbackRecordTarget::updateModel()
 
     m_model->addSamples(samples, nframes);
 
+    if (m_analyser) {
+        m_analyser->addSamples(samples, nframes);
+    }
+
     for (int c = 0; c < m_recordChannelCount; ++c) {
         delete[] samples[c];
     }
@@ -287,6 +296,16 @@ AudioCallbackRecordTarget::startRecording()
     }
 
     m_model->setObjectName(label);
+
+    delete m_analyser;
+    m_analyser = 0;
+    if (m_liveSpectrogram || !m_liveTransforms.empty()) {
+        m_analyser = new RecordAnalyser(m_recordSampleRate,
+                                        m_recordChannelCount,
+                                        m_liveSpectrogram,
+                                        m_liveTransforms);
+    }
+
     m_recording = true;
 
     emit recordStatusChanged(true);
@@ -314,6 +333,12 @@ AudioCallbackRecordTarget::stopRecording()
 
     m_model->writeComplete();
     m_model = 0;
+
+    if (m_analyser) {
+        m_analyser->finish();
+        delete m_analyser;
+        m_analyser = 0;
+    }
     
     emit recordStatusChanged(false);
     emit recordCompleted();
@@ -27,9 +27,11 @@
 
 #include "base/BaseTypes.h"
 #include "base/RingBuffer.h"
+#include "transform/Transform.h"
 
 class ViewManagerBase;
 class WritableWaveFileModel;
+class RecordAnalyser;
 
 class AudioCallbackRecordTarget : public QObject,
                                   public AudioRecordTarget,
@@ -79,6 +81,23 @@ public:
     WritableWaveFileModel *startRecording(); // caller takes ownership of model
     void stopRecording();
 
+    /**
+     * Specify whether to compute a live spectrogram of the input
+     * while recording, and which feature-extraction transforms to run
+     * over it as it arrives. These take effect at the next call to
+     * startRecording().
+     */
+    void setLiveSpectrogramEnabled(bool enabled) { m_liveSpectrogram = enabled; }
+    void setLiveTransforms(const Transforms &transforms) { m_liveTransforms = transforms; }
+
+    /**
+     * Return the analyser for the recording in progress, or 0 if we
+     * are not recording or no live analysis was requested. The
+     * caller should take ownership of the analyser's models (but not
+     * of the analyser itself) straight after startRecording().
+     */
+    RecordAnalyser *getLiveAnalyser() { return m_analyser; }
+
 signals:
     void recordStatusChanged(bool recording);
     void recordDurationChanged(sv_frame_t, sv_samplerate_t); // emitted occasionally
@@ -103,6 +122,9 @@ private:
     float m_inputLeft;
     float m_inputRight;
     bool m_levelsSet;
+    bool m_liveSpectrogram;
+    Transforms m_liveTransforms;
+    RecordAnalyser *m_analyser;
 
     void recreateBuffers();
 };
@@ -33,9 +33,12 @@
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 #include <QDir>
 #include <QFile>
+#include <QReadLocker>
+#include <QWriteLocker>
 
 const sv_frame_t
 AudioGenerator::m_processingBlockSize = 1024;
@@ -49,10 +52,7 @@ AudioGenerator::AudioGenerator() :
     m_sourceSampleRate(0),
     m_targetChannelCount(1),
     m_waveType(0),
-    m_soloing(false),
-    m_channelBuffer(0),
-    m_channelBufSiz(0),
-    m_channelBufCount(0)
+    m_soloing(false)
 {
     initialiseSampleDir();
 
@@ -68,10 +68,73 @@ AudioGenerator::~AudioGenerator()
     SVDEBUG << "AudioGenerator::~AudioGenerator" << endl;
 #endif
 
-    for (int i = 0; i < m_channelBufCount; ++i) {
-        delete[] m_channelBuffer[i];
+    for (ScratchArenaMap::iterator i = m_scratchArenas.begin();
+         i != m_scratchArenas.end(); ++i) {
+        delete i->second;
     }
-    delete[] m_channelBuffer;
+}
+
+AudioGenerator::ScratchArena::~ScratchArena()
+{
+    for (int c = 0; c < channelBufCount; ++c) {
+        delete[] channelBuffer[c];
+    }
+    delete[] channelBuffer;
+    delete[] bufferIndexes;
+}
+
+void
+AudioGenerator::ScratchArena::ensureChannelBuffers(int channels,
+                                                   sv_frame_t frames)
+{
+    if (channelBufSiz >= frames && channelBufCount >= channels) return;
+
+    // Grow only, so repeated calls with similar sizes settle down to
+    // no allocation at all
+    if (frames < channelBufSiz) frames = channelBufSiz;
+    if (channels < channelBufCount) channels = channelBufCount;
+    
+    for (int c = 0; c < channelBufCount; ++c) {
+        delete[] channelBuffer[c];
+    }
+    delete[] channelBuffer;
+
+    channelBuffer = new float *[channels];
+    for (int c = 0; c < channels; ++c) {
+        channelBuffer[c] = new float[frames];
+    }
+
+    channelBufCount = channels;
+    channelBufSiz = frames;
+}
+
+void
+AudioGenerator::ScratchArena::ensureBufferIndexes(int channels)
+{
+    if (bufferIndexCount >= channels) return;
+    delete[] bufferIndexes;
+    bufferIndexes = new float *[channels];
+    bufferIndexCount = channels;
+}
+
+AudioGenerator::ScratchArena *
+AudioGenerator::getScratchArena(const Model *model)
+{
+    ScratchArenaMap::iterator i = m_scratchArenas.find(model);
+    if (i != m_scratchArenas.end()) return i->second;
+
+    ScratchArena *arena = new ScratchArena;
+    arena->ensureBufferIndexes(m_targetChannelCount);
+    m_scratchArenas[model] = arena;
+    return arena;
+}
+
+AudioGenerator::ScratchArena *
+AudioGenerator::findScratchArena(const Model *model)
+{
+    ScratchArenaMap::iterator i = m_scratchArenas.find(model);
+    if (i != m_scratchArenas.end()) return i->second;
+    return 0;
 }
 
 void
@@ -132,6 +195,18 @@ AudioGenerator::addModel(Model *model)
     const Playable *playable = model;
     if (!playable || !playable->canPlay()) return 0;
 
+    {
+        // Set up the scratch arena now rather than on first mix, so
+        // that playback of a newly-added model does not allocate
+        QWriteLocker locker(&m_lock);
+        ScratchArena *arena = getScratchArena(model);
+        DenseTimeValueModel *dtvm = dynamic_cast<DenseTimeValueModel *>(model);
+        if (dtvm) {
+            arena->ensureChannelBuffers(dtvm->getChannelCount(),
+                                        m_processingBlockSize * 16);
+        }
+    }
+
     PlayParameters *parameters =
 	PlayParameterRepository::getInstance()->getPlayParameters(playable);
 
@@ -140,8 +215,9 @@ AudioGenerator::addModel(Model *model)
     if (usesClipMixer(model)) {
         ClipMixer *mixer = makeClipMixerFor(model);
         if (mixer) {
-            QMutexLocker locker(&m_mutex);
+            QWriteLocker locker(&m_lock);
             m_clipMixerMap[model] = mixer;
+            m_noteOffs[model].clear();
             return willPlay;
         }
     }
@@ -149,7 +225,7 @@ AudioGenerator::addModel(Model *model)
     if (usesContinuousSynth(model)) {
         ContinuousSynth *synth = makeSynthFor(model);
         if (synth) {
-            QMutexLocker locker(&m_mutex);
+            QWriteLocker locker(&m_lock);
             m_continuousSynthMap[model] = synth;
             return willPlay;
         }
@@ -173,7 +249,10 @@ AudioGenerator::playClipIdChanged(const Playable *playable, QString)
 
     ClipMixer *mixer = makeClipMixerFor(model);
     if (mixer) {
-        QMutexLocker locker(&m_mutex);
+        QWriteLocker locker(&m_lock);
+        // No mix can be in progress while we hold the write lock, so
+        // the old mixer can go straight away
+        delete m_clipMixerMap[model];
         m_clipMixerMap[model] = mixer;
     }
 }
@@ -273,35 +352,51 @@ AudioGenerator::makeSynthFor(const Model *model)
 void
 AudioGenerator::removeModel(Model *model)
 {
+    {
+        QWriteLocker locker(&m_lock);
+        ScratchArenaMap::iterator i = m_scratchArenas.find(model);
+        if (i != m_scratchArenas.end()) {
+            delete i->second;
+            m_scratchArenas.erase(i);
+        }
+    }
+    
     SparseOneDimensionalModel *sodm =
 	dynamic_cast<SparseOneDimensionalModel *>(model);
     if (!sodm) return; // nothing to do
 
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
 
     if (m_clipMixerMap.find(sodm) == m_clipMixerMap.end()) return;
 
     ClipMixer *mixer = m_clipMixerMap[sodm];
     m_clipMixerMap.erase(sodm);
+    m_noteOffs.erase(sodm);
     delete mixer;
 }
 
 void
 AudioGenerator::clearModels()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
 
     while (!m_clipMixerMap.empty()) {
         ClipMixer *mixer = m_clipMixerMap.begin()->second;
 	m_clipMixerMap.erase(m_clipMixerMap.begin());
 	delete mixer;
     }
+
+    while (!m_scratchArenas.empty()) {
+        ScratchArena *arena = m_scratchArenas.begin()->second;
+        m_scratchArenas.erase(m_scratchArenas.begin());
+        delete arena;
+    }
 }    
 
 void
 AudioGenerator::reset()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
 
 #ifdef DEBUG_AUDIO_GENERATOR
     cerr << "AudioGenerator::reset()" << endl;
@@ -313,7 +408,11 @@ AudioGenerator::reset()
 	}
     }
 
-    m_noteOffs.clear();
+    // Clear the note-off sets rather than the map, so that mixing
+    // (which only reads the map) never needs to insert into it
+    for (NoteOffMap::iterator i = m_noteOffs.begin(); i != m_noteOffs.end(); ++i) {
+        i->second.clear();
+    }
 }
 
 void
@@ -323,12 +422,16 @@ AudioGenerator::setTargetChannelCount(int targetChannelCount)
 
 //    SVDEBUG << "AudioGenerator::setTargetChannelCount(" << targetChannelCount << ")" << endl;
 
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
     m_targetChannelCount = targetChannelCount;
 
     for (ClipMixerMap::iterator i = m_clipMixerMap.begin(); i != m_clipMixerMap.end(); ++i) {
 	if (i->second) i->second->setChannelCount(targetChannelCount);
     }
+
+    for (ScratchArenaMap::iterator i = m_scratchArenas.begin(); i != m_scratchArenas.end(); ++i) {
+        i->second->ensureBufferIndexes(targetChannelCount);
+    }
 }
 
 sv_frame_t
@@ -340,7 +443,7 @@ AudioGenerator::getBlockSize() const
 void
 AudioGenerator::setSoloModelSet(std::set<Model *> s)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
 
     m_soloModelSet = s;
     m_soloing = true;
@@ -349,7 +452,7 @@ AudioGenerator::setSoloModelSet(std::set<Model *> s)
 void
 AudioGenerator::clearSoloModelSet()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker locker(&m_lock);
 
     m_soloModelSet.clear();
     m_soloing = false;
@@ -364,7 +467,7 @@ AudioGenerator::mixModel(Model *model, sv_frame_t startFrame, sv_frame_t frameCo
 	return frameCount;
     }
 
-    QMutexLocker locker(&m_mutex);
+    QReadLocker locker(&m_lock);
 
     Playable *playable = model;
     if (!playable || !playable->canPlay()) return frameCount;
@@ -393,19 +496,22 @@ AudioGenerator::mixModel(Model *model, sv_frame_t startFrame, sv_frame_t frameCo
     float gain = parameters->getPlayGain();
     float pan = parameters->getPlayPan();
 
+    ScratchArena *arena = findScratchArena(model);
+    if (!arena) return frameCount; // never added
+
     DenseTimeValueModel *dtvm = dynamic_cast<DenseTimeValueModel *>(model);
     if (dtvm) {
-	return mixDenseTimeValueModel(dtvm, startFrame, frameCount,
+	return mixDenseTimeValueModel(dtvm, arena, startFrame, frameCount,
 				      buffer, gain, pan, fadeIn, fadeOut);
     }
 
     if (usesClipMixer(model)) {
-        return mixClipModel(model, startFrame, frameCount,
+        return mixClipModel(model, arena, startFrame, frameCount,
                             buffer, gain, pan);
     }
 
     if (usesContinuousSynth(model)) {
-        return mixContinuousSynthModel(model, startFrame, frameCount,
+        return mixContinuousSynthModel(model, arena, startFrame, frameCount,
                                        buffer, gain, pan);
     }
 
@@ -416,6 +522,7 @@ AudioGenerator::mixModel(Model *model, sv_frame_t startFrame, sv_frame_t frameCo
 
 sv_frame_t
 AudioGenerator::mixDenseTimeValueModel(DenseTimeValueModel *dtvm,
+                                       ScratchArena *arena,
 				       sv_frame_t startFrame, sv_frame_t frames,
 				       float **buffer, float gain, float pan,
 				       sv_frame_t fadeIn, sv_frame_t fadeOut)
@@ -424,55 +531,42 @@ AudioGenerator::mixDenseTimeValueModel(DenseTimeValueModel *dtvm,
 
     int modelChannels = dtvm->getChannelCount();
 
-    if (m_channelBufSiz < maxFrames || m_channelBufCount < modelChannels) {
-
-        for (int c = 0; c < m_channelBufCount; ++c) {
-            delete[] m_channelBuffer[c];
-        }
-
-	delete[] m_channelBuffer;
-        m_channelBuffer = new float *[modelChannels];
-
-        for (int c = 0; c < modelChannels; ++c) {
-            m_channelBuffer[c] = new float[maxFrames];
-        }
-
-        m_channelBufCount = modelChannels;
-	m_channelBufSiz = maxFrames;
-    }
+    arena->ensureChannelBuffers(modelChannels, maxFrames);
 
+    float **channelBuffer = arena->channelBuffer;
+    
     sv_frame_t got = 0;
 
     if (startFrame >= fadeIn/2) {
 
-        auto data = dtvm->getMultiChannelData(0, modelChannels - 1,
-                                              startFrame - fadeIn/2,
-                                              frames + fadeOut/2 + fadeIn/2);
-
-        for (int c = 0; c < modelChannels; ++c) {
-            copy(data[c].begin(), data[c].end(), m_channelBuffer[c]);
-        }
-
-        got = data[0].size();
+        got = dtvm->getMultiChannelDataInto(0, modelChannels - 1,
+                                            startFrame - fadeIn/2,
+                                            frames + fadeOut/2 + fadeIn/2,
+                                            channelBuffer);
 
     } else {
         sv_frame_t missing = fadeIn/2 - startFrame;
 
         if (missing > 0) {
-            cerr << "note: channelBufSiz = " << m_channelBufSiz
+            cerr << "note: channelBufSiz = " << arena->channelBufSiz
                  << ", frames + fadeOut/2 = " << frames + fadeOut/2 
                  << ", startFrame = " << startFrame 
                  << ", missing = " << missing << endl;
         }
 
-        auto data = dtvm->getMultiChannelData(0, modelChannels - 1,
-                                              startFrame,
-                                              frames + fadeOut/2);
+        arena->ensureBufferIndexes(modelChannels);
+        
         for (int c = 0; c < modelChannels; ++c) {
-            copy(data[c].begin(), data[c].end(), m_channelBuffer[c] + missing);
+            std::fill(channelBuffer[c], channelBuffer[c] + missing, 0.f);
+            arena->bufferIndexes[c] = channelBuffer[c] + missing;
         }
+        
+        got = dtvm->getMultiChannelDataInto(0, modelChannels - 1,
+                                            startFrame,
+                                            frames + fadeOut/2,
+                                            arena->bufferIndexes);
 
-        got = data[0].size() + missing;
+        got += missing;
     }	    
 
     for (int c = 0; c < m_targetChannelCount; ++c) {
@@ -494,7 +588,7 @@ AudioGenerator::mixDenseTimeValueModel(DenseTimeValueModel *dtvm,
 	    float *back = buffer[c];
 	    back -= fadeIn/2;
 	    back[i] +=
-                (channelGain * m_channelBuffer[sourceChannel][i] * float(i))
+                (channelGain * channelBuffer[sourceChannel][i] * float(i))
                 / float(fadeIn);
 	}
 
@@ -506,7 +600,7 @@ AudioGenerator::mixDenseTimeValueModel(DenseTimeValueModel *dtvm,
 	    if (i > frames - fadeOut/2) {
 		mult = (mult * float((frames + fadeOut/2) - i)) / float(fadeOut);
 	    }
-            float val = m_channelBuffer[sourceChannel][i];
+            float val = channelBuffer[sourceChannel][i];
             if (i >= got) val = 0.f;
 	    buffer[c][i] += mult * val;
 	}
@@ -517,11 +611,16 @@ AudioGenerator::mixDenseTimeValueModel(DenseTimeValueModel *dtvm,
   
 sv_frame_t
 AudioGenerator::mixClipModel(Model *model,
+                             ScratchArena *arena,
                              sv_frame_t startFrame, sv_frame_t frames,
                              float **buffer, float gain, float pan)
 {
-    ClipMixer *clipMixer = m_clipMixerMap[model];
-    if (!clipMixer) return 0;
+    ClipMixerMap::iterator mi = m_clipMixerMap.find(model);
+    if (mi == m_clipMixerMap.end() || !mi->second) return 0;
+    ClipMixer *clipMixer = mi->second;
+
+    NoteOffMap::iterator ni = m_noteOffs.find(model);
+    if (ni == m_noteOffs.end()) return 0;
 
     int blocks = int(frames / m_processingBlockSize);
     
@@ -548,9 +647,10 @@ AudioGenerator::mixClipModel(Model *model,
     ClipMixer::NoteStart on;
     ClipMixer::NoteEnd off;
 
-    NoteOffSet &noteOffs = m_noteOffs[model];
+    NoteOffSet &noteOffs = ni->second;
 
-    float **bufferIndexes = new float *[m_targetChannelCount];
+    arena->ensureBufferIndexes(m_targetChannelCount);
+    float **bufferIndexes = arena->bufferIndexes;
 
     for (int i = 0; i < blocks; ++i) {
 
@@ -629,21 +729,21 @@ AudioGenerator::mixClipModel(Model *model,
         clipMixer->mix(bufferIndexes, gain, starts, ends);
     }
 
-    delete[] bufferIndexes;
-
     return got;
 }
 
 sv_frame_t
 AudioGenerator::mixContinuousSynthModel(Model *model,
+                                        ScratchArena *arena,
                                         sv_frame_t startFrame,
                                         sv_frame_t frames,
                                         float **buffer,
                                         float gain, 
                                         float pan)
 {
-    ContinuousSynth *synth = m_continuousSynthMap[model];
-    if (!synth) return 0;
+    ContinuousSynthMap::iterator si = m_continuousSynthMap.find(model);
+    if (si == m_continuousSynthMap.end() || !si->second) return 0;
+    ContinuousSynth *synth = si->second;
 
     // only type we support here at the moment
     SparseTimeValueModel *stvm = qobject_cast<SparseTimeValueModel *>(model);
@@ -660,7 +760,8 @@ AudioGenerator::mixContinuousSynthModel(Model *model,
 	      << ", blocks " << blocks << endl;
 #endif
     
-    float **bufferIndexes = new float *[m_targetChannelCount];
+    arena->ensureBufferIndexes(m_targetChannelCount);
+    float **bufferIndexes = arena->bufferIndexes;
 
     for (int i = 0; i < blocks; ++i) {
 
@@ -708,8 +809,6 @@ AudioGenerator::mixContinuousSynthModel(Model *model,
                    f0);
     }
 
-    delete[] bufferIndexes;
-
     return got;
 }
 
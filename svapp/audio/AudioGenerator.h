@@ -26,7 +26,7 @@ class ClipMixer;
 class ContinuousSynth;
 
 #include <QObject>
-#include <QMutex>
+#include <QReadWriteLock>
 
 #include <set>
 #include <map>
@@ -80,6 +80,12 @@ public:
 
     /**
      * Mix a single model into an output buffer.
+     *
+     * This may be called from several threads at once, provided that
+     * no two concurrent calls are for the same model: all per-model
+     * state (clip mixer, synth, note-offs, scratch space) is touched
+     * only by the thread mixing that model, and the shared maps are
+     * only read here.
      */
     virtual sv_frame_t mixModel(Model *model, sv_frame_t startFrame, sv_frame_t frameCount,
 			    float **buffer, sv_frame_t fadeIn = 0, sv_frame_t fadeOut = 0);
@@ -128,7 +134,9 @@ protected:
 
     typedef std::map<const Model *, ContinuousSynth *> ContinuousSynthMap;
 
-    QMutex m_mutex;
+    // Held for reading while mixing, and for writing while adding,
+    // removing or reconfiguring models
+    QReadWriteLock m_lock;
 
     ClipMixerMap m_clipMixerMap;
     NoteOffMap m_noteOffs;
@@ -136,6 +144,35 @@ protected:
 
     ContinuousSynthMap m_continuousSynthMap;
 
+    /**
+     * Per-model scratch space used while mixing. Each model gets its
+     * own arena, created when the model is added and only ever grown
+     * (never shrunk) thereafter, so that once playback has warmed up
+     * the mix path no longer allocates.
+     */
+    struct ScratchArena {
+        ScratchArena() :
+            channelBuffer(0), channelBufSiz(0), channelBufCount(0),
+            bufferIndexes(0), bufferIndexCount(0) { }
+        ~ScratchArena();
+
+        void ensureChannelBuffers(int channels, sv_frame_t frames);
+        void ensureBufferIndexes(int channels);
+
+        float **channelBuffer;
+        sv_frame_t channelBufSiz;
+        int channelBufCount;
+
+        float **bufferIndexes;
+        int bufferIndexCount;
+    };
+
+    typedef std::map<const Model *, ScratchArena *> ScratchArenaMap;
+    ScratchArenaMap m_scratchArenas;
+
+    ScratchArena *getScratchArena(const Model *model); // write lock held
+    ScratchArena *findScratchArena(const Model *model); // read lock held
+
     bool usesClipMixer(const Model *);
     bool wantsQuieterClips(const Model *);
     bool usesContinuousSynth(const Model *);
@@ -146,22 +183,21 @@ protected:
     static void initialiseSampleDir();
 
     virtual sv_frame_t mixDenseTimeValueModel
-    (DenseTimeValueModel *model, sv_frame_t startFrame, sv_frame_t frameCount,
+    (DenseTimeValueModel *model, ScratchArena *arena,
+     sv_frame_t startFrame, sv_frame_t frameCount,
      float **buffer, float gain, float pan, sv_frame_t fadeIn, sv_frame_t fadeOut);
 
     virtual sv_frame_t mixClipModel
-    (Model *model, sv_frame_t startFrame, sv_frame_t frameCount,
+    (Model *model, ScratchArena *arena,
+     sv_frame_t startFrame, sv_frame_t frameCount,
      float **buffer, float gain, float pan);
 
     virtual sv_frame_t mixContinuousSynthModel
-    (Model *model, sv_frame_t startFrame, sv_frame_t frameCount,
+    (Model *model, ScratchArena *arena,
+     sv_frame_t startFrame, sv_frame_t frameCount,
      float **buffer, float gain, float pan);
     
     static const sv_frame_t m_processingBlockSize;
-
-    float **m_channelBuffer;
-    sv_frame_t m_channelBufSiz;
-    int m_channelBufCount;
 };
 
 #endif
@@ -20,8 +20,16 @@
 
 #include "base/Debug.h"
 
+#include "bqvec/VectorOps.h"
+
+using breakfastquay::v_add_with_gain;
+
 //#define DEBUG_CLIP_MIXER 1
 
+// Upper limit on the total number of sample frames held across all
+// pre-rendered clips in one mixer's bank
+static const sv_frame_t MAX_BANK_FRAMES = 4 * 1024 * 1024;
+
 ClipMixer::ClipMixer(int channels, sv_samplerate_t sampleRate, sv_frame_t blockSize) :
     m_channels(channels),
     m_sampleRate(sampleRate),
@@ -29,7 +37,11 @@ ClipMixer::ClipMixer(int channels, sv_samplerate_t sampleRate, sv_frame_t blockS
     m_clipData(0),
     m_clipLength(0),
     m_clipF0(0),
-    m_clipRate(0)
+    m_clipRate(0),
+    m_maxVoices(64),
+    m_releaseSampleCount(sv_frame_t(round(0.01 * sampleRate))),
+    m_levels(channels, 0.f),
+    m_bankFrames(0)
 {
 }
 
@@ -42,6 +54,14 @@ void
 ClipMixer::setChannelCount(int channels)
 {
     m_channels = channels;
+    m_levels.resize(channels, 0.f);
+}
+
+void
+ClipMixer::setMaxVoices(int voices)
+{
+    if (voices < 1) voices = 1;
+    m_maxVoices = voices;
 }
 
 bool
@@ -95,6 +115,10 @@ ClipMixer::loadClipData(QString path, double f0, double level)
     m_clipF0 = f0;
     m_clipRate = info.samplerate;
 
+    m_bank.clear();
+    m_lru.clear();
+    m_bankFrames = 0;
+    
     return true;
 }
 
@@ -119,31 +143,92 @@ ClipMixer::getResampledClipDuration(double frequency)
     return sv_frame_t(ceil(double(m_clipLength) * getResampleRatioFor(frequency)));
 }
 
+const std::vector<float> &
+ClipMixer::getRenderedClip(float frequency)
+{
+    ClipBank::iterator i = m_bank.find(frequency);
+    if (i != m_bank.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, i->second.lruPosition);
+        return i->second.data;
+    }
+
+    double ratio = getResampleRatioFor(frequency);
+    sv_frame_t duration = getResampledClipDuration(frequency);
+
+    while (!m_lru.empty() && m_bankFrames + duration > MAX_BANK_FRAMES) {
+        ClipBank::iterator victim = m_bank.find(m_lru.back());
+        m_bankFrames -= sv_frame_t(victim->second.data.size());
+        m_bank.erase(victim);
+        m_lru.pop_back();
+    }
+
+#ifdef DEBUG_CLIP_MIXER
+    cerr << "ClipMixer::getRenderedClip: rendering " << duration
+         << " frames for frequency " << frequency << ", bank now has "
+         << m_bank.size() << " clip(s)" << endl;
+#endif
+    
+    RenderedClip &rc = m_bank[frequency];
+    rc.data.resize(duration);
+
+    for (sv_frame_t s = 0; s < duration; ++s) {
+
+        double os = double(s) / ratio;
+        sv_frame_t osi = sv_frame_t(floor(os));
+
+        //!!! just linear interpolation for now (same as SV's sample
+        //!!! player). a small sinc kernel would be better and
+        //!!! probably "good enough"
+        double value = 0.0;
+        if (osi < m_clipLength) {
+            value += m_clipData[osi];
+        }
+        if (osi + 1 < m_clipLength) {
+            value += (m_clipData[osi + 1] - m_clipData[osi]) * (os - double(osi));
+        }
+
+        rc.data[s] = float(value);
+    }
+
+    m_lru.push_front(frequency);
+    rc.lruPosition = m_lru.begin();
+    m_bankFrames += duration;
+    
+    return rc.data;
+}
+
 void
 ClipMixer::mix(float **toBuffers, 
                float gain,
-               std::vector<NoteStart> newNotes, 
-               std::vector<NoteEnd> endingNotes)
+               const std::vector<NoteStart> &newNotes, 
+               const std::vector<NoteEnd> &endingNotes)
 {
-    foreach (NoteStart note, newNotes) {
+    for (const NoteStart &note: newNotes) {
         if (note.frequency > 20 && 
             note.frequency < 5000) {
             m_playing.push_back(note);
         }
     }
 
-    std::vector<NoteStart> remaining;
-
-    float *levels = new float[m_channels];
+    m_remaining.clear();
 
+    // m_playing is in order of note start, so if we have too many
+    // notes it is the first (oldest) ones that get stolen
+    int stealCount = int(m_playing.size()) - m_maxVoices;
+    
 #ifdef DEBUG_CLIP_MIXER
     cerr << "ClipMixer::mix: have " << m_playing.size() << " playing note(s)"
-         << " and " << endingNotes.size() << " note(s) ending here"
-         << endl;
+         << " and " << endingNotes.size() << " note(s) ending here";
+    if (stealCount > 0) cerr << ", stealing " << stealCount;
+    cerr << endl;
 #endif
 
-    foreach (NoteStart note, m_playing) {
+    float *levels = m_levels.data();
+    
+    for (int ni = 0; ni < int(m_playing.size()); ++ni) {
 
+        const NoteStart &note = m_playing[ni];
+        
         for (int c = 0; c < m_channels; ++c) {
             levels[c] = note.level * gain;
         }
@@ -158,7 +243,7 @@ ClipMixer::mix(float **toBuffers,
 
         bool ending = false;
 
-        foreach (NoteEnd end, endingNotes) {
+        for (const NoteEnd &end: endingNotes) {
             if (end.frequency == note.frequency && 
                 end.frameOffset >= start &&
                 end.frameOffset <= m_blockSize) {
@@ -169,7 +254,17 @@ ClipMixer::mix(float **toBuffers,
             }
         }
 
-        sv_frame_t clipDuration = getResampledClipDuration(note.frequency);
+        if (ni < stealCount) {
+            // Stolen: fade out over the release time from here
+            ending = true;
+            if (durationHere > m_releaseSampleCount) {
+                durationHere = m_releaseSampleCount;
+            }
+        }
+
+        const std::vector<float> &clip = getRenderedClip(note.frequency);
+        sv_frame_t clipDuration = sv_frame_t(clip.size());
+        
         if (start + clipDuration > 0) {
             if (start < 0 && start + clipDuration < durationHere) {
                 durationHere = start + clipDuration;
@@ -177,7 +272,7 @@ ClipMixer::mix(float **toBuffers,
             if (durationHere > 0) {
                 mixNote(toBuffers,
                         levels,
-                        note.frequency,
+                        clip,
                         start < 0 ? -start : 0,
                         start > 0 ?  start : 0,
                         durationHere,
@@ -188,61 +283,59 @@ ClipMixer::mix(float **toBuffers,
         if (!ending) {
             NoteStart adjusted = note;
             adjusted.frameOffset -= m_blockSize;
-            remaining.push_back(adjusted);
+            m_remaining.push_back(adjusted);
         }
     }
 
-    delete[] levels;
-
-    m_playing = remaining;
+    m_playing.swap(m_remaining);
 }
 
 void
 ClipMixer::mixNote(float **toBuffers,
-                   float *levels,
-                   float frequency,
+                   const float *levels,
+                   const std::vector<float> &clip,
                    sv_frame_t sourceOffset,
                    sv_frame_t targetOffset,
                    sv_frame_t sampleCount,
                    bool isEnd)
 {
-    if (!m_clipData) return;
-
-    double ratio = getResampleRatioFor(frequency);
+    sv_frame_t clipLength = sv_frame_t(clip.size());
+    if (sourceOffset >= clipLength) return;
     
-    double releaseTime = 0.01;
-    sv_frame_t releaseSampleCount = sv_frame_t(round(releaseTime * m_sampleRate));
+    sv_frame_t releaseSampleCount = m_releaseSampleCount;
     if (releaseSampleCount > sampleCount) {
         releaseSampleCount = sampleCount;
     }
-    double releaseFraction = 1.0/double(releaseSampleCount);
 
-    for (sv_frame_t i = 0; i < sampleCount; ++i) {
+    sv_frame_t sustainCount = sampleCount;
+    if (isEnd) sustainCount -= releaseSampleCount;
 
-        sv_frame_t s = sourceOffset + i;
+    // The body of the note is a straight gain-scaled copy of the
+    // pre-rendered clip into each channel
 
-        double os = double(s) / ratio;
-        sv_frame_t osi = sv_frame_t(floor(os));
+    sv_frame_t n = sustainCount;
+    if (n > clipLength - sourceOffset) n = clipLength - sourceOffset;
 
-        //!!! just linear interpolation for now (same as SV's sample
-        //!!! player). a small sinc kernel would be better and
-        //!!! probably "good enough"
-        double value = 0.0;
-        if (osi < m_clipLength) {
-            value += m_clipData[osi];
-        }
-        if (osi + 1 < m_clipLength) {
-            value += (m_clipData[osi + 1] - m_clipData[osi]) * (os - double(osi));
-        }
-         
-        if (isEnd && i + releaseSampleCount > sampleCount) {
-            value *= releaseFraction * double(sampleCount - i); // linear ramp for release
+    const float *source = clip.data() + sourceOffset;
+    
+    if (n > 0) {
+        for (int c = 0; c < m_channels; ++c) {
+            v_add_with_gain(toBuffers[c] + targetOffset, source,
+                            levels[c], int(n));
         }
+    }
+
+    if (!isEnd || releaseSampleCount == 0) return;
+
+    // Linear ramp for release
+    
+    double releaseFraction = 1.0/double(releaseSampleCount);
 
+    for (sv_frame_t i = sustainCount; i < sampleCount; ++i) {
+        if (sourceOffset + i >= clipLength) break;
+        double value = source[i] * releaseFraction * double(sampleCount - i);
         for (int c = 0; c < m_channels; ++c) {
             toBuffers[c][targetOffset + i] += float(levels[c] * value);
         }
     }
 }
-
-
@@ -18,6 +18,8 @@
 
 #include <QString>
 #include <vector>
+#include <map>
+#include <list>
 
 #include "base/BaseTypes.h"
 
@@ -26,6 +28,10 @@
  * clip. (i.e. this is an implementation of a digital sampler in the
  * musician's sense.) This can mix any number of notes of arbitrary
  * frequency, so long as they all use the same sample clip.
+ *
+ * The clip is resampled once for each distinct note frequency and
+ * the result kept in a bounded, least-recently-used bank, so that
+ * mixing a note is just a gain-scaled vector add per channel.
  */
 
 class ClipMixer
@@ -47,6 +53,13 @@ public:
 
     void reset(); // discarding any playing notes
 
+    /**
+     * Set the maximum number of notes that may sound at once. If a
+     * block would start more than this, the oldest playing notes are
+     * released early to make room. The default is 64.
+     */
+    void setMaxVoices(int voices);
+
     struct NoteStart {
 	sv_frame_t frameOffset; // within current processing block
 	float frequency; // Hz
@@ -61,8 +74,8 @@ public:
 
     void mix(float **toBuffers, 
              float gain,
-	     std::vector<NoteStart> newNotes, 
-	     std::vector<NoteEnd> endingNotes);
+	     const std::vector<NoteStart> &newNotes, 
+	     const std::vector<NoteEnd> &endingNotes);
 
 private:
     int m_channels;
@@ -76,14 +89,31 @@ private:
     double m_clipF0;
     sv_samplerate_t m_clipRate;
 
+    int m_maxVoices;
+    sv_frame_t m_releaseSampleCount;
+
     std::vector<NoteStart> m_playing;
+    std::vector<NoteStart> m_remaining; // swapped with m_playing in mix
+    std::vector<float> m_levels;
+
+    struct RenderedClip {
+        std::vector<float> data;
+        std::list<float>::iterator lruPosition;
+    };
+
+    typedef std::map<float, RenderedClip> ClipBank; // keyed by frequency
+    ClipBank m_bank;
+    std::list<float> m_lru; // frequencies, most recently used first
+    sv_frame_t m_bankFrames; // total across all rendered clips
 
     double getResampleRatioFor(double frequency);
     sv_frame_t getResampledClipDuration(double frequency);
 
+    const std::vector<float> &getRenderedClip(float frequency);
+    
     void mixNote(float **toBuffers, 
-                 float *levels,
-                 float frequency,
+                 const float *levels,
+                 const std::vector<float> &clip,
                  sv_frame_t sourceOffset, // within resampled note
                  sv_frame_t targetOffset, // within target buffer
                  sv_frame_t sampleCount,
@@ -0,0 +1,531 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RecordAnalyser.h"
+
+#include "base/Debug.h"
+#include "base/RealTime.h"
+#include "base/Window.h"
+
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+
+#include "plugin/FeatureExtractionPluginFactory.h"
+#include "transform/TransformFactory.h"
+
+#include <bqfft/FFT.h>
+#include <bqvec/VectorOps.h>
+
+#include <algorithm>
+#include <cmath>
+
+//#define DEBUG_RECORD_ANALYSER 1
+
+static const int spectrogramWindowSize = 1024;
+static const int spectrogramWindowIncrement = 512;
+
+/**
+ * One consumer of the recorded audio: either the spectrogram (with
+ * no plugin) or a single output of a Vamp plugin. Each has its own
+ * block and step size and keeps track of where its next input block
+ * starts. Frequency-domain blocks are centred on their timestamps,
+ * as in FFTModel, so the first of them starts half a block before
+ * the start of the recording.
+ */
+struct RecordAnalyser::Analysis
+{
+    Analysis(int bs, int ss, bool fd, WindowType wt) :
+        plugin(0),
+        outputNo(0),
+        model(0),
+        blockSize(bs),
+        stepSize(ss),
+        frequencyDomain(fd),
+        nextFrame(fd ? -(bs/2) : 0),
+        fixedRateFeatureNo(-1),
+        window(wt, bs),
+        fft(fd ? new breakfastquay::FFT(bs) : 0),
+        block(bs, 0.f),
+        spectrum(bs + 2, 0.f) { }
+
+    ~Analysis() {
+        delete fft;
+        delete plugin;
+    }
+
+    Vamp::Plugin *plugin;
+    int outputNo;
+    Vamp::Plugin::OutputDescriptor descriptor;
+    Model *model;
+    int blockSize;
+    int stepSize;
+    bool frequencyDomain;
+    sv_frame_t nextFrame;
+    int fixedRateFeatureNo;
+    Window<float> window;
+    breakfastquay::FFT *fft;
+    std::vector<float> block;
+    std::vector<float> spectrum;
+};
+
+RecordAnalyser::RecordAnalyser(sv_samplerate_t sampleRate,
+                               int channelCount,
+                               bool spectrogram,
+                               const Transforms &transforms) :
+    m_sampleRate(sampleRate),
+    m_channelCount(channelCount),
+    m_spectrogramModel(0),
+    m_finishing(false),
+    m_historyStart(0),
+    m_historyEnd(0),
+    m_thread(0)
+{
+    if (spectrogram) {
+
+        Analysis *a = new Analysis(spectrogramWindowSize,
+                                   spectrogramWindowIncrement,
+                                   true, HanningWindow);
+
+        int height = spectrogramWindowSize / 2 + 1;
+
+        m_spectrogramModel = new EditableDenseThreeDimensionalModel
+            (sampleRate, spectrogramWindowIncrement, height,
+             EditableDenseThreeDimensionalModel::NoCompression);
+
+        std::vector<float> binValues;
+        for (int i = 0; i < height; ++i) {
+            binValues.push_back(float((i * sampleRate) /
+                                      spectrogramWindowSize));
+        }
+        m_spectrogramModel->setBinValues(binValues);
+        m_spectrogramModel->setBinValueUnit("Hz");
+        m_spectrogramModel->setObjectName(tr("Live Spectrogram"));
+
+        connect(m_spectrogramModel, SIGNAL(aboutToBeDeleted()),
+                this, SLOT(modelAboutToBeDeleted()));
+
+        a->model = m_spectrogramModel;
+        m_analyses.push_back(a);
+    }
+
+    for (const Transform &transform: transforms) {
+        addAnalysis(transform);
+    }
+
+    m_thread = new AnalysisThread(this);
+    m_thread->start();
+}
+
+RecordAnalyser::~RecordAnalyser()
+{
+    finish();
+
+    for (Analysis *a: m_analyses) {
+        delete a;
+    }
+}
+
+void
+RecordAnalyser::addAnalysis(const Transform &transform)
+{
+    QString id = transform.getPluginIdentifier();
+
+    Vamp::Plugin *plugin =
+        FeatureExtractionPluginFactory::instance()->instantiatePlugin
+        (id, m_sampleRate);
+
+    if (!plugin) {
+        SVCERR << "WARNING: RecordAnalyser: Failed to load plugin \""
+               << id << "\", skipping it" << endl;
+        return;
+    }
+
+    addPluginAnalysis(plugin, transform);
+}
+
+Model *
+RecordAnalyser::addPluginAnalysis(Vamp::Plugin *plugin,
+                                  const Transform &original)
+{
+    Transform transform(original);
+    QString id = transform.getPluginIdentifier();
+
+    TransformFactory::getInstance()->makeContextConsistentWithPlugin
+        (transform, plugin);
+    TransformFactory::getInstance()->setPluginParameters
+        (transform, plugin);
+
+    // The analyser works on a mono mixdown of the recording, as the
+    // spectrogram does
+
+    int blockSize = transform.getBlockSize();
+    int stepSize = transform.getStepSize();
+
+    if (plugin->getMinChannelCount() > 1 ||
+        !plugin->initialise(1, stepSize, blockSize)) {
+        SVCERR << "WARNING: RecordAnalyser: Plugin \"" << id
+               << "\" failed to initialise with one channel, step size "
+               << stepSize << " and block size " << blockSize
+               << ", skipping it" << endl;
+        delete plugin;
+        return 0;
+    }
+
+    Vamp::Plugin::OutputList outputs = plugin->getOutputDescriptors();
+    int outputNo = -1;
+    for (int i = 0; i < (int)outputs.size(); ++i) {
+        if (transform.getOutput() == "" ||
+            transform.getOutput() == outputs[i].identifier.c_str()) {
+            outputNo = i;
+            break;
+        }
+    }
+
+    if (outputNo < 0) {
+        SVCERR << "WARNING: RecordAnalyser: Plugin \"" << id
+               << "\" has no output \"" << transform.getOutput()
+               << "\", skipping it" << endl;
+        delete plugin;
+        return 0;
+    }
+
+    const Vamp::Plugin::OutputDescriptor &d = outputs[outputNo];
+
+    bool frequencyDomain =
+        (plugin->getInputDomain() == Vamp::Plugin::FrequencyDomain);
+
+    Analysis *a = new Analysis(blockSize, stepSize, frequencyDomain,
+                               transform.getWindowType());
+    a->plugin = plugin;
+    a->outputNo = outputNo;
+    a->descriptor = d;
+
+    // A much reduced form of the model selection in
+    // FeatureExtractionModelTransformer: instants for outputs with no
+    // values, dense grids for fixed-rate multi-bin outputs and
+    // time-value points for everything else
+
+    int resolution = 1;
+    if (d.sampleType == Vamp::Plugin::OutputDescriptor::OneSamplePerStep) {
+        resolution = stepSize;
+    } else if (d.sampleType ==
+               Vamp::Plugin::OutputDescriptor::FixedSampleRate &&
+               d.sampleRate > 0.0) {
+        resolution = std::max(1, int(round(m_sampleRate / d.sampleRate)));
+    }
+
+    if (d.hasFixedBinCount && d.binCount == 0) {
+
+        a->model = new SparseOneDimensionalModel(m_sampleRate, resolution);
+
+    } else if (d.hasFixedBinCount && d.binCount > 1 &&
+               d.sampleType !=
+               Vamp::Plugin::OutputDescriptor::VariableSampleRate) {
+
+        EditableDenseThreeDimensionalModel *model =
+            new EditableDenseThreeDimensionalModel
+            (m_sampleRate, resolution, int(d.binCount),
+             EditableDenseThreeDimensionalModel::BasicMultirateCompression);
+
+        std::vector<QString> names;
+        for (const std::string &name: d.binNames) {
+            names.push_back(name.c_str());
+        }
+        model->setBinNames(names);
+        a->model = model;
+
+    } else {
+
+        SparseTimeValueModel *model =
+            new SparseTimeValueModel(m_sampleRate, resolution);
+        model->setScaleUnits(d.unit.c_str());
+        a->model = model;
+    }
+
+    a->model->setObjectName(QString("%1: %2")
+                            .arg(plugin->getName().c_str())
+                            .arg(d.name.c_str()));
+
+    connect(a->model, SIGNAL(aboutToBeDeleted()),
+            this, SLOT(modelAboutToBeDeleted()));
+
+    QMutexLocker locker(&m_modelMutex);
+    m_featureModels.push_back(a->model);
+    m_analyses.push_back(a);
+    return a->model;
+}
+
+void
+RecordAnalyser::addSamples(const float *const *samples, sv_frame_t count)
+{
+    if (count <= 0 || m_channelCount <= 0) return;
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_finishing) {
+        SVCERR << "WARNING: RecordAnalyser::addSamples: Analysis already finished" << endl;
+        return;
+    }
+
+    sv_frame_t base = m_incoming.size();
+    m_incoming.resize(base + count, 0.f);
+
+    float *target = m_incoming.data() + base;
+    for (int c = 0; c < m_channelCount; ++c) {
+        breakfastquay::v_add(target, samples[c], int(count));
+    }
+    if (m_channelCount > 1) {
+        breakfastquay::v_scale(target, 1.0 / m_channelCount, int(count));
+    }
+
+    m_condition.wakeAll();
+}
+
+void
+RecordAnalyser::finish()
+{
+    if (!m_thread) return;
+
+    m_mutex.lock();
+    m_finishing = true;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = 0;
+}
+
+void
+RecordAnalyser::modelAboutToBeDeleted()
+{
+    QMutexLocker locker(&m_modelMutex);
+
+    for (Analysis *a: m_analyses) {
+        if (a->model == sender()) {
+            a->model = 0;
+        }
+    }
+    m_featureModels.erase(std::remove(m_featureModels.begin(),
+                                      m_featureModels.end(),
+                                      sender()),
+                          m_featureModels.end());
+    if (m_spectrogramModel == sender()) {
+        m_spectrogramModel = 0;
+    }
+}
+
+void
+RecordAnalyser::AnalysisThread::run()
+{
+    std::vector<float> incoming;
+
+    while (true) {
+
+        bool final = false;
+
+        m_analyser->m_mutex.lock();
+        while (m_analyser->m_incoming.empty() && !m_analyser->m_finishing) {
+            m_analyser->m_condition.wait(&m_analyser->m_mutex);
+        }
+        incoming.swap(m_analyser->m_incoming);
+        final = m_analyser->m_finishing;
+        m_analyser->m_mutex.unlock();
+
+        m_analyser->m_history.insert(m_analyser->m_history.end(),
+                                     incoming.begin(), incoming.end());
+        m_analyser->m_historyEnd += incoming.size();
+        incoming.clear();
+
+        m_analyser->processAvailable(final);
+
+        if (final) break;
+    }
+}
+
+void
+RecordAnalyser::processAvailable(bool final)
+{
+    Profiler profiler("RecordAnalyser::processAvailable");
+
+    sv_frame_t earliest = m_historyEnd;
+
+    for (Analysis *a: m_analyses) {
+
+        while (true) {
+            if (a->nextFrame + a->blockSize > m_historyEnd) {
+                // Only a partial block is available: wait for more,
+                // unless this is the end, in which case pad with
+                // zeros until we have covered all the audio
+                if (!final) break;
+                if (a->frequencyDomain) {
+                    if (a->nextFrame + a->blockSize/2 > m_historyEnd) break;
+                } else {
+                    if (a->nextFrame >= m_historyEnd) break;
+                }
+            }
+            processBlock(a);
+            a->nextFrame += a->stepSize;
+        }
+
+        if (final && a->plugin) {
+            Vamp::Plugin::FeatureSet features =
+                a->plugin->getRemainingFeatures();
+            addFeatures(a, m_historyEnd, features[a->outputNo]);
+        }
+
+        earliest = std::min(earliest, a->nextFrame);
+    }
+
+    // Drop whatever audio no analysis will need again
+
+    if (earliest > m_historyStart) {
+        sv_frame_t drop = std::min(earliest, m_historyEnd) - m_historyStart;
+        m_history.erase(m_history.begin(), m_history.begin() + drop);
+        m_historyStart += drop;
+    }
+
+#ifdef DEBUG_RECORD_ANALYSER
+    SVDEBUG << "RecordAnalyser::processAvailable: analysed to "
+            << m_historyEnd << ", retaining " << m_history.size()
+            << " frames" << endl;
+#endif
+}
+
+void
+RecordAnalyser::getBlock(sv_frame_t start, int size, float *block) const
+{
+    for (int i = 0; i < size; ++i) {
+        sv_frame_t f = start + i;
+        if (f < m_historyStart || f >= m_historyEnd) {
+            block[i] = 0.f;
+        } else {
+            block[i] = m_history[f - m_historyStart];
+        }
+    }
+}
+
+void
+RecordAnalyser::processBlock(Analysis *a)
+{
+    float *block = a->block.data();
+    getBlock(a->nextFrame, a->blockSize, block);
+
+    sv_frame_t blockFrame = a->nextFrame;
+
+    if (a->frequencyDomain) {
+        a->window.cut(block);
+        breakfastquay::v_fftshift(block, a->blockSize);
+        blockFrame += a->blockSize/2;
+    }
+
+    if (!a->plugin) {
+
+        // Spectrogram column, scaled so that a full-scale sinusoid
+        // gives a magnitude of about 1
+
+        int height = a->blockSize/2 + 1;
+        float *mags = a->spectrum.data();
+        a->fft->forwardMagnitude(block, mags);
+        breakfastquay::v_scale(mags, 2.0 / a->blockSize, height);
+
+        QMutexLocker locker(&m_modelMutex);
+        if (a->model) {
+            static_cast<EditableDenseThreeDimensionalModel *>(a->model)->
+                setColumn(int(blockFrame / a->stepSize),
+                          EditableDenseThreeDimensionalModel::Column
+                          (mags, mags + height));
+        }
+        return;
+    }
+
+    const float *input = block;
+    if (a->frequencyDomain) {
+        a->fft->forwardInterleaved(block, a->spectrum.data());
+        input = a->spectrum.data();
+    }
+
+    Vamp::Plugin::FeatureSet features =
+        a->plugin->process(&input, RealTime::frame2RealTime
+                           (blockFrame, m_sampleRate).toVampRealTime());
+
+    if (features.find(a->outputNo) != features.end()) {
+        addFeatures(a, blockFrame, features[a->outputNo]);
+    }
+}
+
+void
+RecordAnalyser::addFeatures(Analysis *a, sv_frame_t blockFrame,
+                            const Vamp::Plugin::FeatureList &features)
+{
+    QMutexLocker locker(&m_modelMutex);
+    if (!a->model) return;
+
+    const Vamp::Plugin::OutputDescriptor &d = a->descriptor;
+
+    for (const Vamp::Plugin::Feature &feature: features) {
+
+        sv_frame_t frame = blockFrame;
+
+        if (d.sampleType ==
+            Vamp::Plugin::OutputDescriptor::VariableSampleRate) {
+
+            if (!feature.hasTimestamp) continue;
+            frame = RealTime::realTime2Frame(feature.timestamp, m_sampleRate);
+
+        } else if (d.sampleType ==
+                   Vamp::Plugin::OutputDescriptor::FixedSampleRate) {
+
+            sv_samplerate_t rate = d.sampleRate;
+            if (rate <= 0.0) rate = m_sampleRate;
+            if (!feature.hasTimestamp) {
+                ++a->fixedRateFeatureNo;
+            } else {
+                RealTime ts(feature.timestamp.sec, feature.timestamp.nsec);
+                a->fixedRateFeatureNo = int(lrint(ts.toDouble() * rate));
+            }
+            frame = lrint((double(a->fixedRateFeatureNo) / rate) *
+                          m_sampleRate);
+        }
+
+        if (frame < 0) continue;
+
+        if (SparseOneDimensionalModel *model =
+            dynamic_cast<SparseOneDimensionalModel *>(a->model)) {
+
+            model->addPoint(SparseOneDimensionalModel::Point
+                            (frame, feature.label.c_str()));
+
+        } else if (SparseTimeValueModel *model =
+                   dynamic_cast<SparseTimeValueModel *>(a->model)) {
+
+            for (int i = 0; i < (int)feature.values.size(); ++i) {
+                QString label = feature.label.c_str();
+                if (feature.values.size() > 1) {
+                    label = QString("[%1] %2").arg(i+1).arg(label);
+                }
+                model->addPoint(SparseTimeValueModel::Point
+                                (frame, feature.values[i], label));
+            }
+
+        } else if (EditableDenseThreeDimensionalModel *model =
+                   dynamic_cast<EditableDenseThreeDimensionalModel *>
+                   (a->model)) {
+
+            model->setColumn(int(frame / model->getResolution()),
+                             feature.values);
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_RECORD_ANALYSER_H
+#define SV_RECORD_ANALYSER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <vector>
+
+#include "base/BaseTypes.h"
+#include "base/Thread.h"
+#include "transform/Transform.h"
+
+#include <vamp-hostsdk/Plugin.h>
+
+class Model;
+class EditableDenseThreeDimensionalModel;
+
+/**
+ * Analyse audio as it is being recorded. The record target hands
+ * each block of samples to addSamples() at the same time as it
+ * writes them to the recording model, and a worker thread then
+ * computes spectrogram columns into a growing dense model and runs
+ * any requested Vamp feature-extraction transforms over the same
+ * audio, block by block, writing their features into output models
+ * as they are produced.
+ *
+ * The models are created in the constructor and retrieved using
+ * getSpectrogramModel() and getFeatureModels(). The caller takes
+ * ownership of them; the analyser stops writing to any model that is
+ * deleted while analysis is still going on.
+ */
+
+class RecordAnalyser : public QObject
+{
+    Q_OBJECT
+
+public:
+    RecordAnalyser(sv_samplerate_t sampleRate,
+                   int channelCount,
+                   bool spectrogram,
+                   const Transforms &transforms);
+    virtual ~RecordAnalyser();
+
+    /**
+     * Return the live spectrogram model, or 0 if no spectrogram was
+     * requested. Caller takes ownership.
+     */
+    EditableDenseThreeDimensionalModel *getSpectrogramModel() const {
+        return m_spectrogramModel;
+    }
+
+    /**
+     * Return the output models for the transforms passed to the
+     * constructor, in the same order, omitting any whose plugin could
+     * not be loaded. Caller takes ownership.
+     */
+    std::vector<Model *> getFeatureModels() const {
+        return m_featureModels;
+    }
+
+    /**
+     * Add an analysis using a plugin that has already been
+     * instantiated, rather than loading one for a transform as the
+     * constructor does. The analyser takes ownership of the plugin
+     * and initialises it. The transform supplies the output, block
+     * size, step size and window type. This must be called before
+     * the first call to addSamples().
+     *
+     * Return the new output model, or 0 if the plugin could not be
+     * used, in which case it is deleted.
+     */
+    Model *addPluginAnalysis(Vamp::Plugin *plugin,
+                             const Transform &transform);
+
+    /**
+     * Queue some newly recorded audio for analysis. The samples are
+     * mixed down and copied, so the caller may reuse its buffers
+     * straight away. This does not block on the analysis itself.
+     */
+    void addSamples(const float *const *samples, sv_frame_t count);
+
+    /**
+     * Analyse whatever audio remains queued, flush the final
+     * features from each plugin and stop the worker thread. Call
+     * this when recording has stopped; no further samples may be
+     * added afterwards.
+     */
+    void finish();
+
+protected slots:
+    void modelAboutToBeDeleted();
+
+private:
+    struct Analysis;
+
+    class AnalysisThread : public Thread
+    {
+    public:
+        AnalysisThread(RecordAnalyser *analyser) : m_analyser(analyser) { }
+        virtual void run();
+
+    private:
+        RecordAnalyser *m_analyser;
+    };
+
+    sv_samplerate_t m_sampleRate;
+    int m_channelCount;
+
+    EditableDenseThreeDimensionalModel *m_spectrogramModel;
+    std::vector<Model *> m_featureModels;
+    std::vector<Analysis *> m_analyses;
+
+    std::vector<float> m_incoming; // mixed-down, not yet analysed
+    bool m_finishing;
+    QMutex m_mutex; // protects m_incoming and m_finishing
+    QWaitCondition m_condition;
+
+    // Protects the model pointers, which are cleared if the models
+    // are deleted. Separate from m_mutex so that writing features to
+    // a model never holds up addSamples()
+    QMutex m_modelMutex;
+
+    std::vector<float> m_history; // worker thread only
+    sv_frame_t m_historyStart;
+    sv_frame_t m_historyEnd;
+
+    AnalysisThread *m_thread;
+
+    void addAnalysis(const Transform &transform);
+    void processAvailable(bool final);
+    void processBlock(Analysis *a);
+    void addFeatures(Analysis *a, sv_frame_t blockFrame,
+                     const Vamp::Plugin::FeatureList &features);
+    void getBlock(sv_frame_t start, int size, float *block) const;
+};
+
+#endif
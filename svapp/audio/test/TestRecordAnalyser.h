@@ -0,0 +1,227 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_RECORD_ANALYSER_H
+#define TEST_RECORD_ANALYSER_H
+
+#include "../RecordAnalyser.h"
+
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// A time-domain plugin reporting, for each block, its peak absolute
+// value on one output, and that peak together with the number of
+// non-zero samples on another
+class BlockStatsPlugin : public Vamp::Plugin
+{
+public:
+    BlockStatsPlugin(float rate) : Plugin(rate), m_blockSize(0) { }
+
+    string getIdentifier() const { return "blockstats"; }
+    string getName() const { return "Block Stats"; }
+    string getDescription() const { return ""; }
+    string getMaker() const { return ""; }
+    string getCopyright() const { return ""; }
+    int getPluginVersion() const { return 1; }
+    InputDomain getInputDomain() const { return TimeDomain; }
+
+    bool initialise(size_t channels, size_t, size_t blockSize) {
+        m_blockSize = int(blockSize);
+        return channels == 1;
+    }
+    void reset() { }
+
+    OutputList getOutputDescriptors() const {
+        OutputList list;
+        OutputDescriptor d;
+        d.identifier = "peak";
+        d.name = "Peak";
+        d.hasFixedBinCount = true;
+        d.binCount = 1;
+        d.sampleType = OutputDescriptor::OneSamplePerStep;
+        list.push_back(d);
+        d.identifier = "stats";
+        d.name = "Stats";
+        d.binCount = 2;
+        list.push_back(d);
+        return list;
+    }
+
+    FeatureSet process(const float *const *input, Vamp::RealTime) {
+        float peak = 0.f;
+        int nonZero = 0;
+        for (int i = 0; i < m_blockSize; ++i) {
+            peak = max(peak, fabsf(input[0][i]));
+            if (input[0][i] != 0.f) ++nonZero;
+        }
+        FeatureSet fs;
+        Feature f;
+        f.values.push_back(peak);
+        fs[0].push_back(f);
+        f.values.push_back(float(nonZero));
+        fs[1].push_back(f);
+        return fs;
+    }
+
+    FeatureSet getRemainingFeatures() { return FeatureSet(); }
+
+private:
+    int m_blockSize;
+};
+
+class TestRecordAnalyser : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int step = 256;
+
+    // One non-zero sample a little way into each block, rising from
+    // block to block, and a final partial block
+    static float sample(sv_frame_t i) {
+        if (i % step != 7) return 0.f;
+        return float(i / step + 1) / 100.f;
+    }
+
+    void feed(RecordAnalyser &analyser, int channels, sv_frame_t n,
+              float (*f)(sv_frame_t)) {
+        // Deliberately not aligned with any block size
+        const sv_frame_t chunk = 1000;
+        vector<vector<float>> buffers(channels, vector<float>(chunk));
+        vector<float *> ptrs(channels);
+        for (sv_frame_t i = 0; i < n; i += chunk) {
+            sv_frame_t count = min(chunk, n - i);
+            for (int c = 0; c < channels; ++c) {
+                for (sv_frame_t j = 0; j < count; ++j) {
+                    buffers[c][j] = f(i + j);
+                }
+                ptrs[c] = buffers[c].data();
+            }
+            analyser.addSamples(ptrs.data(), count);
+        }
+    }
+
+    Transform transformFor(QString output) {
+        Transform t;
+        t.setPluginIdentifier("vamp:test:blockstats");
+        t.setOutput(output);
+        t.setBlockSize(step);
+        t.setStepSize(step);
+        return t;
+    }
+
+private slots:
+    void spectrogram() {
+        // A sinusoid centred on bin 32 of the 1024-point analysis,
+        // the same in both channels. The Hann window halves its
+        // magnitude, and the analyser scales a full-scale sinusoid
+        // to 1, so its peak should be a quarter
+        RecordAnalyser analyser(44100, 2, true, Transforms());
+        EditableDenseThreeDimensionalModel *model =
+            analyser.getSpectrogramModel();
+        QVERIFY(model);
+        QVERIFY(analyser.getFeatureModels().empty());
+
+        const sv_frame_t n = 512 * 40;
+        feed(analyser, 2, n, [](sv_frame_t i) {
+                return 0.5f * float(sin(2.0 * M_PI * 32.0 * double(i) / 1024.0));
+            });
+        analyser.finish();
+
+        // One column per 512-frame step, centred on each step from
+        // the start of the recording to its end inclusive
+        QCOMPARE(model->getWidth(), 41);
+        QCOMPARE(model->getHeight(), 513);
+
+        // Skip the columns whose windows overlap either end
+        for (int x = 1; x < 40; ++x) {
+            EditableDenseThreeDimensionalModel::Column col =
+                model->getColumn(x);
+            QCOMPARE(int(col.size()), 513);
+            int peakBin = int(max_element(col.begin(), col.end()) -
+                              col.begin());
+            QCOMPARE(peakBin, 32);
+            QVERIFY(fabsf(col[32] - 0.25f) < 0.01f);
+        }
+
+        model->aboutToDelete();
+        delete model;
+    }
+
+    void features() {
+        RecordAnalyser analyser(44100, 1, false, Transforms());
+
+        Model *peakModel = analyser.addPluginAnalysis
+            (new BlockStatsPlugin(44100), transformFor("peak"));
+        Model *statsModel = analyser.addPluginAnalysis
+            (new BlockStatsPlugin(44100), transformFor("stats"));
+        QCOMPARE(int(analyser.getFeatureModels().size()), 2);
+
+        SparseTimeValueModel *peaks =
+            qobject_cast<SparseTimeValueModel *>(peakModel);
+        EditableDenseThreeDimensionalModel *stats =
+            qobject_cast<EditableDenseThreeDimensionalModel *>(statsModel);
+        QVERIFY(peaks);
+        QVERIFY(stats);
+
+        // Ten whole blocks and a partial one, padded at the end
+        const sv_frame_t n = step * 10 + 100;
+        feed(analyser, 1, n, sample);
+        analyser.finish();
+
+        const SparseTimeValueModel::PointList &points = peaks->getPoints();
+        QCOMPARE(int(points.size()), 11);
+        int k = 0;
+        for (const SparseTimeValueModel::Point &p: points) {
+            QCOMPARE(p.frame, sv_frame_t(k * step));
+            QCOMPARE(p.value, float(k + 1) / 100.f);
+            ++k;
+        }
+
+        QCOMPARE(stats->getWidth(), 11);
+        for (int x = 0; x < 11; ++x) {
+            EditableDenseThreeDimensionalModel::Column col =
+                stats->getColumn(x);
+            QCOMPARE(int(col.size()), 2);
+            QCOMPARE(col[0], float(x + 1) / 100.f);
+            QCOMPARE(col[1], 1.f);
+        }
+
+        peakModel->aboutToDelete();
+        delete peakModel;
+        statsModel->aboutToDelete();
+        delete statsModel;
+    }
+
+    void modelDeletedWhileAnalysing() {
+        RecordAnalyser analyser(44100, 1, true, Transforms());
+        Model *model = analyser.getSpectrogramModel();
+        model->aboutToDelete();
+        delete model;
+        QVERIFY(!analyser.getSpectrogramModel());
+        feed(analyser, 1, 4096, sample);
+        analyser.finish();
+    }
+};
+
+#endif
@@ -0,0 +1,5 @@
+TEST_HEADERS += \
+	TestRecordAnalyser.h
+	
+TEST_SOURCES += \
+	svapp-audio-test.cpp
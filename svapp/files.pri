@@ -6,6 +6,7 @@ SVAPP_HEADERS += \
            audio/ClipMixer.h \
            audio/ContinuousSynth.h \
            audio/PlaySpeedRangeMapper.h \
+           audio/RecordAnalyser.h \
            framework/Align.h \
 	   framework/Document.h \
            framework/MainWindowBase.h \
@@ -20,6 +21,7 @@ SVAPP_SOURCES += \
            audio/ClipMixer.cpp \
            audio/ContinuousSynth.cpp \
            audio/PlaySpeedRangeMapper.cpp \
+           audio/RecordAnalyser.cpp \
 	   framework/Align.cpp \
 	   framework/Document.cpp \
            framework/MainWindowBase.cpp \
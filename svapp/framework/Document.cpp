@@ -33,6 +33,7 @@
 #include "transform/TransformFactory.h"
 #include "transform/ModelTransformerFactory.h"
 #include "transform/FeatureExtractionModelTransformer.h"
+#include "transform/RealTimeEffectModel.h"
 #include <QApplication>
 #include <QTextStream>
 #include <QSettings>
@@ -1338,10 +1339,11 @@ Document::toXml(QTextStream &out, QString indent, QString extraAttributes,
         // transform, and are large).
         //
         // At the moment we can get away with deciding not to stream
-        // dense 3d models or writable wave file models, provided they
-        // were generated from a transform, because at the moment there
-        // is no way to edit those model types so it should be safe to
-        // regenerate them.  That won't always work in future though.
+        // dense 3d models, writable wave file models or real-time
+        // effect models, provided they were generated from a
+        // transform, because at the moment there is no way to edit
+        // those model types so it should be safe to regenerate them.
+        // That won't always work in future though.
         // It would be particularly nice to be able to ask the user,
         // as well as making an intelligent guess.
 
@@ -1355,6 +1357,8 @@ Document::toXml(QTextStream &out, QString indent, QString extraAttributes,
         if (haveDerivation) {
             if (dynamic_cast<const WritableWaveFileModel *>(model)) {
                 writeModel = false;
+            } else if (dynamic_cast<const RealTimeEffectModel *>(model)) {
+                writeModel = false;
             } else if (dynamic_cast<const DenseThreeDimensionalModel *>(model)) {
                 writeModel = false;
             }
@@ -49,6 +49,7 @@
 
 #include "audio/AudioCallbackPlaySource.h"
 #include "audio/AudioCallbackRecordTarget.h"
+#include "audio/RecordAnalyser.h"
 #include "audio/PlaySpeedRangeMapper.h"
 
 #include "data/fileio/DataFileReaderFactory.h"
@@ -66,10 +67,12 @@
 #include "base/XmlExportable.h"
 #include "base/Profiler.h"
 #include "base/Preferences.h"
+#include "transform/TransformFactory.h"
 #include "base/TempWriteFile.h"
 #include "base/Exceptions.h"
 #include "base/ResourceFinder.h"
 #include "base/RealTime.h"
+#include "base/Metrics.h"
 
 #include "data/osc/OSCQueue.h"
 #include "data/midi/MIDIInput.h"
@@ -148,6 +151,8 @@ MainWindowBase::MainWindowBase(SoundOptions options) :
     m_audioIO(0),
     m_oscQueue(0),
     m_oscQueueStarter(0),
+    m_oscPolling(false),
+    m_oscPipelined(false),
     m_midiInput(0),
     m_recentFiles("RecentFiles", 20),
     m_recentTransforms("RecentTransforms", 20),
@@ -328,7 +333,13 @@ MainWindowBase::~MainWindowBase()
     delete m_oscQueue;
     delete m_oscQueueStarter;
     delete m_midiInput;
-    Profiles::getInstance()->dump();
+
+    // Set SV_PROFILE_TRACE to a filename to have the profile points
+    // from this session written there as a Chrome trace on exit
+    QString traceFile = qgetenv("SV_PROFILE_TRACE");
+    if (traceFile != "") {
+        Profiles::getInstance()->exportTrace(traceFile);
+    }
 }
 
 void
@@ -1788,8 +1799,7 @@ MainWindowBase::openLayer(FileSource source)
              this, SLOT(modelRegenerationWarning(QString, QString, QString)));
         reader.setCurrentPane(pane);
 
-        QXmlInputSource inputSource(&file);
-        reader.parse(inputSource);
+        reader.parse(&file);
 
         if (!reader.isOK()) {
             cerr << "ERROR: MainWindowBase::openLayer("
@@ -2006,7 +2016,7 @@ MainWindowBase::openSession(FileSource source)
         }
     }
 
-    QXmlInputSource *inputSource = 0;
+    QIODevice *device = 0;
     BZipFileDevice *bzFile = 0;
     QFile *rawFile = 0;
 
@@ -2016,15 +2026,14 @@ MainWindowBase::openSession(FileSource source)
             delete bzFile;
             return FileOpenFailed;
         }
-        inputSource = new QXmlInputSource(bzFile);
+        device = bzFile;
     } else {
         rawFile = new QFile(source.getLocalFilename());
-        inputSource = new QXmlInputSource(rawFile);
+        device = rawFile;
     }
 
     if (!checkSaveModified()) {
         if (bzFile) bzFile->close();
-        delete inputSource;
         delete bzFile;
         delete rawFile;
         return FileOpenCancelled;
@@ -2045,7 +2054,7 @@ MainWindowBase::openSession(FileSource source)
         (&reader, SIGNAL(modelRegenerationWarning(QString, QString, QString)),
          this, SLOT(modelRegenerationWarning(QString, QString, QString)));
 
-    reader.parse(*inputSource);
+    reader.parse(device);
 
     if (!reader.isOK()) {
         error = tr("SV XML file read error:\n%1").arg(reader.getErrorString());
@@ -2053,7 +2062,6 @@ MainWindowBase::openSession(FileSource source)
 
     if (bzFile) bzFile->close();
 
-    delete inputSource;
     delete bzFile;
     delete rawFile;
 
@@ -2118,14 +2126,11 @@ MainWindowBase::openSessionTemplate(FileSource source)
     if (!source.isAvailable()) return FileOpenFailed;
     source.waitForData();
 
-    QXmlInputSource *inputSource = 0;
     QFile *file = 0;
 
     file = new QFile(source.getLocalFilename());
-    inputSource = new QXmlInputSource(file);
 
     if (!checkSaveModified()) {
-        delete inputSource;
         delete file;
         return FileOpenCancelled;
     }
@@ -2145,13 +2150,12 @@ MainWindowBase::openSessionTemplate(FileSource source)
         (&reader, SIGNAL(modelRegenerationWarning(QString, QString, QString)),
          this, SLOT(modelRegenerationWarning(QString, QString, QString)));
 
-    reader.parse(*inputSource);
+    reader.parse(file);
 
     if (!reader.isOK()) {
         error = tr("SV XML file read error:\n%1").arg(reader.getErrorString());
     }
 
-    delete inputSource;
     delete file;
 
     bool ok = (error == "");
@@ -2944,6 +2948,22 @@ MainWindowBase::toggleCentreLine()
     }
 }
 
+void
+MainWindowBase::toggleLiveSpectrogram()
+{
+    Preferences *prefs = Preferences::getInstance();
+    prefs->setLiveSpectrogramWhileRecording
+        (!prefs->getLiveSpectrogramWhileRecording());
+}
+
+void
+MainWindowBase::toggleLiveRecentTransform()
+{
+    Preferences *prefs = Preferences::getInstance();
+    prefs->setLiveRecentTransformWhileRecording
+        (!prefs->getLiveRecentTransformWhileRecording());
+}
+
 void
 MainWindowBase::preferenceChanged(PropertyContainer::PropertyName name)
 {
@@ -3040,6 +3060,23 @@ MainWindowBase::record()
 
     if (m_viewManager) m_viewManager->setGlobalCentreFrame(0);
 
+    // Live analysis is set up afresh for each recording, from the
+    // preferences current when it starts
+
+    Preferences *prefs = Preferences::getInstance();
+    m_recordTarget->setLiveSpectrogramEnabled
+        (prefs->getLiveSpectrogramWhileRecording());
+
+    Transforms liveTransforms;
+    if (prefs->getLiveRecentTransformWhileRecording()) {
+        vector<QString> recent = m_recentTransforms.getRecent();
+        TransformFactory *tf = TransformFactory::getInstance();
+        if (!recent.empty() && tf->haveTransform(recent[0])) {
+            liveTransforms.push_back(tf->getDefaultTransformFor(recent[0]));
+        }
+    }
+    m_recordTarget->setLiveTransforms(liveTransforms);
+
     SVDEBUG << "MainWindowBase::record: about to resume" << endl;
     m_audioIO->resume();
 
@@ -3142,6 +3179,8 @@ MainWindowBase::record()
         CommandHistory::getInstance()->endCompoundOperation();
     }
 
+    addLiveAnalysisLayers();
+
     updateMenuStates();
     m_recentFiles.addFile(model->getLocation());
     currentPaneChanged(m_paneStack->getCurrentPane());
@@ -3149,6 +3188,47 @@ MainWindowBase::record()
     emit audioFileLoaded();
 }
 
+void
+MainWindowBase::addLiveAnalysisLayers()
+{
+    RecordAnalyser *analyser = m_recordTarget->getLiveAnalyser();
+    if (!analyser) return;
+
+    std::vector<Model *> models;
+    if (analyser->getSpectrogramModel()) {
+        models.push_back(analyser->getSpectrogramModel());
+    }
+    for (Model *model: analyser->getFeatureModels()) {
+        models.push_back(model);
+    }
+    if (models.empty()) return;
+
+    CommandHistory::getInstance()->startCompoundOperation
+        (tr("Add Live Analysis"), true);
+
+    for (Model *model: models) {
+
+        m_document->addImportedModel(model);
+
+        AddPaneCommand *command = new AddPaneCommand(this);
+        CommandHistory::getInstance()->addCommand(command);
+
+        Pane *pane = command->getPane();
+
+        if (m_timeRulerLayer) {
+            m_document->addLayerToView(pane, m_timeRulerLayer);
+        }
+
+        Layer *newLayer = m_document->createImportedLayer(model);
+
+        if (newLayer) {
+            m_document->addLayerToView(pane, newLayer);
+        }
+    }
+
+    CommandHistory::getInstance()->endCompoundOperation();
+}
+
 void
 MainWindowBase::ffwd()
 {
@@ -3934,13 +4014,54 @@ MainWindowBase::pollOSC()
 
     if (m_openingAudioFile) return;
 
-    OSCMessage message = m_oscQueue->readMessage();
+    // Handlers may process events, for example while showing
+    // progress, and so call back in here. Leave anything that has
+    // arrived since to the outermost call, which will go round again
+    if (m_oscPolling) return;
+    m_oscPolling = true;
 
-    if (message.getTarget() != 0) {
-        return; //!!! for now -- this class is target 0, others not handled yet
+    static MetricsRegistry::Counter &handled =
+        MetricsRegistry::getInstance()->getCounter
+        ("MainWindowBase: OSC messages handled");
+    static MetricsRegistry::Counter &coalesced =
+        MetricsRegistry::getInstance()->getCounter
+        ("MainWindowBase: OSC messages coalesced");
+
+    // Handle a limited number of messages at once, so that a long
+    // stream of them doesn't hold up repainting and user input
+    int n = m_oscQueue->readMessages(m_oscBatch, 64);
+
+    for (int i = 0; i < n; ++i) {
+
+        const OSCMessage &message = m_oscBatch[i];
+
+        if (message.getTarget() != 0) {
+            continue; //!!! for now -- this class is target 0, others not handled yet
+        }
+
+        if (m_oscPipelined && i + 1 < n &&
+            m_oscBatch[i+1].getTarget() == 0 &&
+            isOSCMessageSupersededBy(message, m_oscBatch[i+1])) {
+            coalesced.add();
+            continue;
+        }
+
+        handleOSCMessage(message);
+        handled.add();
     }
 
-    handleOSCMessage(message);
+    m_oscPolling = false;
+
+    if (!m_oscQueue->isEmpty()) {
+        QTimer::singleShot(0, this, SLOT(pollOSC()));
+    }
+}
+
+bool
+MainWindowBase::isOSCMessageSupersededBy(const OSCMessage &,
+                                         const OSCMessage &) const
+{
+    return false;
 }
 
 void
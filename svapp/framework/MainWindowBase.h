@@ -225,6 +225,8 @@ protected slots:
     virtual void togglePropertyBoxes();
     virtual void toggleStatusBar();
     virtual void toggleCentreLine();
+    virtual void toggleLiveSpectrogram();
+    virtual void toggleLiveRecentTransform();
 
     virtual void play();
     virtual void ffwd();
@@ -371,6 +373,22 @@ protected:
     OSCQueueStarter         *m_oscQueueStarter;
     void startOSCQueue();
 
+    // OSC messages are read from the queue in batches. In pipelined
+    // mode, a message in a batch is dropped without being handled if
+    // the one that immediately follows it supersedes it.
+    std::vector<OSCMessage>  m_oscBatch;
+    bool                     m_oscPolling;
+    bool                     m_oscPipelined;
+
+    /**
+     * Return true if handling the later message would entirely undo
+     * the effect of handling the earlier one, so that in pipelined
+     * mode the earlier one can be skipped. The default implementation
+     * returns false.
+     */
+    virtual bool isOSCMessageSupersededBy(const OSCMessage &earlier,
+                                          const OSCMessage &later) const;
+
     MIDIInput               *m_midiInput;
 
     RecentFiles              m_recentFiles;
@@ -473,6 +491,7 @@ protected:
     virtual void findTimeRulerLayer();
 
     virtual void createAudioIO();
+    virtual void addLiveAnalysisLayers();
     virtual void deleteAudioIO();
 
     virtual void openHelpUrl(QString url);
@@ -35,6 +35,7 @@
 #include "data/model/RegionModel.h"
 #include "data/model/TextModel.h"
 #include "data/model/ImageModel.h"
+#include "data/model/PathModel.h"
 #include "data/model/AlignmentModel.h"
 
 #include "transform/TransformFactory.h"
@@ -48,8 +49,23 @@
 #include <QString>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QXmlStreamReader>
+#include <QtEndian>
 
 #include <iostream>
+#include <cstring>
+
+struct SVFileReader::PendingPoints
+{
+    SparseOneDimensionalModel::PointVector sodm;
+    SparseTimeValueModel::PointVector stvm;
+    NoteModel::PointVector nm;
+    FlexiNoteModel::PointVector fnm;
+    RegionModel::PointVector rm;
+    TextModel::PointVector tm;
+    PathModel::PointVector pm;
+    ImageModel::PointVector im;
+};
 
 SVFileReader::SVFileReader(Document *document,
 			   SVFileReaderPaneCallback &callback,
@@ -60,6 +76,7 @@ SVFileReader::SVFileReader(Document *document,
     m_currentPane(0),
     m_currentLayer(0),
     m_currentDataset(0),
+    m_pendingPoints(new PendingPoints),
     m_currentDerivedModel(0),
     m_currentDerivedModelId(-1),
     m_currentPlayParameters(0),
@@ -94,6 +111,73 @@ SVFileReader::parse(QXmlInputSource &inputSource)
     m_ok = reader.parse(inputSource);
 }    
 
+void
+SVFileReader::parse(QIODevice *device)
+{
+    if (!device->isOpen() && !device->open(QIODevice::ReadOnly)) {
+        m_errorString = QString("ERROR: SV-XML: Failed to open device for reading");
+        cerr << m_errorString << endl;
+        m_ok = false;
+        return;
+    }
+
+    QXmlStreamReader xml(device);
+    QString rowText;
+
+    while (!xml.atEnd()) {
+
+        switch (xml.readNext()) {
+
+        case QXmlStreamReader::StartElement:
+            if (m_currentDataset && xml.name() == QLatin1String("point")) {
+                if (!addPointToDataset(xml.attributes())) {
+                    cerr << "WARNING: SV-XML: Failed to completely process element \"point\"" << endl;
+                }
+            } else {
+                QXmlAttributes attributes;
+                foreach (const QXmlStreamAttribute &a, xml.attributes()) {
+                    attributes.append(a.qualifiedName().toString(),
+                                      a.namespaceUri().toString(),
+                                      a.name().toString(),
+                                      a.value().toString());
+                }
+                startElement(QString(), QString(),
+                             xml.qualifiedName().toString(), attributes);
+                rowText = "";
+            }
+            break;
+
+        case QXmlStreamReader::Characters:
+            // Row data may arrive in more than one piece
+            if (m_inRow) rowText += xml.text();
+            break;
+
+        case QXmlStreamReader::EndElement:
+            if (m_inRow) {
+                characters(rowText);
+                rowText = "";
+            }
+            endElement(QString(), QString(), xml.qualifiedName().toString());
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (xml.hasError()) {
+        m_errorString =
+            QString("FATAL ERROR: SV-XML: %1 at line %2, column %3")
+            .arg(xml.errorString())
+            .arg(xml.lineNumber())
+            .arg(xml.columnNumber());
+        cerr << m_errorString << endl;
+        m_ok = false;
+    } else {
+        m_ok = true;
+    }
+}
+
 bool
 SVFileReader::isOK()
 {
@@ -102,6 +186,8 @@ SVFileReader::isOK()
 	
 SVFileReader::~SVFileReader()
 {
+    delete m_pendingPoints;
+
     if (!m_awaitingDatasets.empty()) {
 	cerr << "WARNING: SV-XML: File ended with "
 		  << m_awaitingDatasets.size() << " unfilled model dataset(s)"
@@ -277,6 +363,8 @@ SVFileReader::endElement(const QString &, const QString &,
     if (name == "dataset") {
 
 	if (m_currentDataset) {
+
+            flushPendingPoints();
 	    
 	    bool foundInAwaiting = false;
 
@@ -966,6 +1054,7 @@ SVFileReader::readDatasetStart(const QXmlAttributes &attributes)
 	else if (dynamic_cast<RegionModel *>(model)) good = true;
 	else if (dynamic_cast<EditableDenseThreeDimensionalModel *>(model)) {
 	    m_datasetSeparator = attributes.value("separator");
+            m_datasetEncoding = attributes.value("encoding");
 	    good = true;
 	}
 	break;
@@ -977,16 +1066,40 @@ SVFileReader::readDatasetStart(const QXmlAttributes &attributes)
 	return false;
     }
 
+    flushPendingPoints();
     m_currentDataset = model;
     return true;
 }
 
+// Attribute lookup for either kind of attribute list; the stream
+// reader's values are returned by reference, without a copy
+
+static inline QString
+attr(const QXmlAttributes &attributes, const char *name)
+{
+    return attributes.value(QLatin1String(name));
+}
+
+static inline QStringRef
+attr(const QXmlStreamAttributes &attributes, const char *name)
+{
+    return attributes.value(QLatin1String(name));
+}
+
+static inline QString str(const QString &s) { return s; }
+static inline QString str(const QStringRef &s) { return s.toString(); }
+
+template <typename Attributes>
 bool
-SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
+SVFileReader::addPointToDatasetFrom(const Attributes &attributes)
 {
     bool ok = false;
 
-    READ_MANDATORY(int, frame, toInt);
+    int frame = attr(attributes, "frame").trimmed().toInt(&ok);
+    if (!ok) {
+	cerr << "WARNING: SV-XML: Missing or invalid mandatory int attribute \"frame\"" << endl;
+	return false;
+    }
 
 //    SVDEBUG << "SVFileReader::addPointToDataset: frame = " << frame << endl;
 
@@ -995,8 +1108,8 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
 
     if (sodm) {
 //        cerr << "Current dataset is a sparse one dimensional model" << endl;
-	QString label = attributes.value("label");
-	sodm->addPoint(SparseOneDimensionalModel::Point(frame, label));
+	QString label = str(attr(attributes, "label"));
+	m_pendingPoints->sodm.push_back(SparseOneDimensionalModel::Point(frame, label));
 	return true;
     }
 
@@ -1006,9 +1119,9 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     if (stvm) {
 //        cerr << "Current dataset is a sparse time-value model" << endl;
 	float value = 0.0;
-	value = attributes.value("value").trimmed().toFloat(&ok);
-	QString label = attributes.value("label");
-	stvm->addPoint(SparseTimeValueModel::Point(frame, value, label));
+	value = attr(attributes, "value").trimmed().toFloat(&ok);
+	QString label = str(attr(attributes, "label"));
+	m_pendingPoints->stvm.push_back(SparseTimeValueModel::Point(frame, value, label));
 	return ok;
     }
 	
@@ -1017,16 +1130,16 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     if (nm) {
 //        cerr << "Current dataset is a note model" << endl;
 	float value = 0.0;
-	value = attributes.value("value").trimmed().toFloat(&ok);
+	value = attr(attributes, "value").trimmed().toFloat(&ok);
 	int duration = 0;
-	duration = attributes.value("duration").trimmed().toInt(&ok);
-	QString label = attributes.value("label");
-        float level = attributes.value("level").trimmed().toFloat(&ok);
+	duration = attr(attributes, "duration").trimmed().toInt(&ok);
+	QString label = str(attr(attributes, "label"));
+        float level = attr(attributes, "level").trimmed().toFloat(&ok);
         if (!ok) { // level is optional
             level = 1.f;
             ok = true;
         }
-	nm->addPoint(NoteModel::Point(frame, value, duration, level, label));
+	m_pendingPoints->nm.push_back(NoteModel::Point(frame, value, duration, level, label));
 	return ok;
     }
 
@@ -1035,16 +1148,16 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     if (fnm) {
 //        cerr << "Current dataset is a flexinote model" << endl;
 	float value = 0.0;
-	value = attributes.value("value").trimmed().toFloat(&ok);
+	value = attr(attributes, "value").trimmed().toFloat(&ok);
 	int duration = 0;
-	duration = attributes.value("duration").trimmed().toInt(&ok);
-	QString label = attributes.value("label");
-        float level = attributes.value("level").trimmed().toFloat(&ok);
+	duration = attr(attributes, "duration").trimmed().toInt(&ok);
+	QString label = str(attr(attributes, "label"));
+        float level = attr(attributes, "level").trimmed().toFloat(&ok);
         if (!ok) { // level is optional
             level = 1.f;
             ok = true;
         }
-	fnm->addPoint(FlexiNoteModel::Point(frame, value, duration, level, label));
+	m_pendingPoints->fnm.push_back(FlexiNoteModel::Point(frame, value, duration, level, label));
 	return ok;
     }
 
@@ -1053,11 +1166,11 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     if (rm) {
 //        cerr << "Current dataset is a region model" << endl;
 	float value = 0.0;
-	value = attributes.value("value").trimmed().toFloat(&ok);
+	value = attr(attributes, "value").trimmed().toFloat(&ok);
 	int duration = 0;
-	duration = attributes.value("duration").trimmed().toInt(&ok);
-	QString label = attributes.value("label");
-	rm->addPoint(RegionModel::Point(frame, value, duration, label));
+	duration = attr(attributes, "duration").trimmed().toInt(&ok);
+	QString label = str(attr(attributes, "label"));
+	m_pendingPoints->rm.push_back(RegionModel::Point(frame, value, duration, label));
 	return ok;
     }
 
@@ -1066,10 +1179,10 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     if (tm) {
 //        cerr << "Current dataset is a text model" << endl;
 	float height = 0.0;
-	height = attributes.value("height").trimmed().toFloat(&ok);
-	QString label = attributes.value("label");
+	height = attr(attributes, "height").trimmed().toFloat(&ok);
+	QString label = str(attr(attributes, "label"));
 //        SVDEBUG << "SVFileReader::addPointToDataset: TextModel: frame = " << frame << ", height = " << height << ", label = " << label << ", ok = " << ok << endl;
-	tm->addPoint(TextModel::Point(frame, height, label));
+	m_pendingPoints->tm.push_back(TextModel::Point(frame, height, label));
 	return ok;
     }
 
@@ -1077,9 +1190,9 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
 
     if (pm) {
 //        cerr << "Current dataset is a path model" << endl;
-        int mapframe = attributes.value("mapframe").trimmed().toInt(&ok);
+        int mapframe = attr(attributes, "mapframe").trimmed().toInt(&ok);
 //        SVDEBUG << "SVFileReader::addPointToDataset: PathModel: frame = " << frame << ", mapframe = " << mapframe << ", ok = " << ok << endl;
-	pm->addPoint(PathModel::Point(frame, mapframe));
+	m_pendingPoints->pm.push_back(PathModel::Point(frame, mapframe));
 	return ok;
     }
 
@@ -1087,10 +1200,10 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
 
     if (im) {
 //        cerr << "Current dataset is an image model" << endl;
-	QString image = attributes.value("image");
-	QString label = attributes.value("label");
+	QString image = str(attr(attributes, "image"));
+	QString label = str(attr(attributes, "label"));
 //        SVDEBUG << "SVFileReader::addPointToDataset: ImageModel: frame = " << frame << ", image = " << image << ", label = " << label << ", ok = " << ok << endl;
-	im->addPoint(ImageModel::Point(frame, image, label));
+	m_pendingPoints->im.push_back(ImageModel::Point(frame, image, label));
 	return ok;
     }
 
@@ -1099,6 +1212,52 @@ SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
     return false;
 }
 
+bool
+SVFileReader::addPointToDataset(const QXmlAttributes &attributes)
+{
+    return addPointToDatasetFrom(attributes);
+}
+
+bool
+SVFileReader::addPointToDataset(const QXmlStreamAttributes &attributes)
+{
+    return addPointToDatasetFrom(attributes);
+}
+
+void
+SVFileReader::flushPendingPoints()
+{
+    // Points are gathered by addPointToDataset and added to the
+    // current dataset in a single batch when it ends
+
+    if (!m_currentDataset) return;
+    
+    PendingPoints &p = *m_pendingPoints;
+    
+    if (SparseOneDimensionalModel *sodm =
+        dynamic_cast<SparseOneDimensionalModel *>(m_currentDataset)) {
+        sodm->addPoints(p.sodm);
+    } else if (SparseTimeValueModel *stvm =
+               dynamic_cast<SparseTimeValueModel *>(m_currentDataset)) {
+        stvm->addPoints(p.stvm);
+    } else if (NoteModel *nm = dynamic_cast<NoteModel *>(m_currentDataset)) {
+        nm->addPoints(p.nm);
+    } else if (FlexiNoteModel *fnm =
+               dynamic_cast<FlexiNoteModel *>(m_currentDataset)) {
+        fnm->addPoints(p.fnm);
+    } else if (RegionModel *rm = dynamic_cast<RegionModel *>(m_currentDataset)) {
+        rm->addPoints(p.rm);
+    } else if (TextModel *tm = dynamic_cast<TextModel *>(m_currentDataset)) {
+        tm->addPoints(p.tm);
+    } else if (PathModel *pm = dynamic_cast<PathModel *>(m_currentDataset)) {
+        pm->addPoints(p.pm);
+    } else if (ImageModel *im = dynamic_cast<ImageModel *>(m_currentDataset)) {
+        im->addPoints(p.im);
+    }
+
+    *m_pendingPoints = PendingPoints();
+}
+
 bool
 SVFileReader::addBinToDataset(const QXmlAttributes &attributes)
 {
@@ -1157,7 +1316,40 @@ SVFileReader::readRowData(const QString &text)
 
     bool warned = false;
 
-    if (dtdm) {
+    if (dtdm && m_datasetEncoding == "float32le-base64") {
+
+        // Binary row, as written by EditableDenseThreeDimensionalModel
+        // when the binary datasets preference is set
+        
+        QByteArray bytes = QByteArray::fromBase64(text.trimmed().toLatin1());
+
+        if (bytes.size() % int(sizeof(quint32)) != 0) {
+            cerr << "WARNING: SV-XML: Binary 3-D dataset row " << m_rowNumber
+                 << " has " << bytes.size() << " bytes, which is not a "
+                 << "whole number of values; ignoring it" << endl;
+            return false;
+        }
+        
+        int n = bytes.size() / int(sizeof(quint32));
+        
+        if (n > dtdm->getHeight()) {
+            cerr << "WARNING: SV-XML: Too many y-bins in 3-D dataset row "
+                 << m_rowNumber << "; truncating" << endl;
+            n = dtdm->getHeight();
+        }
+        
+	DenseThreeDimensionalModel::Column values(n);
+        const uchar *data = (const uchar *)bytes.constData();
+        
+        for (int i = 0; i < n; ++i) {
+            quint32 word = qFromLittleEndian<quint32>(data + i * sizeof(word));
+            memcpy(&values[i], &word, sizeof(word));
+        }
+
+	dtdm->setColumn(m_rowNumber, values);
+	return true;
+        
+    } else if (dtdm) {
 	QStringList data = text.split(m_datasetSeparator);
 
 	DenseThreeDimensionalModel::Column values;
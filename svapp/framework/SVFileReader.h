@@ -20,6 +20,7 @@
 #include "transform/Transform.h"
 
 #include <QXmlDefaultHandler>
+#include <QXmlStreamAttributes>
 
 #include <map>
 
@@ -175,6 +176,15 @@ public:
     void parse(const QString &xmlData);
     void parse(QXmlInputSource &source);
 
+    /**
+     * Parse from the given device using a streaming reader. This is
+     * the quicker way to load large sessions: point elements, which
+     * may number in the millions, are read without building a
+     * QXmlAttributes list for each one. The device is opened for
+     * reading if it is not already open.
+     */
+    void parse(QIODevice *device);
+
     bool isOK();
     QString getErrorString() const { return m_errorString; }
 
@@ -218,6 +228,10 @@ protected:
     bool readDatasetStart(const QXmlAttributes &);
     bool addBinToDataset(const QXmlAttributes &);
     bool addPointToDataset(const QXmlAttributes &);
+    bool addPointToDataset(const QXmlStreamAttributes &);
+    template <typename Attributes>
+    bool addPointToDatasetFrom(const Attributes &);
+    void flushPendingPoints();
     bool addRowToDataset(const QXmlAttributes &);
     bool readRowData(const QString &);
     bool readDerivation(const QXmlAttributes &);
@@ -245,6 +259,8 @@ protected:
     std::map<int, int> m_awaitingDatasets; // map dataset id -> model id
     Layer *m_currentLayer;
     Model *m_currentDataset;
+    struct PendingPoints; // points read for m_currentDataset, not yet added
+    PendingPoints *m_pendingPoints;
     Model *m_currentDerivedModel;
     int m_currentDerivedModelId;
     PlayParameters *m_currentPlayParameters;
@@ -253,6 +269,7 @@ protected:
     int m_currentTransformChannel;
     bool m_currentTransformIsNewStyle;
     QString m_datasetSeparator;
+    QString m_datasetEncoding;
     bool m_inRow;
     bool m_inLayer;
     bool m_inView;
@@ -0,0 +1,178 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_SV_FILE_READER_H
+#define TEST_SV_FILE_READER_H
+
+#include "../SVFileReader.h"
+#include "../Document.h"
+
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "base/Preferences.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QBuffer>
+#include <QtEndian>
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+class NullPaneCallback : public SVFileReaderPaneCallback
+{
+public:
+    virtual Pane *addPane() { return 0; }
+    virtual void setWindowSize(int, int) { }
+    virtual void addSelection(sv_frame_t, sv_frame_t) { }
+};
+
+class SVFileReaderTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef EditableDenseThreeDimensionalModel::Column Column;
+
+    // Parse the given session XML through the streaming reader, and
+    // return the dense model it loads, if any. The model belongs to
+    // the document.
+    EditableDenseThreeDimensionalModel *
+    load(Document &document, QByteArray xml) {
+
+        vector<Model *> added;
+        connect(&document, &Document::modelAdded,
+                [&](Model *m) { added.push_back(m); });
+
+        NullPaneCallback callback;
+        QBuffer buffer(&xml);
+        {
+            SVFileReader reader(&document, callback);
+            reader.parse(&buffer);
+            if (!reader.isOK()) {
+                cerr << "Parse failed: " << reader.getErrorString() << endl;
+                return 0;
+            }
+        }
+
+        if (added.size() != 1) return 0;
+        return dynamic_cast<EditableDenseThreeDimensionalModel *>(added[0]);
+    }
+
+    QByteArray wrap(QString modelXml) {
+        return QString("<sv>\n<data>\n%1</data>\n</sv>\n")
+            .arg(modelXml).toUtf8();
+    }
+    
+    void roundTrip(bool binary) {
+
+        EditableDenseThreeDimensionalModel model
+            (44100, 512, 4, EditableDenseThreeDimensionalModel::NoCompression);
+
+        vector<Column> columns {
+            { 0.f, 1.f, -1.f, 0.5f },
+            { 1e-30f, 3.0e30f, -0.125f, 1.f / 3.f },
+            { 7.f, 6.f, 5.f, 4.f }
+        };
+        for (int i = 0; i < int(columns.size()); ++i) {
+            model.setColumn(i, columns[i]);
+        }
+        model.setMinimumLevel(-1.f);
+        model.setMaximumLevel(7.f);
+
+        Preferences *prefs = Preferences::getInstance();
+        bool wasBinary = prefs->getUseBinaryDatasets();
+        prefs->setUseBinaryDatasets(binary);
+        QString xml = model.toXmlString("  ");
+        prefs->setUseBinaryDatasets(wasBinary);
+
+        QCOMPARE(xml.contains("encoding=\"float32le-base64\""), binary);
+
+        Document document;
+        EditableDenseThreeDimensionalModel *loaded =
+            load(document, wrap(xml));
+        QVERIFY(loaded);
+
+        QCOMPARE(loaded->getHeight(), 4);
+        QCOMPARE(loaded->getWidth(), int(columns.size()));
+        QCOMPARE(loaded->getResolution(), 512);
+        for (int i = 0; i < int(columns.size()); ++i) {
+            Column c = loaded->getColumn(i);
+            QCOMPARE(int(c.size()), 4);
+            for (int j = 0; j < 4; ++j) {
+                if (binary) {
+                    // Exact: the binary encoding carries the bits
+                    QCOMPARE(c[j], columns[i][j]);
+                } else {
+                    QVERIFY(fabsf(c[j] - columns[i][j]) <=
+                            1e-5f * fabsf(columns[i][j]));
+                }
+            }
+        }
+    }
+
+    QString binaryRow(int n, vector<float> values) {
+        QByteArray bytes;
+        for (float f: values) {
+            quint32 word;
+            memcpy(&word, &f, sizeof(word));
+            uchar le[4];
+            qToLittleEndian<quint32>(word, le);
+            bytes.append((const char *)le, 4);
+        }
+        return QString("  <row n=\"%1\">%2</row>\n")
+            .arg(n).arg(QString::fromLatin1(bytes.toBase64()));
+    }
+
+private slots:
+    void binaryRoundTrip() {
+        roundTrip(true);
+    }
+
+    void textRoundTrip() {
+        roundTrip(false);
+    }
+
+    void badBinaryRows() {
+
+        // Row 0 is fine; row 1 has two values too many for the
+        // model's height and should be truncated; row 2 has a length
+        // that is not a whole number of floats and should be dropped
+        
+        QByteArray row2bytes("\x01\x02\x03\x04\x05\x06", 6);
+        
+        QString xml =
+            QString("<model id=\"1\" name=\"\" sampleRate=\"44100\" start=\"0\" end=\"1536\" type=\"dense\" dimensions=\"3\" windowSize=\"512\" yBinCount=\"2\" minimum=\"0\" maximum=\"6\" dataset=\"2\" startFrame=\"0\"/>\n"
+                    "<dataset id=\"2\" dimensions=\"3\" encoding=\"float32le-base64\">\n") +
+            binaryRow(0, { 1.f, 2.f }) +
+            binaryRow(1, { 3.f, 4.f, 5.f, 6.f }) +
+            QString("  <row n=\"2\">%1</row>\n")
+            .arg(QString::fromLatin1(row2bytes.toBase64())) +
+            "</dataset>\n";
+
+        Document document;
+        EditableDenseThreeDimensionalModel *loaded =
+            load(document, wrap(xml));
+        QVERIFY(loaded);
+
+        QCOMPARE(loaded->getWidth(), 2);
+        QCOMPARE(loaded->getColumn(0), Column({ 1.f, 2.f }));
+        QCOMPARE(loaded->getColumn(1), Column({ 3.f, 4.f }));
+    }
+};
+
+#endif
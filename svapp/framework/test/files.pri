@@ -0,0 +1,5 @@
+TEST_HEADERS += \
+	SVFileReaderTest.h
+	
+TEST_SOURCES += \
+	svapp-framework-test.cpp
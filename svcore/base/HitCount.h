@@ -15,56 +15,66 @@
 #ifndef HIT_COUNT_H
 #define HIT_COUNT_H
 
+#include "Metrics.h"
+
 #include <string>
 #include <iostream>
 
 /**
  * Profile class for counting cache hits and the like.
+ *
+ * The counts are kept in the MetricsRegistry as counters named
+ * "<name>: hits", "<name>: partial" and "<name>: misses", so they can
+ * be queried while the program runs. They are printed on destruction
+ * unless NO_HIT_COUNTS is defined.
  */
 class HitCount
 {
 public:
     HitCount(std::string name) :
 	m_name(name),
-	m_hit(0),
-	m_partial(0),
-	m_miss(0)
+	m_hit(MetricsRegistry::getInstance()->getCounter(name + ": hits")),
+	m_partial(MetricsRegistry::getInstance()->getCounter(name + ": partial")),
+	m_miss(MetricsRegistry::getInstance()->getCounter(name + ": misses"))
     { }
     
     ~HitCount() {
 #ifndef NO_HIT_COUNTS
 	using namespace std;
-	int total = m_hit + m_partial + m_miss;
+        int64_t hit = m_hit.get();
+        int64_t partial = m_partial.get();
+        int64_t miss = m_miss.get();
+	int64_t total = hit + partial + miss;
 	cerr << "Hit count: " << m_name << ": ";
-	if (m_partial > 0) {
-	    cerr << m_hit << " hits, " << m_partial << " partial, "
-		 << m_miss << " misses";
+	if (partial > 0) {
+	    cerr << hit << " hits, " << partial << " partial, "
+		 << miss << " misses";
 	} else {
-	    cerr << m_hit << " hits, " << m_miss << " misses";
+	    cerr << hit << " hits, " << miss << " misses";
 	}
 	if (total > 0) {
-	    if (m_partial > 0) {
-		cerr << " (" << ((m_hit * 100.0) / total) << "%, "
-		     << ((m_partial * 100.0) / total) << "%, "
-		     << ((m_miss * 100.0) / total) << "%)";
+	    if (partial > 0) {
+		cerr << " (" << ((hit * 100.0) / total) << "%, "
+		     << ((partial * 100.0) / total) << "%, "
+		     << ((miss * 100.0) / total) << "%)";
 	    } else {
-		cerr << " (" << ((m_hit * 100.0) / total) << "%, "
-		     << ((m_miss * 100.0) / total) << "%)";
+		cerr << " (" << ((hit * 100.0) / total) << "%, "
+		     << ((miss * 100.0) / total) << "%)";
 	    }
 	}
 	cerr << endl;
 #endif
     }
 
-    void hit() { ++m_hit; }
-    void partial() { ++m_partial; }
-    void miss() { ++m_miss; }
+    void hit() { m_hit.add(); }
+    void partial() { m_partial.add(); }
+    void miss() { m_miss.add(); }
 
 private:
     std::string m_name;
-    int m_hit;
-    int m_partial;
-    int m_miss;
+    MetricsRegistry::Counter &m_hit;
+    MetricsRegistry::Counter &m_partial;
+    MetricsRegistry::Counter &m_miss;
 };
 
 #endif
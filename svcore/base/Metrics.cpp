@@ -0,0 +1,191 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "Metrics.h"
+
+#include "Debug.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+MetricsRegistry::Histogram::Histogram() :
+    m_count(0),
+    m_sum(0),
+    m_max(0)
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] = 0;
+    }
+}
+
+void
+MetricsRegistry::Histogram::add(int64_t value)
+{
+    if (value < 0) value = 0;
+
+    // Bucket n holds values v with 2^(n-1) <= v < 2^n (and bucket 0
+    // holds zero)
+    int bucket = 0;
+    for (int64_t v = value; v > 0 && bucket < BucketCount - 1; v >>= 1) {
+        ++bucket;
+    }
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    int64_t prev = m_max.load(std::memory_order_relaxed);
+    while (value > prev &&
+           !m_max.compare_exchange_weak(prev, value,
+                                        std::memory_order_relaxed)) {
+    }
+}
+
+int64_t
+MetricsRegistry::Histogram::getCount() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+int64_t
+MetricsRegistry::Histogram::getSum() const
+{
+    return m_sum.load(std::memory_order_relaxed);
+}
+
+int64_t
+MetricsRegistry::Histogram::getMaximum() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+int64_t
+MetricsRegistry::Histogram::getPercentile(double percentile) const
+{
+    int64_t counts[BucketCount];
+    int64_t total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) return 0;
+
+    double target = (percentile / 100.0) * double(total);
+    int64_t acc = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        acc += counts[i];
+        if (double(acc) >= target && counts[i] > 0) {
+            int64_t upper = (i == 0 ? 0 : (int64_t(1) << i) - 1);
+            return std::min(upper, getMaximum());
+        }
+    }
+    return getMaximum();
+}
+
+MetricsRegistry *
+MetricsRegistry::getInstance()
+{
+    static MetricsRegistry *instance = new MetricsRegistry();
+    return instance;
+}
+
+MetricsRegistry::Counter &
+MetricsRegistry::getCounter(std::string name)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto &p = m_counters[name];
+    if (!p) p.reset(new Counter);
+    return *p;
+}
+
+MetricsRegistry::Gauge &
+MetricsRegistry::getGauge(std::string name)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto &p = m_gauges[name];
+    if (!p) p.reset(new Gauge);
+    return *p;
+}
+
+MetricsRegistry::Histogram &
+MetricsRegistry::getHistogram(std::string name)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto &p = m_histograms[name];
+    if (!p) p.reset(new Histogram);
+    return *p;
+}
+
+QString
+MetricsRegistry::toText(std::string prefix) const
+{
+    std::map<std::string, QString> lines;
+
+    auto matches = [&](const std::string &name) {
+        return name.compare(0, prefix.size(), prefix) == 0;
+    };
+    
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for (const auto &c: m_counters) {
+        if (!matches(c.first)) continue;
+        lines[c.first] += QString("counter %1: %2\n")
+            .arg(c.first.c_str()).arg(qlonglong(c.second->get()));
+    }
+    
+    for (const auto &g: m_gauges) {
+        if (!matches(g.first)) continue;
+        lines[g.first] += QString("gauge %1: %2\n")
+            .arg(g.first.c_str()).arg(g.second->get());
+    }
+    
+    for (const auto &h: m_histograms) {
+        if (!matches(h.first)) continue;
+        const Histogram &hist = *h.second;
+        int64_t count = hist.getCount();
+        double mean = (count > 0 ? double(hist.getSum()) / double(count) : 0.0);
+        lines[h.first] +=
+            QString("histogram %1: count %2 mean %3 p50 %4 p90 %5 p99 %6 max %7\n")
+            .arg(h.first.c_str())
+            .arg(qlonglong(count))
+            .arg(mean)
+            .arg(qlonglong(hist.getPercentile(50)))
+            .arg(qlonglong(hist.getPercentile(90)))
+            .arg(qlonglong(hist.getPercentile(99)))
+            .arg(qlonglong(hist.getMaximum()));
+    }
+
+    QString text;
+    for (const auto &l: lines) {
+        text += l.second;
+    }
+    return text;
+}
+
+bool
+MetricsRegistry::dump(QString filename, std::string prefix) const
+{
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
+        SVCERR << "MetricsRegistry::dump: Failed to open \"" << filename
+               << "\" for writing" << endl;
+        return false;
+    }
+    QTextStream out(&file);
+    out << toText(prefix);
+    out.flush();
+    return file.error() == QFile::NoError;
+}
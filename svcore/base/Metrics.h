@@ -0,0 +1,148 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_METRICS_H
+#define SV_METRICS_H
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * A registry of named runtime metrics (counters, gauges and
+ * histograms) that components update as they run, for example to
+ * report cache hit rates or processing throughput. Unlike Profiler
+ * and HitCount output, metrics are always collected, including in
+ * release builds, and can be read at any time while the program is
+ * running.
+ *
+ * Looking a metric up by name takes a lock, so components should
+ * look up each metric once (typically into a static reference) and
+ * then update it through that reference. Updates are single atomic
+ * operations and are safe to make from any thread, including
+ * realtime audio threads.
+ *
+ * This class is a singleton.
+ */
+class MetricsRegistry
+{
+public:
+    /**
+     * A monotonically increasing count of events.
+     */
+    class Counter
+    {
+    public:
+        Counter() : m_value(0) { }
+        void add(int64_t n = 1) {
+            m_value.fetch_add(n, std::memory_order_relaxed);
+        }
+        int64_t get() const {
+            return m_value.load(std::memory_order_relaxed);
+        }
+    private:
+        std::atomic<int64_t> m_value;
+    };
+
+    /**
+     * A value that is set from time to time, such as a fill level.
+     */
+    class Gauge
+    {
+    public:
+        Gauge() : m_value(0.0) { }
+        void set(double value) {
+            m_value.store(value, std::memory_order_relaxed);
+        }
+        double get() const {
+            return m_value.load(std::memory_order_relaxed);
+        }
+    private:
+        std::atomic<double> m_value;
+    };
+
+    /**
+     * A distribution of non-negative integer samples (such as
+     * durations in microseconds), kept in power-of-two buckets so
+     * that percentiles can be estimated to within a factor of two.
+     */
+    class Histogram
+    {
+    public:
+        enum { BucketCount = 48 };
+        
+        Histogram();
+        void add(int64_t value);
+
+        int64_t getCount() const;
+        int64_t getSum() const;
+        int64_t getMaximum() const;
+
+        /**
+         * Return an upper bound for the given percentile (0-100) of
+         * the samples added so far, or 0 if there are none.
+         */
+        int64_t getPercentile(double percentile) const;
+
+    private:
+        std::atomic<int64_t> m_buckets[BucketCount];
+        std::atomic<int64_t> m_count;
+        std::atomic<int64_t> m_sum;
+        std::atomic<int64_t> m_max;
+    };
+
+    static MetricsRegistry *getInstance();
+
+    /**
+     * Return the metric of the given name, creating it if it does
+     * not exist yet. The returned reference remains valid for the
+     * life of the program.
+     */
+    Counter &getCounter(std::string name);
+    Gauge &getGauge(std::string name);
+    Histogram &getHistogram(std::string name);
+
+    /**
+     * Return the current values of all metrics whose names start
+     * with the given prefix (or all metrics, if the prefix is empty)
+     * as text, one metric per line in name order. Each line has the
+     * form
+     *
+     *   counter <name>: <value>
+     *   gauge <name>: <value>
+     *   histogram <name>: count <n> mean <m> p50 <x> p90 <y> p99 <z> max <w>
+     */
+    QString toText(std::string prefix = "") const;
+
+    /**
+     * Write the text from toText() to the given file, replacing its
+     * contents. Return false if the file could not be written.
+     */
+    bool dump(QString filename, std::string prefix = "") const;
+
+private:
+    MetricsRegistry() { }
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Counter>> m_counters;
+    std::map<std::string, std::unique_ptr<Gauge>> m_gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+};
+
+#endif
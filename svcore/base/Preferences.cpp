@@ -52,7 +52,10 @@ Preferences::Preferences() :
     m_timeToTextMode(TimeToTextMs),
     m_showHMS(true),
     m_octave(4),
-    m_showSplash(true)
+    m_showSplash(true),
+    m_binaryDatasets(false),
+    m_liveSpectrogram(false),
+    m_liveRecentTransform(false)
 {
     QSettings settings;
     settings.beginGroup("Preferences");
@@ -78,6 +81,9 @@ Preferences::Preferences() :
     m_octave = (settings.value("octave-of-middle-c", 4)).toInt();
     m_viewFontSize = settings.value("view-font-size", 10).toInt();
     m_showSplash = settings.value("show-splash", true).toBool();
+    m_binaryDatasets = settings.value("binary-session-datasets", false).toBool();
+    m_liveSpectrogram = settings.value("record-live-spectrogram", false).toBool();
+    m_liveRecentTransform = settings.value("record-live-recent-transform", false).toBool();
     settings.endGroup();
 
     settings.beginGroup("TempDirectory");
@@ -111,6 +117,9 @@ Preferences::getProperties() const
     props.push_back("Octave Numbering System");
     props.push_back("View Font Size");
     props.push_back("Show Splash Screen");
+    props.push_back("Use Binary Datasets");
+    props.push_back("Live Spectrogram While Recording");
+    props.push_back("Live Recent Transform While Recording");
     return props;
 }
 
@@ -171,6 +180,15 @@ Preferences::getPropertyLabel(const PropertyName &name) const
     if (name == "Show Splash Screen") {
         return tr("Show splash screen on startup");
     }
+    if (name == "Use Binary Datasets") {
+        return tr("Save dense data in binary form in session files");
+    }
+    if (name == "Live Spectrogram While Recording") {
+        return tr("Show a live spectrogram of audio while recording it");
+    }
+    if (name == "Live Recent Transform While Recording") {
+        return tr("Run the most recent transform on audio while recording it");
+    }
     return name;
 }
 
@@ -232,6 +250,15 @@ Preferences::getPropertyType(const PropertyName &name) const
     if (name == "Show Splash Screen") {
         return ToggleProperty;
     }
+    if (name == "Use Binary Datasets") {
+        return ToggleProperty;
+    }
+    if (name == "Live Spectrogram While Recording") {
+        return ToggleProperty;
+    }
+    if (name == "Live Recent Transform While Recording") {
+        return ToggleProperty;
+    }
     return InvalidProperty;
 }
 
@@ -318,6 +345,21 @@ Preferences::getPropertyRangeAndValue(const PropertyName &name,
         return m_showSplash ? 1 : 0;
     }
 
+    if (name == "Use Binary Datasets") {
+        if (deflt) *deflt = 0;
+        return m_binaryDatasets ? 1 : 0;
+    }
+
+    if (name == "Live Spectrogram While Recording") {
+        if (deflt) *deflt = 0;
+        return m_liveSpectrogram ? 1 : 0;
+    }
+
+    if (name == "Live Recent Transform While Recording") {
+        if (deflt) *deflt = 0;
+        return m_liveRecentTransform ? 1 : 0;
+    }
+
     return 0;
 }
 
@@ -435,6 +477,12 @@ Preferences::setProperty(const PropertyName &name, int value)
         setViewFontSize(value);
     } else if (name == "Show Splash Screen") {
         setShowSplash(value ? true : false);
+    } else if (name == "Use Binary Datasets") {
+        setUseBinaryDatasets(value ? true : false);
+    } else if (name == "Live Spectrogram While Recording") {
+        setLiveSpectrogramWhileRecording(value ? true : false);
+    } else if (name == "Live Recent Transform While Recording") {
+        setLiveRecentTransformWhileRecording(value ? true : false);
     }
 }
 
@@ -718,4 +766,49 @@ Preferences::setShowSplash(bool show)
         emit propertyChanged("Show Splash Screen");
     }
 }
+
+void
+Preferences::setUseBinaryDatasets(bool binary)
+{
+    if (m_binaryDatasets != binary) {
+
+        m_binaryDatasets = binary;
+
+        QSettings settings;
+        settings.beginGroup("Preferences");
+        settings.setValue("binary-session-datasets", binary);
+        settings.endGroup();
+        emit propertyChanged("Use Binary Datasets");
+    }
+}
+
+void
+Preferences::setLiveSpectrogramWhileRecording(bool live)
+{
+    if (m_liveSpectrogram != live) {
+
+        m_liveSpectrogram = live;
+
+        QSettings settings;
+        settings.beginGroup("Preferences");
+        settings.setValue("record-live-spectrogram", live);
+        settings.endGroup();
+        emit propertyChanged("Live Spectrogram While Recording");
+    }
+}
+
+void
+Preferences::setLiveRecentTransformWhileRecording(bool live)
+{
+    if (m_liveRecentTransform != live) {
+
+        m_liveRecentTransform = live;
+
+        QSettings settings;
+        settings.beginGroup("Preferences");
+        settings.setValue("record-live-recent-transform", live);
+        settings.endGroup();
+        emit propertyChanged("Live Recent Transform While Recording");
+    }
+}
         
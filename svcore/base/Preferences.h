@@ -109,6 +109,18 @@ public:
     
     bool getShowSplash() const { return m_showSplash; }
 
+    /// True if dense datasets should be written to sessions in binary form
+    bool getUseBinaryDatasets() const { return m_binaryDatasets; }
+
+    /// True if a spectrogram should be computed live while recording
+    bool getLiveSpectrogramWhileRecording() const { return m_liveSpectrogram; }
+
+    /// True if the most recently used transform should be run live
+    /// while recording
+    bool getLiveRecentTransformWhileRecording() const {
+        return m_liveRecentTransform;
+    }
+
 public slots:
     virtual void setProperty(const PropertyName &, int);
 
@@ -130,6 +142,9 @@ public slots:
     void setOctaveOfMiddleC(int oct);
     void setViewFontSize(int size);
     void setShowSplash(bool);
+    void setUseBinaryDatasets(bool);
+    void setLiveSpectrogramWhileRecording(bool);
+    void setLiveRecentTransformWhileRecording(bool);
 
 private:
     Preferences(); // may throw DirectoryCreationFailed
@@ -168,6 +183,9 @@ private:
     bool m_showHMS;
     int m_octave;
     bool m_showSplash;
+    bool m_binaryDatasets;
+    bool m_liveSpectrogram;
+    bool m_liveRecentTransform;
 };
 
 #endif
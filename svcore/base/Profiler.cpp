@@ -29,142 +29,537 @@
 #include <set>
 #include <map>
 
-Profiles* Profiles::m_instance = 0;
+#include <QCoreApplication>
+#include <QFile>
+#include <QThread>
+
+#ifndef NO_TIMING
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Each thread log holds its events in a list of fixed-size chunks,
+// so that recording never moves existing events and readers can
+// walk the list while the owning thread is still appending to
+// it. Once a thread has used maxChunks chunks, further events are
+// counted but not kept (the per-point totals are still updated).
+    
+const int chunkSize = 1024;
+const int maxChunks = 256;
+
+// Per-point totals are kept in a small open-addressed table per
+// thread, keyed by the address of the profile point name
+    
+const int statSlots = 512;
+
+// The events of threads that have exited are kept for export up to
+// this many chunks in total, the oldest threads' being discarded
+// first
+
+const int maxRetiredChunks = 1024;
+
+struct Event {
+    const char *id;
+    int64_t start;
+    int64_t duration;
+};
+
+struct Chunk {
+    Chunk() : count(0), next(0) { }
+    Event events[chunkSize];
+    std::atomic<int> count;
+    std::atomic<Chunk *> next;
+};
+
+struct Stat {
+    Stat() : id(0), calls(0), total(0), self(0), worst(0) { }
+    std::atomic<const char *> id;
+    std::atomic<int64_t> calls;
+    std::atomic<int64_t> total;
+    std::atomic<int64_t> self;
+    std::atomic<int64_t> worst;
+};
+
+// Only the owning thread ever writes to a log, so its counters can
+// be updated with plain relaxed load/store pairs rather than
+// read-modify-write operations
+inline void add(std::atomic<int64_t> &a, int64_t n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+}
+
+struct Profiles::ThreadLog
+{
+    ThreadLog(int i, QString n) :
+        id(i), name(n), head(new Chunk), tail(head), chunks(1),
+        droppedEvents(0), droppedStats(0), stats(new Stat[statSlots]) { }
+
+    ~ThreadLog() {
+        while (head) {
+            Chunk *next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+        delete[] stats;
+    }
+
+    int id;
+    QString name;
+    Chunk *head;
+    Chunk *tail;              // owner only
+    int chunks;               // owner only
+    std::atomic<int64_t> droppedEvents;
+    std::atomic<int64_t> droppedStats;
+    Stat *stats;              // freed when the owning thread exits
+    std::vector<int64_t> childTimes; // owner only: per open scope
+
+    void begin() {
+        childTimes.push_back(0);
+    }
+
+    void end(const char *c, int64_t start, int64_t finish) {
+
+        int64_t duration = finish - start;
+        int64_t children = 0;
+        if (!childTimes.empty()) {
+            children = childTimes.back();
+            childTimes.pop_back();
+        }
+        if (!childTimes.empty()) {
+            childTimes.back() += duration;
+        }
+
+        Stat *stat = findStat(c);
+        if (stat) {
+            add(stat->calls, 1);
+            add(stat->total, duration);
+            add(stat->self, duration - children);
+            if (duration > stat->worst.load(std::memory_order_relaxed)) {
+                stat->worst.store(duration, std::memory_order_relaxed);
+            }
+        } else {
+            add(droppedStats, 1);
+        }
+
+        int n = tail->count.load(std::memory_order_relaxed);
+        if (n == chunkSize) {
+            if (chunks == maxChunks) {
+                add(droppedEvents, 1);
+                return;
+            }
+            Chunk *chunk = new Chunk;
+            tail->next.store(chunk, std::memory_order_release);
+            tail = chunk;
+            ++chunks;
+            n = 0;
+        }
+        Event &e = tail->events[n];
+        e.id = c;
+        e.start = start;
+        e.duration = duration;
+        tail->count.store(n + 1, std::memory_order_release);
+    }
+
+    Stat *findStat(const char *c) {
+        size_t slot = (reinterpret_cast<uintptr_t>(c) >> 3) % statSlots;
+        for (int i = 0; i < statSlots; ++i) {
+            Stat &stat = stats[slot];
+            const char *sid = stat.id.load(std::memory_order_relaxed);
+            if (sid == c) return &stat;
+            if (!sid) {
+                stat.id.store(c, std::memory_order_release);
+                return &stat;
+            }
+            slot = (slot + 1) % statSlots;
+        }
+        return 0;
+    }
+};
+
+static std::atomic<bool> profilesDestroyed(false);
+
+/**
+ * Owner of the calling thread's log, retiring it when the thread
+ * exits.
+ */
+struct ThreadLogHolder
+{
+    ThreadLogHolder() : log(0) { }
+    ~ThreadLogHolder() {
+        if (log && !profilesDestroyed) {
+            Profiles::getInstance()->retire(log);
+        }
+        log = 0;
+    }
+    Profiles::ThreadLog *log;
+};
+
+#endif
 
 Profiles* Profiles::getInstance()
 {
-    if (!m_instance) m_instance = new Profiles();
-    
-    return m_instance;
+    // Initialisation of a function-local static is thread-safe, and
+    // it is destroyed (dumping its contents if enabled) at exit
+    static Profiles instance;
+    return &instance;
 }
 
 Profiles::Profiles()
 {
+#ifndef NO_TIMING
+    m_retiredChunks = 0;
+    m_retiredDroppedEvents = 0;
+    m_retiredDroppedStats = 0;
+    m_nextLogId = 1;
+    m_origin = now();
+#endif
 }
 
 Profiles::~Profiles()
 {
     dump();
+
+#ifndef NO_TIMING
+    // Threads still running may yet reach a profile point (during
+    // static destruction, for example) so their logs are left alone
+    profilesDestroyed = true;
+    std::lock_guard<std::mutex> guard(m_logsMutex);
+    for (ThreadLog *log: m_retired) {
+        delete log;
+    }
+    m_retired.clear();
+#endif
 }
 
 #ifndef NO_TIMING
-void Profiles::accumulate(
-    const char* id, clock_t time, RealTime rt
-)
+
+std::atomic<bool> &
+Profiles::enabledFlag()
+{
+    static std::atomic<bool> enabled([]() {
+            const char *env = getenv("SV_PROFILE");
+            return env && *env && strcmp(env, "0") != 0;
+        }());
+    return enabled;
+}
+
+bool
+Profiles::isEnabled()
+{
+    return enabledFlag().load(std::memory_order_relaxed);
+}
+
+void
+Profiles::setEnabled(bool enabled)
+{
+    enabledFlag().store(enabled, std::memory_order_relaxed);
+}
+
+#else
+
+bool
+Profiles::isEnabled()
+{
+    return false;
+}
+
+void
+Profiles::setEnabled(bool)
+{
+}
+
+#endif
+
+#ifndef NO_TIMING
+
+int64_t
+Profiles::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiles::ThreadLog *
+Profiles::getThreadLog()
 {
-    ProfilePair &pair(m_profiles[id]);
-    ++pair.first;
-    pair.second.first += time;
-    pair.second.second = pair.second.second + rt;
+    static thread_local ThreadLogHolder holder;
+    if (holder.log) return holder.log;
+
+    QThread *thread = QThread::currentThread();
+    QString name = thread->objectName();
+    if (name == "") {
+        if (QCoreApplication::instance() &&
+            thread == QCoreApplication::instance()->thread()) {
+            name = "Main thread";
+        } else {
+            name = thread->metaObject()->className();
+        }
+    }
 
-    TimePair &lastPair(m_lastCalls[id]);
-    lastPair.first = time;
-    lastPair.second = rt;
+    std::lock_guard<std::mutex> guard(m_logsMutex);
+    holder.log = new ThreadLog(m_nextLogId++, name);
+    m_logs.push_back(holder.log);
+    return holder.log;
+}
 
-    TimePair &worstPair(m_worstCalls[id]);
-    if (time > worstPair.first) {
-        worstPair.first = time;
+void
+Profiles::retire(ThreadLog *log)
+{
+    // Called from the owning thread as it exits, so nothing else
+    // writes to the log from here on
+
+    std::lock_guard<std::mutex> guard(m_logsMutex);
+
+    m_logs.erase(std::remove(m_logs.begin(), m_logs.end(), log),
+                 m_logs.end());
+
+    for (int i = 0; i < statSlots; ++i) {
+        const Stat &stat = log->stats[i];
+        const char *id = stat.id.load(std::memory_order_relaxed);
+        if (!id) continue;
+        Totals &t = m_retiredTotals[id];
+        t.calls += stat.calls.load(std::memory_order_relaxed);
+        t.total += stat.total.load(std::memory_order_relaxed);
+        t.self += stat.self.load(std::memory_order_relaxed);
+        t.worst = std::max(t.worst, stat.worst.load(std::memory_order_relaxed));
     }
-    if (rt > worstPair.second) {
-        worstPair.second = rt;
+
+    m_retiredDroppedStats += log->droppedStats.load(std::memory_order_relaxed);
+
+    delete[] log->stats;
+    log->stats = 0;
+    log->childTimes = std::vector<int64_t>();
+
+    m_retired.push_back(log);
+    m_retiredChunks += log->chunks;
+
+    while (m_retiredChunks > maxRetiredChunks && !m_retired.empty()) {
+        ThreadLog *oldest = m_retired.front();
+        m_retired.pop_front();
+        m_retiredChunks -= oldest->chunks;
+        for (const Chunk *chunk = oldest->head; chunk;
+             chunk = chunk->next.load(std::memory_order_relaxed)) {
+            m_retiredDroppedEvents += chunk->count.load();
+        }
+        m_retiredDroppedEvents += oldest->droppedEvents.load();
+        delete oldest;
     }
 }
+
 #endif
 
 void Profiles::dump() const
 {
 #ifndef NO_TIMING
 
-    fprintf(stderr, "Profiling points:\n");
+    if (!isEnabled()) return;
 
-    fprintf(stderr, "\nBy name:\n");
-
-    typedef std::set<const char *, std::less<std::string> > StringSet;
-
-    StringSet profileNames;
-    for (ProfileMap::const_iterator i = m_profiles.begin();
-         i != m_profiles.end(); ++i) {
-        profileNames.insert(i->first);
+    // Profile point names are merged by content, as the same name
+    // may be found at different addresses in different threads or
+    // translation units
+    
+    std::map<std::string, Totals> totals;
+    int64_t droppedStats = 0;
+    int threads = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(m_logsMutex);
+        totals = m_retiredTotals;
+        droppedStats = m_retiredDroppedStats;
+        threads = m_nextLogId - 1;
+        for (const ThreadLog *log: m_logs) {
+            for (int i = 0; i < statSlots; ++i) {
+                const Stat &stat = log->stats[i];
+                const char *id = stat.id.load(std::memory_order_acquire);
+                if (!id) continue;
+                Totals &t = totals[id];
+                t.calls += stat.calls.load(std::memory_order_relaxed);
+                t.total += stat.total.load(std::memory_order_relaxed);
+                t.self += stat.self.load(std::memory_order_relaxed);
+                t.worst = std::max
+                    (t.worst, stat.worst.load(std::memory_order_relaxed));
+            }
+            droppedStats += log->droppedStats.load(std::memory_order_relaxed);
+        }
     }
 
-    for (StringSet::const_iterator i = profileNames.begin();
-         i != profileNames.end(); ++i) {
+    auto ms = [](int64_t ns) { return double(ns) / 1000000.0; };
 
-        ProfileMap::const_iterator j = m_profiles.find(*i);
+    fprintf(stderr, "Profiling points (from %d thread(s)):\n", threads);
 
-        if (j == m_profiles.end()) continue;
+    fprintf(stderr, "\nBy name:\n");
 
-        const ProfilePair &pp(j->second);
+    for (const auto &i: totals) {
 
-        fprintf(stderr, "%s(%d):\n", *i, pp.first);
+        const Totals &t(i.second);
+        if (t.calls == 0) continue;
 
-        fprintf(stderr, "\tCPU:  \t%.9g ms/call \t[%d ms total]\n",
-                (((double)pp.second.first * 1000.0 /
-		  (double)pp.first) / CLOCKS_PER_SEC),
-                int((double(pp.second.first) * 1000.0) / CLOCKS_PER_SEC));
+        fprintf(stderr, "%s(%lld):\n", i.first.c_str(), (long long)t.calls);
 
-        fprintf(stderr, "\tReal: \t%s ms      \t[%s ms total]\n",
-                ((pp.second.second / pp.first) * 1000).toString().c_str(),
-                (pp.second.second * 1000).toString().c_str());
+        fprintf(stderr, "\tReal: \t%.9g ms/call \t[%.9g ms total]\n",
+                ms(t.total) / double(t.calls), ms(t.total));
 
-        WorstCallMap::const_iterator k = m_worstCalls.find(*i);
-        if (k == m_worstCalls.end()) continue;
-        
-        const TimePair &wc(k->second);
+        fprintf(stderr, "\tSelf: \t%.9g ms/call \t[%.9g ms total]\n",
+                ms(t.self) / double(t.calls), ms(t.self));
 
-        fprintf(stderr, "\tWorst:\t%s ms/call \t[%d ms CPU]\n",
-                (wc.second * 1000).toString().c_str(),
-                int((double(wc.first) * 1000.0) / CLOCKS_PER_SEC));
+        fprintf(stderr, "\tWorst:\t%.9g ms/call\n", ms(t.worst));
     }
 
-    typedef std::multimap<RealTime, const char *> TimeRMap;
-    typedef std::multimap<int, const char *> IntRMap;
+    typedef std::multimap<int64_t, std::string> RMap;
     
-    TimeRMap totmap, avgmap, worstmap;
-    IntRMap ncallmap;
-
-    for (ProfileMap::const_iterator i = m_profiles.begin();
-         i != m_profiles.end(); ++i) {
-        totmap.insert(TimeRMap::value_type(i->second.second.second, i->first));
-        avgmap.insert(TimeRMap::value_type(i->second.second.second /
-                                           i->second.first, i->first));
-        ncallmap.insert(IntRMap::value_type(i->second.first, i->first));
-    }
-
-    for (WorstCallMap::const_iterator i = m_worstCalls.begin();
-         i != m_worstCalls.end(); ++i) {
-        worstmap.insert(TimeRMap::value_type(i->second.second,
-                                             i->first));
+    RMap totmap, avgmap, worstmap, ncallmap;
+
+    for (const auto &i: totals) {
+        const Totals &t(i.second);
+        if (t.calls == 0) continue;
+        totmap.insert(RMap::value_type(t.total, i.first));
+        avgmap.insert(RMap::value_type(t.total / t.calls, i.first));
+        worstmap.insert(RMap::value_type(t.worst, i.first));
+        ncallmap.insert(RMap::value_type(t.calls, i.first));
     }
 
-
     fprintf(stderr, "\nBy total:\n");
-    for (TimeRMap::const_iterator i = totmap.end(); i != totmap.begin(); ) {
-        --i;
-        fprintf(stderr, "%-40s  %s ms\n", i->second,
-                (i->first * 1000).toString().c_str());
+    for (RMap::const_reverse_iterator i = totmap.rbegin();
+         i != totmap.rend(); ++i) {
+        fprintf(stderr, "%-40s  %.9g ms\n", i->second.c_str(), ms(i->first));
     }
 
     fprintf(stderr, "\nBy average:\n");
-    for (TimeRMap::const_iterator i = avgmap.end(); i != avgmap.begin(); ) {
-        --i;
-        fprintf(stderr, "%-40s  %s ms\n", i->second,
-                (i->first * 1000).toString().c_str());
+    for (RMap::const_reverse_iterator i = avgmap.rbegin();
+         i != avgmap.rend(); ++i) {
+        fprintf(stderr, "%-40s  %.9g ms\n", i->second.c_str(), ms(i->first));
     }
 
     fprintf(stderr, "\nBy worst case:\n");
-    for (TimeRMap::const_iterator i = worstmap.end(); i != worstmap.begin(); ) {
-        --i;
-        fprintf(stderr, "%-40s  %s ms\n", i->second,
-                (i->first * 1000).toString().c_str());
+    for (RMap::const_reverse_iterator i = worstmap.rbegin();
+         i != worstmap.rend(); ++i) {
+        fprintf(stderr, "%-40s  %.9g ms\n", i->second.c_str(), ms(i->first));
     }
 
     fprintf(stderr, "\nBy number of calls:\n");
-    for (IntRMap::const_iterator i = ncallmap.end(); i != ncallmap.begin(); ) {
-        --i;
-        fprintf(stderr, "%-40s  %d\n", i->second, i->first);
+    for (RMap::const_reverse_iterator i = ncallmap.rbegin();
+         i != ncallmap.rend(); ++i) {
+        fprintf(stderr, "%-40s  %lld\n", i->second.c_str(),
+                (long long)i->first);
+    }
+
+    if (droppedStats > 0) {
+        fprintf(stderr, "\n(%lld calls were not counted because a thread used too many distinct profiling points)\n", (long long)droppedStats);
+    }
+
+#endif
+}
+
+#ifndef NO_TIMING
+
+static QByteArray
+escapeJson(const char *s)
+{
+    QByteArray out;
+    for (const char *p = s; *p; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20) {
+            char buf[10];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += char(c);
+        }
+    }
+    return out;
+}
+
+#endif
+
+bool
+Profiles::exportTrace(QString filename) const
+{
+#ifndef NO_TIMING
+
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        cerr << "Profiles::exportTrace: Failed to open \"" << filename
+             << "\" for writing" << endl;
+        return false;
     }
 
+    long long pid = QCoreApplication::applicationPid();
+    int64_t droppedEvents = 0;
+
+    QByteArray out("{\"traceEvents\":[\n");
+    bool first = true;
+    char buf[200];
+
+    std::lock_guard<std::mutex> guard(m_logsMutex);
+
+    droppedEvents += m_retiredDroppedEvents;
+
+    std::vector<const ThreadLog *> logs(m_retired.begin(), m_retired.end());
+    logs.insert(logs.end(), m_logs.begin(), m_logs.end());
+
+    for (const ThreadLog *log: logs) {
+
+        out += (first ? "" : ",\n");
+        first = false;
+        snprintf(buf, sizeof(buf),
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lld,"
+                 "\"tid\":%d,\"args\":{\"name\":\"", pid, log->id);
+        out += buf;
+        out += escapeJson(log->name.toUtf8().data());
+        out += "\"}}";
+
+        for (const Chunk *chunk = log->head; chunk;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+
+            int n = chunk->count.load(std::memory_order_acquire);
+
+            for (int i = 0; i < n; ++i) {
+                const Event &e = chunk->events[i];
+                out += ",\n{\"name\":\"";
+                out += escapeJson(e.id);
+                snprintf(buf, sizeof(buf),
+                         "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"pid\":%lld,\"tid\":%d}",
+                         double(e.start - m_origin) / 1000.0,
+                         double(e.duration) / 1000.0,
+                         pid, log->id);
+                out += buf;
+            }
+
+            if (out.size() > 1024 * 1024) {
+                file.write(out);
+                out.clear();
+            }
+        }
+
+        droppedEvents += log->droppedEvents.load(std::memory_order_relaxed);
+    }
+
+    out += "\n]}\n";
+    file.write(out);
+
+    if (droppedEvents > 0) {
+        cerr << "Profiles::exportTrace: NOTE: " << droppedEvents
+             << " events were not recorded, or were discarded after "
+             << "their threads exited, because log limits were reached"
+             << endl;
+    }
+
+    return file.error() == QFile::NoError;
+
+#else
+
+    cerr << "Profiles::exportTrace: Timing is not compiled in, cannot export \""
+         << filename << "\"" << endl;
+    return false;
+
 #endif
 }
 
@@ -172,28 +567,27 @@ void Profiles::dump() const
 
 Profiler::Profiler(const char* c, bool showOnDestruct) :
     m_c(c),
+    m_log(0),
+    m_start(0),
     m_showOnDestruct(showOnDestruct),
     m_ended(false)
 {
-    m_startCPU = clock();
-
-    struct timeval tv;
-    (void)gettimeofday(&tv, 0);
-    m_startTime = RealTime::fromTimeval(tv);
+    if (!Profiles::isEnabled()) return;
+    m_log = Profiles::getInstance()->getThreadLog();
+    m_log->begin();
+    m_start = Profiles::now();
 }
 
 void
 Profiler::update() const
 {
-    clock_t elapsedCPU = clock() - m_startCPU;
+    if (!m_log) return;
 
-    struct timeval tv;
-    (void)gettimeofday(&tv, 0);
-    RealTime elapsedTime = RealTime::fromTimeval(tv) - m_startTime;
+    int64_t elapsed = Profiles::now() - m_start;
 
     cerr << "Profiler : id = " << m_c
-	 << " - elapsed so far = " << ((elapsedCPU * 1000) / CLOCKS_PER_SEC)
-	 << "ms CPU, " << elapsedTime << " real" << endl;
+	 << " - elapsed so far = " << double(elapsed) / 1000000.0
+         << "ms real" << endl;
 }    
 
 Profiler::~Profiler()
@@ -204,21 +598,21 @@ Profiler::~Profiler()
 void
 Profiler::end()
 {
-    clock_t elapsedCPU = clock() - m_startCPU;
-
-    struct timeval tv;
-    (void)gettimeofday(&tv, 0);
-    RealTime elapsedTime = RealTime::fromTimeval(tv) - m_startTime;
+    if (!m_log || m_ended) {
+        m_ended = true;
+        return;
+    }
 
-    Profiles::getInstance()->accumulate(m_c, elapsedCPU, elapsedTime);
+    int64_t finish = Profiles::now();
+    
+    m_log->end(m_c, m_start, finish);
 
     if (m_showOnDestruct)
         cerr << "Profiler : id = " << m_c
-             << " - elapsed = " << ((elapsedCPU * 1000) / CLOCKS_PER_SEC)
-	     << "ms CPU, " << elapsedTime << " real" << endl;
+             << " - elapsed = " << double(finish - m_start) / 1000000.0
+             << "ms real" << endl;
 
     m_ended = true;
 }
  
 #endif
-
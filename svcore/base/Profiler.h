@@ -29,19 +29,21 @@
 
 #include "RealTime.h"
 
-//#define NO_TIMING 1
+#include <QString>
 
-//#define WANT_TIMING 1
+// Define NO_TIMING to compile profiling out altogether. Otherwise
+// it is compiled in, in release builds as well as debug ones, but
+// records nothing unless enabled at runtime (see Profiles::isEnabled)
 
-#ifdef NDEBUG
-#ifndef WANT_TIMING
-#define NO_TIMING 1
-#endif
-#endif
+//#define NO_TIMING 1
 
 #ifndef NO_TIMING
-#include <ctime>
-#include <sys/time.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
 #endif
 
 /**
@@ -51,7 +53,17 @@
 /**
  * The class holding all profiling data
  *
- * This class is a singleton
+ * This class is a singleton. Each thread that runs a profile point
+ * records into its own log, which only that thread ever writes to,
+ * so profiling from many threads at once needs no locking and does
+ * not serialise them against one another. The logs are read when
+ * dump() or exportTrace() is called, which may happen at any time
+ * from any thread.
+ *
+ * When a thread exits, its per-point totals are merged into a
+ * shared table and the rest of its log is freed, except for its
+ * recorded events, which are kept for exportTrace() up to a fixed
+ * limit across all exited threads.
  */
 class Profiles
 {
@@ -59,26 +71,83 @@ public:
     static Profiles* getInstance();
     ~Profiles();
 
+    /**
+     * Print the accumulated, mean and worst-case times for each
+     * profiling point, summed over all threads, to stderr. Does
+     * nothing unless profiling is enabled. This happens anyway when
+     * the program exits, so there is no need to call it then.
+     */
+    void dump() const;
+
+    /**
+     * Write every profile point call recorded so far, from all
+     * threads, to the given file as Chrome trace-event JSON (which
+     * can be loaded into chrome://tracing or Perfetto). Nested
+     * profile points appear nested within their callers. Return
+     * false if the file could not be written or if timing has been
+     * compiled out.
+     */
+    bool exportTrace(QString filename) const;
+
+    /**
+     * Return true if profile points are currently being recorded.
+     * Recording is off unless the SV_PROFILE environment variable is
+     * set to something other than 0 when the first profile point is
+     * reached, or setEnabled(true) has been called. When it is off,
+     * a profile point costs a single flag test. Always false if
+     * timing has been compiled out.
+     */
+    static bool isEnabled();
+
+    /**
+     * Switch recording of profile points on or off, overriding the
+     * environment. Profile points already in progress are unaffected.
+     */
+    static void setEnabled(bool enabled);
+
 #ifndef NO_TIMING
-    void accumulate(const char* id, clock_t time, RealTime rt);
+    struct ThreadLog;
+
+    /**
+     * Return the log for the calling thread, creating it on first use.
+     */
+    ThreadLog *getThreadLog();
+
+    /**
+     * Return a monotonic timestamp in nanoseconds.
+     */
+    static int64_t now();
 #endif
-    void dump() const;
 
 protected:
     Profiles();
 
 #ifndef NO_TIMING
-    typedef std::pair<clock_t, RealTime> TimePair;
-    typedef std::pair<int, TimePair> ProfilePair;
-    typedef std::map<const char *, ProfilePair> ProfileMap;
-    typedef std::map<const char *, TimePair> LastCallMap;
-    typedef std::map<const char *, TimePair> WorstCallMap;
-    ProfileMap m_profiles;
-    LastCallMap m_lastCalls;
-    WorstCallMap m_worstCalls;
+    struct Totals {
+        Totals() : calls(0), total(0), self(0), worst(0) { }
+        int64_t calls;
+        int64_t total;
+        int64_t self;
+        int64_t worst;
+    };
+
+    static std::atomic<bool> &enabledFlag();
+
+    friend struct ThreadLogHolder;
+    void retire(ThreadLog *log);
+
+    // m_logsMutex protects these containers and the retired logs,
+    // but not the logs of running threads
+    mutable std::mutex m_logsMutex;
+    std::vector<ThreadLog *> m_logs;              // running threads
+    std::deque<ThreadLog *> m_retired;            // exited, events only
+    std::map<std::string, Totals> m_retiredTotals;
+    int m_retiredChunks;
+    int64_t m_retiredDroppedEvents;
+    int64_t m_retiredDroppedStats;
+    int m_nextLogId;
+    int64_t m_origin;
 #endif
-
-    static Profiles* m_instance;
 };
 
 #ifndef NO_TIMING
@@ -86,9 +155,9 @@ protected:
 /**
  * Profile point instance class.  Construct one of these on the stack
  * at the start of a function, in order to record the time consumed
- * within that function.  The profiler object should be effectively
- * optimised out if NO_TIMING is defined, so any overhead in a release
- * build should be negligible so long as you remember to define that.
+ * within that function.  The profiler object is effectively
+ * optimised out if NO_TIMING is defined, and records nothing unless
+ * Profiles::isEnabled() was true when it was constructed.
  */
 class Profiler
 {
@@ -100,6 +169,9 @@ public:
      * object is destroyed; otherwise, only the accumulated, mean and
      * worst-case times will be shown when the program exits or
      * Profiles::dump() is called.
+     *
+     * The name is stored by pointer and must remain valid for the
+     * life of the program (normally it is a string literal).
      */
     Profiler(const char *name, bool showOnDestruct = false);
     ~Profiler();
@@ -109,8 +181,8 @@ public:
 
 protected:
     const char* m_c;
-    clock_t m_startCPU;
-    RealTime m_startTime;
+    Profiles::ThreadLog *m_log;
+    int64_t m_start;
     bool m_showOnDestruct;
     bool m_ended;
 };
@@ -0,0 +1,72 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_METRICS_H
+#define TEST_METRICS_H
+
+#include "../Metrics.h"
+#include "../HitCount.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <thread>
+
+using namespace std;
+
+class TestMetrics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void counterAcrossThreads() {
+        MetricsRegistry::Counter &c =
+            MetricsRegistry::getInstance()->getCounter("TestMetrics: counter");
+        auto work = [&]() { for (int i = 0; i < 10000; ++i) c.add(); };
+        std::thread t1(work), t2(work);
+        t1.join();
+        t2.join();
+        QCOMPARE(c.get(), int64_t(20000));
+        QCOMPARE(&MetricsRegistry::getInstance()->getCounter
+                 ("TestMetrics: counter"), &c);
+    }
+
+    void histogram() {
+        MetricsRegistry::Histogram &h =
+            MetricsRegistry::getInstance()->getHistogram("TestMetrics: histogram");
+        for (int i = 1; i <= 100; ++i) h.add(i);
+        QCOMPARE(h.getCount(), int64_t(100));
+        QCOMPARE(h.getSum(), int64_t(5050));
+        QCOMPARE(h.getMaximum(), int64_t(100));
+        // Percentiles are upper bounds within a factor of two
+        int64_t p50 = h.getPercentile(50);
+        QVERIFY(p50 >= 50 && p50 < 100);
+        QCOMPARE(h.getPercentile(100), int64_t(100));
+    }
+
+    void hitCount() {
+        {
+            HitCount count("TestMetrics: cache");
+            count.hit();
+            count.hit();
+            count.miss();
+        }
+        QString text = MetricsRegistry::getInstance()->toText("TestMetrics: cache");
+        QVERIFY(text.contains("counter TestMetrics: cache: hits: 2"));
+        QVERIFY(text.contains("counter TestMetrics: cache: misses: 1"));
+        QVERIFY(!text.contains("histogram"));
+    }
+};
+
+#endif
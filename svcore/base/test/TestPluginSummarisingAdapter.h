@@ -0,0 +1,232 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_PLUGIN_SUMMARISING_ADAPTER_H
+#define TEST_PLUGIN_SUMMARISING_ADAPTER_H
+
+#include <QObject>
+#include <QtTest>
+
+#include <vamp-hostsdk/PluginSummarisingAdapter.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// A plugin that returns one value from a list on each process call,
+// on a single one-sample-per-step output
+class ScriptedPlugin : public Vamp::Plugin
+{
+public:
+    ScriptedPlugin(float rate, const vector<float> &values) :
+        Plugin(rate), m_values(values), m_n(0) { }
+
+    string getIdentifier() const { return "scripted"; }
+    string getName() const { return "Scripted"; }
+    string getDescription() const { return ""; }
+    string getMaker() const { return ""; }
+    string getCopyright() const { return ""; }
+    int getPluginVersion() const { return 1; }
+    InputDomain getInputDomain() const { return TimeDomain; }
+
+    bool initialise(size_t, size_t, size_t) { return true; }
+    void reset() { m_n = 0; }
+
+    OutputList getOutputDescriptors() const {
+        OutputDescriptor d;
+        d.identifier = "values";
+        d.hasFixedBinCount = true;
+        d.binCount = 1;
+        d.sampleType = OutputDescriptor::OneSamplePerStep;
+        OutputList list;
+        list.push_back(d);
+        return list;
+    }
+
+    FeatureSet process(const float *const *, Vamp::RealTime) {
+        FeatureSet fs;
+        if (m_n < m_values.size()) {
+            Feature f;
+            f.values.push_back(m_values[m_n]);
+            fs[0].push_back(f);
+        }
+        ++m_n;
+        return fs;
+    }
+
+    FeatureSet getRemainingFeatures() { return FeatureSet(); }
+
+private:
+    vector<float> m_values;
+    size_t m_n;
+};
+
+class TestPluginSummarisingAdapter : public QObject
+{
+    Q_OBJECT
+
+    typedef Vamp::HostExt::PluginSummarisingAdapter PSA;
+
+    static const int step = 512;
+
+    // Run the given values through an adapter, starting at the given
+    // step number, and return the adapter for summarising
+    PSA *run(const vector<float> &values, PSA::AccumulationMode mode,
+             int offset = 0) {
+        float rate = 44100.f;
+        PSA *adapter = new PSA(new ScriptedPlugin(rate, values));
+        adapter->setAccumulationMode(mode);
+        adapter->initialise(1, step, step);
+        vector<float> buffer(step, 0.f);
+        const float *buffers[1] = { buffer.data() };
+        for (int i = 0; i < int(values.size()); ++i) {
+            adapter->process(buffers, Vamp::RealTime::frame2RealTime
+                             ((offset + i) * step, int(rate)));
+        }
+        adapter->getRemainingFeatures();
+        return adapter;
+    }
+
+    float summary(PSA *adapter, PSA::SummaryType type,
+                  PSA::AveragingMethod avg = PSA::SampleAverage) {
+        Vamp::Plugin::FeatureList fl =
+            adapter->getSummaryForOutput(0, type, avg);
+        if (fl.size() != 1 || fl[0].values.size() != 1) return NAN;
+        return fl[0].values[0];
+    }
+
+    float percentile(PSA *adapter, float p,
+                     PSA::AveragingMethod avg = PSA::SampleAverage) {
+        Vamp::Plugin::FeatureList fl =
+            adapter->getPercentileForOutput(0, p, avg);
+        if (fl.size() != 1 || fl[0].values.size() != 1) return NAN;
+        return fl[0].values[0];
+    }
+
+    // Uniformly distributed in [0,1), the same on every run
+    vector<float> uniform(int n) {
+        vector<float> values;
+        unsigned int s = 1;
+        for (int i = 0; i < n; ++i) {
+            s = s * 1664525u + 1013904223u;
+            values.push_back(float(s >> 8) / float(1 << 24));
+        }
+        return values;
+    }
+
+    void compareExactSummaries(PSA *a, PSA *b) {
+        QCOMPARE(summary(a, PSA::Count), summary(b, PSA::Count));
+        QCOMPARE(summary(a, PSA::Minimum), summary(b, PSA::Minimum));
+        QCOMPARE(summary(a, PSA::Maximum), summary(b, PSA::Maximum));
+        QVERIFY(fabsf(summary(a, PSA::Sum) - summary(b, PSA::Sum)) < 1e-2f);
+        PSA::AveragingMethod avgs[] = {
+            PSA::SampleAverage, PSA::ContinuousTimeAverage
+        };
+        for (PSA::AveragingMethod avg: avgs) {
+            QVERIFY(fabsf(summary(a, PSA::Mean, avg) -
+                          summary(b, PSA::Mean, avg)) < 1e-5f);
+            QVERIFY(fabsf(summary(a, PSA::Variance, avg) -
+                          summary(b, PSA::Variance, avg)) < 1e-5f);
+        }
+    }
+
+private slots:
+    void sketchAccuracy() {
+        // Streaming percentiles of a long series with all values
+        // distinct, which the sketch has to approximate: within 1%
+        // in rank, which for a uniform series is 0.01 in value
+        vector<float> values = uniform(10000);
+        vector<float> sorted(values);
+        sort(sorted.begin(), sorted.end());
+        PSA *adapter = run(values, PSA::AccumulateStreaming);
+        float ps[] = { 1.f, 10.f, 25.f, 50.f, 75.f, 90.f, 99.f };
+        for (float p: ps) {
+            float exact = sorted[int(p / 100.f * float(sorted.size() - 1))];
+            QVERIFY(fabsf(percentile(adapter, p) - exact) < 0.01f);
+            QVERIFY(fabsf(percentile(adapter, p, PSA::ContinuousTimeAverage)
+                          - exact) < 0.01f);
+        }
+        QCOMPARE(percentile(adapter, 0.f), sorted[0]);
+        QCOMPARE(percentile(adapter, 100.f), sorted[sorted.size()-1]);
+        delete adapter;
+    }
+
+    void streamingMatchesAccumulateAll() {
+        vector<float> values = uniform(5000);
+        PSA *all = run(values, PSA::AccumulateAll);
+        PSA *streaming = run(values, PSA::AccumulateStreaming);
+        compareExactSummaries(all, streaming);
+        QVERIFY(fabsf(summary(all, PSA::Median) -
+                      summary(streaming, PSA::Median)) < 0.01f);
+        delete all;
+        delete streaming;
+    }
+
+    void fewDistinctValuesExact() {
+        // With few distinct values the sketches are exact, so the
+        // median and mode agree with AccumulateAll
+        vector<float> values;
+        for (int i = 0; i < 1001; ++i) values.push_back(float((i * 7) % 5));
+        PSA *all = run(values, PSA::AccumulateAll);
+        PSA *streaming = run(values, PSA::AccumulateStreaming);
+        QCOMPARE(summary(streaming, PSA::Median), summary(all, PSA::Median));
+        QCOMPARE(summary(streaming, PSA::Mode), summary(all, PSA::Mode));
+        QCOMPARE(summary(streaming, PSA::Mode, PSA::ContinuousTimeAverage),
+                 summary(all, PSA::Mode, PSA::ContinuousTimeAverage));
+        delete all;
+        delete streaming;
+    }
+
+    void percentileAfterAccumulateAll() {
+        // In AccumulateAll mode the sketch is built from the retained
+        // results on the first percentile request, after summarising
+        vector<float> values = uniform(2000);
+        PSA *adapter = run(values, PSA::AccumulateAll);
+        float median = summary(adapter, PSA::Median);
+        QVERIFY(fabsf(percentile(adapter, 50.f) - median) < 0.02f);
+        QVERIFY(fabsf(percentile(adapter, 50.f) - median) < 0.02f);
+        delete adapter;
+    }
+
+    void mergeSummaries() {
+        // Two adapters run on consecutive parts of a series, merged,
+        // give the same summaries as one adapter run on all of it
+        vector<float> values = uniform(10000);
+        vector<float> first(values.begin(), values.begin() + 6000);
+        vector<float> second(values.begin() + 6000, values.end());
+        PSA *a = run(first, PSA::AccumulateStreaming);
+        PSA *b = run(second, PSA::AccumulateStreaming, 6000);
+        PSA *whole = run(values, PSA::AccumulateStreaming);
+        QVERIFY(a->mergeSummaries(*b));
+        compareExactSummaries(a, whole);
+        QVERIFY(fabsf(percentile(a, 50.f) - percentile(whole, 50.f)) < 0.01f);
+        delete a;
+        delete b;
+        delete whole;
+    }
+
+    void mergeRequiresStreaming() {
+        vector<float> values = uniform(100);
+        PSA *a = run(values, PSA::AccumulateAll);
+        PSA *b = run(values, PSA::AccumulateStreaming, 100);
+        QVERIFY(!a->mergeSummaries(*b));
+        QVERIFY(!b->mergeSummaries(*a));
+        delete a;
+        delete b;
+    }
+};
+
+#endif
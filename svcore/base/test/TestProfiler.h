@@ -0,0 +1,145 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_PROFILER_H
+#define TEST_PROFILER_H
+
+#include "../Profiler.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <chrono>
+#include <thread>
+#include <map>
+
+using namespace std;
+
+class TestProfiler : public QObject
+{
+    Q_OBJECT
+
+private:
+    static void inner() {
+        Profiler profiler("TestProfiler::inner");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    static void outer() {
+        Profiler profiler("TestProfiler::outer");
+        inner();
+        inner();
+    }
+
+    static void unrecorded() {
+        Profiler profiler("TestProfiler::unrecorded");
+    }
+
+    QJsonArray getTrace() {
+        QString filename = QDir::temp().filePath("test-svcore-profiler.json");
+        if (!Profiles::getInstance()->exportTrace(filename)) {
+            return QJsonArray();
+        }
+        QFile file(filename);
+        if (!file.open(QFile::ReadOnly)) {
+            return QJsonArray();
+        }
+        QJsonParseError err;
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &err);
+        file.close();
+        QFile::remove(filename);
+        if (err.error != QJsonParseError::NoError) {
+            return QJsonArray();
+        }
+        return doc.object()["traceEvents"].toArray();
+    }
+
+    bool wasEnabled;
+    
+private slots:
+    void initTestCase() {
+        wasEnabled = Profiles::isEnabled();
+    }
+
+    void cleanupTestCase() {
+        Profiles::setEnabled(wasEnabled);
+    }
+
+    void disabled() {
+#ifdef NO_TIMING
+        QSKIP("Timing is compiled out in this build");
+#else
+        Profiles::setEnabled(false);
+        unrecorded();
+        Profiles::setEnabled(true);
+        for (auto v: getTrace()) {
+            QVERIFY(v.toObject()["name"].toString() !=
+                    "TestProfiler::unrecorded");
+        }
+#endif
+    }
+
+    void exportTrace() {
+#ifdef NO_TIMING
+        QSKIP("Timing is compiled out in this build");
+#else
+        Profiles::setEnabled(true);
+
+        // The other thread has exited by the time the trace is
+        // exported, so its events come from its retired log
+        std::thread other(outer);
+        outer();
+        other.join();
+
+        QJsonArray trace = getTrace();
+        QVERIFY(!trace.isEmpty());
+
+        // Each outer call should be on its own thread, and contain
+        // both of the inner calls made on that thread
+        
+        std::map<int, QJsonObject> outers;
+        std::map<int, std::vector<QJsonObject>> inners;
+        
+        for (auto v: trace) {
+            QJsonObject e = v.toObject();
+            if (e["ph"].toString() != "X") continue;
+            int tid = e["tid"].toInt();
+            if (e["name"].toString() == "TestProfiler::outer") {
+                outers[tid] = e;
+            } else if (e["name"].toString() == "TestProfiler::inner") {
+                inners[tid].push_back(e);
+            }
+        }
+
+        QCOMPARE(int(outers.size()), 2);
+
+        for (auto o: outers) {
+            double start = o.second["ts"].toDouble();
+            double end = start + o.second["dur"].toDouble();
+            QCOMPARE(int(inners[o.first].size()), 2);
+            for (auto i: inners[o.first]) {
+                QVERIFY(i["ts"].toDouble() >= start);
+                QVERIFY(i["ts"].toDouble() + i["dur"].toDouble() <= end);
+            }
+        }
+#endif
+    }
+};
+
+#endif
@@ -1,9 +1,12 @@
 TEST_HEADERS = \
 	     TestColumnOp.h \
 	     TestLogRange.h \
+	     TestMetrics.h \
 	     TestRangeMapper.h \
 	     TestOurRealTime.h \
 	     TestPitch.h \
+	     TestPluginSummarisingAdapter.h \
+	     TestProfiler.h \
 	     TestScaleTickIntervals.h \
 	     TestStringBits.h \
 	     TestVampRealTime.h
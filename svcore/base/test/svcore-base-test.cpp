@@ -18,7 +18,10 @@
 #include "TestStringBits.h"
 #include "TestOurRealTime.h"
 #include "TestVampRealTime.h"
+#include "TestPluginSummarisingAdapter.h"
 #include "TestColumnOp.h"
+#include "TestProfiler.h"
+#include "TestMetrics.h"
 
 #include <QtTest>
 
@@ -52,6 +55,11 @@ int main(int argc, char *argv[])
 	if (QTest::qExec(&t, argc, argv) == 0) ++good;
 	else ++bad;
     }
+    {
+        TestPluginSummarisingAdapter t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
     {
 	TestStringBits t;
 	if (QTest::qExec(&t, argc, argv) == 0) ++good;
@@ -72,6 +80,16 @@ int main(int argc, char *argv[])
 	if (QTest::qExec(&t, argc, argv) == 0) ++good;
 	else ++bad;
     }
+    {
+	TestProfiler t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+    {
+	TestMetrics t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
 
     if (bad > 0) {
 	cerr << "\n********* " << bad << " test suite(s) failed!\n" << endl;
@@ -0,0 +1,113 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "Benchmark.h"
+
+#include "base/Debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+static const int minRepetitions = 5;
+static const int maxRepetitions = 1000;
+static const double minTotalSeconds = 0.5;
+
+static QByteArray
+jsonEscape(QString s)
+{
+    QByteArray in = s.toUtf8(), out;
+    for (char c: in) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+Benchmark::Benchmark(QString filter) :
+    m_filter(filter),
+    m_runCount(0)
+{
+}
+
+bool
+Benchmark::wants(QString name) const
+{
+    return m_filter == "" || name.contains(m_filter);
+}
+
+void
+Benchmark::run(QString name, int64_t items, QString unit,
+               std::function<void()> work,
+               std::function<void()> setup)
+{
+    if (!wants(name)) return;
+    
+    typedef std::chrono::steady_clock clock;
+
+    if (setup) setup();
+    work(); // warm-up, untimed
+
+    std::vector<double> times;
+    double total = 0.0;
+
+    while ((int(times.size()) < minRepetitions || total < minTotalSeconds) &&
+           int(times.size()) < maxRepetitions) {
+        if (setup) setup();
+        auto start = clock::now();
+        work();
+        double t = std::chrono::duration<double>(clock::now() - start).count();
+        times.push_back(t);
+        total += t;
+    }
+
+    std::sort(times.begin(), times.end());
+    int n = int(times.size());
+    double median = (n % 2 ? times[n/2] : (times[n/2 - 1] + times[n/2]) / 2.0);
+    double minimum = times[0];
+    double mean = total / n;
+    double rate = (median > 0.0 ? double(items) / median : 0.0);
+
+    QByteArray nameUtf8 = jsonEscape(name);
+    QByteArray unitUtf8 = jsonEscape(unit);
+
+    printf("{\"benchmark\": \"%s\", \"repetitions\": %d, "
+           "\"median_ms\": %.6f, \"min_ms\": %.6f, \"mean_ms\": %.6f, "
+           "\"items\": %lld, \"unit\": \"%s\", \"items_per_second\": %.3f}\n",
+           nameUtf8.data(), n, median * 1000.0, minimum * 1000.0,
+           mean * 1000.0, (long long)items, unitUtf8.data(), rate);
+    fflush(stdout);
+
+    SVCERR << name << ": " << median * 1000.0 << " ms median over "
+           << n << " repetitions (" << rate << " " << unit << "/sec)"
+           << endl;
+
+    ++m_runCount;
+}
+
+void
+Benchmark::skip(QString name, QString reason)
+{
+    if (!wants(name)) return;
+    
+    QByteArray nameUtf8 = jsonEscape(name);
+    QByteArray reasonUtf8 = jsonEscape(reason);
+
+    printf("{\"benchmark\": \"%s\", \"skipped\": \"%s\"}\n",
+           nameUtf8.data(), reasonUtf8.data());
+    fflush(stdout);
+
+    SVCERR << name << ": skipped (" << reason << ")" << endl;
+}
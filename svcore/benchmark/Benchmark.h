@@ -0,0 +1,73 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_BENCHMARK_H
+#define SV_BENCHMARK_H
+
+#include <QString>
+
+#include <functional>
+#include <cstdint>
+
+/**
+ * Minimal timing harness for the svcore benchmarks. Each benchmark
+ * is a function that performs a fixed amount of work (a number of
+ * "items", such as FFT columns or decoded frames); the runner calls
+ * it repeatedly, after an untimed warm-up run, until it has both a
+ * minimum number of repetitions and a minimum total running time,
+ * then reports the median, minimum and mean time per repetition and
+ * the median throughput.
+ *
+ * Results are written to stdout as JSON Lines, one object per
+ * benchmark, so that runs can be collected and compared by scripts:
+ *
+ *   {"benchmark": "...", "repetitions": n, "median_ms": t, "min_ms": t,
+ *    "mean_ms": t, "items": n, "unit": "...", "items_per_second": r}
+ *
+ * A human-readable summary of each result goes to stderr.
+ */
+class Benchmark
+{
+public:
+    /**
+     * Construct a runner that only runs benchmarks whose names
+     * contain the given filter string (or all, if it is empty).
+     */
+    Benchmark(QString filter = "");
+
+    /**
+     * Run and report a benchmark. If setup is supplied, it is called
+     * (untimed) before every repetition, for benchmarks that need
+     * fresh state each time, such as an empty cache.
+     */
+    void run(QString name, int64_t items, QString unit,
+             std::function<void()> work,
+             std::function<void()> setup = std::function<void()>());
+
+    /**
+     * Report that a benchmark could not be run, for example because
+     * a plugin or file it uses is not available.
+     */
+    void skip(QString name, QString reason);
+
+    bool wants(QString name) const;
+
+    int getRunCount() const { return m_runCount; }
+    
+private:
+    QString m_filter;
+    int m_runCount;
+};
+
+#endif
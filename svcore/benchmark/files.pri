@@ -0,0 +1,7 @@
+
+BENCHMARK_HEADERS += \
+	Benchmark.h
+
+BENCHMARK_SOURCES += \
+	Benchmark.cpp \
+	svcore-benchmark.cpp
@@ -0,0 +1,400 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "Benchmark.h"
+
+#include "data/model/test/MockWaveModel.h"
+
+#include "data/model/FFTModel.h"
+#include "data/model/Dense3DModelPeakCache.h"
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/ReadOnlyWaveFileModel.h"
+
+#include "data/fileio/AudioFileReaderFactory.h"
+#include "data/fileio/AudioFileReader.h"
+#include "data/fileio/CSVFileReader.h"
+#include "data/fileio/CSVFormat.h"
+#include "data/fileio/FileSource.h"
+
+#include "transform/FeatureExtractionModelTransformer.h"
+#include "transform/TransformFactory.h"
+
+#include "base/Debug.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QThread>
+
+#include <cmath>
+
+// Run as
+//
+//   benchmark-svcore [-f <filter>] [<testdir>]
+//
+// where <testdir> is the svcore/data/fileio/test directory containing
+// the test audio (default: as found from the top of the source tree)
+// and <filter> restricts the run to benchmarks whose names contain it.
+
+static void
+benchmarkFFTModel(Benchmark &b)
+{
+    const int length = 44100 * 10;
+    MockWaveModel model({ Sine }, length, 0);
+
+    for (int windowSize: { 512, 2048 }) {
+
+        FFTModel fftm(&model, 0, HanningWindow, windowSize, windowSize / 4,
+                      windowSize);
+        int width = fftm.getWidth();
+        int height = fftm.getHeight();
+        std::vector<float> mags(height);
+
+        b.run(QString("fftmodel.magnitudes.%1").arg(windowSize),
+              width, "columns",
+              [&]() {
+                  for (int x = 0; x < width; ++x) {
+                      fftm.getMagnitudesAt(x, mags.data());
+                  }
+              });
+    }
+}
+
+static void
+benchmarkPeakCache(Benchmark &b)
+{
+    const int width = 20000, height = 512, columnsPerPeak = 8;
+    
+    EditableDenseThreeDimensionalModel source
+        (44100, 256, height, EditableDenseThreeDimensionalModel::NoCompression,
+         false);
+
+    EditableDenseThreeDimensionalModel::Column column(height);
+    for (int x = 0; x < width; ++x) {
+        for (int y = 0; y < height; ++y) {
+            column[y] = float(((x * 31 + y * 17) % 1000) / 1000.0);
+        }
+        source.setColumn(x, column);
+    }
+
+    Dense3DModelPeakCache *cache = 0;
+    int peaks = width / columnsPerPeak;
+    
+    b.run("dense3dmodelpeakcache.fill", peaks, "peak columns",
+          [&]() {
+              for (int x = 0; x < peaks; ++x) {
+                  (void)cache->getColumn(x);
+              }
+          },
+          [&]() {
+              delete cache;
+              cache = new Dense3DModelPeakCache(&source, columnsPerPeak);
+          });
+
+    // Each benchmark may run alone under a filter, so this one fills
+    // its own cache if the one above did not
+    b.run("dense3dmodelpeakcache.cached", peaks, "peak columns",
+          [&]() {
+              for (int x = 0; x < peaks; ++x) {
+                  (void)cache->getColumn(x);
+              }
+          },
+          [&]() {
+              if (cache) return;
+              cache = new Dense3DModelPeakCache(&source, columnsPerPeak);
+              for (int x = 0; x < peaks; ++x) {
+                  (void)cache->getColumn(x);
+              }
+          });
+
+    delete cache;
+}
+
+static void
+benchmarkSparseModel(Benchmark &b)
+{
+    const int count = 100000;
+    SparseTimeValueModel *model = 0;
+
+    auto populate = [&]() {
+        for (int i = 0; i < count; ++i) {
+            // Mostly in order, as with plugin output, but with some
+            // points arriving late
+            sv_frame_t frame = sv_frame_t(i) * 100;
+            if (i % 10 == 9) frame -= 550;
+            model->addPoint(SparseTimeValueModel::Point
+                            (frame, float(i % 100), ""));
+        }
+    };
+
+    b.run("sparsemodel.insert", count, "points",
+          populate,
+          [&]() {
+              delete model;
+              model = new SparseTimeValueModel(44100, 1, false);
+          });
+
+    const int queries = 10000;
+    const sv_frame_t extent = sv_frame_t(count) * 100;
+    
+    b.run("sparsemodel.rangequery", queries, "queries",
+          [&]() {
+              size_t found = 0;
+              for (int i = 0; i < queries; ++i) {
+                  sv_frame_t start = (sv_frame_t(i) * 7919 * 100) % extent;
+                  found += model->getPoints(start, start + 44100).size();
+              }
+              if (found == 0) SVCERR << "(no points found)" << endl;
+          },
+          [&]() {
+              // As above, in case the insert benchmark was filtered out
+              if (model) return;
+              model = new SparseTimeValueModel(44100, 1, false);
+              populate();
+          });
+
+    delete model;
+}
+
+static void
+waitForReady(Model *model)
+{
+    while (!model->isReady()) {
+        QThread::msleep(1);
+    }
+}
+
+static void
+benchmarkWaveFileModel(Benchmark &b, QString audioDir)
+{
+    QString path = QDir(audioDir).filePath("wav/44100-2-16.wav");
+    if (!QFileInfo(path).exists()) {
+        b.skip("readonlywavefilemodel.fill", "test file not found: " + path);
+        return;
+    }
+
+    ReadOnlyWaveFileModel *model = 0;
+    sv_frame_t frames = 0;
+
+    b.run("readonlywavefilemodel.fill", 1, "files",
+          [&]() {
+              delete model;
+              model = new ReadOnlyWaveFileModel(FileSource(path));
+              waitForReady(model);
+              frames = model->getEndFrame();
+          });
+
+    const std::vector<int> zooms { 16, 256, 4096 };
+    auto summariesName = [](int zoom) {
+        return QString("readonlywavefilemodel.summaries.%1").arg(zoom);
+    };
+
+    bool wantSummaries = false;
+    for (int zoom: zooms) {
+        if (b.wants(summariesName(zoom))) wantSummaries = true;
+    }
+    if (!wantSummaries) {
+        delete model;
+        return;
+    }
+
+    if (!model) {
+        // Not loaded above, because that benchmark was filtered out
+        model = new ReadOnlyWaveFileModel(FileSource(path));
+        waitForReady(model);
+        frames = model->getEndFrame();
+    }
+
+    if (!model->isOK() || frames == 0) {
+        b.skip("readonlywavefilemodel.summaries", "failed to load " + path);
+        delete model;
+        return;
+    }
+    
+    const int pixels = 1000;
+    
+    for (int zoom: zooms) {
+        b.run(summariesName(zoom), pixels, "pixels",
+              [&]() {
+                  RangeSummarisableTimeValueModel::RangeBlock ranges;
+                  int blockSize = zoom;
+                  sv_frame_t count = std::min(frames, sv_frame_t(zoom) * pixels);
+                  for (int ch = 0; ch < model->getChannelCount(); ++ch) {
+                      model->getSummaries(ch, 0, count, ranges, blockSize);
+                  }
+              });
+    }
+
+    delete model;
+}
+
+static void
+benchmarkAudioReaders(Benchmark &b, QString audioDir)
+{
+    QStringList formats = QDir(audioDir).entryList(QDir::Dirs |
+                                                   QDir::NoDotAndDotDot);
+    if (formats.empty()) {
+        b.skip("audiofilereader", "no test audio found in " + audioDir);
+        return;
+    }
+    
+    for (QString format: formats) {
+
+        QStringList files = QDir(QDir(audioDir).filePath(format))
+            .entryList(QDir::Files);
+
+        for (QString file: files) {
+
+            QString name = QString("audiofilereader.%1.%2").arg(format).arg(file);
+            if (!b.wants(name)) continue;
+            
+            QString path = audioDir + "/" + format + "/" + file;
+
+            AudioFileReaderFactory::Parameters params;
+            AudioFileReader *probe = AudioFileReaderFactory::createReader
+                (path, params);
+            if (!probe || !probe->isOK()) {
+                delete probe;
+                b.skip(name, "no reader available for this file");
+                continue;
+            }
+            sv_frame_t frames = probe->getFrameCount();
+            delete probe;
+
+            b.run(name, frames, "frames",
+                  [&]() {
+                      AudioFileReader *reader =
+                          AudioFileReaderFactory::createReader(path, params);
+                      floatvec_t data = reader->getInterleavedFrames
+                          (0, reader->getFrameCount());
+                      delete reader;
+                  });
+        }
+    }
+}
+
+static void
+benchmarkCSVImport(Benchmark &b)
+{
+    QString name = "csvfilereader.timevalue";
+    if (!b.wants(name)) return;
+
+    QTemporaryFile file;
+    if (!file.open()) {
+        b.skip(name, "failed to create temporary file");
+        return;
+    }
+    
+    const int count = 200000;
+    for (int n = 0; n < count; ++n) {
+        file.write(QByteArray::number(n * 0.01, 'f', 2) + "," +
+                   QByteArray::number(n % 100) + "\n");
+    }
+    file.close();
+
+    CSVFormat format;
+    format.setModelType(CSVFormat::TwoDimensionalModel);
+    format.setTimingType(CSVFormat::ExplicitTiming);
+    format.setTimeUnits(CSVFormat::TimeSeconds);
+    format.setSeparator(',');
+    format.setAllowQuoting(true);
+    format.setColumnCount(2);
+    QList<CSVFormat::ColumnPurpose> purposes;
+    purposes << CSVFormat::ColumnStartTime << CSVFormat::ColumnValue;
+    format.setColumnPurposes(purposes);
+
+    b.run(name, count, "rows",
+          [&]() {
+              CSVFileReader reader(file.fileName(), format, 44100);
+              delete reader.load();
+          });
+}
+
+static void
+benchmarkFeatureExtraction(Benchmark &b)
+{
+    const int length = 44100 * 60;
+    MockWaveModel model({ Sine }, length, 0);
+
+    // One time-domain and one frequency-domain plugin from the Vamp
+    // SDK examples, if they are installed
+    QStringList ids;
+    ids << "vamp:vamp-example-plugins:amplitudefollower:amplitude"
+        << "vamp:vamp-example-plugins:spectralcentroid:logcentroid";
+
+    for (QString id: ids) {
+
+        QString name = "featureextraction." + id.section(':', 2, 2);
+        if (!b.wants(name)) continue;
+        
+        if (!TransformFactory::getInstance()->haveTransform(id)) {
+            b.skip(name, "plugin not installed");
+            continue;
+        }
+        
+        Transform transform = TransformFactory::getInstance()->
+            getDefaultTransformFor(id, model.getSampleRate());
+
+        int step = transform.getStepSize();
+        if (step <= 0) step = 1024; // made consistent with plugin later
+        
+        b.run(name, length / step, "blocks",
+              [&]() {
+                  FeatureExtractionModelTransformer transformer
+                      (ModelTransformer::Input(&model), transform);
+                  transformer.start();
+                  transformer.wait();
+                  if (transformer.getMessage() != "") {
+                      SVCERR << name << ": " << transformer.getMessage()
+                             << endl;
+                  }
+              });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("sonic-visualiser");
+    app.setApplicationName("benchmark-svcore");
+
+    QString filter;
+    QString testDir = "svcore/data/fileio/test";
+
+    QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "-f" && i + 1 < args.size()) {
+            filter = args[++i];
+        } else {
+            testDir = args[i];
+        }
+    }
+
+    QString audioDir = testDir + "/audio";
+    
+    Benchmark b(filter);
+
+    benchmarkFFTModel(b);
+    benchmarkPeakCache(b);
+    benchmarkSparseModel(b);
+    benchmarkWaveFileModel(b, audioDir);
+    benchmarkAudioReaders(b, audioDir);
+    benchmarkCSVImport(b);
+    benchmarkFeatureExtraction(b);
+
+    SVCERR << b.getRunCount() << " benchmark(s) run" << endl;
+    return 0;
+}
@@ -17,6 +17,13 @@
 
 using std::vector;
 
+void
+AudioFileReader::getInterleavedFramesInto(sv_frame_t start, sv_frame_t count,
+                                          floatvec_t &buffer) const
+{
+    buffer = getInterleavedFrames(start, count);
+}
+
 vector<floatvec_t>
 AudioFileReader::getDeInterleavedFrames(sv_frame_t start, sv_frame_t count) const
 {
@@ -120,6 +120,19 @@ public:
     virtual floatvec_t getInterleavedFrames(sv_frame_t start,
                                             sv_frame_t count) const = 0;
 
+    /**
+     * As getInterleavedFrames, but write the samples into the given
+     * vector, resizing it to fit. A vector keeps its capacity when
+     * resized, so a caller that passes the same vector each time
+     * will not cause any allocation once it has grown large enough
+     * (provided the subclass overrides this function -- the default
+     * implementation just assigns the result of
+     * getInterleavedFrames).
+     */
+    virtual void getInterleavedFramesInto(sv_frame_t start,
+                                          sv_frame_t count,
+                                          floatvec_t &buffer) const;
+
     /**
      * Return de-interleaved samples for count frames from index
      * start.  Implemented in this class (it calls
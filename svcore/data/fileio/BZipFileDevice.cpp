@@ -18,8 +18,12 @@
 #include <bzlib.h>
 
 #include <iostream>
+#include <cstring>
+
+#include <QThread>
 
 #include "base/Debug.h"
+#include "base/Thread.h"
 
 // for dup:
 #ifdef _MSC_VER
@@ -28,20 +32,149 @@
 #include <unistd.h>
 #endif
 
-BZipFileDevice::BZipFileDevice(QString fileName) :
+// In parallel mode, written data is cut into pieces of this size,
+// each of which is compressed separately into a single bzip2 block
+// and then spliced into one output stream. The size must be small
+// enough that the block can't overflow even at the worst-case
+// expansion (5/4) of bzip2's initial run-length encoding, which at
+// level 9 means under 0.8 * 899981 bytes
+static const int blockInputSize = 700000;
+
+// The 48-bit markers that begin each block and end each stream. These
+// are not byte-aligned in general
+static const unsigned long long blockMagic = 0x314159265359ULL;
+static const unsigned long long streamEndMagic = 0x177245385090ULL;
+
+// The 32-bit stream header "BZh9"
+static const int streamHeaderBits = 32;
+
+static unsigned int
+getBits(const uchar *data, qint64 pos, int n)
+{
+    // Return n (<= 32) bits starting at bit pos, counting from the
+    // most significant bit of the first byte as bzip2 does
+    qint64 byte = pos >> 3;
+    int offset = int(pos & 7);
+    int nbytes = (offset + n + 7) / 8;
+    unsigned long long v = 0;
+    for (int i = 0; i < nbytes; ++i) {
+        v = (v << 8) | data[byte + i];
+    }
+    v >>= (nbytes * 8 - offset - n);
+    return (unsigned int)(v & ((1ULL << n) - 1));
+}
+
+static unsigned long long
+getMagic(const uchar *data, qint64 pos)
+{
+    return ((unsigned long long)getBits(data, pos, 16) << 32) |
+        getBits(data, pos + 16, 32);
+}
+
+static void
+putBits(QByteArray &out, unsigned long long &buffer, int &count,
+        unsigned int value, int n)
+{
+    buffer = (buffer << n) | (value & ((1ULL << n) - 1));
+    count += n;
+    while (count >= 8) {
+        out.append(char((buffer >> (count - 8)) & 0xff));
+        count -= 8;
+    }
+    buffer &= ((1ULL << count) - 1);
+}
+
+static void
+putBytes(QByteArray &out, unsigned long long &buffer, int &count,
+         const char *bytes)
+{
+    while (*bytes) {
+        putBits(out, buffer, count, uchar(*bytes++), 8);
+    }
+}
+
+static void
+copyBits(QByteArray &out, unsigned long long &buffer, int &count,
+         const uchar *data, qint64 from, qint64 to)
+{
+    while (to - from >= 32) {
+        putBits(out, buffer, count, getBits(data, from, 32), 32);
+        from += 32;
+    }
+    if (to > from) {
+        int n = int(to - from);
+        putBits(out, buffer, count, getBits(data, from, n), n);
+    }
+}
+
+static void
+putStreamEnd(QByteArray &out, unsigned long long &buffer, int &count,
+             unsigned int crc)
+{
+    putBits(out, buffer, count, (unsigned int)(streamEndMagic >> 32), 16);
+    putBits(out, buffer, count, (unsigned int)(streamEndMagic), 32);
+    putBits(out, buffer, count, crc, 32);
+    if (count > 0) {
+        putBits(out, buffer, count, 0, 8 - count);
+    }
+}
+
+class BZipFileDevice::CompressThread : public Thread
+{
+public:
+    CompressThread(const QByteArray &input, Block &block) :
+        m_input(input), m_block(block) { }
+
+    virtual void run() {
+        m_block.ok = compressBlock(m_input, m_block);
+    }
+
+private:
+    const QByteArray &m_input;
+    Block &m_block;
+};
+
+class BZipFileDevice::DecompressThread : public Thread
+{
+public:
+    DecompressThread(const uchar *data, Block &block) :
+        m_data(data), m_block(block) { }
+
+    virtual void run() {
+        m_block.ok = decompressBlock(m_data, m_block);
+    }
+
+private:
+    const uchar *m_data;
+    Block &m_block;
+};
+
+BZipFileDevice::BZipFileDevice(QString fileName, bool parallel) :
     m_fileName(fileName),
+    m_parallel(parallel),
     m_qfile(fileName),
     m_file(0),
     m_bzFile(0),
     m_atEnd(true),
-    m_ok(true)
+    m_ok(true),
+    m_blockWriting(false),
+    m_bitBuffer(0),
+    m_bitCount(0),
+    m_combinedCRC(0),
+    m_blockReading(false),
+    m_mapped(0),
+    m_data(0),
+    m_dataSize(0),
+    m_nextBlock(0),
+    m_decodedPos(0),
+    m_delivered(0)
 {
 }
 
 BZipFileDevice::~BZipFileDevice()
 {
 //    SVDEBUG << "BZipFileDevice::~BZipFileDevice(" << m_fileName << ")" << endl;
-    if (m_bzFile) close();
+    if (m_bzFile || m_blockWriting || m_blockReading) close();
 }
 
 bool
@@ -55,7 +188,7 @@ BZipFileDevice::open(OpenMode mode)
 {
     setErrorString("");
 
-    if (m_bzFile) {
+    if (m_bzFile || m_blockWriting || m_blockReading) {
         setErrorString(tr("File is already open"));
         return false;
     }
@@ -98,6 +231,9 @@ BZipFileDevice::open(OpenMode mode)
     //
     // Note that bz2 will *not* fclose the FILE* it was passed, so we
     // don't have a problem with calling both bzWriteClose and fclose.
+    //
+    // None of this applies in parallel mode, where we compress and
+    // decompress whole blocks in memory and do our own file I/O.
 
     if (mode & WriteOnly) {
 
@@ -107,6 +243,17 @@ BZipFileDevice::open(OpenMode mode)
             return false;
         }
         
+        if (m_parallel) {
+            if (!openBlockWriter()) {
+                m_qfile.close();
+                m_ok = false;
+                return false;
+            }
+            setErrorString(QString());
+            setOpenMode(mode);
+            return true;
+        }
+
         m_file = fdopen(dup(m_qfile.handle()), "wb");
         if (!m_file) {
             setErrorString(tr("Failed to open file handle for writing"));
@@ -142,23 +289,10 @@ BZipFileDevice::open(OpenMode mode)
             return false;
         }
         
-        m_file = fdopen(dup(m_qfile.handle()), "rb");
-        if (!m_file) {
-            setErrorString(tr("Failed to open file handle for reading"));
-            m_ok = false;
-            return false;
-        }
-
-        int bzError = BZ_OK;
-        m_bzFile = BZ2_bzReadOpen(&bzError, m_file, 0, 0, NULL, 0);
-
-        if (!m_bzFile) {
-            fclose(m_file);
-            m_file = 0;
-            m_qfile.close();
-            setErrorString(tr("Failed to open bzip2 stream for reading"));
-            m_ok = false;
-            return false;
+        if (!(m_parallel && openBlockReader())) {
+            if (!openSerialReader()) {
+                return false;
+            }
         }
 
 //        cerr << "BZipFileDevice: opened \"" << m_fileName << "\" for reading" << endl;
@@ -175,10 +309,39 @@ BZipFileDevice::open(OpenMode mode)
     return false;
 }
 
+bool
+BZipFileDevice::openSerialReader()
+{
+    m_file = fdopen(dup(m_qfile.handle()), "rb");
+    if (!m_file) {
+        setErrorString(tr("Failed to open file handle for reading"));
+        m_ok = false;
+        return false;
+    }
+
+    // The fd is shared with the QFile, which may already have read
+    // from it if we tried and abandoned a parallel read
+    fseek(m_file, 0, SEEK_SET);
+
+    int bzError = BZ_OK;
+    m_bzFile = BZ2_bzReadOpen(&bzError, m_file, 0, 0, NULL, 0);
+
+    if (!m_bzFile) {
+        fclose(m_file);
+        m_file = 0;
+        m_qfile.close();
+        setErrorString(tr("Failed to open bzip2 stream for reading"));
+        m_ok = false;
+        return false;
+    }
+
+    return true;
+}
+
 void
 BZipFileDevice::close()
 {
-    if (!m_bzFile) {
+    if (!m_bzFile && !m_blockWriting && !m_blockReading) {
         setErrorString(tr("File not open"));
         m_ok = false;
         return;
@@ -187,6 +350,12 @@ BZipFileDevice::close()
     int bzError = BZ_OK;
 
     if (openMode() & WriteOnly) {
+        if (m_blockWriting) {
+            closeBlockWriter();
+            m_qfile.close();
+            m_ok = false;
+            return;
+        }
         unsigned int in = 0, out = 0;
         BZ2_bzWriteClose(&bzError, m_bzFile, 0, &in, &out);
 //	cerr << "Wrote bzip2 stream (in=" << in << ", out=" << out << ")" << endl;
@@ -202,6 +371,12 @@ BZipFileDevice::close()
     }
 
     if (openMode() & ReadOnly) {
+        if (m_blockReading) {
+            closeBlockReader();
+            m_qfile.close();
+            m_ok = false;
+            return;
+        }
         BZ2_bzReadClose(&bzError, m_bzFile);
         if (bzError != BZ_OK) {
             setErrorString(tr("bzip2 stream read close error"));
@@ -223,6 +398,10 @@ BZipFileDevice::readData(char *data, qint64 maxSize)
 {
     if (m_atEnd) return 0;
 
+    if (m_blockReading) {
+        return readBlocks(data, maxSize);
+    }
+
     int bzError = BZ_OK;
     int read = BZ2_bzRead(&bzError, m_bzFile, data, int(maxSize));
 
@@ -246,6 +425,10 @@ BZipFileDevice::readData(char *data, qint64 maxSize)
 qint64
 BZipFileDevice::writeData(const char *data, qint64 maxSize)
 {
+    if (m_blockWriting) {
+        return writeBlocks(data, maxSize);
+    }
+
     int bzError = BZ_OK;
     BZ2_bzWrite(&bzError, m_bzFile, (void *)data, int(maxSize));
 
@@ -263,3 +446,429 @@ BZipFileDevice::writeData(const char *data, qint64 maxSize)
     return maxSize;
 }
 
+// Parallel writing.
+//
+// Each piece of input is compressed on its own, by libbz2, into a
+// complete single-block stream. We then take just the block from each
+// of those (the bits between the stream header and the end-of-stream
+// marker) and write them one after another into a single output
+// stream, followed by an end-of-stream marker with the combined CRC
+// calculated from the CRCs of all the blocks. Blocks are not
+// byte-aligned, so this splicing has to be done bitwise. The result
+// is exactly what a single-threaded bzip2 would have produced, had it
+// chosen the same block boundaries.
+
+bool
+BZipFileDevice::openBlockWriter()
+{
+    m_input.clear();
+    m_pending.clear();
+    m_output.clear();
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+    m_combinedCRC = 0;
+    putBytes(m_output, m_bitBuffer, m_bitCount, "BZh9");
+    m_blockWriting = true;
+    return true;
+}
+
+qint64
+BZipFileDevice::writeBlocks(const char *data, qint64 size)
+{
+    if (!m_ok) return -1;
+
+    qint64 written = 0;
+
+    while (written < size) {
+        int n = blockInputSize - m_input.size();
+        if (n > size - written) n = int(size - written);
+        m_input.append(data + written, n);
+        written += n;
+        if (m_input.size() == blockInputSize) {
+            m_pending.push_back(m_input);
+            m_input = QByteArray();
+            m_input.reserve(blockInputSize);
+            if (int(m_pending.size()) >= QThread::idealThreadCount()) {
+                if (!compressPendingBlocks()) return -1;
+            }
+        }
+    }
+
+    return written;
+}
+
+bool
+BZipFileDevice::compressPendingBlocks()
+{
+    int n = int(m_pending.size());
+    if (n == 0) return true;
+
+    std::vector<Block> blocks(n);
+
+    if (n == 1) {
+        blocks[0].ok = compressBlock(m_pending[0], blocks[0]);
+    } else {
+        std::vector<CompressThread *> threads;
+        for (int i = 0; i < n; ++i) {
+            threads.push_back(new CompressThread(m_pending[i], blocks[i]));
+            threads[i]->start();
+        }
+        for (int i = 0; i < n; ++i) {
+            threads[i]->wait();
+            delete threads[i];
+        }
+    }
+
+    m_pending.clear();
+
+    for (int i = 0; i < n; ++i) {
+        if (!blocks[i].ok) {
+            cerr << "BZipFileDevice::compressPendingBlocks: error condition"
+                 << endl;
+            setErrorString(tr("bzip2 stream write error"));
+            m_ok = false;
+            return false;
+        }
+        copyBits(m_output, m_bitBuffer, m_bitCount,
+                 (const uchar *)blocks[i].data.constData(),
+                 blocks[i].startBit, blocks[i].endBit);
+        m_combinedCRC = ((m_combinedCRC << 1) | (m_combinedCRC >> 31));
+        m_combinedCRC ^= blocks[i].crc;
+    }
+
+    if (m_qfile.write(m_output) != m_output.size()) {
+        setErrorString(tr("bzip2 stream write error"));
+        m_ok = false;
+        return false;
+    }
+    m_output.clear();
+
+    return true;
+}
+
+bool
+BZipFileDevice::closeBlockWriter()
+{
+    bool ok = m_ok;
+
+    if (ok && !m_input.isEmpty()) {
+        m_pending.push_back(m_input);
+        m_input.clear();
+    }
+    if (ok) {
+        ok = compressPendingBlocks();
+    }
+    if (ok) {
+        putStreamEnd(m_output, m_bitBuffer, m_bitCount, m_combinedCRC);
+        if (m_qfile.write(m_output) != m_output.size()) {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        setErrorString(tr("bzip2 stream write close error"));
+    }
+
+    m_input.clear();
+    m_pending.clear();
+    m_output.clear();
+    m_blockWriting = false;
+    return ok;
+}
+
+bool
+BZipFileDevice::compressBlock(const QByteArray &input, Block &block)
+{
+    unsigned int size = input.size() + input.size() / 100 + 600;
+    block.data.resize(size);
+
+    int rv = BZ2_bzBuffToBuffCompress
+        (block.data.data(), &size, (char *)input.constData(), input.size(),
+         9, 0, 0);
+    if (rv != BZ_OK) return false;
+
+    block.data.resize(size);
+    const uchar *data = (const uchar *)block.data.constData();
+    qint64 bits = qint64(size) * 8;
+
+    // The block follows the stream header, and its CRC follows the
+    // block magic. We expect exactly one block, so the stream CRC
+    // must be the same as the block CRC
+
+    block.startBit = streamHeaderBits;
+    if (bits < block.startBit + 48 + 32 + 48 + 32) return false;
+    if (getMagic(data, block.startBit) != blockMagic) return false;
+    block.crc = getBits(data, block.startBit + 48, 32);
+
+    // Find the end-of-stream marker, which comes before 0-7 bits of
+    // padding at the end
+    for (int pad = 0; pad < 8; ++pad) {
+        qint64 end = bits - 80 - pad;
+        if (getMagic(data, end) == streamEndMagic &&
+            getBits(data, end + 48, 32) == block.crc) {
+            block.endBit = end;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Parallel reading.
+//
+// We scan the whole compressed file for block and end-of-stream
+// markers. Each block runs from its own marker to the next marker of
+// either kind. To decompress a block, we wrap it up as a complete
+// single-block stream (header, block, end-of-stream marker and
+// the block's own CRC as the stream CRC) and hand it to libbz2, which
+// verifies the block CRC as it goes. That also copes with files made
+// of several concatenated streams, as written by some parallel
+// compressors.
+//
+// Block markers are not escaped in the compressed data, so a marker
+// could in principle appear by chance within a block. If that happens
+// the block will fail to decompress, and we fall back to reading the
+// file serially from the point we had reached.
+
+bool
+BZipFileDevice::openBlockReader()
+{
+    m_dataSize = m_qfile.size();
+
+    m_mapped = m_qfile.map(0, m_dataSize);
+    if (m_mapped) {
+        m_data = m_mapped;
+    } else {
+        m_compressed = m_qfile.readAll();
+        m_data = (const uchar *)m_compressed.constData();
+        m_dataSize = m_compressed.size();
+    }
+
+    m_blocks.clear();
+
+    bool ok = (m_dataSize >= 4 &&
+               m_data[0] == 'B' && m_data[1] == 'Z' && m_data[2] == 'h' &&
+               m_data[3] >= '1' && m_data[3] <= '9');
+
+    bool inBlock = false;
+    bool first = true;
+    unsigned long long window = 0;
+    const unsigned long long mask = (1ULL << 48) - 1;
+
+    for (qint64 i = 0; ok && i < m_dataSize; ++i) {
+
+        window = (window << 8) | m_data[i];
+        if (i < 6) continue;
+
+        // Check every bit alignment of a marker ending in this byte,
+        // in order of increasing start position
+
+        for (int shift = 7; shift >= 0; --shift) {
+
+            qint64 start = (i + 1) * 8 - shift - 48;
+            if (start < streamHeaderBits) continue;
+
+            unsigned long long candidate = (window >> shift) & mask;
+            bool isBlock = (candidate == blockMagic);
+            bool isEnd = (candidate == streamEndMagic);
+            if (!isBlock && !isEnd) continue;
+
+            if (first) {
+                // The first marker must immediately follow the header
+                if (start != streamHeaderBits) ok = false;
+                first = false;
+            }
+
+            if (inBlock) {
+                m_blocks.back().endBit = start;
+                inBlock = false;
+            }
+
+            if (isBlock) {
+                if (start + 48 + 32 > m_dataSize * 8) {
+                    ok = false;
+                    break;
+                }
+                Block block;
+                block.startBit = start;
+                block.endBit = start;
+                block.crc = getBits(m_data, start + 48, 32);
+                block.ok = false;
+                m_blocks.push_back(block);
+                inBlock = true;
+            }
+        }
+    }
+
+    if (first || inBlock) {
+        // no markers at all, or a block with no end: not a file we
+        // can split, or truncated
+        ok = false;
+    }
+
+    if (!ok) {
+        closeBlockReader();
+        return false;
+    }
+
+    SVDEBUG << "BZipFileDevice::openBlockReader: found " << m_blocks.size()
+            << " blocks in " << m_dataSize << " bytes" << endl;
+
+    m_nextBlock = 0;
+    m_decoded.clear();
+    m_decodedPos = 0;
+    m_delivered = 0;
+    m_blockReading = true;
+    return true;
+}
+
+qint64
+BZipFileDevice::readBlocks(char *data, qint64 maxSize)
+{
+    while (m_decodedPos >= m_decoded.size()) {
+
+        if (m_nextBlock >= m_blocks.size()) {
+            m_atEnd = true;
+            return 0;
+        }
+
+        if (decompressNextBlocks()) continue;
+
+        SVDEBUG << "BZipFileDevice::readBlocks: block decompression failed, "
+                << "falling back to serial read from " << m_delivered
+                << " bytes" << endl;
+
+        qint64 toSkip = m_delivered;
+        closeBlockReader();
+        if (!openSerialReader()) {
+            return -1;
+        }
+
+        char buffer[65536];
+        while (toSkip > 0) {
+            qint64 n = (toSkip < qint64(sizeof(buffer)) ?
+                        toSkip : qint64(sizeof(buffer)));
+            qint64 read = readData(buffer, n);
+            if (read < 0) return -1;
+            if (read == 0 && m_atEnd) break;
+            toSkip -= read;
+        }
+        if (toSkip > 0) {
+            cerr << "BZipFileDevice::readBlocks: error condition" << endl;
+            setErrorString(tr("bzip2 stream read error"));
+            m_ok = false;
+            return -1;
+        }
+
+        return readData(data, maxSize);
+    }
+
+    qint64 n = m_decoded.size() - m_decodedPos;
+    if (n > maxSize) n = maxSize;
+    memcpy(data, m_decoded.constData() + m_decodedPos, size_t(n));
+    m_decodedPos += int(n);
+    m_delivered += n;
+    return n;
+}
+
+bool
+BZipFileDevice::decompressNextBlocks()
+{
+    int n = QThread::idealThreadCount();
+    if (n < 1) n = 1;
+    if (n > int(m_blocks.size() - m_nextBlock)) {
+        n = int(m_blocks.size() - m_nextBlock);
+    }
+
+    std::vector<Block> blocks(m_blocks.begin() + m_nextBlock,
+                              m_blocks.begin() + m_nextBlock + n);
+
+    if (n == 1) {
+        blocks[0].ok = decompressBlock(m_data, blocks[0]);
+    } else {
+        std::vector<DecompressThread *> threads;
+        for (int i = 0; i < n; ++i) {
+            threads.push_back(new DecompressThread(m_data, blocks[i]));
+            threads[i]->start();
+        }
+        for (int i = 0; i < n; ++i) {
+            threads[i]->wait();
+            delete threads[i];
+        }
+    }
+
+    m_decoded.clear();
+    m_decodedPos = 0;
+
+    for (int i = 0; i < n; ++i) {
+        if (!blocks[i].ok) {
+            m_decoded.clear();
+            return false;
+        }
+        m_decoded.append(blocks[i].data);
+    }
+
+    m_nextBlock += n;
+    return true;
+}
+
+void
+BZipFileDevice::closeBlockReader()
+{
+    if (m_mapped) {
+        m_qfile.unmap(m_mapped);
+        m_mapped = 0;
+    }
+    m_compressed.clear();
+    m_data = 0;
+    m_dataSize = 0;
+    m_blocks.clear();
+    m_nextBlock = 0;
+    m_decoded.clear();
+    m_decodedPos = 0;
+    m_blockReading = false;
+}
+
+bool
+BZipFileDevice::decompressBlock(const uchar *data, Block &block)
+{
+    QByteArray stream;
+    stream.reserve(int((block.endBit - block.startBit) / 8 + 20));
+
+    unsigned long long buffer = 0;
+    int count = 0;
+    putBytes(stream, buffer, count, "BZh9");
+    copyBits(stream, buffer, count, data, block.startBit, block.endBit);
+    putStreamEnd(stream, buffer, count, block.crc);
+
+    bz_stream bz;
+    memset(&bz, 0, sizeof(bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) return false;
+
+    bz.next_in = stream.data();
+    bz.avail_in = stream.size();
+
+    // A block holds at most 900000 bytes before bzip2's initial
+    // run-length encoding, so this is usually enough
+    block.data.resize(1024 * 1024);
+    int produced = 0;
+    int rv = BZ_OK;
+
+    while (rv == BZ_OK) {
+        if (produced == block.data.size()) {
+            block.data.resize(block.data.size() * 2);
+        }
+        bz.next_out = block.data.data() + produced;
+        bz.avail_out = block.data.size() - produced;
+        rv = BZ2_bzDecompress(&bz);
+        produced = block.data.size() - int(bz.avail_out);
+        if (rv == BZ_OK && bz.avail_in == 0 && bz.avail_out > 0) {
+            // input exhausted without reaching the end of stream
+            rv = BZ_UNEXPECTED_EOF;
+        }
+    }
+
+    BZ2_bzDecompressEnd(&bz);
+
+    block.data.resize(produced);
+    return (rv == BZ_STREAM_END);
+}
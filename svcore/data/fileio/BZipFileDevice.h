@@ -21,12 +21,21 @@
 
 #include <bzlib.h>
 
+#include <vector>
+
 class BZipFileDevice : public QIODevice
 {
     Q_OBJECT
 
 public:
-    BZipFileDevice(QString fileName);
+    /**
+     * Construct a device for the given file. If parallel is true,
+     * compression and decompression are spread across worker threads
+     * a block at a time. The file written is a single standard
+     * bzip2 stream in either case; files that cannot be split into
+     * blocks on reading are decoded serially.
+     */
+    BZipFileDevice(QString fileName, bool parallel = true);
     virtual ~BZipFileDevice();
     
     virtual bool open(OpenMode mode);
@@ -40,13 +49,61 @@ protected:
     virtual qint64 readData(char *data, qint64 maxSize);
     virtual qint64 writeData(const char *data, qint64 maxSize);
 
+    bool openSerialReader();
+    
+    bool openBlockWriter();
+    qint64 writeBlocks(const char *data, qint64 size);
+    bool compressPendingBlocks();
+    bool closeBlockWriter();
+
+    bool openBlockReader();
+    qint64 readBlocks(char *data, qint64 maxSize);
+    bool decompressNextBlocks();
+    void closeBlockReader();
+
+    struct Block {
+        qint64 startBit;    // of the block magic, within the stream
+        qint64 endBit;      // of the following block or end-of-stream
+        unsigned int crc;   // block CRC, from the block header
+        QByteArray data;    // compressed or decompressed contents
+        bool ok;
+    };
+
+    class CompressThread;
+    class DecompressThread;
+
+    static bool compressBlock(const QByteArray &input, Block &block);
+    static bool decompressBlock(const uchar *data, Block &block);
+
     QString m_fileName;
+    bool m_parallel;
 
     QFile m_qfile;
     FILE *m_file;
     BZFILE *m_bzFile;
     bool m_atEnd;
     bool m_ok;
+
+    // Block-parallel writing
+    bool m_blockWriting;
+    QByteArray m_input;                // not yet handed to a block
+    std::vector<QByteArray> m_pending; // awaiting compression
+    QByteArray m_output;               // spliced bits awaiting write
+    unsigned long long m_bitBuffer;
+    int m_bitCount;
+    unsigned int m_combinedCRC;
+
+    // Block-parallel reading
+    bool m_blockReading;
+    uchar *m_mapped;
+    QByteArray m_compressed;           // if the file could not be mapped
+    const uchar *m_data;
+    qint64 m_dataSize;
+    std::vector<Block> m_blocks;
+    size_t m_nextBlock;
+    QByteArray m_decoded;
+    int m_decodedPos;
+    qint64 m_delivered;
 };
 
 #endif
@@ -18,6 +18,7 @@
 #include "model/Model.h"
 #include "base/RealTime.h"
 #include "base/StringBits.h"
+#include "base/Thread.h"
 #include "model/SparseOneDimensionalModel.h"
 #include "model/SparseTimeValueModel.h"
 #include "model/EditableDenseThreeDimensionalModel.h"
@@ -31,6 +32,7 @@
 #include <QRegExp>
 #include <QStringList>
 #include <QTextStream>
+#include <QThread>
 
 #include <iostream>
 #include <map>
@@ -97,19 +99,250 @@ CSVFileReader::getError() const
     return m_error;
 }
 
+
+struct CSVFileReader::Row
+{
+    Row() :
+        frame(0), haveFrame(false),
+        endFrame(0), haveEndTime(false),
+        duration(0),
+        value(0.f), haveValue(false),
+        pitch(0.f), havePitch(false),
+        columnCount(0) { }
+
+    sv_frame_t frame;
+    bool haveFrame;
+    sv_frame_t endFrame;
+    bool haveEndTime;
+    sv_frame_t duration;
+    float value;
+    bool haveValue;
+    float pitch;
+    bool havePitch;
+    QString label;
+    DenseThreeDimensionalModel::Column values; // all value columns, in order
+    int columnCount;
+    QString badTime;  // first time field that could not be parsed, if any
+    QString badValue; // first value field that could not be parsed, if any
+};
+
+class CSVFileReader::ParseThread : public Thread
+{
+public:
+    ParseThread(const CSVFileReader &reader,
+                const char *start, const char *end,
+                RowList &rows, const ParseParameters &params) :
+        m_reader(reader), m_start(start), m_end(end),
+        m_rows(rows), m_params(params) { }
+
+    virtual void run() {
+        m_reader.parseChunk(m_start, m_end, m_rows, m_params);
+    }
+
+private:
+    const CSVFileReader &m_reader;
+    const char *m_start;
+    const char *m_end;
+    RowList &m_rows;
+    ParseParameters m_params;
+};
+
+class CSVFileReader::ModelBuilder
+{
+public:
+    ModelBuilder(const CSVFileReader &reader,
+                 sv_samplerate_t sampleRate, int windowSize);
+
+    /**
+     * Add points for the given rows, which must follow on from those
+     * of the previous call, and then release the rows.
+     */
+    void addRows(RowList &rows);
+
+    /**
+     * Finish off the model and return it, or return 0 if no rows
+     * were added.
+     */
+    Model *finish();
+
+private:
+    const CSVFileReader &m_reader;
+    CSVFormat::ModelType m_modelType;
+    CSVFormat::TimingType m_timingType;
+    sv_samplerate_t m_sampleRate;
+    int m_windowSize;
+    int m_valueColumns;
+
+    SparseOneDimensionalModel *m_model1;
+    SparseTimeValueModel *m_model2;
+    RegionModel *m_model2a;
+    NoteModel *m_model2b;
+    EditableDenseThreeDimensionalModel *m_model3;
+    Model *m_model;
+
+    unsigned int m_warnings;
+    unsigned int m_lineno;
+
+    float m_min;
+    float m_max;
+
+    sv_frame_t m_frameNo;
+
+    bool m_haveAnyValue;
+    bool m_pitchLooksLikeMIDI;
+
+    sv_frame_t m_startFrame; // for calculation of dense model resolution
+    bool m_firstEverValue;
+
+    map<QString, int> m_labelCountMap;
+
+    SparseOneDimensionalModel::PointVector m_points1;
+    SparseTimeValueModel::PointVector m_points2;
+    RegionModel::PointVector m_points2a;
+    NoteModel::PointVector m_points2b;
+
+    void createModel();
+};
+
+// Files smaller than this are parsed in a single thread
+static const qint64 minChunkSize = 1024 * 1024;
+
+// Larger files are parsed in chunks of no more than this, so that
+// only a few chunks' worth of rows are held at once
+static const qint64 maxChunkSize = 8 * 1024 * 1024;
+
+// Rows are handed on in batches of this many when reading from a
+// text stream
+static const int streamBatchRows = 65536;
+
+static const unsigned int warnLimit = 10;
+
+static bool
+parseNumber(const char *p, const char *e, double &result)
+{
+    // Fast parse of a plain decimal number, e.g. "-12.5e3", with
+    // optional surrounding spaces. Returns false for anything else,
+    // and also for anything it can't convert exactly (more than 2^53
+    // in the mantissa or a decimal exponent beyond 22) so that the
+    // caller can fall back to QString::toDouble
+
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    while (p < e && (*p == ' ' || *p == '\t')) ++p;
+    while (e > p && (e[-1] == ' ' || e[-1] == '\t')) --e;
+    if (p == e) return false;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0, scale = 0;
+    bool any = false;
+
+    while (p < e && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) ++digits;
+        } else {
+            ++scale;
+        }
+        any = true;
+        ++p;
+    }
+
+    if (p < e && *p == '.') {
+        ++p;
+        while (p < e && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) ++digits;
+                --scale;
+            }
+            any = true;
+            ++p;
+        }
+    }
+
+    if (!any) return false;
+
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negexp = false;
+        if (p < e && (*p == '+' || *p == '-')) {
+            negexp = (*p == '-');
+            ++p;
+        }
+        if (p == e) return false;
+        int exponent = 0;
+        while (p < e && *p >= '0' && *p <= '9') {
+            if (exponent < 10000) exponent = exponent * 10 + (*p - '0');
+            ++p;
+        }
+        scale += (negexp ? -exponent : exponent);
+    }
+
+    if (p != e) return false;
+
+    if (mantissa > (1ULL << 53) || scale < -22 || scale > 22) return false;
+
+    double d = double(mantissa);
+    if (scale < 0) d /= powers[-scale];
+    else d *= powers[scale];
+
+    result = (negative ? -d : d);
+    return true;
+}
+
+static bool
+parseInteger(const char *p, const char *e, long &result)
+{
+    while (p < e && (*p == ' ' || *p == '\t')) ++p;
+    while (e > p && (e[-1] == ' ' || e[-1] == '\t')) --e;
+    if (p == e) return false;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        ++p;
+    }
+    if (p == e || e - p > 18) return false;
+
+    long n = 0;
+    while (p < e) {
+        if (*p < '0' || *p > '9') return false;
+        n = n * 10 + (*p - '0');
+        ++p;
+    }
+
+    result = (negative ? -n : n);
+    return true;
+}
+
+static inline QString
+decode(const char *p, const char *e, bool utf8)
+{
+    if (utf8) return QString::fromUtf8(p, int(e - p));
+    else return QString::fromLocal8Bit(p, int(e - p));
+}
+
 sv_frame_t
-CSVFileReader::convertTimeValue(QString s, int lineno,
-                                sv_samplerate_t sampleRate,
-                                int windowSize) const
+CSVFileReader::convertTimeValue(QString s, sv_samplerate_t sampleRate,
+                                int windowSize, bool &ok) const
 {
     QRegExp nonNumericRx("[^0-9eE.,+-]");
-    int warnLimit = 10;
 
     CSVFormat::TimeUnits timeUnits = m_format.getTimeUnits();
 
     sv_frame_t calculatedFrame = 0;
 
-    bool ok = false;
+    ok = false;
     QString numeric = s;
     numeric.remove(nonNumericRx);
     
@@ -134,83 +367,271 @@ CSVFileReader::convertTimeValue(QString s, int lineno,
             calculatedFrame *= windowSize;
         }
     }
+
+    return calculatedFrame;
+}
+
+sv_frame_t
+CSVFileReader::convertTimeValue(const char *p, const char *e,
+                                sv_samplerate_t sampleRate,
+                                int windowSize, bool &ok) const
+{
+    // As above, but for the common case of a plain number, without
+    // constructing a QString. Anything else goes the slow way
     
-    if (!ok) {
-        if (m_warnings < warnLimit) {
-            cerr << "WARNING: CSVFileReader::load: "
-                      << "Bad time format (\"" << s
-                      << "\") in data line "
-                      << lineno+1 << endl;
-        } else if (m_warnings == warnLimit) {
-            cerr << "WARNING: Too many warnings" << endl;
+    CSVFormat::TimeUnits timeUnits = m_format.getTimeUnits();
+
+    ok = true;
+    
+    if (timeUnits == CSVFormat::TimeSeconds) {
+        double time = 0.0;
+        if (parseNumber(p, e, time)) {
+            return sv_frame_t(time * sampleRate + 0.5);
+        }
+    } else if (timeUnits == CSVFormat::TimeMilliseconds) {
+        double time = 0.0;
+        if (parseNumber(p, e, time)) {
+            return sv_frame_t((time / 1000.0) * sampleRate + 0.5);
+        }
+    } else {
+        long n = 0;
+        if (parseInteger(p, e, n)) {
+            sv_frame_t calculatedFrame = 0;
+            if (n >= 0) calculatedFrame = n;
+            if (timeUnits == CSVFormat::TimeWindows) {
+                calculatedFrame *= windowSize;
+            }
+            return calculatedFrame;
         }
-        ++m_warnings;
     }
 
-    return calculatedFrame;
+    return convertTimeValue(QString::fromLatin1(p, int(e - p)),
+                            sampleRate, windowSize, ok);
 }
 
-Model *
-CSVFileReader::load() const
+void
+CSVFileReader::parseFields(const QStringList &list, Row &row,
+                           const ParseParameters &params) const
 {
-    if (!m_device) return 0;
+    row.columnCount = list.size();
+    
+    for (int i = 0; i < list.size(); ++i) {
 
-    CSVFormat::ModelType modelType = m_format.getModelType();
-    CSVFormat::TimingType timingType = m_format.getTimingType();
-    CSVFormat::TimeUnits timeUnits = m_format.getTimeUnits();
-    sv_samplerate_t sampleRate = m_format.getSampleRate();
-    int windowSize = m_format.getWindowSize();
-    QChar separator = m_format.getSeparator();
-    bool allowQuoting = m_format.getAllowQuoting();
+        const QString &s = list[i];
+        bool ok = true;
 
-    if (timingType == CSVFormat::ExplicitTiming) {
-        if (modelType == CSVFormat::ThreeDimensionalModel) {
-            // This will be overridden later if more than one line
-            // appears in our file, but we want to choose a default
-            // that's likely to be visible
-            windowSize = 1024;
-        } else {
-            windowSize = 1;
+        switch (m_format.getColumnPurpose(i)) {
+
+        case CSVFormat::ColumnUnknown:
+            break;
+
+        case CSVFormat::ColumnStartTime:
+            row.frame = convertTimeValue
+                (s, params.sampleRate, params.windowSize, ok);
+            row.haveFrame = true;
+            if (!ok && row.badTime == "") row.badTime = s;
+            break;
+                
+        case CSVFormat::ColumnEndTime:
+            row.endFrame = convertTimeValue
+                (s, params.sampleRate, params.windowSize, ok);
+            row.haveEndTime = true;
+            if (!ok && row.badTime == "") row.badTime = s;
+            break;
+
+        case CSVFormat::ColumnDuration:
+            row.duration = convertTimeValue
+                (s, params.sampleRate, params.windowSize, ok);
+            if (!ok && row.badTime == "") row.badTime = s;
+            break;
+
+        case CSVFormat::ColumnValue:
+            row.value = s.toFloat(&ok);
+            row.haveValue = true;
+            row.values.push_back(row.value);
+            if (!ok && row.badValue == "") row.badValue = s;
+            break;
+
+        case CSVFormat::ColumnPitch:
+            row.pitch = s.toFloat();
+            row.havePitch = true;
+            break;
+
+        case CSVFormat::ColumnLabel:
+            row.label = s;
+            break;
         }
-	if (timeUnits == CSVFormat::TimeSeconds ||
-            timeUnits == CSVFormat::TimeMilliseconds) {
-	    sampleRate = m_mainModelSampleRate;
-	}
     }
+}
 
-    SparseOneDimensionalModel *model1 = 0;
-    SparseTimeValueModel *model2 = 0;
-    RegionModel *model2a = 0;
-    NoteModel *model2b = 0;
-    EditableDenseThreeDimensionalModel *model3 = 0;
-    Model *model = 0;
+void
+CSVFileReader::parseChunk(const char *start, const char *end, RowList &rows,
+                          const ParseParameters &params) const
+{
+    // Parse the lines found between start and end, which must be
+    // line-aligned. This must be thread-safe: it may be called for
+    // several chunks of the same file at once.
 
-    QTextStream in(m_device);
+    // Lines are separated by CR, LF or CR/LF, and empty lines and
+    // those starting with # are skipped. Fields are split on the
+    // separator as in StringBits::split. Lines that need unquoting or
+    // unescaping go through StringBits::split itself.
 
-    unsigned int warnings = 0, warnLimit = 10;
-    unsigned int lineno = 0;
+    const char separator = char(m_format.getSeparator().unicode());
+    const bool quoting = m_format.getAllowQuoting();
 
-    float min = 0.0, max = 0.0;
+    std::vector<std::pair<const char *, const char *> > fields;
+    
+    const char *p = start;
 
-    sv_frame_t frameNo = 0;
-    sv_frame_t duration = 0;
-    sv_frame_t endFrame = 0;
+    while (p < end) {
 
-    bool haveAnyValue = false;
-    bool haveEndTime = false;
-    bool pitchLooksLikeMIDI = true;
+        const char *ls = p;
+        while (p < end && *p != '\n' && *p != '\r') ++p;
+        const char *le = p;
+        if (p < end) ++p;
 
-    sv_frame_t startFrame = 0; // for calculation of dense model resolution
-    bool firstEverValue = true;
+        if (ls == le || *ls == '#') continue;
 
-    map<QString, int> labelCountMap;
-    
-    int valueColumns = 0;
-    for (int i = 0; i < m_format.getColumnCount(); ++i) {
-        if (m_format.getColumnPurpose(i) == CSVFormat::ColumnValue) {
-            ++valueColumns;
+        bool slow = false;
+        if (quoting) {
+            for (const char *q = ls; q < le; ++q) {
+                char c = *q;
+                if (c == '"' || c == '\'' || c == '\\' ||
+                    (separator == ' ' && (c & 0x80))) {
+                    slow = true;
+                    break;
+                }
+            }
+        }
+
+        rows.push_back(Row());
+        Row &row = rows.back();
+
+        if (slow) {
+            QString line = decode(ls, le, params.utf8);
+            parseFields(StringBits::split(line, m_format.getSeparator(), true),
+                        row, params);
+            continue;
+        }
+
+        fields.clear();
+
+        if (separator == ' ') {
+            const char *q = ls;
+            while (q < le) {
+                while (q < le &&
+                       (*q == ' ' ||
+                        (quoting && (*q == '\t' || *q == '\v' || *q == '\f')))) {
+                    ++q;
+                }
+                if (q == le) break;
+                const char *fs = q;
+                while (q < le &&
+                       !(*q == ' ' ||
+                         (quoting && (*q == '\t' || *q == '\v' || *q == '\f')))) {
+                    ++q;
+                }
+                fields.push_back({ fs, q });
+            }
+        } else {
+            const char *fs = ls;
+            for (const char *q = ls; q < le; ++q) {
+                if (*q == separator) {
+                    fields.push_back({ fs, q });
+                    fs = q + 1;
+                }
+            }
+            // StringBits::splitQuoted drops an empty final field
+            if (!quoting || fs < le) {
+                fields.push_back({ fs, le });
+            }
+        }
+
+        row.columnCount = int(fields.size());
+
+        for (int i = 0; i < int(fields.size()); ++i) {
+
+            const char *fs = fields[i].first;
+            const char *fe = fields[i].second;
+            bool ok = true;
+            double d = 0.0;
+
+            switch (m_format.getColumnPurpose(i)) {
+
+            case CSVFormat::ColumnUnknown:
+                break;
+
+            case CSVFormat::ColumnStartTime:
+                row.frame = convertTimeValue
+                    (fs, fe, params.sampleRate, params.windowSize, ok);
+                row.haveFrame = true;
+                if (!ok && row.badTime == "") {
+                    row.badTime = decode(fs, fe, params.utf8);
+                }
+                break;
+                
+            case CSVFormat::ColumnEndTime:
+                row.endFrame = convertTimeValue
+                    (fs, fe, params.sampleRate, params.windowSize, ok);
+                row.haveEndTime = true;
+                if (!ok && row.badTime == "") {
+                    row.badTime = decode(fs, fe, params.utf8);
+                }
+                break;
+
+            case CSVFormat::ColumnDuration:
+                row.duration = convertTimeValue
+                    (fs, fe, params.sampleRate, params.windowSize, ok);
+                if (!ok && row.badTime == "") {
+                    row.badTime = decode(fs, fe, params.utf8);
+                }
+                break;
+
+            case CSVFormat::ColumnValue:
+                if (parseNumber(fs, fe, d)) {
+                    row.value = float(d);
+                } else {
+                    QString s = decode(fs, fe, params.utf8);
+                    row.value = s.toFloat(&ok);
+                    if (!ok && row.badValue == "") row.badValue = s;
+                }
+                row.haveValue = true;
+                row.values.push_back(row.value);
+                break;
+
+            case CSVFormat::ColumnPitch:
+                if (parseNumber(fs, fe, d)) {
+                    row.pitch = float(d);
+                } else {
+                    row.pitch = decode(fs, fe, params.utf8).toFloat();
+                }
+                row.havePitch = true;
+                break;
+
+            case CSVFormat::ColumnLabel:
+                row.label = decode(fs, fe, params.utf8);
+                break;
+            }
         }
     }
+}
+
+void
+CSVFileReader::readRowsFromStream(const QByteArray &data,
+                                  ModelBuilder &builder,
+                                  const ParseParameters &params) const
+{
+    // Slow path, for files in encodings other than UTF-8 or the
+    // local 8-bit encoding, or with a non-ASCII separator
+    
+    QByteArray copy(data);
+    QTextStream in(&copy, QIODevice::ReadOnly);
+
+    QChar separator = m_format.getSeparator();
+    bool allowQuoting = m_format.getAllowQuoting();
+
+    RowList rows;
 
     while (!in.atEnd()) {
 
@@ -234,191 +655,396 @@ CSVFileReader::load() const
             
             if (line.startsWith("#")) continue;
 
-            QStringList list = StringBits::split(line, separator, allowQuoting);
-            if (!model) {
+            rows.push_back(Row());
+            parseFields(StringBits::split(line, separator, allowQuoting),
+                        rows.back(), params);
 
-                switch (modelType) {
+            if (int(rows.size()) >= streamBatchRows) {
+                builder.addRows(rows);
+            }
+        }
+    }
 
-                case CSVFormat::OneDimensionalModel:
-                    model1 = new SparseOneDimensionalModel(sampleRate, windowSize);
-                    model = model1;
-                    break;
-		
-                case CSVFormat::TwoDimensionalModel:
-                    model2 = new SparseTimeValueModel(sampleRate, windowSize, false);
-                    model = model2;
-                    break;
-		
-                case CSVFormat::TwoDimensionalModelWithDuration:
-                    model2a = new RegionModel(sampleRate, windowSize, false);
-                    model = model2a;
-                    break;
-		
-                case CSVFormat::TwoDimensionalModelWithDurationAndPitch:
-                    model2b = new NoteModel(sampleRate, windowSize, false);
-                    model = model2b;
-                    break;
-		
-                case CSVFormat::ThreeDimensionalModel:
-                    model3 = new EditableDenseThreeDimensionalModel
-                        (sampleRate,
-                         windowSize,
-                         valueColumns,
-                         EditableDenseThreeDimensionalModel::NoCompression);
-                    model = model3;
-                    break;
-                }
+    builder.addRows(rows);
+}
 
-                if (model) {
-                    if (m_filename != "") {
-                        model->setObjectName(m_filename);
-                    }
-                }
+bool
+CSVFileReader::readRows(ModelBuilder &builder,
+                        const ParseParameters &givenParams) const
+{
+    ParseParameters params(givenParams);
+    
+    // Map the file if we can, otherwise read it all in
+    
+    QByteArray data;
+    const char *base = 0;
+    qint64 size = 0;
+    uchar *mapped = 0;
+
+    QFile *file = dynamic_cast<QFile *>(m_device);
+    if (file) {
+        qint64 offset = file->pos();
+        size = file->size() - offset;
+        if (size <= 0) return true;
+        mapped = file->map(offset, size);
+    }
+
+    if (mapped) {
+        base = reinterpret_cast<const char *>(mapped);
+    } else {
+        data = m_device->readAll();
+        base = data.constData();
+        size = data.size();
+    }
+
+    const char *end = base + size;
+
+    bool unicode =
+        (size >= 2 &&
+         ((uchar(base[0]) == 0xff && uchar(base[1]) == 0xfe) ||
+          (uchar(base[0]) == 0xfe && uchar(base[1]) == 0xff)));
+
+    if (unicode || m_format.getSeparator().unicode() > 0x7f) {
+        if (mapped) {
+            readRowsFromStream(QByteArray::fromRawData(base, int(size)),
+                               builder, params);
+            file->unmap(mapped);
+        } else {
+            readRowsFromStream(data, builder, params);
+        }
+        return true;
+    }
+
+    if (size >= 3 &&
+        uchar(base[0]) == 0xef &&
+        uchar(base[1]) == 0xbb &&
+        uchar(base[2]) == 0xbf) {
+        base += 3;
+        params.utf8 = true;
+    }
+
+    // Split into line-aligned chunks, at least one per thread. Up to
+    // one chunk per thread is parsed at a time, and each chunk's rows
+    // go to the builder as soon as it and those before it are done
+    
+    int threadCount = QThread::idealThreadCount();
+    if (threadCount > (end - base) / minChunkSize) {
+        threadCount = int((end - base) / minChunkSize);
+    }
+    if (threadCount < 1) threadCount = 1;
+
+    int n = int(((end - base) + maxChunkSize - 1) / maxChunkSize);
+    if (n < threadCount) n = threadCount;
+    if (n < 1) n = 1;
+
+    std::vector<const char *> bounds;
+    bounds.push_back(base);
+    for (int i = 1; i < n; ++i) {
+        const char *p = base + ((end - base) * i) / n;
+        if (p < bounds.back()) p = bounds.back();
+        while (p < end && *p != '\n' && *p != '\r') ++p;
+        if (p < end) ++p;
+        bounds.push_back(p);
+    }
+    bounds.push_back(end);
+
+    if (threadCount == 1) {
+        RowList rows;
+        for (int i = 0; i < n; ++i) {
+            parseChunk(bounds[i], bounds[i+1], rows, params);
+            builder.addRows(rows);
+        }
+    } else {
+        SVDEBUG << "CSVFileReader::readRows: parsing " << size
+                << " bytes in " << n << " chunks on " << threadCount
+                << " threads" << endl;
+        std::vector<RowList> chunks(n);
+        std::vector<ParseThread *> threads(n, nullptr);
+        int started = 0;
+        for (int i = 0; i < n; ++i) {
+            while (started < n && started < i + threadCount) {
+                threads[started] = new ParseThread
+                    (*this, bounds[started], bounds[started+1],
+                     chunks[started], params);
+                threads[started]->start();
+                ++started;
             }
+            threads[i]->wait();
+            delete threads[i];
+            builder.addRows(chunks[i]);
+        }
+    }
 
-            float value = 0.f;
-            float pitch = 0.f;
-            QString label = "";
+    if (mapped) {
+        file->unmap(mapped);
+    }
+    
+    return true;
+}
 
-            duration = 0.f;
-            haveEndTime = false;
+Model *
+CSVFileReader::load() const
+{
+    if (!m_device) return 0;
 
-            for (int i = 0; i < list.size(); ++i) {
+    CSVFormat::ModelType modelType = m_format.getModelType();
+    CSVFormat::TimingType timingType = m_format.getTimingType();
+    CSVFormat::TimeUnits timeUnits = m_format.getTimeUnits();
+    sv_samplerate_t sampleRate = m_format.getSampleRate();
+    int windowSize = m_format.getWindowSize();
 
-                QString s = list[i];
+    if (timingType == CSVFormat::ExplicitTiming) {
+        if (modelType == CSVFormat::ThreeDimensionalModel) {
+            // This will be overridden later if more than one line
+            // appears in our file, but we want to choose a default
+            // that's likely to be visible
+            windowSize = 1024;
+        } else {
+            windowSize = 1;
+        }
+	if (timeUnits == CSVFormat::TimeSeconds ||
+            timeUnits == CSVFormat::TimeMilliseconds) {
+	    sampleRate = m_mainModelSampleRate;
+	}
+    }
 
-                CSVFormat::ColumnPurpose purpose = m_format.getColumnPurpose(i);
+    // The lines are parsed a chunk at a time, sharing the chunks
+    // between threads where the file is big enough, and the builder
+    // turns each chunk's rows into points, in order, as soon as the
+    // chunk is done. Parsing is the expensive part; building the
+    // model can't be shared out, but it can overlap with the parsing.
+    
+    ParseParameters params;
+    params.sampleRate = sampleRate;
+    params.windowSize = windowSize;
+    params.utf8 = false;
 
-                switch (purpose) {
+    ModelBuilder builder(*this, sampleRate, windowSize);
 
-                case CSVFormat::ColumnUnknown:
-                    break;
+    bool ok = readRows(builder, params);
 
-                case CSVFormat::ColumnStartTime:
-                    frameNo = convertTimeValue(s, lineno, sampleRate, windowSize);
-                    break;
-                
-                case CSVFormat::ColumnEndTime:
-                    endFrame = convertTimeValue(s, lineno, sampleRate, windowSize);
-                    haveEndTime = true;
-                    break;
+    Model *model = builder.finish();
 
-                case CSVFormat::ColumnDuration:
-                    duration = convertTimeValue(s, lineno, sampleRate, windowSize);
-                    break;
+    if (!ok) {
+        delete model;
+        return 0;
+    }
 
-                case CSVFormat::ColumnValue:
-                    value = s.toFloat();
-                    haveAnyValue = true;
-                    break;
+    return model;
+}
 
-                case CSVFormat::ColumnPitch:
-                    pitch = s.toFloat();
-                    if (pitch < 0.f || pitch > 127.f) {
-                        pitchLooksLikeMIDI = false;
-                    }
-                    break;
+CSVFileReader::ModelBuilder::ModelBuilder(const CSVFileReader &reader,
+                                          sv_samplerate_t sampleRate,
+                                          int windowSize) :
+    m_reader(reader),
+    m_modelType(reader.m_format.getModelType()),
+    m_timingType(reader.m_format.getTimingType()),
+    m_sampleRate(sampleRate),
+    m_windowSize(windowSize),
+    m_valueColumns(0),
+    m_model1(0),
+    m_model2(0),
+    m_model2a(0),
+    m_model2b(0),
+    m_model3(0),
+    m_model(0),
+    m_warnings(0),
+    m_lineno(0),
+    m_min(0.f),
+    m_max(0.f),
+    m_frameNo(0),
+    m_haveAnyValue(false),
+    m_pitchLooksLikeMIDI(true),
+    m_startFrame(0),
+    m_firstEverValue(true)
+{
+    for (int i = 0; i < reader.m_format.getColumnCount(); ++i) {
+        if (reader.m_format.getColumnPurpose(i) == CSVFormat::ColumnValue) {
+            ++m_valueColumns;
+        }
+    }
+}
 
-                case CSVFormat::ColumnLabel:
-                    label = s;
-                    break;
-                }
-            }
+void
+CSVFileReader::ModelBuilder::createModel()
+{
+    switch (m_modelType) {
+
+    case CSVFormat::OneDimensionalModel:
+        m_model1 = new SparseOneDimensionalModel(m_sampleRate, m_windowSize);
+        m_model = m_model1;
+        break;
+		
+    case CSVFormat::TwoDimensionalModel:
+        m_model2 = new SparseTimeValueModel(m_sampleRate, m_windowSize, false);
+        m_model = m_model2;
+        break;
+		
+    case CSVFormat::TwoDimensionalModelWithDuration:
+        m_model2a = new RegionModel(m_sampleRate, m_windowSize, false);
+        m_model = m_model2a;
+        break;
+		
+    case CSVFormat::TwoDimensionalModelWithDurationAndPitch:
+        m_model2b = new NoteModel(m_sampleRate, m_windowSize, false);
+        m_model = m_model2b;
+        break;
+		
+    case CSVFormat::ThreeDimensionalModel:
+        m_model3 = new EditableDenseThreeDimensionalModel
+            (m_sampleRate,
+             m_windowSize,
+             m_valueColumns,
+             EditableDenseThreeDimensionalModel::NoCompression);
+        m_model = m_model3;
+        break;
+    }
+
+    if (m_model) {
+        if (m_reader.m_filename != "") {
+            m_model->setObjectName(m_reader.m_filename);
+        }
+    }
+}
+
+void
+CSVFileReader::ModelBuilder::addRows(RowList &rows)
+{
+    for (int ri = 0; ri < int(rows.size()); ++ri) {
 
-            ++labelCountMap[label];
+        const Row &row = rows[ri];
             
-            if (haveEndTime) { // ... calculate duration now all cols read
-                if (endFrame > frameNo) {
-                    duration = endFrame - frameNo;
-                }
+        if (!m_model) {
+            createModel();
+        }
+
+        if (row.badTime != "") {
+            if (m_reader.m_warnings < int(warnLimit)) {
+                cerr << "WARNING: CSVFileReader::load: "
+                     << "Bad time format (\"" << row.badTime
+                     << "\") in data line "
+                     << m_lineno+1 << endl;
+            } else if (m_reader.m_warnings == int(warnLimit)) {
+                cerr << "WARNING: Too many warnings" << endl;
             }
+            ++m_reader.m_warnings;
+        }
 
-            if (modelType == CSVFormat::OneDimensionalModel) {
-	    
-                SparseOneDimensionalModel::Point point(frameNo, label);
-                model1->addPoint(point);
+        if (row.haveFrame) {
+            m_frameNo = row.frame;
+        }
+
+        float value = row.value;
+        float pitch = row.pitch;
+        const QString &label = row.label;
+
+        sv_frame_t duration = row.duration;
 
-            } else if (modelType == CSVFormat::TwoDimensionalModel) {
+        if (row.haveValue) {
+            m_haveAnyValue = true;
+        }
+
+        if (row.havePitch && (pitch < 0.f || pitch > 127.f)) {
+            m_pitchLooksLikeMIDI = false;
+        }
 
-                SparseTimeValueModel::Point point(frameNo, value, label);
-                model2->addPoint(point);
+        ++m_labelCountMap[label];
+            
+        if (row.haveEndTime) { // ... calculate duration now all cols read
+            if (row.endFrame > m_frameNo) {
+                duration = row.endFrame - m_frameNo;
+            }
+        }
 
-            } else if (modelType == CSVFormat::TwoDimensionalModelWithDuration) {
+        if (m_modelType == CSVFormat::OneDimensionalModel) {
+	    
+            m_points1.push_back(SparseOneDimensionalModel::Point
+                                (m_frameNo, label));
 
-                RegionModel::Point point(frameNo, value, duration, label);
-                model2a->addPoint(point);
+        } else if (m_modelType == CSVFormat::TwoDimensionalModel) {
 
-            } else if (modelType == CSVFormat::TwoDimensionalModelWithDurationAndPitch) {
+            m_points2.push_back(SparseTimeValueModel::Point
+                                (m_frameNo, value, label));
 
-                float level = ((value >= 0.f && value <= 1.f) ? value : 1.f);
-                NoteModel::Point point(frameNo, pitch, duration, level, label);
-                model2b->addPoint(point);
+        } else if (m_modelType == CSVFormat::TwoDimensionalModelWithDuration) {
 
-            } else if (modelType == CSVFormat::ThreeDimensionalModel) {
+            m_points2a.push_back(RegionModel::Point
+                                 (m_frameNo, value, duration, label));
 
-                DenseThreeDimensionalModel::Column values;
+        } else if (m_modelType == CSVFormat::TwoDimensionalModelWithDurationAndPitch) {
 
-                for (int i = 0; i < list.size(); ++i) {
+            float level = ((value >= 0.f && value <= 1.f) ? value : 1.f);
+            m_points2b.push_back(NoteModel::Point
+                                 (m_frameNo, pitch, duration, level, label));
 
-                    if (m_format.getColumnPurpose(i) != CSVFormat::ColumnValue) {
-                        continue;
-                    }
+        } else if (m_modelType == CSVFormat::ThreeDimensionalModel) {
 
-                    bool ok = false;
-                    float value = list[i].toFloat(&ok);
+            for (int i = 0; i < int(row.values.size()); ++i) {
 
-                    values.push_back(value);
+                float value = row.values[i];
 	    
-                    if (firstEverValue || value < min) min = value;
-                    if (firstEverValue || value > max) max = value;
+                if (m_firstEverValue || value < m_min) m_min = value;
+                if (m_firstEverValue || value > m_max) m_max = value;
                     
-                    if (firstEverValue) {
-                        startFrame = frameNo;
-                        model3->setStartFrame(startFrame);
-                    } else if (lineno == 1 &&
-                               timingType == CSVFormat::ExplicitTiming) {
-                        model3->setResolution(int(frameNo - startFrame));
-                    }
+                if (m_firstEverValue) {
+                    m_startFrame = m_frameNo;
+                    m_model3->setStartFrame(m_startFrame);
+                } else if (m_lineno == 1 &&
+                           m_timingType == CSVFormat::ExplicitTiming) {
+                    m_model3->setResolution(int(m_frameNo - m_startFrame));
+                }
                     
-                    firstEverValue = false;
-
-                    if (!ok) {
-                        if (warnings < warnLimit) {
-                            cerr << "WARNING: CSVFileReader::load: "
-                                      << "Non-numeric value \""
-                                      << list[i]
-                                      << "\" in data line " << lineno+1
-                                      << ":" << endl;
-                            cerr << line << endl;
-                            ++warnings;
-                        } else if (warnings == warnLimit) {
-//                            cerr << "WARNING: Too many warnings" << endl;
-                        }
-                    }
+                m_firstEverValue = false;
+            }
+
+            if (row.badValue != "") {
+                if (m_warnings < warnLimit) {
+                    cerr << "WARNING: CSVFileReader::load: "
+                         << "Non-numeric value \""
+                         << row.badValue
+                         << "\" in data line " << m_lineno+1
+                         << endl;
+                    ++m_warnings;
                 }
+            }
 	
-//                SVDEBUG << "Setting bin values for count " << lineno << ", frame "
-//                          << frameNo << ", time " << RealTime::frame2RealTime(frameNo, sampleRate) << endl;
+//            SVDEBUG << "Setting bin values for count " << m_lineno << ", frame "
+//                      << m_frameNo << ", time " << RealTime::frame2RealTime(m_frameNo, m_sampleRate) << endl;
 
-                model3->setColumn(lineno, values);
-            }
+            m_model3->setColumn(m_lineno, row.values);
+        }
 
-            ++lineno;
-            if (timingType == CSVFormat::ImplicitTiming ||
-                list.size() == 0) {
-                frameNo += windowSize;
-            }
+        ++m_lineno;
+        if (m_timingType == CSVFormat::ImplicitTiming ||
+            row.columnCount == 0) {
+            m_frameNo += m_windowSize;
         }
     }
 
-    if (!haveAnyValue) {
-        if (model2a) {
+    if (m_model1) m_model1->addPoints(m_points1);
+    if (m_model2) m_model2->addPoints(m_points2);
+    if (m_model2a) m_model2a->addPoints(m_points2a);
+    if (m_model2b) m_model2b->addPoints(m_points2b);
+
+    m_points1.clear();
+    m_points2.clear();
+    m_points2a.clear();
+    m_points2b.clear();
+
+    RowList().swap(rows);
+}
+
+Model *
+CSVFileReader::ModelBuilder::finish()
+{
+    if (!m_haveAnyValue) {
+        if (m_model2a) {
             // assign values for regions based on label frequency; we
-            // have this in our labelCountMap, sort of
+            // have this in our m_labelCountMap, sort of
 
             map<int, map<QString, float> > countLabelValueMap;
-            for (map<QString, int>::iterator i = labelCountMap.begin();
-                 i != labelCountMap.end(); ++i) {
+            for (map<QString, int>::iterator i = m_labelCountMap.begin();
+                 i != m_labelCountMap.end(); ++i) {
                 countLabelValueMap[i->second][i->first] = -1.f;
             }
 
@@ -438,10 +1064,10 @@ CSVFileReader::load() const
             map<RegionModel::Point, RegionModel::Point,
                 RegionModel::Point::Comparator> pointMap;
             for (RegionModel::PointList::const_iterator i =
-                     model2a->getPoints().begin();
-                 i != model2a->getPoints().end(); ++i) {
+                     m_model2a->getPoints().begin();
+                 i != m_model2a->getPoints().end(); ++i) {
                 RegionModel::Point p(*i);
-                int count = labelCountMap[p.label];
+                int count = m_labelCountMap[p.label];
                 v = countLabelValueMap[count][p.label];
                 cerr << "mapping from label \"" << p.label << "\" (count " << count << ") to value " << v << endl;
                 RegionModel::Point pp(p.frame, v, p.duration, p.label);
@@ -457,27 +1083,27 @@ CSVFileReader::load() const
                 if (i->first.value == i->second.value) {
                     continue;
                 }
-                while (model2a->containsPoint(i->first)) {
-                    model2a->deletePoint(i->first);
-                    model2a->addPoint(i->second);
+                while (m_model2a->containsPoint(i->first)) {
+                    m_model2a->deletePoint(i->first);
+                    m_model2a->addPoint(i->second);
                 }
             }
         }
     }
                 
-    if (model2b) {
-        if (pitchLooksLikeMIDI) {
-            model2b->setScaleUnits("MIDI Pitch");
+    if (m_model2b) {
+        if (m_pitchLooksLikeMIDI) {
+            m_model2b->setScaleUnits("MIDI Pitch");
         } else {
-            model2b->setScaleUnits("Hz");
+            m_model2b->setScaleUnits("Hz");
         }
     }
 
-    if (model3) {
-	model3->setMinimumLevel(min);
-	model3->setMaximumLevel(max);
+    if (m_model3) {
+	m_model3->setMinimumLevel(m_min);
+	m_model3->setMaximumLevel(m_max);
     }
 
-    return model;
+    return m_model;
 }
 
@@ -26,6 +26,8 @@
 #include <QStringList>
 #include <QIODevice>
 
+#include <vector>
+
 class QFile;
 
 class CSVFileReader : public DataFileReader
@@ -61,8 +63,37 @@ protected:
     mutable int m_warnings;
     sv_samplerate_t m_mainModelSampleRate;
 
-    sv_frame_t convertTimeValue(QString, int lineno, sv_samplerate_t sampleRate,
-                                int windowSize) const;
+    /**
+     * One data line's worth of parsed fields. Lines are parsed into
+     * rows a chunk at a time (in parallel where possible), and each
+     * chunk's rows are added to the model in order, by a
+     * ModelBuilder, as soon as the chunk is done.
+     */
+    struct Row;
+    typedef std::vector<Row> RowList;
+
+    struct ParseParameters {
+        sv_samplerate_t sampleRate;
+        int windowSize;
+        bool utf8;
+    };
+
+    class ParseThread;
+    class ModelBuilder;
+
+    sv_frame_t convertTimeValue(QString, sv_samplerate_t sampleRate,
+                                int windowSize, bool &ok) const;
+    sv_frame_t convertTimeValue(const char *, const char *,
+                                sv_samplerate_t sampleRate,
+                                int windowSize, bool &ok) const;
+
+    bool readRows(ModelBuilder &builder, const ParseParameters &) const;
+    void readRowsFromStream(const QByteArray &data, ModelBuilder &builder,
+                            const ParseParameters &) const;
+    void parseChunk(const char *start, const char *end, RowList &rows,
+                    const ParseParameters &) const;
+    void parseFields(const QStringList &fields, Row &row,
+                     const ParseParameters &) const;
 };
 
 
@@ -547,30 +547,39 @@ CodedAudioFileReader::pushBufferResampling(float *buffer, sv_frame_t sz,
 
 floatvec_t
 CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
+{
+    floatvec_t frames;
+    getInterleavedFramesInto(start, count, frames);
+    return frames;
+}
+
+void
+CodedAudioFileReader::getInterleavedFramesInto(sv_frame_t start, sv_frame_t count,
+                                               floatvec_t &frames) const
 {
     // Lock is only required in CacheInMemory mode (the cache file
     // reader is expected to be thread safe and manage its own
     // locking)
 
+    frames.clear();
+
     if (!m_initialised) {
         SVDEBUG << "CodedAudioFileReader::getInterleavedFrames: not initialised" << endl;
-        return {};
+        return;
     }
 
-    floatvec_t frames;
-    
     switch (m_cacheMode) {
 
     case CacheInTemporaryFile:
         if (m_cacheFileReader) {
-            frames = m_cacheFileReader->getInterleavedFrames(start, count);
+            m_cacheFileReader->getInterleavedFramesInto(start, count, frames);
         }
         break;
 
     case CacheInMemory:
     {
-        if (!isOK()) return {};
-        if (count == 0) return {};
+        if (!isOK()) return;
+        if (count == 0) return;
 
         sv_frame_t ix0 = start * m_channelCount;
         sv_frame_t ix1 = ix0 + (count * m_channelCount);
@@ -583,7 +592,7 @@ CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) c
         sv_frame_t n = sv_frame_t(m_data.size());
         if (ix0 > n) ix0 = n;
         if (ix1 > n) ix1 = n;
-        frames = floatvec_t(m_data.begin() + ix0, m_data.begin() + ix1);
+        frames.assign(m_data.begin() + ix0, m_data.begin() + ix1);
         m_dataLock.unlock();
         break;
     }
@@ -592,7 +601,5 @@ CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) c
     if (m_normalised) {
         for (auto &f: frames) f *= m_gain;
     }
-
-    return frames;
 }
 
@@ -53,6 +53,8 @@ public:
     };
 
     virtual floatvec_t getInterleavedFrames(sv_frame_t start, sv_frame_t count) const;
+    virtual void getInterleavedFramesInto(sv_frame_t start, sv_frame_t count,
+                                          floatvec_t &buffer) const;
 
     virtual sv_samplerate_t getNativeRate() const { return m_fileRate; }
 
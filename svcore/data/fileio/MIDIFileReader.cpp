@@ -21,10 +21,10 @@
 
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 
 #include "MIDIFileReader.h"
 
@@ -33,17 +33,19 @@
 #include "model/Model.h"
 #include "base/Pitch.h"
 #include "base/RealTime.h"
+#include "base/Thread.h"
 #include "model/NoteModel.h"
 
 #include <QString>
+#include <QFile>
 #include <QFileInfo>
+#include <QThread>
 
 #include <sstream>
 
 #include "base/Debug.h"
 
 using std::string;
-using std::ifstream;
 using std::stringstream;
 using std::ends;
 using std::ios;
@@ -56,6 +58,27 @@ using namespace MIDIConstants;
 //#define MIDI_DEBUG 1
 
 
+class MIDIFileReader::ParseThread : public Thread
+{
+public:
+    ParseThread(const MIDIFileReader &reader,
+                std::vector<ChunkData> &chunks, int from, int step) :
+        m_reader(reader), m_chunks(chunks), m_from(from), m_step(step) { }
+
+    virtual void run() {
+        m_reader.parseChunks(m_chunks, m_from, m_step);
+    }
+
+private:
+    const MIDIFileReader &m_reader;
+    std::vector<ChunkData> &m_chunks;
+    int m_from;
+    int m_step;
+};
+
+// Files smaller than this are parsed in a single thread
+static const qint64 minParallelFileSize = 256 * 1024;
+
 MIDIFileReader::MIDIFileReader(QString path,
                                MIDIFileImportPreferenceAcquirer *acquirer,
 			       sv_samplerate_t mainModelSampleRate) :
@@ -65,10 +88,7 @@ MIDIFileReader::MIDIFileReader(QString path,
     m_subframes(0),
     m_format(MIDI_FILE_BAD_FORMAT),
     m_numberOfTracks(0),
-    m_trackByteCount(0),
-    m_decrementCount(false),
     m_path(path),
-    m_midiFile(0),
     m_fileSize(0),
     m_mainModelSampleRate(mainModelSampleRate),
     m_acquirer(acquirer)
@@ -80,18 +100,6 @@ MIDIFileReader::MIDIFileReader(QString path,
 
 MIDIFileReader::~MIDIFileReader()
 {
-    for (MIDIComposition::iterator i = m_midiComposition.begin();
-	 i != m_midiComposition.end(); ++i) {
-	
-	for (MIDITrack::iterator j = i->second.begin();
-	     j != i->second.end(); ++j) {
-	    delete *j;
-	}
-
-	i->second.clear();
-    }
-
-    m_midiComposition.clear();
 }
 
 bool
@@ -107,101 +115,66 @@ MIDIFileReader::getError() const
 }
 
 long
-MIDIFileReader::midiBytesToLong(const string& bytes)
+MIDIFileReader::getMIDILong(Cursor &cursor)
 {
-    if (bytes.length() != 4) {
-	throw MIDIException(tr("Wrong length for long data in MIDI stream (%1, should be %2)").arg(bytes.length()).arg(4));
+    if (cursor.end - cursor.pos < 4) {
+	throw MIDIException(tr("Wrong length for long data in MIDI stream (%1, should be %2)").arg(cursor.end - cursor.pos).arg(4));
     }
 
-    long longRet = ((long)(((MIDIByte)bytes[0]) << 24)) |
-                   ((long)(((MIDIByte)bytes[1]) << 16)) |
-                   ((long)(((MIDIByte)bytes[2]) << 8)) |
-                   ((long)((MIDIByte)(bytes[3])));
+    const MIDIByte *bytes = cursor.pos;
+    cursor.pos += 4;
+
+    long longRet = ((long)(bytes[0] << 24)) |
+                   ((long)(bytes[1] << 16)) |
+                   ((long)(bytes[2] << 8)) |
+                   ((long)(bytes[3]));
 
     return longRet;
 }
 
 int
-MIDIFileReader::midiBytesToInt(const string& bytes)
+MIDIFileReader::getMIDIInt(Cursor &cursor)
 {
-    if (bytes.length() != 2) {
-	throw MIDIException(tr("Wrong length for int data in MIDI stream (%1, should be %2)").arg(bytes.length()).arg(2));
+    if (cursor.end - cursor.pos < 2) {
+	throw MIDIException(tr("Wrong length for int data in MIDI stream (%1, should be %2)").arg(cursor.end - cursor.pos).arg(2));
     }
 
-    int intRet = ((int)(((MIDIByte)bytes[0]) << 8)) |
-                 ((int)(((MIDIByte)bytes[1])));
+    const MIDIByte *bytes = cursor.pos;
+    cursor.pos += 2;
+
+    int intRet = ((int)(bytes[0] << 8)) |
+                 ((int)(bytes[1]));
     return(intRet);
 }
 
 
 // Gets a single byte from the MIDI byte stream.  For each track
-// section we can read only a specified number of bytes held in
-// m_trackByteCount.
+// section we can read only as far as the end of the track chunk.
 //
 MIDIByte
-MIDIFileReader::getMIDIByte()
+MIDIFileReader::getMIDIByte(Cursor &cursor)
 {
-    if (!m_midiFile) {
-	throw MIDIException(tr("getMIDIByte called but no MIDI file open"));
-    }
-
-    if (m_midiFile->eof()) {
-        throw MIDIException(tr("End of MIDI file encountered while reading"));
-    }
-
-    if (m_decrementCount && m_trackByteCount <= 0) {
+    if (cursor.pos >= cursor.end) {
         throw MIDIException(tr("Attempt to get more bytes than expected on Track"));
     }
 
-    char byte;
-    if (m_midiFile->read(&byte, 1)) {
-	--m_trackByteCount;
-	return (MIDIByte)byte;
-    }
-
-    throw MIDIException(tr("Attempt to read past MIDI file end"));
+    return *cursor.pos++;
 }
 
 
 // Gets a specified number of bytes from the MIDI byte stream.  For
-// each track section we can read only a specified number of bytes
-// held in m_trackByteCount.
+// each track section we can read only as far as the end of the track
+// chunk.
 //
 string
-MIDIFileReader::getMIDIBytes(unsigned long numberOfBytes)
+MIDIFileReader::getMIDIBytes(Cursor &cursor, unsigned long numberOfBytes)
 {
-    if (!m_midiFile) {
-	throw MIDIException(tr("getMIDIBytes called but no MIDI file open"));
+    if (numberOfBytes > (unsigned long)(cursor.end - cursor.pos)) {
+        throw MIDIException(tr("Attempt to get more bytes than available on Track (%1, only have %2)").arg(numberOfBytes).arg(cursor.end - cursor.pos));
     }
 
-    if (m_midiFile->eof()) {
-        throw MIDIException(tr("End of MIDI file encountered while reading"));
-    }
-
-    if (m_decrementCount && (numberOfBytes > (unsigned long)m_trackByteCount)) {
-        throw MIDIException(tr("Attempt to get more bytes than available on Track (%1, only have %2)").arg(numberOfBytes).arg(m_trackByteCount));
-    }
-
-    string stringRet;
-    char fileMIDIByte;
-
-    while (stringRet.length() < numberOfBytes &&
-           m_midiFile->read(&fileMIDIByte, 1)) {
-        stringRet += fileMIDIByte;
-    }
-
-    // if we've reached the end of file without fulfilling the
-    // quota then panic as our parsing has performed incorrectly
-    //
-    if (stringRet.length() < numberOfBytes) {
-        stringRet = "";
-        throw MIDIException(tr("Attempt to read past MIDI file end"));
-    }
-
-    // decrement the byte count
-    if (m_decrementCount)
-        m_trackByteCount -= stringRet.length();
-
+    string stringRet((const char *)cursor.pos, numberOfBytes);
+    cursor.pos += numberOfBytes;
     return stringRet;
 }
 
@@ -209,63 +182,54 @@ MIDIFileReader::getMIDIBytes(unsigned long numberOfBytes)
 // Get a long number of variable length from the MIDI byte stream.
 //
 long
-MIDIFileReader::getNumberFromMIDIBytes(int firstByte)
+MIDIFileReader::getNumberFromMIDIBytes(Cursor &cursor, int firstByte)
 {
-    if (!m_midiFile) {
-	throw MIDIException(tr("getNumberFromMIDIBytes called but no MIDI file open"));
-    }
-
     long longRet = 0;
     MIDIByte midiByte;
 
     if (firstByte >= 0) {
 	midiByte = (MIDIByte)firstByte;
-    } else if (m_midiFile->eof()) {
+    } else if (cursor.pos >= cursor.end) {
 	return longRet;
     } else {
-	midiByte = getMIDIByte();
+	midiByte = getMIDIByte(cursor);
     }
 
     longRet = midiByte;
     if (midiByte & 0x80) {
 	longRet &= 0x7F;
 	do {
-	    midiByte = getMIDIByte();
+	    midiByte = getMIDIByte(cursor);
 	    longRet = (longRet << 7) + (midiByte & 0x7F);
-	} while (!m_midiFile->eof() && (midiByte & 0x80));
+	} while (midiByte & 0x80);
     }
 
     return longRet;
 }
 
 
-// Seek to the next track in the midi file and set the number
-// of bytes to be read in the counter m_trackByteCount.
+// Seek to the next track in the midi file and return a cursor
+// spanning its data. Leaves the file cursor at the start of the
+// following chunk.
 //
 bool
-MIDIFileReader::skipToNextTrack()
+MIDIFileReader::skipToNextTrack(Cursor &cursor, Cursor &track)
 {
-    if (!m_midiFile) {
-	throw MIDIException(tr("skipToNextTrack called but no MIDI file open"));
-    }
-
-    string buffer, buffer2;
-    m_trackByteCount = -1;
-    m_decrementCount = false;
-
-    while (!m_midiFile->eof() && (m_decrementCount == false)) {
-        buffer = getMIDIBytes(4); 
+    while (cursor.pos < cursor.end) {
+        string buffer = getMIDIBytes(cursor, 4);
 	if (buffer.compare(0, 4, MIDI_TRACK_HEADER) == 0) {
-	    m_trackByteCount = midiBytesToLong(getMIDIBytes(4));
-	    m_decrementCount = true;
+	    long length = getMIDILong(cursor);
+            if (length < 0 || length > cursor.end - cursor.pos) {
+                throw MIDIException(tr("Attempt to read past MIDI file end"));
+            }
+            track.pos = cursor.pos;
+            track.end = cursor.pos + length;
+            cursor.pos = track.end;
+            return true;
 	}
     }
 
-    if (m_trackByteCount == -1) { // we haven't found a track
-        return false;
-    } else {
-        return true;
-    }
+    return false; // we haven't found a track
 }
 
 
@@ -273,55 +237,59 @@ MIDIFileReader::skipToNextTrack()
 // here if we run into trouble which we can then pass back out to
 // whoever called us using a nice bool.
 //
+// The file is mapped into memory and its track chunks located first;
+// then the chunks are parsed independently, in parallel for larger
+// files, and their results merged in order.
+//
 bool
 MIDIFileReader::parseFile()
 {
     m_error = "";
 
 #ifdef MIDI_DEBUG
-    SVDEBUG << "MIDIFileReader::open() : fileName = " << m_fileName.c_str() << endl;
+    SVDEBUG << "MIDIFileReader::open() : fileName = " << m_path << endl;
 #endif
 
     // Open the file
-    m_midiFile = new ifstream(m_path.toLocal8Bit().data(),
-			      ios::in | ios::binary);
+    QFile file(m_path);
 
-    if (!*m_midiFile) {
+    if (!file.open(QIODevice::ReadOnly)) {
 	m_error = "File not found or not readable.";
 	m_format = MIDI_FILE_BAD_FORMAT;
-	delete m_midiFile;
-        m_midiFile = 0;
 	return false;
     }
 
+    m_fileSize = size_t(file.size());
+
+    QByteArray buffer;
+    const MIDIByte *data = file.map(0, file.size());
+    const MIDIByte *mapped = data;
+    if (!mapped) {
+        buffer = file.readAll();
+        data = (const MIDIByte *)buffer.constData();
+        m_fileSize = buffer.size();
+    }
+
+    Cursor cursor;
+    cursor.pos = data;
+    cursor.end = data + m_fileSize;
+
+    std::vector<ChunkData> chunks;
     bool retval = false;
 
     try {
 
-	// Set file size so we can count it off
-	//
-	m_midiFile->seekg(0, ios::end);
-        std::streamoff off = m_midiFile->tellg();
-	m_fileSize = 0;
-        if (off > 0) m_fileSize = off;
-	m_midiFile->seekg(0, ios::beg);
-
 	// Parse the MIDI header first.  The first 14 bytes of the file.
-	if (!parseHeader(getMIDIBytes(14))) {
+	if (!parseHeader(cursor)) {
 	    m_format = MIDI_FILE_BAD_FORMAT;
 	    m_error = "Not a MIDI file.";
 	    goto done;
 	}
 
-	unsigned int i = 0;
-
 	for (unsigned int j = 0; j < m_numberOfTracks; ++j) {
 
-#ifdef MIDI_DEBUG
-	    SVDEBUG << "Parsing Track " << j << endl;
-#endif
-
-	    if (!skipToNextTrack()) {
+	    ChunkData chunk;
+	    if (!skipToNextTrack(cursor, chunk.chunk)) {
 #ifdef MIDI_DEBUG
 		SVDEBUG << "Couldn't find Track " << j << endl;
 #endif
@@ -331,57 +299,104 @@ MIDIFileReader::parseFile()
 	    }
 
 #ifdef MIDI_DEBUG
-	    SVDEBUG << "Track has " << m_trackByteCount << " bytes" << endl;
+	    SVDEBUG << "Track has " << (chunk.chunk.end - chunk.chunk.pos) << " bytes" << endl;
 #endif
 
-	    // Run through the events taking them into our internal
-	    // representation.
-	    if (!parseTrack(i)) {
-#ifdef MIDI_DEBUG
-		SVDEBUG << "Track " << j << " parsing failed" << endl;
-#endif
-		m_error = "File corrupted or in non-standard format?";
-		m_format = MIDI_FILE_BAD_FORMAT;
-		goto done;
-	    }
-
-	    ++i; // j is the source track number, i the destination
+	    chunks.push_back(chunk);
 	}
-	
-	m_numberOfTracks = i;
-	retval = true;
 
-    } catch (MIDIException e) {
+    } catch (const MIDIException &e) {
 
         SVDEBUG << "MIDIFileReader::open() - caught exception - " << e.what() << endl;
 	m_error = e.what();
+        goto done;
     }
-    
-done:
-    m_midiFile->close();
-    delete m_midiFile;
 
-    for (unsigned int track = 0; track < m_numberOfTracks; ++track) {
+    {
+        int n = QThread::idealThreadCount();
+        if (n > int(chunks.size())) n = int(chunks.size());
+        if (qint64(m_fileSize) < minParallelFileSize) n = 1;
+
+        if (n <= 1) {
+            parseChunks(chunks, 0, 1);
+        } else {
+            SVDEBUG << "MIDIFileReader::parseFile: parsing " << chunks.size()
+                    << " tracks in " << n << " threads" << endl;
+            std::vector<ParseThread *> threads;
+            for (int i = 0; i < n; ++i) {
+                threads.push_back(new ParseThread(*this, chunks, i, n));
+                threads[i]->start();
+            }
+            for (int i = 0; i < n; ++i) {
+                threads[i]->wait();
+                delete threads[i];
+            }
+        }
+    }
+
+    {
+        // Merge the parsed chunks, numbering their tracks in order.
+        // j is the source track number, i the destination
+
+        unsigned int i = 0;
+
+        for (unsigned int j = 0; j < chunks.size(); ++j) {
+
+            ChunkData &chunk = chunks[j];
+
+            if (chunk.error != "") {
+#ifdef MIDI_DEBUG
+                SVDEBUG << "Track " << j << " parsing failed" << endl;
+#endif
+                m_error = chunk.error;
+                break;
+            }
+
+            unsigned int metaTrack = i;
+
+            if (chunk.haveName) {
+                m_trackNames[metaTrack] = chunk.name;
+            }
 
-        // Convert the deltaTime to an absolute time since the track
-        // start.  The addTime method returns the sum of the current
-        // MIDI Event delta time plus the argument.
+            for (unsigned int k = 0; k < chunk.tracks.size(); ++k) {
+                m_midiComposition[i + k].swap(chunk.tracks[k]);
+                if (chunk.loadableTracks.find(k) !=
+                    chunk.loadableTracks.end()) {
+                    m_loadableTracks.insert(i + k);
+                }
+                if (chunk.percussionTracks.find(k) !=
+                    chunk.percussionTracks.end()) {
+                    m_percussionTracks.insert(i + k);
+                }
+                if (k > 0) {
+                    m_trackNames[i + k] = QString("%1 <%2>")
+                        .arg(m_trackNames[metaTrack]).arg(k + 1);
+                }
+            }
 
-	unsigned long acc = 0;
+            for (size_t k = 0; k < chunk.tempoChanges.size(); ++k) {
+                SVDEBUG << "MIDIFileReader: have tempo, it's "
+                        << chunk.tempoChanges[k].second << " qpm at "
+                        << chunk.tempoChanges[k].first << endl;
+                m_tempoMap[chunk.tempoChanges[k].first] =
+                    TempoChange(RealTime::zeroTime,
+                                chunk.tempoChanges[k].second);
+            }
 
-        for (MIDITrack::iterator i = m_midiComposition[track].begin();
-             i != m_midiComposition[track].end(); ++i) {
-            acc = (*i)->addTime(acc);
+            i += (unsigned int)chunk.tracks.size();
         }
 
-        if (consolidateNoteOffEvents(track)) { // returns true if some notes exist
-	    m_loadableTracks.insert(track);
-	}
+        if (m_error == "") {
+            m_numberOfTracks = i;
+            retval = true;
+        }
     }
 
-    for (unsigned int track = 0; track < m_numberOfTracks; ++track) {
-        updateTempoMap(track);
+done:
+    if (mapped) {
+        file.unmap((uchar *)mapped);
     }
+    file.close();
 
     calculateTempoTimestamps();
 
@@ -391,16 +406,16 @@ done:
 // Parse and ensure the MIDI Header is legitimate
 //
 bool
-MIDIFileReader::parseHeader(const string &midiHeader)
+MIDIFileReader::parseHeader(Cursor &cursor)
 {
-    if (midiHeader.size() < 14) {
+    if (cursor.end - cursor.pos < 14) {
 #ifdef MIDI_DEBUG
         SVDEBUG << "MIDIFileReader::parseHeader() - file header undersized" << endl;
 #endif
         return false;
     }
 
-    if (midiHeader.compare(0, 4, MIDI_FILE_HEADER) != 0) {
+    if (getMIDIBytes(cursor, 4).compare(0, 4, MIDI_FILE_HEADER) != 0) {
 #ifdef MIDI_DEBUG
 	SVDEBUG << "MIDIFileReader::parseHeader()"
 	     << "- file header not found or malformed"
@@ -409,7 +424,7 @@ MIDIFileReader::parseHeader(const string &midiHeader)
 	return false;
     }
 
-    if (midiBytesToLong(midiHeader.substr(4,4)) != 6L) {
+    if (getMIDILong(cursor) != 6L) {
 #ifdef MIDI_DEBUG
         SVDEBUG << "MIDIFileReader::parseHeader()"
 	     << " - header length incorrect"
@@ -418,9 +433,9 @@ MIDIFileReader::parseHeader(const string &midiHeader)
         return false;
     }
 
-    m_format = (MIDIFileFormatType) midiBytesToInt(midiHeader.substr(8,2));
-    m_numberOfTracks = midiBytesToInt(midiHeader.substr(10,2));
-    m_timingDivision = midiBytesToInt(midiHeader.substr(12,2));
+    m_format = (MIDIFileFormatType) getMIDIInt(cursor);
+    m_numberOfTracks = getMIDIInt(cursor);
+    m_timingDivision = getMIDIInt(cursor);
 
     if (m_timingDivision >= 32768) {
         m_smpte = true;
@@ -433,12 +448,67 @@ MIDIFileReader::parseHeader(const string &midiHeader)
     return true; 
 }
 
-// Extract the contents from a MIDI file track and places it into
-// our local map of MIDI events.
+// Parse every step'th chunk starting at from, catching any exceptions
+// and leaving them in the chunk's error string.
 //
-bool
-MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
+void
+MIDIFileReader::parseChunks(std::vector<ChunkData> &chunks,
+                            int from, int step) const
 {
+    for (int i = from; i < int(chunks.size()); i += step) {
+
+        ChunkData &chunk = chunks[i];
+
+        try {
+            parseTrack(chunk);
+        } catch (const MIDIException &e) {
+            SVDEBUG << "MIDIFileReader::parseChunks() - caught exception - " << e.what() << endl;
+            chunk.error = e.what();
+            continue;
+        }
+
+        for (unsigned int track = 0; track < chunk.tracks.size(); ++track) {
+
+            // returns true if some notes exist
+            if (consolidateNoteOffEvents(chunk.tracks[track])) {
+                chunk.loadableTracks.insert(track);
+            }
+        }
+
+        // Record any tempo events; these are meta events, so are
+        // found in the first track
+        if (!chunk.tracks.empty()) {
+            const MIDITrack &track = chunk.tracks[0];
+            for (MIDITrack::const_iterator e = track.begin();
+                 e != track.end(); ++e) {
+                if (e->isMeta() &&
+                    e->getMetaEventCode() == MIDI_SET_TEMPO) {
+                    string message = e->getMetaMessage();
+                    if (message.length() < 3) continue;
+                    MIDIByte m0 = message[0];
+                    MIDIByte m1 = message[1];
+                    MIDIByte m2 = message[2];
+                    long tempo = (((m0 << 8) + m1) << 8) + m2;
+                    if (tempo != 0) {
+                        double qpm = 60000000.0 / double(tempo);
+                        chunk.tempoChanges.push_back
+                            (std::pair<unsigned long, double>(e->getTime(),
+                                                               qpm));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Extract the contents from a MIDI file track chunk and place them
+// into the chunk's own tracks, with absolute times.
+//
+void
+MIDIFileReader::parseTrack(ChunkData &data) const
+{
+    Cursor cursor = data.chunk;
+
     MIDIByte midiByte, metaEventCode, data1, data2;
     MIDIByte eventCode = 0x80;
     string metaMessage;
@@ -446,33 +516,28 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
     long deltaTime;
     long accumulatedTime = 0;
 
-    // The trackNum passed in to this method is the default track for
-    // all events provided they're all on the same channel.  If we find
-    // events on more than one channel, we increment trackNum and record
-    // the mapping from channel to trackNum in this channelTrackMap.
-    // We then return the new trackNum by reference so the calling
-    // method knows we've got more tracks than expected.
+    // All events go into track zero, provided they're all on the same
+    // channel.  If we find events on more than one channel, we add a
+    // track and record the mapping from channel to track number in
+    // this channelTrackMap.
 
     // This would be a vector<unsigned int> but we need -1 to indicate
     // "not yet used"
     vector<int> channelTrackMap(16, -1);
 
-    // This is used to store the last absolute time found on each track,
-    // allowing us to modify delta-times correctly when separating events
-    // out from one to multiple tracks
-    //
-    map<int, unsigned long> trackTimeMap;
-
     // Meta-events don't have a channel, so we place them in a fixed
     // track number instead
-    unsigned int metaTrack = lastTrackNum;
+    unsigned int metaTrack = 0;
+    unsigned int lastTrackNum = 0;
+
+    data.tracks.resize(1);
 
     // Remember the last non-meta status byte (-1 if we haven't seen one)
     int runningStatus = -1;
 
     bool firstTrack = true;
 
-    while (!m_midiFile->eof() && (m_trackByteCount > 0)) {
+    while (cursor.pos < cursor.end) {
 
 	if (eventCode < 0x80) {
 #ifdef MIDI_DEBUG
@@ -482,14 +547,14 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
 	    throw MIDIException(tr("Invalid event code %1 found").arg(int(eventCode)));
 	}
 
-        deltaTime = getNumberFromMIDIBytes();
+        deltaTime = getNumberFromMIDIBytes(cursor);
 
 #ifdef MIDI_DEBUG
 	SVDEBUG << "read delta time " << deltaTime << endl;
 #endif
 
         // Get a single byte
-        midiByte = getMIDIByte();
+        midiByte = getMIDIByte(cursor);
 
         if (!(midiByte & MIDI_STATUS_BYTE_MASK)) {
 
@@ -508,57 +573,49 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
 	    SVDEBUG << "have new event code " << int(midiByte) << endl;
 #endif
             eventCode = midiByte;
-	    data1 = getMIDIByte();
+	    data1 = getMIDIByte(cursor);
 	}
 
+        // Events are given their absolute times within the track
+        accumulatedTime += deltaTime;
+
         if (eventCode == MIDI_FILE_META_EVENT) {
 
 	    metaEventCode = data1;
-            messageLength = getNumberFromMIDIBytes();
-
-//#ifdef MIDI_DEBUG
-		SVDEBUG << "Meta event of type " << int(metaEventCode) << " and " << messageLength << " bytes found, putting on track " << metaTrack << endl;
-//#endif
-            metaMessage = getMIDIBytes(messageLength);
-
-	    long gap = accumulatedTime - trackTimeMap[metaTrack];
-	    accumulatedTime += deltaTime;
-	    deltaTime += gap;
-	    trackTimeMap[metaTrack] = accumulatedTime;
+            messageLength = getNumberFromMIDIBytes(cursor);
 
-            MIDIEvent *e = new MIDIEvent(deltaTime,
-                                         MIDI_FILE_META_EVENT,
-                                         metaEventCode,
-                                         metaMessage);
+#ifdef MIDI_DEBUG
+            SVDEBUG << "Meta event of type " << int(metaEventCode) << " and " << messageLength << " bytes found, putting on track " << metaTrack << endl;
+#endif
+            metaMessage = getMIDIBytes(cursor, messageLength);
 
-	    m_midiComposition[metaTrack].push_back(e);
+	    data.tracks[metaTrack].push_back(MIDIEvent(accumulatedTime,
+                                                       MIDI_FILE_META_EVENT,
+                                                       metaEventCode,
+                                                       metaMessage));
 
 	    if (metaEventCode == MIDI_TRACK_NAME) {
-		m_trackNames[metaTrack] = metaMessage.c_str();
+                data.haveName = true;
+		data.name = metaMessage.c_str();
 	    }
 
         } else { // non-meta events
 
 	    runningStatus = eventCode;
 
-            MIDIEvent *midiEvent;
-
 	    int channel = (eventCode & MIDI_CHANNEL_NUM_MASK);
 	    if (channelTrackMap[channel] == -1) {
-		if (!firstTrack) ++lastTrackNum;
-		else firstTrack = false;
+		if (!firstTrack) {
+                    ++lastTrackNum;
+                    data.tracks.resize(lastTrackNum + 1);
+                } else {
+                    firstTrack = false;
+                }
 		channelTrackMap[channel] = lastTrackNum;
 	    }
 
 	    unsigned int trackNum = channelTrackMap[channel];
-	    
-	    // accumulatedTime is abs time of last event on any track;
-	    // trackTimeMap[trackNum] is that of last event on this track
-	    
-	    long gap = accumulatedTime - trackTimeMap[trackNum];
-	    accumulatedTime += deltaTime;
-	    deltaTime += gap;
-	    trackTimeMap[trackNum] = accumulatedTime;
+            MIDITrack &track = data.tracks[trackNum];
 
             switch (eventCode & MIDI_MESSAGE_TYPE_MASK) {
 
@@ -566,51 +623,44 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
             case MIDI_NOTE_OFF:
             case MIDI_POLY_AFTERTOUCH:
             case MIDI_CTRL_CHANGE:
-                data2 = getMIDIByte();
+                data2 = getMIDIByte(cursor);
 
                 // create and store our event
-                midiEvent = new MIDIEvent(deltaTime, eventCode, data1, data2);
-
-                /*
-		SVDEBUG << "MIDI event for channel " << channel << " (track "
-			  << trackNum << ")" << endl;
-		midiEvent->print();
-                          */
-
-
-                m_midiComposition[trackNum].push_back(midiEvent);
+                track.push_back(MIDIEvent(accumulatedTime,
+                                          eventCode, data1, data2));
 
-		if (midiEvent->getChannelNumber() == MIDI_PERCUSSION_CHANNEL) {
-		    m_percussionTracks.insert(trackNum);
+		if (channel == MIDI_PERCUSSION_CHANNEL) {
+		    data.percussionTracks.insert(trackNum);
 		}
 
                 break;
 
             case MIDI_PITCH_BEND:
-                data2 = getMIDIByte();
+                data2 = getMIDIByte(cursor);
 
                 // create and store our event
-                midiEvent = new MIDIEvent(deltaTime, eventCode, data1, data2);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                track.push_back(MIDIEvent(accumulatedTime,
+                                          eventCode, data1, data2));
                 break;
 
             case MIDI_PROG_CHANGE:
             case MIDI_CHNL_AFTERTOUCH:
                 // create and store our event
-                midiEvent = new MIDIEvent(deltaTime, eventCode, data1);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                track.push_back(MIDIEvent(accumulatedTime,
+                                          eventCode, data1));
                 break;
 
             case MIDI_SYSTEM_EXCLUSIVE:
-                messageLength = getNumberFromMIDIBytes(data1);
+                messageLength = getNumberFromMIDIBytes(cursor, data1);
 
 #ifdef MIDI_DEBUG
 		SVDEBUG << "SysEx of " << messageLength << " bytes found" << endl;
 #endif
 
-                metaMessage= getMIDIBytes(messageLength);
+                metaMessage = getMIDIBytes(cursor, messageLength);
 
-                if (MIDIByte(metaMessage[metaMessage.length() - 1]) !=
+                if (metaMessage.empty() ||
+                    MIDIByte(metaMessage[metaMessage.length() - 1]) !=
                         MIDI_END_OF_EXCLUSIVE)
                 {
 #ifdef MIDI_DEBUG
@@ -626,10 +676,9 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
                 //
                 metaMessage = metaMessage.substr(0, metaMessage.length()-1);
 
-                midiEvent = new MIDIEvent(deltaTime,
+                track.push_back(MIDIEvent(accumulatedTime,
                                           MIDI_SYSTEM_EXCLUSIVE,
-                                          metaMessage);
-                m_midiComposition[trackNum].push_back(midiEvent);
+                                          metaMessage));
                 break;
 
             default:
@@ -642,96 +691,81 @@ MIDIFileReader::parseTrack(unsigned int &lastTrackNum)
             } 
         }
     }
-
-    if (lastTrackNum > metaTrack) {
-	for (unsigned int track = metaTrack + 1; track <= lastTrackNum; ++track) {
-	    m_trackNames[track] = QString("%1 <%2>")
-		.arg(m_trackNames[metaTrack]).arg(track - metaTrack + 1);
-	}
-    }
-
-    return true;
 }
 
 // Delete dead NOTE OFF and NOTE ON/Zero Velocity Events after
 // reading them and modifying their relevant NOTE ONs.  Return true
 // if there are some notes in this track.
 //
+// Each note-off is matched with the earliest still-open note-on of
+// the same channel and pitch that precedes it. This gives the same
+// pairing as searching forward from each note-on in turn for the
+// first unused note-off, but in a single pass.
+//
 bool
-MIDIFileReader::consolidateNoteOffEvents(unsigned int track)
+MIDIFileReader::consolidateNoteOffEvents(MIDITrack &track)
 {
-    bool notesOnTrack = false;
-    bool noteOffFound;
-
-    for (MIDITrack::iterator i = m_midiComposition[track].begin();
-	 i != m_midiComposition[track].end(); i++) {
+    if (track.empty()) return false;
 
-        if ((*i)->getMessageType() == MIDI_NOTE_ON && (*i)->getVelocity() > 0) {
+    bool notesOnTrack = false;
 
-	    notesOnTrack = true;
-            noteOffFound = false;
+    // Indices of open note-ons, by channel * 256 + pitch
+    vector<std::deque<size_t> > open(16 * 256);
 
-            for (MIDITrack::iterator j = i;
-		 j != m_midiComposition[track].end(); j++) {
+    // For each note-off that has been matched, the index of its note-on
+    vector<bool> consumed(track.size(), false);
+    vector<size_t> consumedBy(track.size(), 0);
 
-                if (((*j)->getChannelNumber() == (*i)->getChannelNumber()) &&
-		    ((*j)->getPitch() == (*i)->getPitch()) &&
-                    ((*j)->getMessageType() == MIDI_NOTE_OFF ||
-                    ((*j)->getMessageType() == MIDI_NOTE_ON &&
-                     (*j)->getVelocity() == 0x00))) {
+    for (size_t i = 0; i < track.size(); ++i) {
 
-                    (*i)->setDuration((*j)->getTime() - (*i)->getTime());
+        MIDIEvent &e = track[i];
+        MIDIByte type = e.getMessageType();
 
-                    delete *j;
-                    m_midiComposition[track].erase(j);
+        if (e.isMeta()) continue;
+        if (type != MIDI_NOTE_ON && type != MIDI_NOTE_OFF) continue;
 
-                    noteOffFound = true;
-                    break;
-                }
-            }
+        std::deque<size_t> &q =
+            open[e.getChannelNumber() * 256 + e.getPitch()];
 
-            // If no matching NOTE OFF has been found then set
-            // Event duration to length of track
-            //
-            if (!noteOffFound) {
-		MIDITrack::iterator j = m_midiComposition[track].end();
-		--j;
-                (*i)->setDuration((*j)->getTime() - (*i)->getTime());
-	    }
+        if (type == MIDI_NOTE_ON && e.getVelocity() > 0) {
+            notesOnTrack = true;
+            q.push_back(i);
+        } else if (!q.empty()) {
+            MIDIEvent &on = track[q.front()];
+            on.setDuration(e.getTime() - on.getTime());
+            consumed[i] = true;
+            consumedBy[i] = q.front();
+            q.pop_front();
         }
     }
 
-    return notesOnTrack;
-}
-
-// Add any tempo events found in the given track to the global tempo map.
-//
-void
-MIDIFileReader::updateTempoMap(unsigned int track)
-{
-    SVDEBUG << "updateTempoMap for track " << track << " (" << m_midiComposition[track].size() << " events)" << endl;
-
-    for (MIDITrack::iterator i = m_midiComposition[track].begin();
-	 i != m_midiComposition[track].end(); ++i) {
-
-        if ((*i)->isMeta() &&
-	    (*i)->getMetaEventCode() == MIDI_SET_TEMPO) {
+    if (!notesOnTrack) return false;
 
-	    MIDIByte m0 = (*i)->getMetaMessage()[0];
-	    MIDIByte m1 = (*i)->getMetaMessage()[1];
-	    MIDIByte m2 = (*i)->getMetaMessage()[2];
-	    
-	    long tempo = (((m0 << 8) + m1) << 8) + m2;
+    // If no matching NOTE OFF has been found then set Event duration
+    // to length of track, i.e. up to the last event not already
+    // removed by an earlier note
+    //
+    vector<size_t> unmatched;
+    for (size_t i = 0; i < open.size(); ++i) {
+        unmatched.insert(unmatched.end(), open[i].begin(), open[i].end());
+    }
+    std::sort(unmatched.begin(), unmatched.end());
 
-	    SVDEBUG << "updateTempoMap: have tempo, it's " << tempo << " at " << (*i)->getTime() << endl;
+    size_t last = track.size() - 1;
+    for (size_t i = 0; i < unmatched.size(); ++i) {
+        size_t j = unmatched[i];
+        while (consumed[last] && consumedBy[last] < j) --last;
+        track[j].setDuration(track[last].getTime() - track[j].getTime());
+    }
 
-	    if (tempo != 0) {
-		double qpm = 60000000.0 / double(tempo);
-		m_tempoMap[(*i)->getTime()] =
-		    TempoChange(RealTime::zeroTime, qpm);
-	    }
-        }
+    MIDITrack remaining;
+    remaining.reserve(track.size());
+    for (size_t i = 0; i < track.size(); ++i) {
+        if (!consumed[i]) remaining.push_back(track[i]);
     }
+    track.swap(remaining);
+
+    return notesOnTrack;
 }
 
 void
@@ -945,27 +979,25 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
 
     bool sharpKey = true;
 
-    for (MIDITrack::const_iterator i = track.begin(); i != track.end(); ++i) {
+    // Notes are gathered up and added to the model in one go at the
+    // end of the track
+    NoteModel::PointVector notes;
+    notes.reserve(track.size());
 
-        RealTime rt;
-        unsigned long midiTime = (*i)->getTime();
+    int lastProgress = -1;
 
-        if (m_smpte) {
-            rt = RealTime::frame2RealTime(midiTime, m_fps * m_subframes);
-        } else {
-            rt = getTimeForMIDITime(midiTime);
-        }
+    for (MIDITrack::const_iterator i = track.begin(); i != track.end(); ++i) {
 
 	// We ignore most of these event types for now, though in
 	// theory some of the text ones could usefully be incorporated
 
-	if ((*i)->isMeta()) {
+	if (i->isMeta()) {
 
-	    switch((*i)->getMetaEventCode()) {
+	    switch(i->getMetaEventCode()) {
 
 	    case MIDI_KEY_SIGNATURE:
-		// minorKey = (int((*i)->getMetaMessage()[1]) != 0);
-		sharpKey = (int((*i)->getMetaMessage()[0]) >= 0);
+		// minorKey = (int(i->getMetaMessage()[1]) != 0);
+		sharpKey = (int(i->getMetaMessage()[0]) >= 0);
 		break;
 
 	    case MIDI_TEXT_EVENT:
@@ -997,17 +1029,20 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
 
 	} else {
 
-	    switch ((*i)->getMessageType()) {
+	    switch (i->getMessageType()) {
 
 	    case MIDI_NOTE_ON:
 
-                if ((*i)->getVelocity() == 0) break; // effective note-off
+                if (i->getVelocity() == 0) break; // effective note-off
 		else {
-		    RealTime endRT;
-                    unsigned long endMidiTime = (*i)->getTime() + (*i)->getDuration();
+		    RealTime rt, endRT;
+                    unsigned long midiTime = i->getTime();
+                    unsigned long endMidiTime = i->getTime() + i->getDuration();
                     if (m_smpte) {
+                        rt = RealTime::frame2RealTime(midiTime, m_fps * m_subframes);
                         endRT = RealTime::frame2RealTime(endMidiTime, m_fps * m_subframes);
                     } else {
+                        rt = getTimeForMIDITime(midiTime);
                         endRT = getTimeForMIDITime(endMidiTime);
                     }
 
@@ -1017,21 +1052,21 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
 		    long endFrame = RealTime::realTime2Frame
 			(endRT, model->getSampleRate());
 
-		    QString pitchLabel = Pitch::getPitchLabel((*i)->getPitch(),
+		    QString pitchLabel = Pitch::getPitchLabel(i->getPitch(),
 							      0, 
 							      !sharpKey);
 
 		    QString noteLabel = tr("%1 - vel %2")
-			.arg(pitchLabel).arg(int((*i)->getVelocity()));
+			.arg(pitchLabel).arg(int(i->getVelocity()));
 
-                    float level = float((*i)->getVelocity()) / 128.f;
+                    float level = float(i->getVelocity()) / 128.f;
 
-		    Note note(startFrame, (*i)->getPitch(),
+		    Note note(startFrame, i->getPitch(),
 			      endFrame - startFrame, level, noteLabel);
 
-//		    SVDEBUG << "Adding note " << startFrame << "," << (endFrame-startFrame) << " : " << int((*i)->getPitch()) << endl;
+//		    SVDEBUG << "Adding note " << startFrame << "," << (endFrame-startFrame) << " : " << int(i->getPitch()) << endl;
 
-		    model->addPoint(note);
+		    notes.push_back(note);
 		    break;
 		}
 
@@ -1052,11 +1087,16 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
             }
 	}
 
-	model->setCompletion(minProgress +
-			     (count * progressAmount) / totalEvents);
+        int progress = minProgress + (count * progressAmount) / totalEvents;
+        if (progress != lastProgress) {
+            model->setCompletion(progress);
+            lastProgress = progress;
+        }
 	++count;
     }
 
+    model->addPoints(notes);
+
     return model;
 }
 
@@ -23,6 +23,7 @@
 
 #include "DataFileReader.h"
 #include "base/RealTime.h"
+#include "data/midi/MIDIEvent.h"
 
 #include <map>
 #include <set>
@@ -30,10 +31,6 @@
 
 #include <QObject>
 
-class MIDIEvent;
-
-typedef unsigned char MIDIByte;
-
 class MIDIFileImportPreferenceAcquirer // welcome to our grand marble foyer
 {
 public:
@@ -69,7 +66,7 @@ public:
     virtual Model *load() const;
 
 protected:
-    typedef std::vector<MIDIEvent *> MIDITrack;
+    typedef std::vector<MIDIEvent> MIDITrack;
     typedef std::map<unsigned int, MIDITrack> MIDIComposition;
     typedef std::pair<RealTime, double> TempoChange; // time, qpm
     typedef std::map<unsigned long, TempoChange> TempoMap; // key is MIDI time
@@ -81,31 +78,56 @@ protected:
 	MIDI_FILE_BAD_FORMAT            = 0xFF
     } MIDIFileFormatType;
 
+    // A read position within the file data, bounded by the end of
+    // the current chunk (or of the file)
+    struct Cursor {
+        const MIDIByte *pos;
+        const MIDIByte *end;
+    };
+
+    // The result of parsing a single track chunk. A chunk whose
+    // events use more than one channel is split into one track per
+    // channel; these are numbered from zero here, and renumbered
+    // when the chunks are merged. Meta events go in track zero.
+    struct ChunkData {
+        Cursor chunk;
+        std::vector<MIDITrack> tracks;
+        std::set<unsigned int> loadableTracks;
+        std::set<unsigned int> percussionTracks;
+        bool haveName;
+        QString name;
+        std::vector<std::pair<unsigned long, double> > tempoChanges;
+        QString error;
+        ChunkData() : haveName(false) { }
+    };
+
+    class ParseThread;
+
     bool parseFile();
-    bool parseHeader(const std::string &midiHeader);
-    bool parseTrack(unsigned int &trackNum);
+    bool parseHeader(Cursor &cursor);
+    void parseTrack(ChunkData &data) const;
+    void parseChunks(std::vector<ChunkData> &chunks, int from, int step) const;
 
     Model *loadTrack(unsigned int trackNum,
 		     Model *existingModel = 0,
 		     int minProgress = 0,
 		     int progressAmount = 100) const;
 
-    bool consolidateNoteOffEvents(unsigned int track);
-    void updateTempoMap(unsigned int track);
+    static bool consolidateNoteOffEvents(MIDITrack &track);
     void calculateTempoTimestamps();
     RealTime getTimeForMIDITime(unsigned long midiTime) const;
 
     // Internal convenience functions
     //
-    int  midiBytesToInt(const std::string &bytes);
-    long midiBytesToLong(const std::string &bytes);
+    static int  getMIDIInt(Cursor &cursor);
+    static long getMIDILong(Cursor &cursor);
 
-    long getNumberFromMIDIBytes(int firstByte = -1);
+    static long getNumberFromMIDIBytes(Cursor &cursor, int firstByte = -1);
 
-    MIDIByte getMIDIByte();
-    std::string getMIDIBytes(unsigned long bytes);
+    static MIDIByte getMIDIByte(Cursor &cursor);
+    static std::string getMIDIBytes(Cursor &cursor, unsigned long bytes);
 
-    bool skipToNextTrack();
+    static bool skipToNextTrack(Cursor &cursor, Cursor &track);
 
     bool                   m_smpte;
     int                    m_timingDivision;   // pulses per quarter note
@@ -114,9 +136,6 @@ protected:
     MIDIFileFormatType     m_format;
     unsigned int           m_numberOfTracks;
 
-    long                   m_trackByteCount;
-    bool                   m_decrementCount;
-
     std::map<int, QString> m_trackNames;
     std::set<unsigned int> m_loadableTracks;
     std::set<unsigned int> m_percussionTracks;
@@ -124,7 +143,6 @@ protected:
     TempoMap               m_tempoMap;
 
     QString                m_path;
-    std::ifstream         *m_midiFile;
     size_t                 m_fileSize;
     QString                m_error;
     sv_samplerate_t        m_mainModelSampleRate;
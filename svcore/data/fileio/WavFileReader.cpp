@@ -140,23 +140,34 @@ WavFileReader::updateDone()
 
 floatvec_t
 WavFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
+{
+    floatvec_t data;
+    getInterleavedFramesInto(start, count, data);
+    return data;
+}
+
+void
+WavFileReader::getInterleavedFramesInto(sv_frame_t start, sv_frame_t count,
+                                        floatvec_t &buffer) const
 {
     static HitCount lastRead("WavFileReader: last read");
 
-    if (count == 0) return {};
+    buffer.clear();
+    
+    if (count == 0) return;
 
     QMutexLocker locker(&m_mutex);
 
     Profiler profiler("WavFileReader::getInterleavedFrames");
     
     if (!m_file || !m_channelCount) {
-        return {};
+        return;
     }
 
     if (start >= m_fileInfo.frames) {
 //        SVDEBUG << "WavFileReader::getInterleavedFrames: " << start
 //                  << " > " << m_fileInfo.frames << endl;
-        return {};
+        return;
     }
 
     if (start + count > m_fileInfo.frames) {
@@ -168,7 +179,8 @@ WavFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
     // repeatedly for the same data. So this is worth cacheing.
     if (start == m_lastStart && count == m_lastCount) {
         lastRead.hit();
-        return m_buffer;
+        buffer = m_buffer;
+        return;
     }
 
     // We don't actually support partial cache reads, but let's use
@@ -181,23 +193,28 @@ WavFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
     }
     
     if (sf_seek(m_file, start, SEEK_SET) < 0) {
-        return {};
+        return;
     }
 
-    floatvec_t data;
     sv_frame_t n = count * m_fileInfo.channels;
-    data.resize(n);
+    buffer.resize(n);
 
     m_lastStart = start;
     m_lastCount = count;
     
     sf_count_t readCount = 0;
-    if ((readCount = sf_readf_float(m_file, data.data(), count)) < 0) {
-        return {};
+    if ((readCount = sf_readf_float(m_file, buffer.data(), count)) < 0) {
+        buffer.clear();
+        return;
     }
 
-    m_buffer = data;
-    return data;
+    // A short read leaves the rest zeroed, as it would be in a newly
+    // allocated vector
+    for (sv_frame_t i = readCount * m_fileInfo.channels; i < n; ++i) {
+        buffer[i] = 0.f;
+    }
+
+    m_buffer = buffer;
 }
 
 void
@@ -56,6 +56,8 @@ public:
      * arguments on the same object at the same time.
      */
     virtual floatvec_t getInterleavedFrames(sv_frame_t start, sv_frame_t count) const;
+    virtual void getInterleavedFramesInto(sv_frame_t start, sv_frame_t count,
+                                          floatvec_t &buffer) const;
     
     static void getSupportedExtensions(std::set<QString> &extensions);
     static bool supportsExtension(QString ext);
@@ -0,0 +1,137 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_BZIP_FILE_DEVICE_H
+#define TEST_BZIP_FILE_DEVICE_H
+
+#include "../BZipFileDevice.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryFile>
+
+#include <bzlib.h>
+
+#include <iostream>
+
+using namespace std;
+
+class BZipFileDeviceTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QByteArray testData() {
+        // Several blocks' worth of session-like text, with a long run
+        // in the middle to exercise bzip2's run-length encoding
+        QByteArray data;
+        for (int n = 0; n < 60000; ++n) {
+            data.append("<point frame=\"" + QByteArray::number(n * 512) +
+                        "\" value=\"" + QByteArray::number(n % 97) +
+                        "\" label=\"\" />\n");
+            if (n == 30000) data.append(QByteArray(300000, 'x'));
+        }
+        return data;
+    }
+
+    bool write(QString fileName, const QByteArray &data, bool parallel) {
+        BZipFileDevice device(fileName, parallel);
+        if (!device.open(QIODevice::WriteOnly)) return false;
+        // in uneven pieces, as a QTextStream would write them
+        int pos = 0, piece = 1000;
+        while (pos < data.size()) {
+            int n = std::min(piece, data.size() - pos);
+            if (device.write(data.constData() + pos, n) != n) return false;
+            pos += n;
+            piece = (piece * 7) % 65536 + 1;
+        }
+        bool ok = device.isOK();
+        device.close();
+        return ok;
+    }
+
+    QByteArray read(QString fileName, bool parallel) {
+        BZipFileDevice device(fileName, parallel);
+        if (!device.open(QIODevice::ReadOnly)) return QByteArray();
+        QByteArray data = device.readAll();
+        device.close();
+        return data;
+    }
+
+public:
+    BZipFileDeviceTest(QString) { }
+
+private slots:
+    void roundTrip()
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.close();
+
+        QByteArray data = testData();
+        QVERIFY(write(file.fileName(), data, true));
+
+        QCOMPARE(read(file.fileName(), true), data);
+        QCOMPARE(read(file.fileName(), false), data);
+    }
+
+    void singleStream()
+    {
+        // The parallel writer must produce one standard stream that
+        // libbz2 can decode in a single call, not a concatenation
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.close();
+
+        QByteArray data = testData();
+        QVERIFY(write(file.fileName(), data, true));
+
+        QVERIFY(file.open());
+        QByteArray compressed = file.readAll();
+        file.close();
+
+        QByteArray decompressed(data.size() + 1, '\0');
+        unsigned int size = decompressed.size();
+        QCOMPARE(BZ2_bzBuffToBuffDecompress
+                 (decompressed.data(), &size,
+                  compressed.data(), compressed.size(), 0, 0), BZ_OK);
+        decompressed.resize(size);
+        QCOMPARE(decompressed, data);
+    }
+
+    void serialToParallel()
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.close();
+
+        QByteArray data = testData();
+        QVERIFY(write(file.fileName(), data, false));
+        QCOMPARE(read(file.fileName(), true), data);
+    }
+
+    void empty()
+    {
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.close();
+
+        QVERIFY(write(file.fileName(), QByteArray(), true));
+        QCOMPARE(read(file.fileName(), true), QByteArray());
+        QCOMPARE(read(file.fileName(), false), QByteArray());
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_CSV_FILE_READER_H
+#define TEST_CSV_FILE_READER_H
+
+#include "../CSVFileReader.h"
+#include "../CSVFormat.h"
+
+#include "../../model/SparseTimeValueModel.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QBuffer>
+#include <QTemporaryFile>
+
+#include "base/Debug.h"
+
+#include <iostream>
+
+using namespace std;
+
+class CSVFileReaderTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    CSVFormat timeValueFormat() {
+        CSVFormat format;
+        format.setModelType(CSVFormat::TwoDimensionalModel);
+        format.setTimingType(CSVFormat::ExplicitTiming);
+        format.setTimeUnits(CSVFormat::TimeSeconds);
+        format.setSeparator(',');
+        format.setAllowQuoting(true);
+        format.setColumnCount(2);
+        QList<CSVFormat::ColumnPurpose> purposes;
+        purposes << CSVFormat::ColumnStartTime << CSVFormat::ColumnValue;
+        format.setColumnPurposes(purposes);
+        return format;
+    }
+    
+public:
+    CSVFileReaderTest(QString) { }
+
+private slots:
+    void lineEndings()
+    {
+        // Mixed LF, CR and CR/LF endings, a comment, a blank line and
+        // a quoted value, which has to go the slow way
+        QByteArray data("0.0,1\r0.5,2\n# comment\n\n1.0,\"3\"\r\n1.5,4");
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        
+        CSVFileReader reader(&buffer, timeValueFormat(), 100);
+        QVERIFY(reader.isOK());
+
+        Model *m = reader.load();
+        SparseTimeValueModel *model = dynamic_cast<SparseTimeValueModel *>(m);
+        QVERIFY(model);
+        QCOMPARE(model->getPointCount(), 4);
+
+        const SparseTimeValueModel::PointList &points = model->getPoints();
+        SparseTimeValueModel::PointList::const_iterator i = points.begin();
+        for (int n = 0; n < 4; ++n, ++i) {
+            QCOMPARE(i->frame, sv_frame_t(n * 50));
+            QCOMPARE(i->value, float(n + 1));
+        }
+        delete m;
+    }
+
+    void largeFile()
+    {
+        // Big enough to be mapped and split across several threads
+        QTemporaryFile file;
+        QVERIFY(file.open());
+
+        int count = 200000;
+        for (int n = 0; n < count; ++n) {
+            QByteArray line = QByteArray::number(n * 0.01, 'f', 2) + "," +
+                QByteArray::number(n % 100) + "\n";
+            file.write(line);
+        }
+        file.close();
+        QVERIFY(file.size() > 1024 * 1024);
+
+        CSVFileReader reader(file.fileName(), timeValueFormat(), 100);
+        QVERIFY(reader.isOK());
+
+        Model *m = reader.load();
+        SparseTimeValueModel *model = dynamic_cast<SparseTimeValueModel *>(m);
+        QVERIFY(model);
+        QCOMPARE(model->getPointCount(), count);
+        
+        const SparseTimeValueModel::PointList &points = model->getPoints();
+        QCOMPARE(points.begin()->frame, sv_frame_t(0));
+        QCOMPARE(points.rbegin()->frame, sv_frame_t(count - 1));
+        QCOMPARE(points.rbegin()->value, float((count - 1) % 100));
+
+        sv_frame_t expected = 0;
+        for (SparseTimeValueModel::PointList::const_iterator i = points.begin();
+             i != points.end(); ++i) {
+            if (i->frame != expected) {
+                QCOMPARE(i->frame, expected);
+            }
+            ++expected;
+        }
+        delete m;
+    }
+};
+
+#endif
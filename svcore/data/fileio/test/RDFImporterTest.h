@@ -0,0 +1,142 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_RDF_IMPORTER_H
+#define TEST_RDF_IMPORTER_H
+
+#include "rdf/RDFImporter.h"
+#include "data/model/Model.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QDir>
+#include <QRegExp>
+
+#include "base/Debug.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+class RDFImporterTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString testDirBase;
+    QString rdfDir;
+
+    // The same document read through the streaming reader and
+    // through the triple store should give the same models, though
+    // not necessarily in the same order. Compare them through their
+    // XML, less the export ids, which differ from one model to the
+    // next regardless of content
+
+    QStringList load(QString filename, RDFImporter::ReadMode mode,
+                     QString &error) {
+
+        RDFImporter importer(rdfDir + "/" + filename, 44100, mode);
+        QStringList result;
+        if (!importer.isOK()) {
+            error = importer.getErrorString();
+            return result;
+        }
+
+        vector<Model *> models = importer.getDataModels(nullptr);
+        if (!importer.isOK()) {
+            error = importer.getErrorString();
+        }
+
+        QRegExp ids(" (id|dataset|model|sourceModel|mainModel)=\"[0-9]+\"");
+        for (Model *m: models) {
+            QString xml = m->toXmlString();
+            xml.replace(ids, "");
+            result.push_back(QString("%1 %2\n%3")
+                             .arg(m->getTypeName())
+                             .arg(m->objectName())
+                             .arg(xml));
+            delete m;
+        }
+        result.sort();
+        return result;
+    }
+
+    void compare(QStringList a, QStringList b) {
+        QCOMPARE(a.size(), b.size());
+        for (int i = 0; i < a.size(); ++i) {
+            if (a[i] != b[i]) {
+                cerr << "Model " << i << " differs:\n" << a[i] << "\nvs\n"
+                     << b[i] << endl;
+            }
+            QCOMPARE(a[i], b[i]);
+        }
+    }
+
+public:
+    RDFImporterTest(QString base) {
+        if (base == "") {
+            base = "svcore/data/fileio/test";
+        }
+        testDirBase = base;
+        rdfDir = base + "/rdf";
+    }
+
+private slots:
+    void init()
+    {
+        if (!QDir(rdfDir).exists()) {
+            cerr << "ERROR: RDF file directory \"" << rdfDir << "\" does not exist" << endl;
+            QVERIFY2(QDir(rdfDir).exists(), "RDF file directory not found");
+        }
+    }
+
+    void turtleStreamedAndStored()
+    {
+        QString error;
+        QStringList streamed = load("features.ttl",
+                                    RDFImporter::ReadStreamingWherePossible,
+                                    error);
+        QCOMPARE(error, QString());
+        QStringList stored = load("features.ttl",
+                                  RDFImporter::ReadIntoStore,
+                                  error);
+        QCOMPARE(error, QString());
+
+        // instants, time-values, notes, text, and one dense feature
+        // of each height
+        QCOMPARE(streamed.size(), 6);
+        compare(streamed, stored);
+    }
+
+    void rdfXmlAndTurtle()
+    {
+        QString error;
+        QStringList xml = load("features.rdf",
+                               RDFImporter::ReadIntoStore,
+                               error);
+        if (error != "") {
+            // Not every triple store backend can parse RDF/XML
+            QSKIP("RDF/XML import not supported by this triple store");
+        }
+        QStringList streamed = load("features.ttl",
+                                    RDFImporter::ReadStreamingWherePossible,
+                                    error);
+        QCOMPARE(error, QString());
+        compare(xml, streamed);
+    }
+};
+
+#endif
@@ -3,8 +3,11 @@ TEST_HEADERS += \
 	     AudioFileReaderTest.h \
 	     AudioFileWriterTest.h \
 	     AudioTestData.h \
+             BZipFileDeviceTest.h \
+             CSVFileReaderTest.h \
              EncodingTest.h \
-             MIDIFileReaderTest.h
+             MIDIFileReaderTest.h \
+             RDFImporterTest.h
 	     
 TEST_SOURCES += \
 	     svcore-data-fileio-test.cpp
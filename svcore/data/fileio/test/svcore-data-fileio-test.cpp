@@ -14,8 +14,11 @@
 
 #include "AudioFileReaderTest.h"
 #include "AudioFileWriterTest.h"
+#include "BZipFileDeviceTest.h"
+#include "CSVFileReaderTest.h"
 #include "EncodingTest.h"
 #include "MIDIFileReaderTest.h"
+#include "RDFImporterTest.h"
 
 #include <QtTest>
 
@@ -58,6 +61,18 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        BZipFileDeviceTest t(testDir);
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        CSVFileReaderTest t(testDir);
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
     {
         EncodingTest t(testDir);
         if (QTest::qExec(&t, argc, argv) == 0) ++good;
@@ -70,6 +85,12 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        RDFImporterTest t(testDir);
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
     if (bad > 0) {
 	cerr << "\n********* " << bad << " test suite(s) failed!\n" << endl;
 	return 1;
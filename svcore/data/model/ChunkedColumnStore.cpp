@@ -0,0 +1,554 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ChunkedColumnStore.h"
+
+#include "base/StorageAdviser.h"
+#include "base/TempDirectory.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QMutexLocker>
+#include <QDir>
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+//#define DEBUG_CHUNKED_COLUMN_STORE 1
+
+// How much more resident data we accumulate before asking the
+// StorageAdviser again whether we should be spilling to disc
+static const size_t ADVICE_INTERVAL = 64 * 1024 * 1024;
+
+ChunkedColumnStore::ChunkedColumnStore(int chunkWidth) :
+    m_chunkWidth(std::max(chunkWidth, 1)),
+    m_width(0),
+    m_quantisation(NoQuantisation),
+    m_spillEnabled(true),
+    m_openChunk(-1),
+    m_useCount(0),
+    m_resident(0),
+    m_budget(0),
+    m_nextAdvice(ADVICE_INTERVAL),
+    m_file(0),
+    m_fileEnd(0)
+{
+}
+
+ChunkedColumnStore::~ChunkedColumnStore()
+{
+    for (Chunk *c: m_chunks) {
+        delete c;
+    }
+    if (m_file) {
+        m_file->close();
+        if (!m_file->remove()) {
+            SVDEBUG << "WARNING: ChunkedColumnStore::~ChunkedColumnStore: "
+                    << "Failed to delete spill file \"" << m_file->fileName()
+                    << "\"" << endl;
+        }
+        delete m_file;
+    }
+}
+
+void
+ChunkedColumnStore::setQuantisation(Quantisation q)
+{
+    QMutexLocker locker(&m_mutex);
+    m_quantisation = q;
+}
+
+ChunkedColumnStore::Quantisation
+ChunkedColumnStore::getQuantisation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_quantisation;
+}
+
+void
+ChunkedColumnStore::setSpillEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_spillEnabled = enabled;
+}
+
+void
+ChunkedColumnStore::setMemoryBudget(size_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget = bytes;
+    if (bytes > 0) {
+        m_nextAdvice = size_t(-1);
+    } else {
+        m_nextAdvice = m_resident + ADVICE_INTERVAL;
+    }
+    checkBudget();
+}
+
+int
+ChunkedColumnStore::getWidth() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_width;
+}
+
+size_t
+ChunkedColumnStore::getResidentSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_resident;
+}
+
+size_t
+ChunkedColumnStore::getElementSize(Quantisation q)
+{
+    switch (q) {
+    case Quantise16Bit: return sizeof(uint16_t);
+    case Quantise8Bit: return sizeof(uint8_t);
+    case NoQuantisation: default: return sizeof(float);
+    }
+}
+
+size_t
+ChunkedColumnStore::getChunkBytes(const Chunk *c)
+{
+    return c->offsets.size() * sizeof(int) +
+        c->values.capacity() * sizeof(float) +
+        c->packed.capacity();
+}
+
+ChunkedColumnStore::Column
+ChunkedColumnStore::getColumn(int x) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (x < 0 || x >= m_width) return Column();
+    
+    Chunk *c = m_chunks[x / m_chunkWidth];
+    int i = x % m_chunkWidth;
+    int from = c->offsets[i];
+    int n = c->offsets[i+1] - from;
+
+    Column col(n);
+    if (n == 0) return col;
+
+    if (c->state == Chunk::Spilled) {
+        if (!load(c)) {
+            return Column(n, 0.f);
+        }
+    } else {
+        touch(c);
+    }
+
+    if (c->state == Chunk::Open) {
+        std::copy(c->values.begin() + from, c->values.begin() + from + n,
+                  col.begin());
+        return col;
+    }
+
+    decode(c, from, n, col.data());
+    return col;
+}
+
+void
+ChunkedColumnStore::list(Chunk *c) const
+{
+    ChunkList &l = (c->fileValid ? m_saved : m_unsaved);
+    l.push_front(c);
+    c->position = l.begin();
+    c->listed = true;
+    c->lastUse = ++m_useCount;
+}
+
+void
+ChunkedColumnStore::unlist(Chunk *c) const
+{
+    if (!c->listed) return;
+    ChunkList &l = (c->fileValid ? m_saved : m_unsaved);
+    l.erase(c->position);
+    c->listed = false;
+}
+
+void
+ChunkedColumnStore::touch(Chunk *c) const
+{
+    c->lastUse = ++m_useCount;
+    if (c->listed) {
+        ChunkList &l = (c->fileValid ? m_saved : m_unsaved);
+        l.splice(l.begin(), l, c->position);
+    }
+}
+
+void
+ChunkedColumnStore::decode(const Chunk *c, int from, int n, float *out) const
+{
+    switch (c->quantisation) {
+
+    case NoQuantisation:
+        memcpy(out, c->packed.data() + from * sizeof(float), n * sizeof(float));
+        break;
+
+    case Quantise16Bit: {
+        const uint16_t *q =
+            reinterpret_cast<const uint16_t *>(c->packed.data()) + from;
+        float scale = (c->maximum - c->minimum) / 65535.f;
+        for (int i = 0; i < n; ++i) {
+            out[i] = c->minimum + float(q[i]) * scale;
+        }
+        break;
+    }
+
+    case Quantise8Bit: {
+        const uint8_t *q = c->packed.data() + from;
+        float scale = (c->maximum - c->minimum) / 255.f;
+        for (int i = 0; i < n; ++i) {
+            out[i] = c->minimum + float(q[i]) * scale;
+        }
+        break;
+    }
+    }
+}
+
+void
+ChunkedColumnStore::setColumn(int x, const Column &values)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (x < 0) return;
+
+    int ci = x / m_chunkWidth;
+    int i = x % m_chunkWidth;
+
+    while (int(m_chunks.size()) <= ci) {
+        Chunk *c = new Chunk(m_chunkWidth);
+        m_resident += getChunkBytes(c);
+        m_chunks.push_back(c);
+    }
+
+    // Seal the chunk we were last writing to, if we have moved on
+    // from it. When columns are set in order, as they are while a
+    // model is being calculated, this leaves only the chunk at the
+    // end unpacked.
+    
+    if (m_openChunk >= 0 && m_openChunk != ci) {
+        seal(m_chunks[m_openChunk]);
+    }
+    m_openChunk = ci;
+    
+    Chunk *c = m_chunks[ci];
+    if (c->state != Chunk::Open) {
+        unpack(c);
+    }
+
+    m_resident -= getChunkBytes(c);
+
+    int from = c->offsets[i];
+    int prev = c->offsets[i+1] - from;
+    int n = int(values.size());
+
+    if (n != prev) {
+        int delta = n - prev;
+        if (delta > 0) {
+            c->values.insert(c->values.begin() + from + prev, delta, 0.f);
+        } else {
+            c->values.erase(c->values.begin() + from + n,
+                            c->values.begin() + from + prev);
+        }
+        for (int j = i + 1; j <= m_chunkWidth; ++j) {
+            c->offsets[j] += delta;
+        }
+    }
+
+    std::copy(values.begin(), values.end(), c->values.begin() + from);
+    touch(c);
+
+    m_resident += getChunkBytes(c);
+
+    if (x >= m_width) m_width = x + 1;
+
+    checkBudget();
+}
+
+void
+ChunkedColumnStore::seal(Chunk *c)
+{
+    if (c->state != Chunk::Open) return;
+
+    m_resident -= getChunkBytes(c);
+
+    Quantisation q = m_quantisation;
+    int n = int(c->values.size());
+
+    bool have = false;
+    float mn = 0.f, mx = 0.f;
+    if (q != NoQuantisation || c->quantisedBefore) {
+        for (int i = 0; i < n; ++i) {
+            float v = c->values[i];
+            if (std::isnan(v) || std::isinf(v)) continue;
+            if (!have || v < mn) mn = v;
+            if (!have || v > mx) mx = v;
+            have = true;
+        }
+    }
+
+    if (c->quantisedBefore) {
+        // Quantising these values on a new scale would lose a little
+        // more precision each time the chunk was edited. If they
+        // still fit the scale they were last stored on, use that
+        // again, which reproduces the unedited values exactly;
+        // otherwise store them as they are
+        float levels = (c->quantisation == Quantise16Bit ? 65535.f : 255.f);
+        float half = (c->maximum - c->minimum) / levels / 2.f;
+        if (c->quantisation != NoQuantisation &&
+            (!have || (mn >= c->minimum - half && mx <= c->maximum + half))) {
+            q = c->quantisation;
+            mn = c->minimum;
+            mx = c->maximum;
+        } else {
+            q = NoQuantisation;
+        }
+    }
+    
+    c->quantisation = q;
+    c->packed = std::vector<unsigned char>(n * getElementSize(q));
+
+    if (q == NoQuantisation) {
+
+        memcpy(c->packed.data(), c->values.data(), n * sizeof(float));
+
+    } else {
+
+        c->minimum = mn;
+        c->maximum = mx;
+        c->quantisedBefore = true;
+
+        float levels = (q == Quantise16Bit ? 65535.f : 255.f);
+        float scale = (mx > mn ? levels / (mx - mn) : 0.f);
+
+        for (int i = 0; i < n; ++i) {
+            float v = c->values[i];
+            float qv = 0.f;
+            if (std::isnan(v)) {
+                qv = 0.f;
+            } else if (v >= mx) {
+                qv = levels;
+            } else if (v > mn) {
+                qv = std::min(levels, roundf((v - mn) * scale));
+            }
+            if (q == Quantise16Bit) {
+                reinterpret_cast<uint16_t *>(c->packed.data())[i] =
+                    uint16_t(qv);
+            } else {
+                c->packed[i] = uint8_t(qv);
+            }
+        }
+    }
+
+    Column().swap(c->values);
+    c->state = Chunk::Packed;
+    c->fileValid = false;
+    list(c);
+
+    m_resident += getChunkBytes(c);
+}
+
+void
+ChunkedColumnStore::unpack(Chunk *c)
+{
+    if (c->state == Chunk::Spilled) {
+        load(c);
+    }
+    if (c->state != Chunk::Packed) return;
+    
+    unlist(c);
+    m_resident -= getChunkBytes(c);
+
+    int n = int(c->packed.size() / getElementSize(c->quantisation));
+    c->values = Column(n);
+    if (n > 0) {
+        decode(c, 0, n, c->values.data());
+    }
+
+    std::vector<unsigned char>().swap(c->packed);
+    c->state = Chunk::Open;
+    c->fileValid = false;
+
+    m_resident += getChunkBytes(c);
+}
+
+bool
+ChunkedColumnStore::load(Chunk *c) const
+{
+    if (c->state != Chunk::Spilled) return true;
+
+    std::vector<unsigned char> packed(c->fileSize);
+
+    if (!m_file ||
+        !m_file->seek(c->fileOffset) ||
+        m_file->read(reinterpret_cast<char *>(packed.data()), c->fileSize)
+        != c->fileSize) {
+        SVCERR << "ERROR: ChunkedColumnStore::load: Failed to read "
+               << c->fileSize << " bytes at " << c->fileOffset
+               << " from spill file" << endl;
+        return false;
+    }
+    
+    m_resident -= getChunkBytes(c);
+    c->packed.swap(packed);
+    c->state = Chunk::Packed;
+    list(c);
+    m_resident += getChunkBytes(c);
+
+    // Reading back may take us over budget again. Drop the least
+    // recently used chunks that already have an up-to-date copy on
+    // disc, which needs no writing
+
+    while (m_budget > 0 && m_resident > m_budget && !m_saved.empty()) {
+        Chunk *coldest = m_saved.back();
+        if (coldest == c) break;
+        unlist(coldest);
+        m_resident -= getChunkBytes(coldest);
+        std::vector<unsigned char>().swap(coldest->packed);
+        coldest->state = Chunk::Spilled;
+        m_resident += getChunkBytes(coldest);
+    }
+
+#ifdef DEBUG_CHUNKED_COLUMN_STORE
+    SVDEBUG << "ChunkedColumnStore::load: loaded " << c->fileSize
+            << " bytes from " << c->fileOffset << endl;
+#endif
+    
+    return true;
+}
+
+bool
+ChunkedColumnStore::spill(Chunk *c)
+{
+    if (c->state != Chunk::Packed) return false;
+
+    unlist(c);
+
+    if (!c->fileValid) {
+
+        if (!m_file) {
+            try {
+                QDir dir(TempDirectory::getInstance()->getPath());
+                m_file = new QFile(dir.filePath(QString("columns_%1.dat")
+                                                .arg((intptr_t)this)));
+            } catch (const DirectoryCreationFailed &) {
+                SVDEBUG << "WARNING: ChunkedColumnStore::spill: Failed to "
+                        << "find temporary directory, not spilling" << endl;
+                list(c);
+                return false;
+            }
+            if (!m_file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+                SVDEBUG << "WARNING: ChunkedColumnStore::spill: Failed to "
+                        << "open spill file \"" << m_file->fileName()
+                        << "\", not spilling" << endl;
+                delete m_file;
+                m_file = 0;
+                list(c);
+                return false;
+            }
+        }
+
+        // The file is append-only: the space used by an earlier copy
+        // of a chunk that has since been edited is not reclaimed
+        // until the store is destroyed
+        
+        qint64 size = qint64(c->packed.size());
+        if (!m_file->seek(m_fileEnd) ||
+            m_file->write(reinterpret_cast<const char *>(c->packed.data()),
+                          size) != size) {
+            SVDEBUG << "WARNING: ChunkedColumnStore::spill: Failed to "
+                    << "write to spill file" << endl;
+            list(c);
+            return false;
+        }
+
+        c->fileOffset = m_fileEnd;
+        c->fileSize = size;
+        c->fileValid = true;
+        m_fileEnd += size;
+    }
+
+    m_resident -= getChunkBytes(c);
+    std::vector<unsigned char>().swap(c->packed);
+    c->state = Chunk::Spilled;
+    m_resident += getChunkBytes(c);
+
+    return true;
+}
+
+void
+ChunkedColumnStore::checkBudget()
+{
+    if (!m_spillEnabled) return;
+
+    if (m_resident >= m_nextAdvice) {
+
+        size_t kb = m_resident / 1024;
+        bool useDisc = false;
+        
+        try {
+            StorageAdviser::Recommendation rec =
+                StorageAdviser::recommend
+                (StorageAdviser::Criteria(StorageAdviser::LongRetentionLikely),
+                 kb, kb);
+            useDisc = ((rec & StorageAdviser::UseDisc) ||
+                       (rec & StorageAdviser::PreferDisc));
+        } catch (const InsufficientDiscSpace &) {
+            useDisc = false;
+        }
+
+#ifdef DEBUG_CHUNKED_COLUMN_STORE
+        SVDEBUG << "ChunkedColumnStore::checkBudget: " << kb
+                << "K resident, useDisc = " << useDisc << endl;
+#endif
+        
+        if (useDisc) {
+            // Hold memory use at what we have now, and spill
+            // anything beyond that
+            m_budget = m_resident;
+            m_nextAdvice = size_t(-1);
+        } else {
+            m_nextAdvice = m_resident + ADVICE_INTERVAL;
+        }
+    }
+
+    if (m_budget == 0) return;
+    
+    while (m_resident > m_budget) {
+
+        Chunk *coldest = 0;
+        if (!m_saved.empty()) {
+            coldest = m_saved.back();
+        }
+        if (!m_unsaved.empty() &&
+            (!coldest || m_unsaved.back()->lastUse < coldest->lastUse)) {
+            coldest = m_unsaved.back();
+        }
+        
+        if (!coldest) break;
+        
+        if (!spill(coldest)) {
+            // No point in trying again each time a column is set
+            m_spillEnabled = false;
+            break;
+        }
+    }
+}
@@ -0,0 +1,176 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_CHUNKED_COLUMN_STORE_H
+#define SV_CHUNKED_COLUMN_STORE_H
+
+#include <QMutex>
+#include <QFile>
+
+#include <vector>
+#include <list>
+
+/**
+ * Storage for a sequence of float columns of arbitrary (and possibly
+ * varying) heights, as used by EditableDenseThreeDimensionalModel.
+ *
+ * Columns are packed into chunks of a fixed number of columns, each
+ * holding its values in one contiguous array rather than one heap
+ * vector per column.  Once the store moves on from a chunk, the
+ * chunk is sealed: its values are optionally quantised to 16 or 8
+ * bits relative to the chunk's own range, and if the StorageAdviser
+ * says memory is running short, the least recently used sealed
+ * chunks are written out to a file in the temporary directory and
+ * read back on demand.  Setting a column in a sealed chunk unpacks
+ * that chunk again.
+ *
+ * Quantised storage does not preserve non-finite values: infinities
+ * are stored as the chunk extremes and NaNs as the chunk minimum.
+ * Values are only ever quantised once. A quantised chunk that is
+ * edited is sealed again on its existing scale if the new values fit
+ * it, which leaves the values that were not edited unchanged, and is
+ * otherwise sealed without quantisation.
+ *
+ * All methods are thread-safe.
+ */
+class ChunkedColumnStore
+{
+public:
+    typedef std::vector<float> Column;
+
+    enum Quantisation {
+        NoQuantisation,
+        Quantise16Bit,
+        Quantise8Bit
+    };
+
+    ChunkedColumnStore(int chunkWidth = 256);
+    ~ChunkedColumnStore();
+
+    /**
+     * Set the quantisation to be used for chunks sealed from now on.
+     * The default is NoQuantisation, which stores values exactly.
+     */
+    void setQuantisation(Quantisation q);
+    Quantisation getQuantisation() const;
+
+    /**
+     * Set whether sealed chunks may be written to disc when the
+     * StorageAdviser recommends it. The default is true.
+     */
+    void setSpillEnabled(bool enabled);
+
+    /**
+     * Set the number of bytes of column data to hold in memory
+     * before spilling sealed chunks to disc, instead of asking the
+     * StorageAdviser when memory use grows. Pass 0 to go back to
+     * asking the StorageAdviser.
+     */
+    void setMemoryBudget(size_t bytes);
+
+    /**
+     * Return the number of columns, i.e. one more than the highest
+     * index ever set.
+     */
+    int getWidth() const;
+
+    /**
+     * Return the column at the given index, as it was set (subject
+     * to quantisation).  Columns that have never been set, or are out
+     * of range, are returned empty.
+     */
+    Column getColumn(int x) const;
+
+    /**
+     * Set the column at the given index, extending the store if
+     * necessary.
+     */
+    void setColumn(int x, const Column &values);
+
+    /**
+     * Return the approximate number of bytes of column data currently
+     * held in memory.
+     */
+    size_t getResidentSize() const;
+
+private:
+    struct Chunk;
+    typedef std::list<Chunk *> ChunkList;
+
+    struct Chunk {
+        enum State { Open, Packed, Spilled };
+        Chunk(int width) :
+            state(Open), offsets(width + 1, 0),
+            quantisation(NoQuantisation), minimum(0.f), maximum(0.f),
+            quantisedBefore(false), fileOffset(-1), fileSize(0), fileValid(false),
+            lastUse(0), listed(false) { }
+        State state;
+        std::vector<int> offsets;
+        std::vector<float> values;          // when Open
+        std::vector<unsigned char> packed;  // when Packed
+        Quantisation quantisation;          // of packed or spilled data
+        float minimum;
+        float maximum;
+        bool quantisedBefore;               // values have been through quantisation
+        qint64 fileOffset;
+        qint64 fileSize;
+        bool fileValid;                     // file copy matches packed data
+        unsigned int lastUse;
+        bool listed;                        // in m_saved or m_unsaved
+        ChunkList::iterator position;       // in m_saved or m_unsaved
+    };
+
+    int m_chunkWidth;
+    int m_width;
+    Quantisation m_quantisation;
+    bool m_spillEnabled;
+    std::vector<Chunk *> m_chunks;
+    int m_openChunk;
+
+    mutable unsigned int m_useCount;
+    mutable size_t m_resident;
+    size_t m_budget;
+    size_t m_nextAdvice;
+
+    mutable QFile *m_file;
+    qint64 m_fileEnd;
+
+    // The Packed chunks, most recently used first, split according
+    // to whether they already have an up-to-date copy on disc. The
+    // candidates for spilling are at the backs of these.
+    mutable ChunkList m_saved;
+    mutable ChunkList m_unsaved;
+
+    mutable QMutex m_mutex;
+
+    static size_t getElementSize(Quantisation q);
+    static size_t getChunkBytes(const Chunk *c);
+
+    void seal(Chunk *c);
+    void unpack(Chunk *c);
+    bool load(Chunk *c) const;
+    bool spill(Chunk *c);
+    void checkBudget();
+    void decode(const Chunk *c, int from, int n, float *out) const;
+
+    void list(Chunk *c) const;
+    void unlist(Chunk *c) const;
+    void touch(Chunk *c) const;
+
+    ChunkedColumnStore(const ChunkedColumnStore &); // not provided
+    ChunkedColumnStore &operator=(const ChunkedColumnStore &); // not provided
+};
+
+#endif
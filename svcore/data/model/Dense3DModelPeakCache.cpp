@@ -18,6 +18,7 @@
 #include "base/Profiler.h"
 
 #include "base/HitCount.h"
+#include "base/Metrics.h"
 
 Dense3DModelPeakCache::Dense3DModelPeakCache(const DenseThreeDimensionalModel *source,
 					     int columnsPerPeak) :
@@ -95,6 +96,11 @@ Dense3DModelPeakCache::fillColumn(int column) const
 {
     Profiler profiler("Dense3DModelPeakCache::fillColumn");
 
+    static MetricsRegistry::Counter &filled =
+        MetricsRegistry::getInstance()->getCounter
+        ("Dense3DModelPeakCache: columns filled");
+    filled.add();
+
     if (!in_range_for(m_coverage, column)) {
         if (m_coverage.size() > 0) {
             // The last peak may have come from an incomplete read, which
@@ -18,6 +18,8 @@
 
 #include <QStringList>
 
+#include <algorithm>
+
 DenseTimeValueModel::DenseTimeValueModel()
 {
     PlayParameterRepository::getInstance()->addPlayable(this);
@@ -27,6 +29,25 @@ DenseTimeValueModel::~DenseTimeValueModel()
 {
     PlayParameterRepository::getInstance()->removePlayable(this);
 }
+
+sv_frame_t
+DenseTimeValueModel::getMultiChannelDataInto(int fromchannel, int tochannel,
+                                             sv_frame_t start, sv_frame_t count,
+                                             float *const *buffers) const
+{
+    auto data = getMultiChannelData(fromchannel, tochannel, start, count);
+
+    if (data.empty()) return 0;
+
+    sv_frame_t got = sv_frame_t(data[0].size());
+    if (got > count) got = count;
+
+    for (int c = 0; in_range_for(data, c); ++c) {
+        std::copy(data[c].begin(), data[c].begin() + got, buffers[c]);
+    }
+
+    return got;
+}
 	
 QString
 DenseTimeValueModel::toDelimitedDataStringSubset(QString delimiter, sv_frame_t f0, sv_frame_t f1) const
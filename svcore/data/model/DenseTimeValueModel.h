@@ -79,6 +79,26 @@ public:
                                                         sv_frame_t count)
         const = 0;
 
+    /**
+     * Get the specified set of samples from given contiguous range of
+     * channels of the model into the caller-supplied buffers, which
+     * must consist of (tochannel - fromchannel + 1) arrays of at
+     * least count samples each. Return the number of frames actually
+     * written to each channel, which may be fewer than requested if
+     * the end of file was reached.
+     *
+     * This is intended for callers such as the playback fill thread
+     * that read repeatedly and want to avoid allocating a new set of
+     * vectors on every call. The default implementation simply
+     * copies from getMultiChannelData; subclasses that can write
+     * straight into the target buffers should override it.
+     */
+    virtual sv_frame_t getMultiChannelDataInto(int fromchannel,
+                                               int tochannel,
+                                               sv_frame_t start,
+                                               sv_frame_t count,
+                                               float *const *buffers) const;
+
     virtual bool canPlay() const { return true; }
     virtual QString getDefaultPlayClipId() const { return ""; }
 
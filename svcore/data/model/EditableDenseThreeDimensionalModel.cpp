@@ -16,16 +16,19 @@
 #include "EditableDenseThreeDimensionalModel.h"
 
 #include "base/LogRange.h"
+#include "base/Preferences.h"
 
 #include <QTextStream>
 #include <QStringList>
 #include <QReadLocker>
 #include <QWriteLocker>
+#include <QtEndian>
 
 #include <iostream>
 
 #include <cmath>
 #include <cassert>
+#include <cstring>
 
 using std::vector;
 
@@ -75,10 +78,16 @@ EditableDenseThreeDimensionalModel::setStartFrame(sv_frame_t f)
     m_startFrame = f; 
 }
 
+void
+EditableDenseThreeDimensionalModel::setQuantisation(Quantisation q)
+{
+    m_data.setQuantisation(q);
+}
+
 sv_frame_t
 EditableDenseThreeDimensionalModel::getEndFrame() const
 {
-    return m_resolution * m_data.size() + (m_resolution - 1);
+    return m_resolution * sv_frame_t(m_data.getWidth()) + (m_resolution - 1);
 }
 
 int
@@ -96,7 +105,7 @@ EditableDenseThreeDimensionalModel::setResolution(int sz)
 int
 EditableDenseThreeDimensionalModel::getWidth() const
 {
-    return int(m_data.size());
+    return m_data.getWidth();
 }
 
 int
@@ -139,7 +148,7 @@ EditableDenseThreeDimensionalModel::Column
 EditableDenseThreeDimensionalModel::getColumn(int index) const
 {
     QReadLocker locker(&m_lock);
-    if (in_range_for(m_data, index)) return expandAndRetrieve(index);
+    if (index >= 0 && index < m_data.getWidth()) return expandAndRetrieve(index);
     else return Column();
 }
 
@@ -157,7 +166,7 @@ void
 EditableDenseThreeDimensionalModel::truncateAndStore(int index,
                                                      const Column &values)
 {
-    assert(in_range_for(m_data, index));
+    assert(in_range_for(m_trunc, index));
 
     //cout << "truncateAndStore(" << index << ", " << values.size() << ")" << endl;
 
@@ -172,7 +181,7 @@ EditableDenseThreeDimensionalModel::truncateAndStore(int index,
         int(values.size()) != m_yBinCount) {
 //        given += values.size();
 //        stored += values.size();
-        m_data[index] = values;
+        m_data.setColumn(index, values);
         return;
     }
 
@@ -236,7 +245,7 @@ EditableDenseThreeDimensionalModel::truncateAndStore(int index,
                 for (int i = bcount; i < h; ++i) {
                     tcol[i - bcount] = values.at(i);
                 }
-                m_data[index] = tcol;
+                m_data.setColumn(index, tcol);
                 m_trunc[index] = (signed char)(-tdist);
                 return;
             } else {
@@ -247,7 +256,7 @@ EditableDenseThreeDimensionalModel::truncateAndStore(int index,
                 for (int i = 0; i < h - tcount; ++i) {
                     tcol[i] = values.at(i);
                 }
-                m_data[index] = tcol;
+                m_data.setColumn(index, tcol);
                 m_trunc[index] = (signed char)(tdist);
                 return;
             }
@@ -260,7 +269,7 @@ EditableDenseThreeDimensionalModel::truncateAndStore(int index,
 //              << ((float(stored) / float(given)) * 100.f) << "%)" << endl;
 
     // default case if nothing wacky worked out
-    m_data[index] = values;
+    m_data.setColumn(index, values);
     return;
 }
 
@@ -280,8 +289,8 @@ EditableDenseThreeDimensionalModel::expandAndRetrieve(int index) const
 {
     // See comment above m_trunc declaration in header
 
-    assert(index >= 0 && index < int(m_data.size()));
-    Column c = m_data.at(index);
+    assert(index >= 0 && index < m_data.getWidth());
+    Column c = m_data.getColumn(index);
     if (index == 0) {
         return rightHeight(c);
     }
@@ -320,8 +329,7 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
 {
     QWriteLocker locker(&m_lock);
 
-    while (index >= int(m_data.size())) {
-	m_data.push_back(Column());
+    while (index >= int(m_trunc.size())) {
         m_trunc.push_back(0);
     }
 
@@ -354,7 +362,7 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
 	if (allChange) {
 	    emit modelChanged();
 	} else {
-	    emit modelChangedWithin(windowStart, windowStart + m_resolution);
+	    notifyChangedWithin(windowStart, windowStart + m_resolution);
 	}
     } else {
 	if (allChange) {
@@ -437,8 +445,8 @@ EditableDenseThreeDimensionalModel::shouldUseLogValueScale() const
     
     for (int i = 0; i < 10; ++i) {
         int index = i * 10;
-        if (in_range_for(m_data, index)) {
-            const Column &c = m_data.at(index);
+        if (index < m_data.getWidth()) {
+            Column c = m_data.getColumn(index);
             while (c.size() > sample.size()) {
                 sample.push_back(0.0);
                 n.push_back(0);
@@ -467,6 +475,7 @@ EditableDenseThreeDimensionalModel::setCompletion(int completion, bool update)
 	if (completion == 100) {
 
 	    m_notifyOnAdd = true; // henceforth
+            flushChanges();
 	    emit modelChanged();
 
 	} else if (!m_notifyOnAdd) {
@@ -474,8 +483,8 @@ EditableDenseThreeDimensionalModel::setCompletion(int completion, bool update)
 	    if (update &&
                 m_sinceLastNotifyMin >= 0 &&
 		m_sinceLastNotifyMax >= 0) {
-		emit modelChangedWithin(m_sinceLastNotifyMin,
-                                        m_sinceLastNotifyMax + m_resolution);
+		notifyChangedWithin(m_sinceLastNotifyMin,
+                                    m_sinceLastNotifyMax + m_resolution);
 		m_sinceLastNotifyMin = m_sinceLastNotifyMax = -1;
 	    } else {
 		emit completionChanged();
@@ -491,10 +500,11 @@ EditableDenseThreeDimensionalModel::toDelimitedDataString(QString delimiter) con
 {
     QReadLocker locker(&m_lock);
     QString s;
-    for (int i = 0; in_range_for(m_data, i); ++i) {
+    for (int i = 0; i < m_data.getWidth(); ++i) {
         QStringList list;
-	for (int j = 0; in_range_for(m_data.at(i), j); ++j) {
-            list << QString("%1").arg(m_data.at(i).at(j));
+        Column c = m_data.getColumn(i);
+	for (int j = 0; in_range_for(c, j); ++j) {
+            list << QString("%1").arg(c.at(j));
         }
         s += list.join(delimiter) + "\n";
     }
@@ -506,12 +516,13 @@ EditableDenseThreeDimensionalModel::toDelimitedDataStringSubset(QString delimite
 {
     QReadLocker locker(&m_lock);
     QString s;
-    for (int i = 0; in_range_for(m_data, i); ++i) {
+    for (int i = 0; i < m_data.getWidth(); ++i) {
         sv_frame_t fr = m_startFrame + i * m_resolution;
         if (fr >= f0 && fr < f1) {
             QStringList list;
-            for (int j = 0; in_range_for(m_data.at(i), j); ++j) {
-                list << QString("%1").arg(m_data.at(i).at(j));
+            Column c = m_data.getColumn(i);
+            for (int j = 0; in_range_for(c, j); ++j) {
+                list << QString("%1").arg(c.at(j));
             }
             s += list.join(delimiter) + "\n";
         }
@@ -541,9 +552,21 @@ EditableDenseThreeDimensionalModel::toXml(QTextStream &out,
          .arg(m_startFrame)
 	 .arg(extraAttributes));
 
+    // Rows are normally written as space-separated text. With the
+    // binary datasets preference, each row is instead the base64
+    // encoding of its values as little-endian 32-bit floats, which
+    // is smaller and much quicker to read back
+
+    bool binary = Preferences::getInstance()->getUseBinaryDatasets();
+    
     out << indent;
-    out << QString("<dataset id=\"%1\" dimensions=\"3\" separator=\" \">\n")
-	.arg(getObjectExportId(&m_data));
+    if (binary) {
+        out << QString("<dataset id=\"%1\" dimensions=\"3\" encoding=\"float32le-base64\">\n")
+            .arg(getObjectExportId(&m_data));
+    } else {
+        out << QString("<dataset id=\"%1\" dimensions=\"3\" separator=\" \">\n")
+            .arg(getObjectExportId(&m_data));
+    }
 
     for (int i = 0; i < (int)m_binNames.size(); ++i) {
 	if (m_binNames[i] != "") {
@@ -553,13 +576,28 @@ EditableDenseThreeDimensionalModel::toXml(QTextStream &out,
 	}
     }
 
-    for (int i = 0; i < (int)m_data.size(); ++i) {
+    QByteArray bytes;
+    
+    for (int i = 0; i < m_data.getWidth(); ++i) {
 	out << indent + "  ";
 	out << QString("<row n=\"%1\">").arg(i);
-	for (int j = 0; j < (int)m_data.at(i).size(); ++j) {
-	    if (j > 0) out << " ";
-	    out << m_data.at(i).at(j);
-	}
+        Column c = m_data.getColumn(i);
+        if (binary) {
+            bytes.resize(int(c.size() * sizeof(float)));
+            for (int j = 0; j < (int)c.size(); ++j) {
+                quint32 word;
+                float value = c.at(j);
+                memcpy(&word, &value, sizeof(word));
+                qToLittleEndian<quint32>
+                    (word, (uchar *)bytes.data() + j * sizeof(word));
+            }
+            out << bytes.toBase64();
+        } else {
+            for (int j = 0; j < (int)c.size(); ++j) {
+                if (j > 0) out << " ";
+                out << c.at(j);
+            }
+        }
 	out << QString("</row>\n");
         out.flush();
     }
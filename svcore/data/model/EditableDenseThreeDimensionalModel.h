@@ -17,6 +17,7 @@
 #define _EDITABLE_DENSE_THREE_DIMENSIONAL_MODEL_H_
 
 #include "DenseThreeDimensionalModel.h"
+#include "ChunkedColumnStore.h"
 
 #include <QReadWriteLock>
 
@@ -59,6 +60,18 @@ public:
      */
     virtual void setStartFrame(sv_frame_t);
 
+    typedef ChunkedColumnStore::Quantisation Quantisation;
+
+    /**
+     * Set the precision with which column values are stored.  With
+     * any quantisation other than NoQuantisation, values are stored
+     * to 16 or 8 bits relative to the range of the block of columns
+     * they belong to, which saves memory at the expense of accuracy.
+     * This affects only columns stored after the call, and should
+     * normally be set before any columns are added.
+     */
+    void setQuantisation(Quantisation q);
+
     /**
      * Return the number of sample frames covered by each set of bins.
      */
@@ -196,8 +209,8 @@ public:
                        QString extraAttributes = "") const;
 
 protected:
-    typedef std::vector<Column> ValueMatrix;
-    ValueMatrix m_data;
+    // Columns as stored, after truncation (see below)
+    ChunkedColumnStore m_data;
 
     // m_trunc is used for simple compression.  If at least the top N
     // elements of column x (for N = some proportion of the column
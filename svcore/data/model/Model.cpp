@@ -15,6 +15,7 @@
 
 #include "Model.h"
 #include "AlignmentModel.h"
+#include "ModelChangeHub.h"
 
 #include <QTextStream>
 
@@ -34,12 +35,26 @@ Model::~Model()
                 << endl;
     }
 
+    ModelChangeHub::getInstance()->forget(this);
+
     if (m_alignment) {
         m_alignment->aboutToDelete();
         delete m_alignment;
     }
 }
 
+void
+Model::notifyChangedWithin(sv_frame_t startFrame, sv_frame_t endFrame)
+{
+    ModelChangeHub::getInstance()->changedWithin(this, startFrame, endFrame);
+}
+
+void
+Model::flushChanges()
+{
+    ModelChangeHub::getInstance()->flush(this);
+}
+
 void
 Model::setSourceModel(Model *model)
 {
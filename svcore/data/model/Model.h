@@ -288,6 +288,24 @@ protected:
         m_abandoning(false), 
         m_aboutToDelete(false) { }
 
+    /**
+     * Report a change within the given range of frames.  Rather than
+     * emitting modelChangedWithin directly, this passes the range to
+     * the ModelChangeHub, which merges it with any other changes to
+     * this model still pending and emits modelChangedWithin for the
+     * result at a bounded rate.  Use this for changes made
+     * repeatedly while the model is being filled in; it may be called
+     * from any thread.
+     */
+    void notifyChangedWithin(sv_frame_t startFrame, sv_frame_t endFrame);
+
+    /**
+     * Emit modelChangedWithin at once for any change reported through
+     * notifyChangedWithin that has not yet been delivered.  Call this
+     * before reporting completion.
+     */
+    void flushChanges();
+
     // Not provided.
     Model(const Model &);
     Model &operator=(const Model &); 
@@ -0,0 +1,209 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "ModelChangeHub.h"
+#include "Model.h"
+
+#include "base/Debug.h"
+
+#include <QTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QCoreApplication>
+
+#include <algorithm>
+
+//#define DEBUG_MODEL_CHANGE_HUB 1
+
+ModelChangeHub *
+ModelChangeHub::m_instance = 0;
+
+ModelChangeHub *
+ModelChangeHub::getInstance()
+{
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+    if (!m_instance) m_instance = new ModelChangeHub();
+    return m_instance;
+}
+
+ModelChangeHub::ModelChangeHub() :
+    m_scheduled(false),
+    m_interval(100),
+    m_timer(0)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(deliver()));
+
+    // Deliveries are made from the main thread, whichever thread
+    // happens to report the first change
+    QCoreApplication *app = QCoreApplication::instance();
+    if (app && thread() != app->thread()) {
+        moveToThread(app->thread());
+    }
+}
+
+ModelChangeHub::~ModelChangeHub()
+{
+}
+
+void
+ModelChangeHub::setInterval(int ms)
+{
+    m_interval = std::max(ms, 0);
+}
+
+void
+ModelChangeHub::merge(RangeMap &map, Model *model,
+                      sv_frame_t startFrame, sv_frame_t endFrame)
+{
+    RangeMap::iterator i = map.find(model);
+    if (i == map.end()) {
+        Range r;
+        r.start = startFrame;
+        r.end = endFrame;
+        map[model] = r;
+    } else {
+        i->second.start = std::min(i->second.start, startFrame);
+        i->second.end = std::max(i->second.end, endFrame);
+    }
+}
+
+bool
+ModelChangeHub::haveEventLoop() const
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    return (app && app->thread() == thread() && thread()->loopLevel() > 0);
+}
+
+void
+ModelChangeHub::changedWithin(Model *model,
+                              sv_frame_t startFrame, sv_frame_t endFrame)
+{
+    bool schedule = false;
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        merge(m_pending, model, startFrame, endFrame);
+        if (!m_scheduled) {
+            m_scheduled = true;
+            schedule = true;
+        }
+    }
+
+    if (!haveEventLoop()) {
+        // Nobody is going to process a queued delivery, so there is
+        // no event loop to protect either: deliver everything now
+        deliver();
+        return;
+    }
+
+    if (schedule) {
+        // The timer can only be started from its own thread
+        QMetaObject::invokeMethod(this, "scheduleDelivery",
+                                  Qt::QueuedConnection);
+    }
+}
+
+void
+ModelChangeHub::scheduleDelivery()
+{
+    // Deliver straight away if we have been idle for at least the
+    // interval, so that occasional changes such as edits are not
+    // delayed; otherwise wait out the remainder of it
+    
+    int wait = 0;
+    if (m_sinceDelivery.isValid()) {
+        qint64 elapsed = m_sinceDelivery.elapsed();
+        if (elapsed < m_interval) {
+            wait = int(m_interval - elapsed);
+        }
+    }
+
+#ifdef DEBUG_MODEL_CHANGE_HUB
+    SVDEBUG << "ModelChangeHub::scheduleDelivery: delivering in "
+            << wait << "ms" << endl;
+#endif
+    
+    m_timer->start(wait);
+}
+
+void
+ModelChangeHub::deliver()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_delivering.swap(m_pending);
+        m_pending.clear();
+        m_scheduled = false;
+    }
+
+    m_sinceDelivery.start();
+
+    // Take one model at a time, as a listener might delete some other
+    // model (which will forget() it) while handling a signal
+
+    while (true) {
+
+        Model *model = 0;
+        Range r;
+        
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_delivering.empty()) break;
+            RangeMap::iterator i = m_delivering.begin();
+            model = i->first;
+            r = i->second;
+            m_delivering.erase(i);
+        }
+
+#ifdef DEBUG_MODEL_CHANGE_HUB
+        SVDEBUG << "ModelChangeHub::deliver: model " << model << ", "
+                << r.start << " -> " << r.end << endl;
+#endif
+
+        emit model->modelChangedWithin(r.start, r.end);
+    }
+}
+
+void
+ModelChangeHub::flush(Model *model)
+{
+    Range r;
+    bool found = false;
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        RangeMap::iterator i = m_pending.find(model);
+        if (i != m_pending.end()) {
+            r = i->second;
+            m_pending.erase(i);
+            found = true;
+        }
+    }
+
+    if (found) {
+        emit model->modelChangedWithin(r.start, r.end);
+    }
+}
+
+void
+ModelChangeHub::forget(Model *model)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.erase(model);
+    m_delivering.erase(model);
+}
@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_MODEL_CHANGE_HUB_H
+#define SV_MODEL_CHANGE_HUB_H
+
+#include "base/BaseTypes.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include <map>
+
+class Model;
+class QTimer;
+
+/**
+ * ModelChangeHub collects the changed-range notifications that models
+ * generate while their contents are being filled in, merges them per
+ * model, and delivers them as modelChangedWithin signals from the GUI
+ * thread at a bounded rate.
+ *
+ * Without this, a model receiving features from a background thread
+ * would emit a queued signal per added point or column, and every
+ * view, layer and other listener connected to it would be asked to
+ * handle each one in turn, so the GUI event loop became busier the
+ * more transforms were running.
+ *
+ * Deliveries are made from the application's main thread, through
+ * its event loop. If that event loop is not running, as in
+ * command-line tools and unit tests, each change is instead delivered
+ * straight away from the thread that reports it.
+ *
+ * Models do not normally use this class directly, but call
+ * Model::notifyChangedWithin() and Model::flushChanges().
+ */
+class ModelChangeHub : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ModelChangeHub *getInstance();
+
+    virtual ~ModelChangeHub();
+
+    /**
+     * Record a change to the given model within the given frame
+     * range.  The range is merged with any others pending for the
+     * same model, and modelChangedWithin will be emitted for the
+     * merged range shortly.  May be called from any thread.
+     */
+    void changedWithin(Model *model, sv_frame_t startFrame, sv_frame_t endFrame);
+
+    /**
+     * Emit modelChangedWithin at once for any range pending for the
+     * given model, from the calling thread.  Models call this when
+     * their calculation completes, so that no change is left waiting
+     * behind the final notification.
+     */
+    void flush(Model *model);
+
+    /**
+     * Discard anything pending for the given model, which is about to
+     * be deleted.
+     */
+    void forget(Model *model);
+
+    /**
+     * Set the minimum interval in milliseconds between deliveries.
+     * The default is 100ms.
+     */
+    void setInterval(int ms);
+    int getInterval() const { return m_interval; }
+
+protected slots:
+    void scheduleDelivery();
+    void deliver();
+
+protected:
+    ModelChangeHub();
+
+    struct Range {
+        sv_frame_t start;
+        sv_frame_t end;
+    };
+    typedef std::map<Model *, Range> RangeMap;
+
+    static void merge(RangeMap &map, Model *model,
+                      sv_frame_t startFrame, sv_frame_t endFrame);
+
+    bool haveEventLoop() const;
+
+    QMutex m_mutex;
+    RangeMap m_pending;
+    RangeMap m_delivering;
+    bool m_scheduled;
+    int m_interval;
+    QTimer *m_timer;
+    QElapsedTimer m_sinceDelivery;
+
+    static ModelChangeHub *m_instance;
+};
+
+#endif
@@ -36,9 +36,6 @@ using namespace std;
 
 //#define DEBUG_WAVE_FILE_MODEL 1
 
-PowerOfSqrtTwoZoomConstraint
-ReadOnlyWaveFileModel::m_zoomConstraint;
-
 ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, sv_samplerate_t targetRate) :
     m_source(source),
     m_path(source.getLocation()),
@@ -108,8 +105,7 @@ ReadOnlyWaveFileModel::~ReadOnlyWaveFileModel()
     m_reader = 0;
 
     SVDEBUG << "ReadOnlyWaveFileModel: Destructor exiting; we had caches of "
-            << (m_cache[0].size() * sizeof(Range)) << " and "
-            << (m_cache[1].size() * sizeof(Range)) << " bytes" << endl;
+            << m_cache.getMemoryUsage() << " bytes" << endl;
 }
 
 bool
@@ -324,203 +320,115 @@ ReadOnlyWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
     return result;
 }
 
-int
-ReadOnlyWaveFileModel::getSummaryBlockSize(int desired) const
-{
-    int cacheType = 0;
-    int power = m_zoomConstraint.getMinCachePower();
-    int roundedBlockSize = m_zoomConstraint.getNearestBlockSize
-        (desired, cacheType, power, ZoomConstraint::RoundDown);
-    if (cacheType != 0 && cacheType != 1) {
-        // We will be reading directly from file, so can satisfy any
-        // blocksize requirement
-        return desired;
-    } else {
-        return roundedBlockSize;
-    }
-}    
-
-void
-ReadOnlyWaveFileModel::getSummaries(int channel, sv_frame_t start, sv_frame_t count,
-                                    RangeBlock &ranges, int &blockSize) const
+sv_frame_t
+ReadOnlyWaveFileModel::getMultiChannelDataInto(int fromchannel, int tochannel,
+                                               sv_frame_t start, sv_frame_t count,
+                                               float *const *buffers) const
 {
-    ranges.clear();
-    if (!isOK()) return;
-    ranges.reserve((count / blockSize) + 1);
-
-    if (start > m_startFrame) start -= m_startFrame;
-    else if (count <= m_startFrame - start) return;
-    else {
-        count -= (m_startFrame - start);
-        start = 0;
-    }
-
-    int cacheType = 0;
-    int power = m_zoomConstraint.getMinCachePower();
-    int roundedBlockSize = m_zoomConstraint.getNearestBlockSize
-        (blockSize, cacheType, power, ZoomConstraint::RoundDown);
+    // As getMultiChannelData, but de-interleaving straight into the
+    // caller's buffers rather than building a vector per channel.
+    // Used by playback.
 
     int channels = getChannelCount();
 
-    if (cacheType != 0 && cacheType != 1) {
-
-        // We need to read directly from the file.  We haven't got
-        // this cached.  Hope the requested area is small.  This is
-        // not optimal -- we'll end up reading the same frames twice
-        // for stereo files, in two separate calls to this method.
-        // We could fairly trivially handle this for most cases that
-        // matter by putting a single cache in getInterleavedFrames
-        // for short queries.
-
-        m_directReadMutex.lock();
-
-        if (m_lastDirectReadStart != start ||
-            m_lastDirectReadCount != count ||
-            m_directRead.empty()) {
-
-            m_directRead = m_reader->getInterleavedFrames(start, count);
-            m_lastDirectReadStart = start;
-            m_lastDirectReadCount = count;
-        }
-
-        float max = 0.0, min = 0.0, total = 0.0;
-        sv_frame_t i = 0, got = 0;
-
-        while (i < count) {
-
-            sv_frame_t index = i * channels + channel;
-            if (index >= (sv_frame_t)m_directRead.size()) break;
-            
-            float sample = m_directRead[index];
-            if (sample > max || got == 0) max = sample;
-            if (sample < min || got == 0) min = sample;
-            total += fabsf(sample);
-
-            ++i;
-            ++got;
-            
-            if (got == blockSize) {
-                ranges.push_back(Range(min, max, total / float(got)));
-                min = max = total = 0.0f;
-                got = 0;
-            }
-        }
-
-        m_directReadMutex.unlock();
+    if (fromchannel > tochannel) {
+        cerr << "ERROR: ReadOnlyWaveFileModel::getMultiChannelDataInto: fromchannel ("
+                  << fromchannel << ") > tochannel (" << tochannel << ")"
+                  << endl;
+        return 0;
+    }
 
-        if (got > 0) {
-            ranges.push_back(Range(min, max, total / float(got)));
-        }
+    if (tochannel >= channels) {
+        cerr << "ERROR: ReadOnlyWaveFileModel::getMultiChannelDataInto: tochannel ("
+                  << tochannel << ") >= channel count (" << channels << ")"
+                  << endl;
+        return 0;
+    }
 
-        return;
+    if (!m_reader || !m_reader->isOK() || count == 0) {
+        return 0;
+    }
 
+    if (start >= m_startFrame) {
+        start -= m_startFrame;
     } else {
-
-        QMutexLocker locker(&m_mutex);
-    
-        const RangeBlock &cache = m_cache[cacheType];
-
-        blockSize = roundedBlockSize;
-
-        sv_frame_t cacheBlock, div;
-
-        cacheBlock = (sv_frame_t(1) << m_zoomConstraint.getMinCachePower());
-        if (cacheType == 1) {
-            cacheBlock = sv_frame_t(double(cacheBlock) * sqrt(2.) + 0.01);
+        if (count <= m_startFrame - start) {
+            return 0;
+        } else {
+            count -= (m_startFrame - start);
+            start = 0;
         }
-        div = blockSize / cacheBlock;
+    }
 
-        sv_frame_t startIndex = start / cacheBlock;
-        sv_frame_t endIndex = (start + count) / cacheBlock;
+    QMutexLocker locker(&m_playbackReadMutex);
 
-        float max = 0.0, min = 0.0, total = 0.0;
-        sv_frame_t i = 0, got = 0;
+    floatvec_t &interleaved = m_playbackRead;
+    m_reader->getInterleavedFramesInto(start, count, interleaved);
 
-#ifdef DEBUG_WAVE_FILE_MODEL
-        cerr << "blockSize is " << blockSize << ", cacheBlock " << cacheBlock << ", start " << start << ", count " << count << " (frame count " << getFrameCount() << "), power is " << power << ", div is " << div << ", startIndex " << startIndex << ", endIndex " << endIndex << endl;
-#endif
+    sv_frame_t obtained = interleaved.size() / channels;
+    if (obtained > count) obtained = count;
 
-        for (i = 0; i <= endIndex - startIndex; ) {
-        
-            sv_frame_t index = (i + startIndex) * channels + channel;
-            if (!in_range_for(cache, index)) break;
-            
-            const Range &range = cache[index];
-            if (range.max() > max || got == 0) max = range.max();
-            if (range.min() < min || got == 0) min = range.min();
-            total += range.absmean();
-            
-            ++i;
-            ++got;
-            
-            if (got == div) {
-                ranges.push_back(Range(min, max, total / float(got)));
-                min = max = total = 0.0f;
-                got = 0;
-            }
-        }
-                
-        if (got > 0) {
-            ranges.push_back(Range(min, max, total / float(got)));
+    for (int c = fromchannel; c <= tochannel; ++c) {
+        float *target = buffers[c - fromchannel];
+        for (sv_frame_t i = 0; i < obtained; ++i) {
+            target[i] = interleaved[i * channels + c];
         }
     }
 
-#ifdef DEBUG_WAVE_FILE_MODEL
-    cerr << "returning " << ranges.size() << " ranges" << endl;
-#endif
-    return;
+    return obtained;
 }
 
-ReadOnlyWaveFileModel::Range
-ReadOnlyWaveFileModel::getSummary(int channel, sv_frame_t start, sv_frame_t count) const
+int
+ReadOnlyWaveFileModel::getSummaryBlockSize(int desired) const
 {
-    Range range;
-    if (!isOK()) return range;
+    return WaveRangeCache::getSummaryBlockSize(desired);
+}    
+
+void
+ReadOnlyWaveFileModel::getSummaries(int channel, sv_frame_t start, sv_frame_t count,
+                                    RangeBlock &ranges, int &blockSize) const
+{
+    ranges.clear();
+    if (!isOK()) return;
+    ranges.reserve((count / blockSize) + 1);
 
     if (start > m_startFrame) start -= m_startFrame;
-    else if (count <= m_startFrame - start) return range;
+    else if (count <= m_startFrame - start) return;
     else {
         count -= (m_startFrame - start);
         start = 0;
     }
 
-    int blockSize;
-    for (blockSize = 1; blockSize <= count; blockSize *= 2);
-    if (blockSize > 1) blockSize /= 2;
-
-    bool first = false;
-
-    sv_frame_t blockStart = (start / blockSize) * blockSize;
-    sv_frame_t blockEnd = ((start + count) / blockSize) * blockSize;
-
-    if (blockStart < start) blockStart += blockSize;
-        
-    if (blockEnd > blockStart) {
-        RangeBlock ranges;
-        getSummaries(channel, blockStart, blockEnd - blockStart, ranges, blockSize);
-        for (int i = 0; i < (int)ranges.size(); ++i) {
-            if (first || ranges[i].min() < range.min()) range.setMin(ranges[i].min());
-            if (first || ranges[i].max() > range.max()) range.setMax(ranges[i].max());
-            if (first || ranges[i].absmean() < range.absmean()) range.setAbsmean(ranges[i].absmean());
-            first = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.getSummaries(channel, start, count, ranges, blockSize)) {
+#ifdef DEBUG_WAVE_FILE_MODEL
+            cerr << "returning " << ranges.size() << " cached ranges" << endl;
+#endif
+            return;
         }
     }
 
-    if (blockStart > start) {
-        Range startRange = getSummary(channel, start, blockStart - start);
-        range.setMin(min(range.min(), startRange.min()));
-        range.setMax(max(range.max(), startRange.max()));
-        range.setAbsmean(min(range.absmean(), startRange.absmean()));
-    }
+    // We need to read directly from the file.  We haven't got this
+    // cached.  Hope the requested area is small.  This is not optimal
+    // -- we'll end up reading the same frames twice for stereo files,
+    // in two separate calls to this method.  The single-entry cache
+    // of the last direct read handles that for most cases that
+    // matter.
 
-    if (blockEnd < start + count) {
-        Range endRange = getSummary(channel, blockEnd, start + count - blockEnd);
-        range.setMin(min(range.min(), endRange.min()));
-        range.setMax(max(range.max(), endRange.max()));
-        range.setAbsmean(min(range.absmean(), endRange.absmean()));
+    QMutexLocker locker(&m_directReadMutex);
+
+    if (m_lastDirectReadStart != start ||
+        m_lastDirectReadCount != count ||
+        m_directRead.empty()) {
+
+        m_directRead = m_reader->getInterleavedFrames(start, count);
+        m_lastDirectReadStart = start;
+        m_lastDirectReadCount = count;
     }
 
-    return range;
+    WaveRangeCache::summarise(m_directRead, getChannelCount(), channel,
+                              blockSize, ranges);
 }
 
 void
@@ -552,7 +460,7 @@ ReadOnlyWaveFileModel::fillTimerTimedOut()
         SVDEBUG << "ReadOnlyWaveFileModel::fillTimerTimedOut: extent = " << fillExtent << endl;
 #endif
         if (fillExtent > m_lastFillExtent) {
-            emit modelChangedWithin(m_lastFillExtent, fillExtent);
+            notifyChangedWithin(m_lastFillExtent, fillExtent);
             m_lastFillExtent = fillExtent;
         }
     } else {
@@ -572,6 +480,7 @@ ReadOnlyWaveFileModel::cacheFilled()
     delete m_updateTimer;
     m_updateTimer = 0;
     m_mutex.unlock();
+    flushChanges();
     if (getEndFrame() > m_lastFillExtent) {
         emit modelChangedWithin(m_lastFillExtent, getEndFrame());
     }
@@ -585,11 +494,6 @@ ReadOnlyWaveFileModel::cacheFilled()
 void
 ReadOnlyWaveFileModel::RangeCacheFillThread::run()
 {
-    int cacheBlockSize[2];
-    cacheBlockSize[0] = (1 << m_model.m_zoomConstraint.getMinCachePower());
-    cacheBlockSize[1] = (int((1 << m_model.m_zoomConstraint.getMinCachePower()) *
-                                        sqrt(2.) + 0.01));
-    
     sv_frame_t frame = 0;
     const sv_frame_t readBlockSize = 32768;
     floatvec_t block;
@@ -609,12 +513,9 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
         }
     }
 
-    Range *range = new Range[2 * channels];
-    float *means = new float[2 * channels];
-    int count[2];
-    count[0] = count[1] = 0;
-    for (int i = 0; i < 2 * channels; ++i) {
-        means[i] = 0.f;
+    {
+        QMutexLocker locker(&m_model.m_mutex);
+        m_model.m_cache.setChannelCount(channels);
     }
 
     bool first = true;
@@ -624,67 +525,31 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
         updating = m_model.m_reader->isUpdating();
         m_frameCount = m_model.getFrameCount();
 
-        m_model.m_mutex.lock();
-
         while (frame < m_frameCount) {
 
-            m_model.m_mutex.unlock();
-
 #ifdef DEBUG_WAVE_FILE_MODEL
             cerr << "ReadOnlyWaveFileModel::fill inner loop: frame = " << frame << ", count = " << m_frameCount << ", blocksize " << readBlockSize << endl;
 #endif
 
             if (updating && (frame + readBlockSize > m_frameCount)) {
-                m_model.m_mutex.lock(); // must be locked on exiting loop
                 break;
             }
 
             block = m_model.m_reader->getInterleavedFrames(frame, readBlockSize);
 
             sv_frame_t gotBlockSize = block.size() / channels;
+            if (gotBlockSize == 0) break;
 
             m_model.m_mutex.lock();
+            m_model.m_cache.addInterleaved(block.data(), gotBlockSize);
+            m_model.m_mutex.unlock();
 
-            for (sv_frame_t i = 0; i < gotBlockSize; ++i) {
-                
-                for (int ch = 0; ch < channels; ++ch) {
-
-                    sv_frame_t index = channels * i + ch;
-                    float sample = block[index];
-                    
-                    for (int cacheType = 0; cacheType < 2; ++cacheType) {
-                        sv_frame_t rangeIndex = ch * 2 + cacheType;
-                        range[rangeIndex].sample(sample);
-                        means[rangeIndex] += fabsf(sample);
-                    }
-                }
-
-                for (int cacheType = 0; cacheType < 2; ++cacheType) {
-
-                    if (++count[cacheType] == cacheBlockSize[cacheType]) {
-                        
-                        for (int ch = 0; ch < int(channels); ++ch) {
-                            int rangeIndex = ch * 2 + cacheType;
-                            means[rangeIndex] = means[rangeIndex] / float(count[cacheType]);
-                            range[rangeIndex].setAbsmean(means[rangeIndex]);
-                            m_model.m_cache[cacheType].push_back(range[rangeIndex]);
-                            range[rangeIndex] = Range();
-                            means[rangeIndex] = 0.f;
-                        }
-
-                        count[cacheType] = 0;
-                    }
-                }
-                
-                ++frame;
-            }
+            frame += gotBlockSize;
 
             if (m_model.m_exiting) break;
             m_fillExtent = frame;
         }
 
-        m_model.m_mutex.unlock();
-            
         first = false;
         if (m_model.m_exiting) break;
         if (updating) {
@@ -693,39 +558,14 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
     }
 
     if (!m_model.m_exiting) {
-
         QMutexLocker locker(&m_model.m_mutex);
-
-        for (int cacheType = 0; cacheType < 2; ++cacheType) {
-
-            if (count[cacheType] > 0) {
-
-                for (int ch = 0; ch < int(channels); ++ch) {
-                    int rangeIndex = ch * 2 + cacheType;
-                    means[rangeIndex] = means[rangeIndex] / float(count[cacheType]);
-                    range[rangeIndex].setAbsmean(means[rangeIndex]);
-                    m_model.m_cache[cacheType].push_back(range[rangeIndex]);
-                    range[rangeIndex] = Range();
-                    means[rangeIndex] = 0.f;
-                }
-
-                count[cacheType] = 0;
-            }
-            
-            const Range &rr = *m_model.m_cache[cacheType].begin();
-            MUNLOCK(&rr, m_model.m_cache[cacheType].capacity() * sizeof(Range));
-        }
+        m_model.m_cache.complete();
     }
     
-    delete[] means;
-    delete[] range;
-
     m_fillExtent = m_frameCount;
 
 #ifdef DEBUG_WAVE_FILE_MODEL        
-    for (int cacheType = 0; cacheType < 2; ++cacheType) {
-        cerr << "Cache type " << cacheType << " now contains " << m_model.m_cache[cacheType].size() << " ranges" << endl;
-    }
+    cerr << "Range cache now uses " << m_model.m_cache.getMemoryUsage() << " bytes" << endl;
 #endif
 }
 
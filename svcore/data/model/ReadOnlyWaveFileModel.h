@@ -25,7 +25,7 @@
 #include "data/fileio/FileSource.h"
 
 #include "RangeSummarisableTimeValueModel.h"
-#include "PowerOfSqrtTwoZoomConstraint.h"
+#include "WaveRangeCache.h"
 
 #include <stdlib.h>
 
@@ -43,7 +43,9 @@ public:
     bool isOK() const;
     bool isReady(int *) const;
 
-    const ZoomConstraint *getZoomConstraint() const { return &m_zoomConstraint; }
+    const ZoomConstraint *getZoomConstraint() const {
+        return WaveRangeCache::getZoomConstraint();
+    }
 
     sv_frame_t getFrameCount() const;
     int getChannelCount() const;
@@ -68,14 +70,14 @@ public:
 
     virtual std::vector<floatvec_t> getMultiChannelData(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count) const;
 
+    virtual sv_frame_t getMultiChannelDataInto(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count, float *const *buffers) const;
+
     virtual int getSummaryBlockSize(int desired) const;
 
     virtual void getSummaries(int channel, sv_frame_t start, sv_frame_t count,
                               RangeBlock &ranges,
                               int &blockSize) const;
 
-    virtual Range getSummary(int channel, sv_frame_t start, sv_frame_t count) const;
-
     QString getTypeName() const { return tr("Wave File"); }
 
     virtual void toXml(QTextStream &out,
@@ -114,18 +116,22 @@ protected:
 
     sv_frame_t m_startFrame;
 
-    RangeBlock m_cache[2]; // interleaved at two base resolutions
+    WaveRangeCache m_cache;
     mutable QMutex m_mutex;
     RangeCacheFillThread *m_fillThread;
     QTimer *m_updateTimer;
     sv_frame_t m_lastFillExtent;
     bool m_exiting;
-    static PowerOfSqrtTwoZoomConstraint m_zoomConstraint;
 
     mutable floatvec_t m_directRead;
     mutable sv_frame_t m_lastDirectReadStart;
     mutable sv_frame_t m_lastDirectReadCount;
     mutable QMutex m_directReadMutex;
+
+    // Interleaved read buffer for getMultiChannelDataInto, reused
+    // across calls so that playback doesn't allocate
+    mutable floatvec_t m_playbackRead;
+    mutable QMutex m_playbackReadMutex;
 };    
 
 #endif
@@ -208,6 +208,18 @@ public:
         if (point.value != 0.f) m_haveDistinctValues = true;
         IntervalModel<RegionRec>::addPoint(point);
     }
+
+    virtual void addPoints(const PointVector &points)
+    {
+        for (PointVector::const_iterator i = points.begin();
+             i != points.end(); ++i) {
+            if (i->value != 0.f) {
+                m_haveDistinctValues = true;
+                break;
+            }
+        }
+        IntervalModel<RegionRec>::addPoints(points);
+    }
     
 protected:
     float m_valueQuantization;
@@ -126,6 +126,18 @@ public:
      */
     virtual void addPoint(const PointType &point);
 
+    typedef std::vector<PointType> PointVector;
+
+    /**
+     * Add a batch of points. This has the same effect as calling
+     * addPoint for each of them, but the points are sorted and merged
+     * into the model under a single lock, and only one change
+     * notification is issued for the whole batch. Importers and
+     * transforms that produce many points at a time should prefer
+     * this.
+     */
+    virtual void addPoints(const PointVector &points);
+
     /** 
      * Remove a point.  Points are not necessarily unique, so this
      * function will remove the first point that compares equal to the
@@ -772,11 +784,12 @@ SparseModel<PointType>::addPoint(const PointType &point)
     // too many signals going on here (especially as they'll probably
     // be queued from one thread to another), which is why we need the
     // notifyOnAdd as an option rather than a necessity (the
-    // alternative is to notify on setCompletion).
+    // alternative is to notify on setCompletion). Notifications on
+    // add are also coalesced through the ModelChangeHub.
 
     if (m_notifyOnAdd) {
         m_rows.clear(); //!!! inefficient
-	emit modelChangedWithin(point.frame, point.frame + m_resolution);
+	notifyChangedWithin(point.frame, point.frame + m_resolution);
     } else {
 	if (m_sinceLastNotifyMin == -1 ||
 	    point.frame < m_sinceLastNotifyMin) {
@@ -789,6 +802,57 @@ SparseModel<PointType>::addPoint(const PointType &point)
     }
 }
 
+template <typename PointType>
+void
+SparseModel<PointType>::addPoints(const PointVector &points)
+{
+    if (points.empty()) return;
+
+    PointVector sorted(points);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     typename PointType::OrderComparator());
+
+    sv_frame_t minFrame = sorted.begin()->frame;
+    sv_frame_t maxFrame = sorted.rbegin()->frame;
+    
+    QMutexLocker locker(&m_mutex);
+
+    // Each point in a sorted batch belongs just after the one before
+    // it, unless some existing point intervenes, so inserting with
+    // that position as a hint is usually constant-time. Points that
+    // compare equal to existing ones go after them, as with addPoint.
+
+    typename PointType::OrderComparator comparator;
+    PointListIterator hint = m_points.end();
+    
+    for (typename PointVector::const_iterator i = sorted.begin();
+         i != sorted.end(); ++i) {
+        if (hint == m_points.end() || comparator(*i, *hint)) {
+            hint = m_points.insert(hint, *i);
+        } else {
+            hint = m_points.insert(*i);
+        }
+        ++hint;
+        if (!m_hasTextLabels && i->getLabel() != "") m_hasTextLabels = true;
+    }
+    
+    m_pointCount += int(sorted.size());
+
+    if (m_notifyOnAdd) {
+        m_rows.clear();
+        notifyChangedWithin(minFrame, maxFrame + m_resolution);
+    } else {
+        if (m_sinceLastNotifyMin == -1 ||
+            minFrame < m_sinceLastNotifyMin) {
+            m_sinceLastNotifyMin = minFrame;
+        }
+        if (m_sinceLastNotifyMax == -1 ||
+            maxFrame > m_sinceLastNotifyMax) {
+            m_sinceLastNotifyMax = maxFrame;
+        }
+    }
+}
+
 template <typename PointType>
 bool
 SparseModel<PointType>::containsPoint(const PointType &point)
@@ -851,6 +915,7 @@ SparseModel<PointType>::setCompletion(int completion, bool update)
 
 	    m_notifyOnAdd = true; // henceforth
             m_rows.clear(); //!!! inefficient
+            flushChanges();
 	    emit modelChanged();
 
 	} else if (!m_notifyOnAdd) {
@@ -859,7 +924,7 @@ SparseModel<PointType>::setCompletion(int completion, bool update)
                 m_sinceLastNotifyMin >= 0 &&
 		m_sinceLastNotifyMax >= 0) {
                 m_rows.clear(); //!!! inefficient
-		emit modelChangedWithin(m_sinceLastNotifyMin, m_sinceLastNotifyMax);
+		notifyChangedWithin(m_sinceLastNotifyMin, m_sinceLastNotifyMax);
 		m_sinceLastNotifyMin = m_sinceLastNotifyMax = -1;
 	    } else {
 		emit completionChanged();
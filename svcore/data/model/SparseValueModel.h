@@ -84,6 +84,26 @@ public:
 	if (allChange) emit modelChanged();
     }
 
+    virtual void addPoints(const typename SparseModel<PointType>::PointVector &points)
+    {
+        bool allChange = false;
+
+        for (typename SparseModel<PointType>::PointVector::const_iterator i =
+                 points.begin(); i != points.end(); ++i) {
+            if (ISNAN(i->value) || ISINF(i->value)) continue;
+            if (!m_haveExtents || i->value < m_valueMinimum) {
+                m_valueMinimum = i->value; allChange = true;
+            }
+            if (!m_haveExtents || i->value > m_valueMaximum) {
+                m_valueMaximum = i->value; allChange = true;
+            }
+            m_haveExtents = true;
+        }
+
+        SparseModel<PointType>::addPoints(points);
+        if (allChange) emit modelChanged();
+    }
+
     virtual void deletePoint(const PointType &point)
     {
 	SparseModel<PointType>::deletePoint(point);
@@ -15,7 +15,82 @@
 
 #include "WaveFileModel.h"
 
+#include <algorithm>
+
 WaveFileModel::~WaveFileModel()
 {
 }
 
+
+WaveFileModel::Range
+WaveFileModel::getSummary(int channel, sv_frame_t start, sv_frame_t count) const
+{
+    Range range;
+    if (!isOK()) return range;
+
+    sv_frame_t startFrame = getStartFrame();
+    if (start + count <= startFrame) return range;
+    if (start < startFrame) {
+        count -= (startFrame - start);
+        start = startFrame;
+    }
+
+    double total = 0.0;
+    sv_frame_t covered = 0;
+    accumulateSummary(channel, start, count, range, total, covered);
+    if (covered > 0) range.setAbsmean(float(total / double(covered)));
+    return range;
+}
+
+void
+WaveFileModel::accumulateSummary(int channel, sv_frame_t start, sv_frame_t count,
+                                 Range &range, double &total,
+                                 sv_frame_t &covered) const
+{
+    // Summarise the largest run of whole power-of-two blocks within
+    // the range in a single call to getSummaries, and the pieces
+    // either side of it recursively. Block alignment is relative to
+    // the start of the audio, as in the caches. The mean is weighted
+    // by the number of frames each range covers
+
+    if (count <= 0) return;
+
+    sv_frame_t startFrame = getStartFrame();
+    sv_frame_t relStart = start - startFrame;
+
+    int blockSize;
+    for (blockSize = 1; blockSize <= count; blockSize *= 2);
+    if (blockSize > 1) blockSize /= 2;
+
+    sv_frame_t blockStart = (relStart / blockSize) * blockSize;
+    sv_frame_t blockEnd = ((relStart + count) / blockSize) * blockSize;
+
+    if (blockStart < relStart) blockStart += blockSize;
+
+    if (blockEnd > blockStart) {
+        RangeBlock ranges;
+        sv_frame_t remaining = blockEnd - blockStart;
+        getSummaries(channel, blockStart + startFrame, remaining,
+                     ranges, blockSize);
+        for (const Range &r: ranges) {
+            if (remaining <= 0) break;
+            sv_frame_t n = std::min(sv_frame_t(blockSize), remaining);
+            if (covered == 0 || r.min() < range.min()) range.setMin(r.min());
+            if (covered == 0 || r.max() > range.max()) range.setMax(r.max());
+            total += double(r.absmean()) * double(n);
+            covered += n;
+            remaining -= n;
+        }
+    }
+
+    if (blockStart > relStart) {
+        accumulateSummary(channel, start, blockStart - relStart,
+                          range, total, covered);
+    }
+
+    if (blockEnd < relStart + count) {
+        accumulateSummary(channel, blockEnd + startFrame,
+                          relStart + count - blockEnd,
+                          range, total, covered);
+    }
+}
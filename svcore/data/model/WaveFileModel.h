@@ -41,8 +41,18 @@ public:
 
     virtual void setStartFrame(sv_frame_t startFrame) = 0;
 
+    /**
+     * Return the range across the given frames, made up from as few
+     * calls to getSummaries() as possible.
+     */
+    virtual Range getSummary(int channel, sv_frame_t start, sv_frame_t count) const;
+
 protected:
     WaveFileModel() { } // only accessible from subclasses
+
+    void accumulateSummary(int channel, sv_frame_t start, sv_frame_t count,
+                           Range &range, double &total,
+                           sv_frame_t &covered) const;
 };    
 
 #endif
@@ -0,0 +1,220 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "WaveRangeCache.h"
+
+#include "system/System.h"
+
+#include <cmath>
+
+PowerOfSqrtTwoZoomConstraint
+WaveRangeCache::m_zoomConstraint;
+
+WaveRangeCache::WaveRangeCache(int channels) :
+    m_channels(0),
+    m_frameCount(0)
+{
+    m_cacheBlockSize[0] = (1 << m_zoomConstraint.getMinCachePower());
+    m_cacheBlockSize[1] = (int((1 << m_zoomConstraint.getMinCachePower()) *
+                               sqrt(2.) + 0.01));
+    setChannelCount(channels);
+}
+
+void
+WaveRangeCache::setChannelCount(int channels)
+{
+    m_channels = channels;
+    m_frameCount = 0;
+    for (int cacheType = 0; cacheType < 2; ++cacheType) {
+        m_cache[cacheType].clear();
+        m_rangeCount[cacheType] = 0;
+    }
+    m_ranges = RangeBlock(2 * channels);
+    m_means = std::vector<float>(2 * channels, 0.f);
+}
+
+void
+WaveRangeCache::addSample(int channel, float sample)
+{
+    for (int cacheType = 0; cacheType < 2; ++cacheType) {
+        int rangeIndex = channel * 2 + cacheType;
+        m_ranges[rangeIndex].sample(sample);
+        m_means[rangeIndex] += fabsf(sample);
+    }
+}
+
+void
+WaveRangeCache::endFrame()
+{
+    for (int cacheType = 0; cacheType < 2; ++cacheType) {
+        if (++m_rangeCount[cacheType] == m_cacheBlockSize[cacheType]) {
+            flush(cacheType);
+        }
+    }
+    ++m_frameCount;
+}
+
+void
+WaveRangeCache::flush(int cacheType)
+{
+    for (int ch = 0; ch < m_channels; ++ch) {
+        int rangeIndex = ch * 2 + cacheType;
+        m_ranges[rangeIndex].setAbsmean
+            (m_means[rangeIndex] / float(m_rangeCount[cacheType]));
+        m_cache[cacheType].push_back(m_ranges[rangeIndex]);
+        m_ranges[rangeIndex] = Range();
+        m_means[rangeIndex] = 0.f;
+    }
+    m_rangeCount[cacheType] = 0;
+}
+
+void
+WaveRangeCache::add(const float *const *samples, sv_frame_t count)
+{
+    for (sv_frame_t i = 0; i < count; ++i) {
+        for (int ch = 0; ch < m_channels; ++ch) {
+            addSample(ch, samples[ch][i]);
+        }
+        endFrame();
+    }
+}
+
+void
+WaveRangeCache::addInterleaved(const float *frames, sv_frame_t count)
+{
+    for (sv_frame_t i = 0; i < count; ++i) {
+        for (int ch = 0; ch < m_channels; ++ch) {
+            addSample(ch, frames[i * m_channels + ch]);
+        }
+        endFrame();
+    }
+}
+
+void
+WaveRangeCache::complete()
+{
+    for (int cacheType = 0; cacheType < 2; ++cacheType) {
+        if (m_rangeCount[cacheType] > 0) {
+            flush(cacheType);
+        }
+        if (!m_cache[cacheType].empty()) {
+            const Range &rr = *m_cache[cacheType].begin();
+            MUNLOCK(&rr, m_cache[cacheType].capacity() * sizeof(Range));
+        }
+    }
+}
+
+size_t
+WaveRangeCache::getMemoryUsage() const
+{
+    return (m_cache[0].size() + m_cache[1].size()) * sizeof(Range);
+}
+
+int
+WaveRangeCache::getSummaryBlockSize(int desired)
+{
+    int cacheType = 0;
+    int power = m_zoomConstraint.getMinCachePower();
+    int roundedBlockSize = m_zoomConstraint.getNearestBlockSize
+        (desired, cacheType, power, ZoomConstraint::RoundDown);
+    if (cacheType != 0 && cacheType != 1) {
+        // Reading directly from the audio, so can satisfy any
+        // blocksize requirement
+        return desired;
+    } else {
+        return roundedBlockSize;
+    }
+}
+
+bool
+WaveRangeCache::getSummaries(int channel, sv_frame_t start, sv_frame_t count,
+                             RangeBlock &ranges, int &blockSize) const
+{
+    int cacheType = 0;
+    int power = m_zoomConstraint.getMinCachePower();
+    int roundedBlockSize = m_zoomConstraint.getNearestBlockSize
+        (blockSize, cacheType, power, ZoomConstraint::RoundDown);
+
+    if (cacheType != 0 && cacheType != 1) {
+        return false;
+    }
+
+    const RangeBlock &cache = m_cache[cacheType];
+
+    blockSize = roundedBlockSize;
+
+    sv_frame_t cacheBlock = m_cacheBlockSize[cacheType];
+    sv_frame_t div = blockSize / cacheBlock;
+
+    sv_frame_t startIndex = start / cacheBlock;
+    sv_frame_t endIndex = (start + count) / cacheBlock;
+
+    float max = 0.0, min = 0.0, total = 0.0;
+    sv_frame_t i = 0, got = 0;
+
+    for (i = 0; i <= endIndex - startIndex; ) {
+
+        sv_frame_t index = (i + startIndex) * m_channels + channel;
+        if (!in_range_for(cache, index)) break;
+
+        const Range &range = cache[index];
+        if (range.max() > max || got == 0) max = range.max();
+        if (range.min() < min || got == 0) min = range.min();
+        total += range.absmean();
+
+        ++i;
+        ++got;
+
+        if (got == div) {
+            ranges.push_back(Range(min, max, total / float(got)));
+            min = max = total = 0.0f;
+            got = 0;
+        }
+    }
+
+    if (got > 0) {
+        ranges.push_back(Range(min, max, total / float(got)));
+    }
+
+    return true;
+}
+
+void
+WaveRangeCache::summarise(const floatvec_t &frames, int channels,
+                          int channel, int blockSize, RangeBlock &ranges)
+{
+    float max = 0.0, min = 0.0, total = 0.0;
+    sv_frame_t got = 0;
+
+    for (sv_frame_t index = channel; in_range_for(frames, index);
+         index += channels) {
+
+        float sample = frames[index];
+        if (sample > max || got == 0) max = sample;
+        if (sample < min || got == 0) min = sample;
+        total += fabsf(sample);
+
+        ++got;
+
+        if (got == blockSize) {
+            ranges.push_back(Range(min, max, total / float(got)));
+            min = max = total = 0.0f;
+            got = 0;
+        }
+    }
+
+    if (got > 0) {
+        ranges.push_back(Range(min, max, total / float(got)));
+    }
+}
@@ -0,0 +1,119 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef WAVE_RANGE_CACHE_H
+#define WAVE_RANGE_CACHE_H
+
+#include "RangeSummarisableTimeValueModel.h"
+#include "PowerOfSqrtTwoZoomConstraint.h"
+
+#include "base/BaseTypes.h"
+
+#include <vector>
+
+/**
+ * Min/max/mean range summaries of audio at the two base resolutions
+ * used by the wave file models, built up incrementally as audio is
+ * added, together with the zoom constraint that goes with them.
+ *
+ * This class is not thread-safe: the model that owns it is expected
+ * to serialise calls with its own mutex.
+ */
+class WaveRangeCache
+{
+public:
+    typedef RangeSummarisableTimeValueModel::Range Range;
+    typedef RangeSummarisableTimeValueModel::RangeBlock RangeBlock;
+
+    WaveRangeCache(int channels = 0);
+
+    static const ZoomConstraint *getZoomConstraint() {
+        return &m_zoomConstraint;
+    }
+
+    /**
+     * Set the number of channels, discarding anything cached so far.
+     */
+    void setChannelCount(int channels);
+    int getChannelCount() const { return m_channels; }
+
+    /**
+     * Summarise the given de-interleaved samples, appending a range
+     * to the cache for each block completed at either resolution.
+     */
+    void add(const float *const *samples, sv_frame_t count);
+
+    /**
+     * Summarise the given interleaved samples, as add().
+     */
+    void addInterleaved(const float *frames, sv_frame_t count);
+
+    /**
+     * Append the ranges of the final partial blocks, once no more
+     * audio will be added.
+     */
+    void complete();
+
+    /**
+     * Return the frame count summarised so far.
+     */
+    sv_frame_t getFrameCount() const { return m_frameCount; }
+
+    size_t getMemoryUsage() const;
+
+    /**
+     * Return the nearest block size to that desired that
+     * getSummaries() can supply, from the cache or otherwise.
+     */
+    static int getSummaryBlockSize(int desired);
+
+    /**
+     * Fill ranges with summaries of the given channel from the
+     * cache, starting at the given frame (relative to the start of
+     * the audio), rounding blockSize down to a cached resolution.
+     * Return false without changing anything if the block size is
+     * too small to be served from the cache, in which case the
+     * caller should read the audio and use summarise() instead.
+     */
+    bool getSummaries(int channel, sv_frame_t start, sv_frame_t count,
+                      RangeBlock &ranges, int &blockSize) const;
+
+    /**
+     * Append to ranges the summaries of one channel of the given
+     * interleaved audio, at exactly the given block size.
+     */
+    static void summarise(const floatvec_t &frames, int channels,
+                          int channel, int blockSize, RangeBlock &ranges);
+
+private:
+    int m_channels;
+    sv_frame_t m_frameCount;
+
+    RangeBlock m_cache[2]; // interleaved at two base resolutions
+    int m_cacheBlockSize[2];
+
+    // Ranges and means of the blocks currently being summarised,
+    // indexed by channel * 2 + cache type
+    RangeBlock m_ranges;
+    std::vector<float> m_means;
+    int m_rangeCount[2];
+
+    void addSample(int channel, float sample);
+    void endFrame();
+    void flush(int cacheType);
+
+    static PowerOfSqrtTwoZoomConstraint m_zoomConstraint;
+};
+
+#endif
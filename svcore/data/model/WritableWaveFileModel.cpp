@@ -15,8 +15,6 @@
 
 #include "WritableWaveFileModel.h"
 
-#include "ReadOnlyWaveFileModel.h"
-
 #include "base/TempDirectory.h"
 #include "base/Exceptions.h"
 
@@ -27,6 +25,7 @@
 #include <QTextStream>
 
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <stdint.h>
 
@@ -39,14 +38,16 @@ const int WritableWaveFileModel::PROPORTION_UNKNOWN = -1;
 WritableWaveFileModel::WritableWaveFileModel(sv_samplerate_t sampleRate,
 					     int channels,
 					     QString path) :
-    m_model(0),
     m_writer(0),
     m_reader(0),
     m_sampleRate(sampleRate),
     m_channels(channels),
     m_frameCount(0),
     m_startFrame(0),
-    m_proportion(PROPORTION_UNKNOWN)
+    m_proportion(PROPORTION_UNKNOWN),
+    m_tailStart(0),
+    m_tailFrames(sv_frame_t(sampleRate * 30)), // at least 30 sec in memory
+    m_cache(channels)
 {
     if (path.isEmpty()) {
         try {
@@ -70,6 +71,10 @@ WritableWaveFileModel::WritableWaveFileModel(sv_samplerate_t sampleRate,
         return;
     }
 
+    // The file is only read back for audio that has dropped out of
+    // the in-memory tail, so the reader is not needed immediately
+    // and is only brought up to date when such a read happens
+
     FileSource source(m_writer->getPath());
 
     m_reader = new WavFileReader(source, true);
@@ -79,26 +84,10 @@ WritableWaveFileModel::WritableWaveFileModel(sv_samplerate_t sampleRate,
         m_reader = 0;
         return;
     }
-    
-    m_model = new ReadOnlyWaveFileModel(source, m_reader);
-    if (!m_model->isOK()) {
-        cerr << "WritableWaveFileModel: Error in creating wave file model" << endl;
-        delete m_model;
-        m_model = 0;
-        delete m_reader;
-        m_reader = 0;
-        return;
-    }
-    m_model->setStartFrame(m_startFrame);
-
-    connect(m_model, SIGNAL(modelChanged()), this, SIGNAL(modelChanged()));
-    connect(m_model, SIGNAL(modelChangedWithin(sv_frame_t, sv_frame_t)),
-            this, SIGNAL(modelChangedWithin(sv_frame_t, sv_frame_t)));
 }
 
 WritableWaveFileModel::~WritableWaveFileModel()
 {
-    delete m_model;
     delete m_writer;
     delete m_reader;
 }
@@ -107,7 +96,6 @@ void
 WritableWaveFileModel::setStartFrame(sv_frame_t startFrame)
 {
     m_startFrame = startFrame;
-    if (m_model) m_model->setStartFrame(startFrame);
 }
 
 bool
@@ -124,21 +112,51 @@ WritableWaveFileModel::addSamples(const float *const *samples, sv_frame_t count)
         return false;
     }
 
-    m_frameCount += count;
+    sv_frame_t prevCount;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        sv_frame_t base = m_tail.size();
+        m_tail.resize(base + count * m_channels);
+        for (sv_frame_t i = 0; i < count; ++i) {
+            for (int c = 0; c < m_channels; ++c) {
+                m_tail[base + i * m_channels + c] = samples[c][i];
+            }
+        }
+
+        sv_frame_t tailCount = m_tail.size() / m_channels;
+        if (tailCount > m_tailFrames * 2) {
+            // Everything before the tail has already gone to the
+            // file, and will be read from there on demand
+            sv_frame_t drop = tailCount - m_tailFrames;
+            m_tail.erase(m_tail.begin(), m_tail.begin() + drop * m_channels);
+            m_tailStart += drop;
+        }
+
+        m_cache.add(samples, count);
 
-    if (m_reader && m_reader->getChannelCount() == 0) {
-        m_reader->updateFrameCount();
+        prevCount = m_frameCount;
+        m_frameCount += count;
     }
 
+    notifyChangedWithin(m_startFrame + prevCount,
+                        m_startFrame + prevCount + count);
+
     return true;
 }
 
 void
 WritableWaveFileModel::updateModel()
 {
-    if (m_reader) {
-        m_reader->updateFrameCount();
-    }
+    flushChanges();
+}
+
+void
+WritableWaveFileModel::setTailFrames(sv_frame_t frames)
+{
+    QMutexLocker locker(&m_mutex);
+    m_tailFrames = frames;
 }
 
 bool
@@ -175,7 +193,12 @@ WritableWaveFileModel::writeComplete()
 {
     m_writer->close();
     if (m_reader) m_reader->updateDone();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cache.complete();
+    }
     m_proportion = 100;
+    flushChanges();
     emit modelChanged();
 }
 
@@ -186,26 +209,181 @@ WritableWaveFileModel::getFrameCount() const
     return m_frameCount;
 }
 
+QString
+WritableWaveFileModel::getTitle() const
+{
+    QString title;
+    if (m_reader) title = m_reader->getTitle();
+    if (title == "") title = objectName();
+    return title;
+}
+
+QString
+WritableWaveFileModel::getMaker() const
+{
+    if (m_reader) return m_reader->getMaker();
+    return "";
+}
+
+QString
+WritableWaveFileModel::getLocation() const
+{
+    if (m_reader) return m_reader->getLocation();
+    return "";
+}
+
+floatvec_t
+WritableWaveFileModel::getInterleavedFrames(sv_frame_t start,
+                                            sv_frame_t count) const
+{
+    // Start is relative to the start of the file. Frames still in the
+    // tail are copied from memory; anything earlier is read from the
+    // file, with the lock released while we do so. The tail only
+    // ever moves forward, so we may need to go round more than once
+
+    floatvec_t result;
+
+    QMutexLocker locker(&m_mutex);
+
+    if (start < 0 || start >= m_frameCount || count <= 0) return result;
+    if (start + count > m_frameCount) count = m_frameCount - start;
+
+    result.reserve(count * m_channels);
+
+    sv_frame_t frame = start;
+    sv_frame_t end = start + count;
+
+    while (frame < end && frame < m_tailStart) {
+
+        sv_frame_t n = min(end, m_tailStart) - frame;
+        locker.unlock();
+
+        floatvec_t fromFile;
+        if (m_reader) {
+            if (m_reader->getFrameCount() < frame + n) {
+                m_reader->updateFrameCount();
+            }
+            fromFile = m_reader->getInterleavedFrames(frame, n);
+        }
+        fromFile.resize(n * m_channels, 0.f);
+        result.insert(result.end(), fromFile.begin(), fromFile.end());
+        frame += n;
+
+        locker.relock();
+    }
+
+    if (frame < end) {
+        auto from = m_tail.begin() + (frame - m_tailStart) * m_channels;
+        result.insert(result.end(), from, from + (end - frame) * m_channels);
+    }
+
+    return result;
+}
+
 floatvec_t
 WritableWaveFileModel::getData(int channel, sv_frame_t start, sv_frame_t count) const
 {
-    if (!m_model || m_model->getChannelCount() == 0) return {};
-    return m_model->getData(channel, start, count);
+    int channels = m_channels;
+
+    if (channel >= channels) {
+        cerr << "ERROR: WritableWaveFileModel::getData: channel ("
+             << channel << ") >= channel count (" << channels << ")"
+             << endl;
+        return {};
+    }
+
+    if (count == 0) return {};
+
+    if (start >= m_startFrame) {
+        start -= m_startFrame;
+    } else {
+        if (count <= m_startFrame - start) {
+            return {};
+        } else {
+            count -= (m_startFrame - start);
+            start = 0;
+        }
+    }
+
+    floatvec_t interleaved = getInterleavedFrames(start, count);
+    if (channels == 1) return interleaved;
+
+    sv_frame_t obtained = interleaved.size() / channels;
+    
+    floatvec_t result(obtained, 0.f);
+    
+    if (channel != -1) {
+        // get a single channel
+        for (int i = 0; i < obtained; ++i) {
+            result[i] = interleaved[i * channels + channel];
+        }
+    } else {
+        // channel == -1, mix down all channels
+        for (int i = 0; i < obtained; ++i) {
+            for (int c = 0; c < channels; ++c) {
+                result[i] += interleaved[i * channels + c];
+            }
+        }
+    }
+
+    return result;
 }
 
 vector<floatvec_t>
 WritableWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
                                            sv_frame_t start, sv_frame_t count) const
 {
-    if (!m_model || m_model->getChannelCount() == 0) return {};
-    return m_model->getMultiChannelData(fromchannel, tochannel, start, count);
+    int channels = m_channels;
+
+    if (fromchannel > tochannel) {
+        cerr << "ERROR: WritableWaveFileModel::getData: fromchannel ("
+                  << fromchannel << ") > tochannel (" << tochannel << ")"
+                  << endl;
+        return {};
+    }
+
+    if (tochannel >= channels) {
+        cerr << "ERROR: WritableWaveFileModel::getData: tochannel ("
+                  << tochannel << ") >= channel count (" << channels << ")"
+                  << endl;
+        return {};
+    }
+
+    if (count == 0) return {};
+
+    int reqchannels = (tochannel - fromchannel) + 1;
+
+    if (start >= m_startFrame) {
+        start -= m_startFrame;
+    } else {
+        if (count <= m_startFrame - start) {
+            return {};
+        } else {
+            count -= (m_startFrame - start);
+            start = 0;
+        }
+    }
+
+    floatvec_t interleaved = getInterleavedFrames(start, count);
+    if (channels == 1) return { interleaved };
+
+    sv_frame_t obtained = interleaved.size() / channels;
+    vector<floatvec_t> result(reqchannels, floatvec_t(obtained, 0.f));
+
+    for (int c = fromchannel; c <= tochannel; ++c) {
+        int destc = c - fromchannel;
+        for (int i = 0; i < obtained; ++i) {
+            result[destc][i] = interleaved[i * channels + c];
+        }
+    }
+    
+    return result;
 }    
 
 int
 WritableWaveFileModel::getSummaryBlockSize(int desired) const
 {
-    if (!m_model) return desired;
-    return m_model->getSummaryBlockSize(desired);
+    return WaveRangeCache::getSummaryBlockSize(desired);
 }
 
 void
@@ -214,15 +392,28 @@ WritableWaveFileModel::getSummaries(int channel, sv_frame_t start, sv_frame_t co
                                     int &blockSize) const
 {
     ranges.clear();
-    if (!m_model || m_model->getChannelCount() == 0) return;
-    m_model->getSummaries(channel, start, count, ranges, blockSize);
-}
+    if (!isOK()) return;
+    ranges.reserve((count / blockSize) + 1);
+
+    if (start > m_startFrame) start -= m_startFrame;
+    else if (count <= m_startFrame - start) return;
+    else {
+        count -= (m_startFrame - start);
+        start = 0;
+    }
 
-WritableWaveFileModel::Range
-WritableWaveFileModel::getSummary(int channel, sv_frame_t start, sv_frame_t count) const
-{
-    if (!m_model || m_model->getChannelCount() == 0) return Range();
-    return m_model->getSummary(channel, start, count);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.getSummaries(channel, start, count, ranges, blockSize)) {
+            return;
+        }
+    }
+
+    // Not cached at this resolution: read the samples directly,
+    // which for a recent area will come from the in-memory tail
+
+    WaveRangeCache::summarise(getInterleavedFrames(start, count),
+                              m_channels, channel, blockSize, ranges);
 }
 
 void
@@ -17,8 +17,9 @@
 #define WRITABLE_WAVE_FILE_MODEL_H
 
 #include "WaveFileModel.h"
-#include "ReadOnlyWaveFileModel.h"
-#include "PowerOfSqrtTwoZoomConstraint.h"
+#include "WaveRangeCache.h"
+
+#include <QMutex>
 
 class WavFileWriter;
 class WavFileReader;
@@ -35,17 +36,17 @@ public:
      * Call addSamples to append a block of samples to the end of the
      * file.
      *
-     * This function only appends the samples to the file being
-     * written; it does not update the model's view of the samples in
-     * that file. That is, it updates the file on disc but the model
-     * itself does not change its content. This is because re-reading
-     * the file to update the model may be more expensive than adding
-     * the samples in the first place. If you are writing small
-     * numbers of samples repeatedly, you probably only want the model
-     * to update periodically rather than after every write.
+     * The samples are written to the file and also retained in an
+     * in-memory buffer holding the most recently written audio, from
+     * which reads near the end of the model are served without going
+     * back to the file. The model's summary cache is extended from
+     * the same samples, so the model's content changes immediately.
+     * Change notifications are merged and delivered at a bounded
+     * rate, so it is fine to add small numbers of samples
+     * repeatedly.
      *
-     * Call updateModel() periodically to tell the model to update its
-     * own view of the samples in the file being written.
+     * Call updateModel() to have any pending change notifications
+     * delivered at once.
      *
      * Call setWriteProportion() periodically if the file being
      * written has known duration and you want the model to be able to
@@ -56,9 +57,8 @@ public:
     virtual bool addSamples(const float *const *samples, sv_frame_t count);
 
     /**
-     * Tell the model to update its own (read) view of the (written)
-     * file. May cause modelChanged() and modelChangedWithin() to be
-     * emitted. See the comment to addSamples above for rationale.
+     * Deliver any change notifications pending from calls to
+     * addSamples. May cause modelChangedWithin() to be emitted.
      */
     void updateModel();
     
@@ -84,6 +84,14 @@ public:
     void writeComplete();
 
     static const int PROPORTION_UNKNOWN;
+
+    /**
+     * Set the minimum number of most recently written frames to be
+     * retained in memory. Earlier audio is read back from the file.
+     * The default is 30 seconds' worth. Takes effect from the next
+     * call to addSamples().
+     */
+    void setTailFrames(sv_frame_t frames);
     
     /**
      * Get the proportion of the file which has been written so far,
@@ -103,8 +111,7 @@ public:
     virtual int getCompletion() const { return 100; }
 
     const ZoomConstraint *getZoomConstraint() const {
-        static PowerOfSqrtTwoZoomConstraint zc;
-        return &zc;
+        return WaveRangeCache::getZoomConstraint();
     }
 
     sv_frame_t getFrameCount() const;
@@ -112,18 +119,9 @@ public:
     sv_samplerate_t getSampleRate() const { return m_sampleRate; }
     sv_samplerate_t getNativeRate() const { return m_sampleRate; }
 
-    QString getTitle() const {
-        if (m_model) return m_model->getTitle();
-        else return "";
-    } 
-    QString getMaker() const {
-        if (m_model) return m_model->getMaker();
-        else return "";
-    }
-    QString getLocation() const {
-        if (m_model) return m_model->getLocation();
-        else return "";
-    }
+    QString getTitle() const;
+    QString getMaker() const;
+    QString getLocation() const;
 
     float getValueMinimum() const { return -1.0f; }
     float getValueMaximum() const { return  1.0f; }
@@ -142,8 +140,6 @@ public:
     virtual void getSummaries(int channel, sv_frame_t start, sv_frame_t count,
                               RangeBlock &ranges, int &blockSize) const;
 
-    virtual Range getSummary(int channel, sv_frame_t start, sv_frame_t count) const;
-
     QString getTypeName() const { return tr("Writable Wave File"); }
 
     virtual void toXml(QTextStream &out,
@@ -151,7 +147,6 @@ public:
                        QString extraAttributes = "") const;
 
 protected:
-    ReadOnlyWaveFileModel *m_model;
     WavFileWriter *m_writer;
     WavFileReader *m_reader;
     sv_samplerate_t m_sampleRate;
@@ -159,6 +154,21 @@ protected:
     sv_frame_t m_frameCount;
     sv_frame_t m_startFrame;
     int m_proportion;
+
+    // The most recently written audio, interleaved, starting at
+    // frame m_tailStart of the file. Trimmed from the front as it
+    // grows, so as to hold between m_tailFrames and twice that
+    floatvec_t m_tail;
+    sv_frame_t m_tailStart;
+    sv_frame_t m_tailFrames;
+
+    // Summaries of everything written so far, extended as samples
+    // are added rather than read back from the file
+    WaveRangeCache m_cache;
+
+    mutable QMutex m_mutex;
+
+    floatvec_t getInterleavedFrames(sv_frame_t start, sv_frame_t count) const;
 };
 
 #endif
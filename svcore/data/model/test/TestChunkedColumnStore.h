@@ -0,0 +1,177 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_CHUNKED_COLUMN_STORE_H
+#define TEST_CHUNKED_COLUMN_STORE_H
+
+#include "../ChunkedColumnStore.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <cmath>
+
+using namespace std;
+
+class TestChunkedColumnStore : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef ChunkedColumnStore::Column Column;
+
+    Column makeColumn(int x, int height) {
+        Column c(height);
+        for (int i = 0; i < height; ++i) {
+            c[i] = float(sin(x * 0.1 + i) * (i + 1));
+        }
+        return c;
+    }
+
+private slots:
+    void empty() {
+        ChunkedColumnStore s(4);
+        QCOMPARE(s.getWidth(), 0);
+        QCOMPARE(int(s.getColumn(0).size()), 0);
+        QCOMPARE(int(s.getColumn(-1).size()), 0);
+    }
+
+    void inOrder() {
+        // Several chunks' worth, so that the earlier ones get sealed
+        ChunkedColumnStore s(4);
+        for (int x = 0; x < 19; ++x) {
+            s.setColumn(x, makeColumn(x, 1 + x % 5));
+        }
+        QCOMPARE(s.getWidth(), 19);
+        for (int x = 0; x < 19; ++x) {
+            QCOMPARE(s.getColumn(x), makeColumn(x, 1 + x % 5));
+        }
+        QCOMPARE(int(s.getColumn(19).size()), 0);
+    }
+
+    void edits() {
+        ChunkedColumnStore s(4);
+        for (int x = 0; x < 12; ++x) {
+            s.setColumn(x, makeColumn(x, 3));
+        }
+        // Change the size of a column in a sealed chunk, and leave a
+        // gap beyond the end
+        s.setColumn(5, makeColumn(50, 7));
+        s.setColumn(1, Column());
+        s.setColumn(15, makeColumn(15, 2));
+        QCOMPARE(s.getWidth(), 16);
+        for (int x = 0; x < 16; ++x) {
+            Column expected;
+            if (x == 5) expected = makeColumn(50, 7);
+            else if (x == 15) expected = makeColumn(15, 2);
+            else if (x < 12 && x != 1) expected = makeColumn(x, 3);
+            QCOMPARE(s.getColumn(x), expected);
+        }
+    }
+
+    void quantised() {
+        ChunkedColumnStore s(4);
+        s.setQuantisation(ChunkedColumnStore::Quantise16Bit);
+        int height = 10;
+        for (int x = 0; x < 9; ++x) {
+            s.setColumn(x, makeColumn(x, height));
+        }
+        // Range of values is at most +/- height, so a 16-bit step is
+        // at most 2 * height / 65535
+        float thresh = 2.f * float(height) / 65535.f;
+        for (int x = 0; x < 9; ++x) {
+            Column c = s.getColumn(x);
+            Column expected = makeColumn(x, height);
+            QCOMPARE(int(c.size()), height);
+            for (int i = 0; i < height; ++i) {
+                QVERIFY(fabsf(c[i] - expected[i]) <= thresh);
+            }
+        }
+    }
+
+    void quantised8Bit() {
+        ChunkedColumnStore s(4);
+        s.setQuantisation(ChunkedColumnStore::Quantise8Bit);
+        int height = 10;
+        for (int x = 0; x < 9; ++x) {
+            s.setColumn(x, makeColumn(x, height));
+        }
+        float thresh = 2.f * float(height) / 255.f;
+        for (int x = 0; x < 9; ++x) {
+            Column c = s.getColumn(x);
+            Column expected = makeColumn(x, height);
+            QCOMPARE(int(c.size()), height);
+            for (int i = 0; i < height; ++i) {
+                QVERIFY(fabsf(c[i] - expected[i]) <= thresh);
+            }
+        }
+    }
+
+    void quantisedEdits() {
+        // Editing a column in a quantised chunk, over and over, must
+        // not change the other columns in it beyond their first
+        // quantisation -- neither when the edit fits the chunk's
+        // range nor when it extends it
+        ChunkedColumnStore s(4);
+        s.setQuantisation(ChunkedColumnStore::Quantise8Bit);
+        int height = 10;
+        for (int x = 0; x < 9; ++x) {
+            s.setColumn(x, makeColumn(x, height));
+        }
+        vector<Column> sealed;
+        for (int x = 0; x < 8; ++x) {
+            sealed.push_back(s.getColumn(x));
+        }
+        for (int round = 0; round < 10; ++round) {
+            Column c = makeColumn(round, height);
+            for (int i = 0; i < height; ++i) c[i] *= 0.5f;
+            if (round == 5) c[0] = 1000.f;
+            s.setColumn(1, c);
+            s.setColumn(8, makeColumn(8, height)); // reseal chunk 0
+        }
+        for (int x = 0; x < 8; ++x) {
+            if (x == 1) continue;
+            QCOMPARE(s.getColumn(x), sealed[x]);
+        }
+    }
+
+    void spill() {
+        ChunkedColumnStore s(4);
+        int height = 10;
+        size_t budget = 4000;
+        s.setMemoryBudget(budget);
+        // Allow for the open chunk, which can't be spilled, and the
+        // per-chunk column offsets, which stay in memory
+        size_t slack = 4 * height * sizeof(float) + 1000;
+        for (int x = 0; x < 200; ++x) {
+            s.setColumn(x, makeColumn(x, height));
+        }
+        QVERIFY(s.getResidentSize() <= budget + slack);
+        // Read back out of order, so that chunks are loaded from the
+        // spill file and others dropped to make room
+        for (int n = 0, x = 0; n < 400; ++n, x = (x + 37) % 200) {
+            QCOMPARE(s.getColumn(x), makeColumn(x, height));
+        }
+        QVERIFY(s.getResidentSize() <= budget + slack);
+        // Edit a spilled chunk, which must be written out afresh
+        s.setColumn(5, makeColumn(500, 3));
+        s.setColumn(150, makeColumn(150, height));
+        for (int x = 0; x < 200; ++x) {
+            if (x == 5) QCOMPARE(s.getColumn(x), makeColumn(500, 3));
+            else QCOMPARE(s.getColumn(x), makeColumn(x, height));
+        }
+    }
+};
+
+#endif
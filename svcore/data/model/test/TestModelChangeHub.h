@@ -0,0 +1,148 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_MODEL_CHANGE_HUB_H
+#define TEST_MODEL_CHANGE_HUB_H
+
+#include "../ModelChangeHub.h"
+#include "MockWaveModel.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+class ChangeRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    ChangeRecorder(Model *model) {
+        connect(model, SIGNAL(modelChangedWithin(sv_frame_t, sv_frame_t)),
+                this, SLOT(changed(sv_frame_t, sv_frame_t)));
+    }
+
+    vector<pair<sv_frame_t, sv_frame_t>> ranges;
+
+public slots:
+    void changed(sv_frame_t start, sv_frame_t end) {
+        ranges.push_back({ start, end });
+    }
+};
+
+class TestModelChangeHub : public QObject
+{
+    Q_OBJECT
+
+private:
+    // Run an event loop for the given time, having first called f
+    // from within it, so that the hub delivers through the loop
+    // rather than synchronously
+    template <typename F>
+    void runLoop(int ms, F f) {
+        QEventLoop loop;
+        QTimer::singleShot(0, f);
+        QTimer::singleShot(ms, &loop, SLOT(quit()));
+        loop.exec();
+    }
+
+private slots:
+    void cleanup() {
+        ModelChangeHub::getInstance()->setInterval(100);
+    }
+
+    void synchronousWithoutEventLoop() {
+        MockWaveModel model({ DC }, 1000, 0);
+        ChangeRecorder recorder(&model);
+        ModelChangeHub::getInstance()->changedWithin(&model, 10, 20);
+        QCOMPARE(int(recorder.ranges.size()), 1);
+        QCOMPARE(recorder.ranges[0].first, sv_frame_t(10));
+        QCOMPARE(recorder.ranges[0].second, sv_frame_t(20));
+    }
+
+    void mergeRanges() {
+        MockWaveModel a({ DC }, 1000, 0);
+        MockWaveModel b({ DC }, 1000, 0);
+        ChangeRecorder ra(&a), rb(&b);
+        ModelChangeHub *hub = ModelChangeHub::getInstance();
+        runLoop(300, [&]() {
+                hub->changedWithin(&a, 100, 200);
+                hub->changedWithin(&b, 5, 6);
+                hub->changedWithin(&a, 50, 120);
+                hub->changedWithin(&a, 300, 400);
+            });
+        QCOMPARE(int(ra.ranges.size()), 1);
+        QCOMPARE(ra.ranges[0].first, sv_frame_t(50));
+        QCOMPARE(ra.ranges[0].second, sv_frame_t(400));
+        QCOMPARE(int(rb.ranges.size()), 1);
+        QCOMPARE(rb.ranges[0].first, sv_frame_t(5));
+        QCOMPARE(rb.ranges[0].second, sv_frame_t(6));
+    }
+
+    void rateLimit() {
+        MockWaveModel model({ DC }, 1000, 0);
+        ChangeRecorder recorder(&model);
+        ModelChangeHub *hub = ModelChangeHub::getInstance();
+        hub->setInterval(400);
+        int countPartWay = -1;
+        QEventLoop loop;
+        QTimer::singleShot(0, [&]() { hub->changedWithin(&model, 0, 10); });
+        QTimer::singleShot(150, [&]() { hub->changedWithin(&model, 10, 20); });
+        QTimer::singleShot(300, [&]() {
+                countPartWay = int(recorder.ranges.size());
+            });
+        QTimer::singleShot(1000, &loop, SLOT(quit()));
+        loop.exec();
+        // The first change arrives with the hub idle and goes out at
+        // once; the second has to wait for the interval to pass
+        QCOMPARE(countPartWay, 1);
+        QCOMPARE(int(recorder.ranges.size()), 2);
+        QCOMPARE(recorder.ranges[1].first, sv_frame_t(10));
+    }
+
+    void flush() {
+        MockWaveModel model({ DC }, 1000, 0);
+        ChangeRecorder recorder(&model);
+        ModelChangeHub *hub = ModelChangeHub::getInstance();
+        int countAfterFlush = -1;
+        runLoop(300, [&]() {
+                hub->changedWithin(&model, 0, 10);
+                hub->changedWithin(&model, 20, 30);
+                hub->flush(&model);
+                countAfterFlush = int(recorder.ranges.size());
+            });
+        QCOMPARE(countAfterFlush, 1);
+        QCOMPARE(int(recorder.ranges.size()), 1);
+        QCOMPARE(recorder.ranges[0].first, sv_frame_t(0));
+        QCOMPARE(recorder.ranges[0].second, sv_frame_t(30));
+    }
+
+    void forget() {
+        MockWaveModel model({ DC }, 1000, 0);
+        ChangeRecorder recorder(&model);
+        ModelChangeHub *hub = ModelChangeHub::getInstance();
+        runLoop(300, [&]() {
+                hub->changedWithin(&model, 0, 10);
+                hub->forget(&model);
+            });
+        QCOMPARE(int(recorder.ranges.size()), 0);
+    }
+};
+
+#endif
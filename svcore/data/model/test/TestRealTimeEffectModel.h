@@ -0,0 +1,229 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_REAL_TIME_EFFECT_MODEL_H
+#define TEST_REAL_TIME_EFFECT_MODEL_H
+
+#include "transform/RealTimeEffectModel.h"
+#include "plugin/RealTimePluginInstance.h"
+
+#include "MockWaveModel.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <vector>
+
+using namespace std;
+
+// A mono delay with a reported latency, which also adds a tiny offset
+// growing with the number of samples processed since it was last
+// silenced. That gives it a memory longer than any warm-up, so its
+// output only matches a full render if it has been run in order from
+// the start.
+class MockDelayPlugin : public RealTimePluginInstance
+{
+public:
+    MockDelayPlugin(int blockSize, int latency) :
+        RealTimePluginInstance(0, "mock:delay"),
+        m_blockSize(blockSize),
+        m_latency(latency),
+        m_in(blockSize, 0.f),
+        m_out(blockSize, 0.f),
+        m_inPtr(m_in.data()),
+        m_outPtr(m_out.data()) {
+        silence();
+    }
+
+    string getIdentifier() const { return "delay"; }
+    string getName() const { return "Delay"; }
+    string getDescription() const { return ""; }
+    string getMaker() const { return ""; }
+    string getCopyright() const { return ""; }
+    int getPluginVersion() const { return 1; }
+
+    bool isOK() const { return true; }
+    QString getPluginIdentifier() const { return "mock:delay"; }
+
+    void run(const RealTime &, int) {
+        for (int i = 0; i < m_blockSize; ++i) {
+            float v = m_in[i] + float(double(m_processed++) * 1e-6);
+            m_out[i] = m_line[m_pos];
+            m_line[m_pos] = v;
+            m_pos = (m_pos + 1) % m_latency;
+        }
+    }
+
+    int getBufferSize() const { return m_blockSize; }
+    int getAudioInputCount() const { return 1; }
+    int getAudioOutputCount() const { return 1; }
+    sample_t **getAudioInputBuffers() { return &m_inPtr; }
+    sample_t **getAudioOutputBuffers() { return &m_outPtr; }
+
+    int getControlOutputCount() const { return 0; }
+    float getControlOutputValue(int) const { return 0.f; }
+    int getParameterCount() const { return 0; }
+    void setParameterValue(int, float) { }
+    float getParameterValue(int) const { return 0.f; }
+    float getParameterDefault(int) const { return 0.f; }
+    int getParameterDisplayHint(int) const { return 0; }
+
+    bool isBypassed() const { return false; }
+    void setBypassed(bool) { }
+    sv_frame_t getLatency() { return m_latency; }
+
+    void silence() {
+        m_line = vector<float>(m_latency, 0.f);
+        m_pos = 0;
+        m_processed = 0;
+    }
+    void setIdealChannelCount(int) { silence(); }
+
+private:
+    int m_blockSize;
+    int m_latency;
+    vector<float> m_in;
+    vector<float> m_out;
+    float *m_inPtr;
+    float *m_outPtr;
+    vector<float> m_line;
+    int m_pos;
+    long m_processed;
+};
+
+class TestRealTimeEffectModel : public QObject
+{
+    Q_OBJECT
+
+private:
+    // As in RealTimeEffectModel, which warms the plugin up over one
+    // chunk's worth of input before rendering a chunk out of order
+    static const sv_frame_t chunkSize = 65536;
+
+    static const int blockSize = 1024;
+    static const int latency = 100;
+
+    MockWaveModel *m_input;
+    sv_frame_t m_frames;
+
+    // The output of a fresh plugin run over the whole input in
+    // order, less its latency, as the original full render
+    floatvec_t fullRender() {
+        MockDelayPlugin plugin(blockSize, latency);
+        floatvec_t result;
+        for (sv_frame_t f = 0; f < m_frames + latency; f += blockSize) {
+            floatvec_t in = m_input->getData(0, f, blockSize);
+            float *inbuf = plugin.getAudioInputBuffers()[0];
+            for (int i = 0; i < blockSize; ++i) {
+                inbuf[i] = (i < int(in.size()) ? in[i] : 0.f);
+            }
+            plugin.run(RealTime::zeroTime, 0);
+            float *outbuf = plugin.getAudioOutputBuffers()[0];
+            for (int i = 0; i < blockSize; ++i) {
+                if (f + i >= latency) result.push_back(outbuf[i]);
+            }
+        }
+        result.resize(m_frames);
+        return result;
+    }
+
+    RealTimeEffectModel *makeModel(bool withSecondInstance) {
+        RealTimeEffectModel *model = new RealTimeEffectModel
+            (m_input, 0,
+             new MockDelayPlugin(blockSize, latency),
+             withSecondInstance ? new MockDelayPlugin(blockSize, latency) : 0);
+        model->setExtent(0, m_frames);
+        return model;
+    }
+
+    // Read a range well into the output, forcing a render with
+    // warm-up, and return whether it differed from the full render
+    bool readOutOfOrder(RealTimeEffectModel *model, const floatvec_t &full) {
+        sv_frame_t start = 3 * chunkSize + 100;
+        floatvec_t data = model->getData(0, start, 1000);
+        if (data.size() != 1000) return false;
+        for (int i = 0; i < 1000; ++i) {
+            if (data[i] != full[start + i]) return true;
+        }
+        return false;
+    }
+
+    void deleteModel(RealTimeEffectModel *model) {
+        model->aboutToDelete();
+        delete model;
+    }
+
+private slots:
+    void init() {
+        m_input = new MockWaveModel({ Sine }, int(4 * chunkSize + 3000), 500);
+        m_frames = m_input->getEndFrame();
+    }
+
+    void cleanup() {
+        m_input->aboutToDelete();
+        delete m_input;
+        m_input = 0;
+    }
+
+    void inOrderMatchesFullRender() {
+        floatvec_t full = fullRender();
+        RealTimeEffectModel *model = makeModel(true);
+
+        // Leave the cache holding chunks that were warmed up rather
+        // than rendered in order, with more being rendered in the
+        // background while we read
+        QVERIFY(readOutOfOrder(model, full));
+        RangeSummarisableTimeValueModel::RangeBlock ranges;
+        int summaryBlockSize = 4096;
+        model->getSummaries(0, 0, m_frames, ranges, summaryBlockSize);
+
+        // Then read it all in order, one channel and one block at a
+        // time as the audio file writer does
+        const sv_frame_t bs = 2048;
+        for (sv_frame_t f = 0; f < m_frames; f += bs) {
+            sv_frame_t n = min(bs, m_frames - f);
+            floatvec_t data = model->getData(0, f, n);
+            QCOMPARE(sv_frame_t(data.size()), n);
+            for (sv_frame_t i = 0; i < n; ++i) {
+                if (data[i] != full[f + i]) {
+                    cerr << "at frame " << f + i << ": " << data[i]
+                         << " != " << full[f + i] << endl;
+                    QCOMPARE(data[i], full[f + i]);
+                }
+            }
+            // Reading the same range again is also exact
+            QVERIFY(model->getData(0, f, n) == data);
+        }
+
+        deleteModel(model);
+    }
+
+    void inOrderFromCacheWithoutSecondInstance() {
+        // Chunks rendered for the cache one after another from the
+        // start are exact too, with the latency compensated across
+        // the chunk boundary
+        floatvec_t full = fullRender();
+        RealTimeEffectModel *model = makeModel(false);
+        floatvec_t data = model->getData(0, 0, 2 * chunkSize);
+        QCOMPARE(sv_frame_t(data.size()), sv_frame_t(2 * chunkSize));
+        for (sv_frame_t i = 0; i < 2 * chunkSize; ++i) {
+            if (data[i] != full[i]) {
+                QCOMPARE(data[i], full[i]);
+            }
+        }
+        deleteModel(model);
+    }
+};
+
+#endif
@@ -0,0 +1,108 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+
+#ifndef TEST_SPARSE_MODEL_H
+#define TEST_SPARSE_MODEL_H
+
+#include "../SparseTimeValueModel.h"
+#include "../RegionModel.h"
+
+#include <QObject>
+#include <QtTest>
+
+using namespace std;
+
+class TestSparseModel : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef SparseTimeValueModel::Point Point;
+
+    // Deliberately unsorted, with coincident frames
+    SparseTimeValueModel::PointVector makePoints() {
+        SparseTimeValueModel::PointVector points;
+        for (int i = 0; i < 50; ++i) {
+            sv_frame_t frame = (i * 37) % 20 * 10;
+            points.push_back(Point(frame, float(i) - 10.f,
+                                   QString("%1").arg(i)));
+        }
+        return points;
+    }
+
+    void compare(const SparseTimeValueModel &a, const SparseTimeValueModel &b) {
+        QCOMPARE(a.getPointCount(), b.getPointCount());
+        SparseTimeValueModel::PointList::const_iterator i = a.getPoints().begin();
+        SparseTimeValueModel::PointList::const_iterator j = b.getPoints().begin();
+        while (i != a.getPoints().end()) {
+            QCOMPARE(i->frame, j->frame);
+            QCOMPARE(i->value, j->value);
+            QCOMPARE(i->label, j->label);
+            ++i;
+            ++j;
+        }
+        QCOMPARE(a.getValueMinimum(), b.getValueMinimum());
+        QCOMPARE(a.getValueMaximum(), b.getValueMaximum());
+        QCOMPARE(a.hasTextLabels(), b.hasTextLabels());
+    }
+
+private slots:
+    void addPointsEmpty() {
+        SparseTimeValueModel m(100, 1, false);
+        m.addPoints(SparseTimeValueModel::PointVector());
+        QVERIFY(m.isEmpty());
+        QVERIFY(!m.hasTextLabels());
+    }
+
+    void addPointsMatchesAddPoint() {
+        SparseTimeValueModel::PointVector points = makePoints();
+        SparseTimeValueModel a(100, 1, false), b(100, 1, false);
+        for (int i = 0; i < int(points.size()); ++i) {
+            a.addPoint(points[i]);
+        }
+        b.addPoints(points);
+        compare(a, b);
+    }
+
+    void addPointsInterleaved() {
+        // A batch that lands among points already in the model
+        SparseTimeValueModel::PointVector points = makePoints();
+        SparseTimeValueModel::PointVector first(points.begin(),
+                                                points.begin() + 20);
+        SparseTimeValueModel::PointVector second(points.begin() + 20,
+                                                 points.end());
+        SparseTimeValueModel a(100, 1, false), b(100, 1, false);
+        for (int i = 0; i < int(points.size()); ++i) {
+            a.addPoint(points[i]);
+        }
+        b.addPoints(first);
+        b.addPoints(second);
+        compare(a, b);
+    }
+
+    void addPointsRegionValues() {
+        RegionModel m(100, 1, false);
+        RegionModel::PointVector points;
+        points.push_back(RegionModel::Point(0, 0.f, 10, ""));
+        m.addPoints(points);
+        QVERIFY(!m.haveDistinctValues());
+        points.push_back(RegionModel::Point(20, 2.f, 10, ""));
+        m.addPoints(points);
+        QVERIFY(m.haveDistinctValues());
+        QCOMPARE(m.getPointCount(), 3);
+    }
+};
+
+#endif
@@ -0,0 +1,178 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_WRITABLE_WAVE_FILE_MODEL_H
+#define TEST_WRITABLE_WAVE_FILE_MODEL_H
+
+#include "../WritableWaveFileModel.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+class TailExposingWaveFileModel : public WritableWaveFileModel
+{
+public:
+    TailExposingWaveFileModel(sv_samplerate_t rate, int channels) :
+        WritableWaveFileModel(rate, channels) { }
+
+    sv_frame_t getTailStart() const {
+        QMutexLocker locker(&m_mutex);
+        return m_tailStart;
+    }
+};
+
+class TestWritableWaveFileModel : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int channels = 2;
+    static const sv_frame_t frames = 10000;
+    static const sv_frame_t tailFrames = 1000;
+
+    TailExposingWaveFileModel *m_model;
+
+    static float sample(int c, sv_frame_t i) {
+        return float(((i * 37 + c * 11) % 200) - 100) / 100.f;
+    }
+
+    typedef RangeSummarisableTimeValueModel::Range Range;
+
+    static Range expected(int c, sv_frame_t start, sv_frame_t count) {
+        float min = sample(c, start), max = min;
+        double total = 0.0;
+        for (sv_frame_t i = start; i < start + count; ++i) {
+            float s = sample(c, i);
+            if (s < min) min = s;
+            if (s > max) max = s;
+            total += fabs(s);
+        }
+        return Range(min, max, float(total / double(count)));
+    }
+
+    void compare(Range r, Range e) {
+        QCOMPARE(r.min(), e.min());
+        QCOMPARE(r.max(), e.max());
+        QVERIFY(fabsf(r.absmean() - e.absmean()) < 1e-4f);
+    }
+
+    // The in-memory tail should start well into the recorded audio,
+    // with enough either side of it to read across
+    bool tailStartOK(sv_frame_t t) {
+        if (t < 1000 || t > frames - 800) {
+            cerr << "tail starts at " << t << endl;
+            return false;
+        }
+        return true;
+    }
+
+private slots:
+    void init() {
+        m_model = new TailExposingWaveFileModel(44100, channels);
+        QVERIFY(m_model->isOK());
+        m_model->setTailFrames(tailFrames);
+        vector<vector<float>> buffers(channels, vector<float>(100));
+        float *ptrs[channels];
+        for (sv_frame_t i = 0; i < frames; i += 100) {
+            for (int c = 0; c < channels; ++c) {
+                for (int j = 0; j < 100; ++j) {
+                    buffers[c][j] = sample(c, i + j);
+                }
+                ptrs[c] = buffers[c].data();
+            }
+            QVERIFY(m_model->addSamples(ptrs, 100));
+        }
+        QCOMPARE(m_model->getFrameCount(), sv_frame_t(frames));
+    }
+
+    void cleanup() {
+        delete m_model;
+        m_model = 0;
+    }
+
+    void dataAcrossTail() {
+        sv_frame_t t = m_model->getTailStart();
+        QVERIFY(tailStartOK(t));
+        for (int c = 0; c < channels; ++c) {
+            floatvec_t data = m_model->getData(c, t - 300, 600);
+            QCOMPARE(sv_frame_t(data.size()), sv_frame_t(600));
+            for (sv_frame_t i = 0; i < 600; ++i) {
+                QCOMPARE(data[i], sample(c, t - 300 + i));
+            }
+        }
+    }
+
+    void directSummariesAcrossTail() {
+        sv_frame_t t = m_model->getTailStart();
+        QVERIFY(tailStartOK(t));
+        sv_frame_t start = t - 305;
+        for (int c = 0; c < channels; ++c) {
+            int blockSize = 10;
+            RangeSummarisableTimeValueModel::RangeBlock ranges;
+            m_model->getSummaries(c, start, 600, ranges, blockSize);
+            QCOMPARE(blockSize, 10);
+            QCOMPARE(int(ranges.size()), 60);
+            for (int i = 0; i < 60; ++i) {
+                compare(ranges[i], expected(c, start + i * 10, 10));
+            }
+        }
+    }
+
+    void cachedSummariesAcrossTail() {
+        sv_frame_t t = m_model->getTailStart();
+        QVERIFY(tailStartOK(t));
+        int blockSize = 128;
+        sv_frame_t start = (t / blockSize) * blockSize - 2 * blockSize;
+        for (int c = 0; c < channels; ++c) {
+            RangeSummarisableTimeValueModel::RangeBlock ranges;
+            m_model->getSummaries(c, start, 4 * blockSize, ranges, blockSize);
+            QCOMPARE(blockSize, 128);
+            QVERIFY(ranges.size() >= 4);
+            for (int i = 0; i < 4; ++i) {
+                compare(ranges[i], expected(c, start + i * blockSize,
+                                            blockSize));
+            }
+        }
+    }
+
+    void summaryAcrossTail() {
+        sv_frame_t t = m_model->getTailStart();
+        QVERIFY(tailStartOK(t));
+        for (int c = 0; c < channels; ++c) {
+            compare(m_model->getSummary(c, t - 777, 1500),
+                    expected(c, t - 777, 1500));
+            compare(m_model->getSummary(c, t - 1, 3),
+                    expected(c, t - 1, 3));
+        }
+    }
+
+    void summaryWithStartFrame() {
+        sv_frame_t t = m_model->getTailStart();
+        QVERIFY(tailStartOK(t));
+        m_model->setStartFrame(500);
+        for (int c = 0; c < channels; ++c) {
+            compare(m_model->getSummary(c, 500 + t - 333, 1000),
+                    expected(c, t - 333, 1000));
+        }
+        // Only the part after the start frame counts
+        compare(m_model->getSummary(0, 0, 600), expected(0, 0, 100));
+    }
+};
+
+#endif
@@ -1,7 +1,12 @@
 TEST_HEADERS += \
 	Compares.h \
 	MockWaveModel.h \
-	TestFFTModel.h
+	TestChunkedColumnStore.h \
+	TestFFTModel.h \
+	TestModelChangeHub.h \
+	TestRealTimeEffectModel.h \
+	TestSparseModel.h \
+	TestWritableWaveFileModel.h
 	
 TEST_SOURCES += \
 	MockWaveModel.cpp \
@@ -12,6 +12,11 @@
 */
 
 #include "TestFFTModel.h"
+#include "TestChunkedColumnStore.h"
+#include "TestSparseModel.h"
+#include "TestModelChangeHub.h"
+#include "TestWritableWaveFileModel.h"
+#include "TestRealTimeEffectModel.h"
 
 #include <QtTest>
 
@@ -33,6 +38,36 @@ int main(int argc, char *argv[])
 	else ++bad;
     }
 
+    {
+	TestChunkedColumnStore t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+
+    {
+	TestSparseModel t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+
+    {
+	TestModelChangeHub t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+
+    {
+	TestWritableWaveFileModel t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+
+    {
+	TestRealTimeEffectModel t;
+	if (QTest::qExec(&t, argc, argv) == 0) ++good;
+	else ++bad;
+    }
+
     if (bad > 0) {
 	cerr << "\n********* " << bad << " test suite(s) failed!\n" << endl;
 	return 1;
@@ -20,6 +20,8 @@
 
 #include "OSCMessage.h"
 
+#include <utility>
+
 
 OSCMessage::~OSCMessage()
 {
@@ -50,3 +52,12 @@ OSCMessage::getArg(int i) const
     return m_args[i];
 }
 
+void
+OSCMessage::swap(OSCMessage &other)
+{
+    std::swap(m_target, other.m_target);
+    std::swap(m_targetData, other.m_targetData);
+    m_method.swap(other.m_method);
+    m_args.swap(other.m_args);
+}
+
@@ -50,6 +50,12 @@ public:
     int getArgCount() const;
     const QVariant &getArg(int i) const;
 
+    /**
+     * Exchange contents with another message, without copying or
+     * reallocating the argument storage of either.
+     */
+    void swap(OSCMessage &other);
+
 private:
     int m_target;
     int m_targetData;
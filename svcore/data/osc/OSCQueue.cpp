@@ -51,7 +51,10 @@ OSCQueue::oscMessageHandler(const char *path, const char *types, lo_arg **argv,
 	return 1;
     }
 
-    OSCMessage message;
+    // Reuse the same message each time, so that its argument
+    // storage is only allocated for the first few messages
+    OSCMessage &message = queue->m_incoming;
+    message.clearArgs();
     message.setTarget(target);
     message.setTargetData(targetData);
     message.setMethod(method);
@@ -93,10 +96,17 @@ OSCQueue::OSCQueue() :
 #ifdef HAVE_LIBLO
     m_thread(0),
 #endif
-    m_buffer(OSC_MESSAGE_QUEUE_SIZE)
+    m_buffer(OSC_MESSAGE_QUEUE_SIZE),
+    m_free(OSC_MESSAGE_QUEUE_SIZE),
+    m_signalPending(false)
 {
     Profiler profiler("OSCQueue::OSCQueue");
 
+    for (int i = 0; i < OSC_MESSAGE_QUEUE_SIZE; ++i) {
+        OSCMessage *mp = new OSCMessage();
+        m_free.write(&mp, 1);
+    }
+
 #ifdef HAVE_LIBLO
     m_thread = lo_server_thread_new(NULL, oscError);
 
@@ -121,6 +131,9 @@ OSCQueue::~OSCQueue()
     while (m_buffer.getReadSpace() > 0) {
         delete m_buffer.readOne();
     }
+    while (m_free.getReadSpace() > 0) {
+        delete m_free.readOne();
+    }
 }
 
 bool
@@ -152,17 +165,47 @@ OSCQueue::getMessagesAvailable() const
 OSCMessage
 OSCQueue::readMessage()
 {
+    m_signalPending = false;
     OSCMessage *message = m_buffer.readOne();
     OSCMessage rmessage = *message;
-    delete message;
+    release(message);
     return rmessage;
 }
 
+int
+OSCQueue::readMessages(std::vector<OSCMessage> &messages, int max)
+{
+    // Clear the flag before reading, so that anything posted from
+    // here on signals again even if we don't get to read it now
+    m_signalPending = false;
+
+    int n = m_buffer.getReadSpace();
+    if (n > max) n = max;
+
+    messages.resize(n);
+
+    for (int i = 0; i < n; ++i) {
+        OSCMessage *message = m_buffer.readOne();
+        messages[i].swap(*message);
+        release(message);
+    }
+
+    return n;
+}
+
 void
-OSCQueue::postMessage(OSCMessage message)
+OSCQueue::release(OSCMessage *message)
+{
+    // The free list has room for every slot in the pool, so this
+    // can't fail
+    m_free.write(&message, 1);
+}
+
+void
+OSCQueue::postMessage(const OSCMessage &message)
 {
     int count = 0, max = 5;
-    while (m_buffer.getWriteSpace() == 0) {
+    while (m_free.getReadSpace() == 0) {
         if (count == max) {
             cerr << "ERROR: OSCQueue::postMessage: OSC message queue is full and not clearing -- abandoning incoming message" << endl;
             return;
@@ -177,12 +220,18 @@ OSCQueue::postMessage(OSCMessage message)
         count++;
     }
 
-    OSCMessage *mp = new OSCMessage(message);
+    // Assigning into a pooled slot reuses whatever argument storage
+    // it was left with by the message it last held
+    OSCMessage *mp = m_free.readOne();
+    *mp = message;
     m_buffer.write(&mp, 1);
     SVDEBUG << "OSCQueue::postMessage: Posted OSC message: target "
               << message.getTarget() << ", target data " << message.getTargetData()
               << ", method " << message.getMethod() << endl;
-    emit messagesAvailable();
+
+    if (!m_signalPending.exchange(true)) {
+        emit messagesAvailable();
+    }
 }
 
 bool
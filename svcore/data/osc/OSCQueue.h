@@ -27,10 +27,26 @@
 
 #include <QObject>
 
+#include <atomic>
+#include <vector>
+
 #ifdef HAVE_LIBLO
 #include <lo/lo.h>
 #endif
 
+/**
+ * Queue of OSC messages received on a liblo server thread, for
+ * handling in the GUI thread.
+ *
+ * Messages are stored in a fixed pool of preallocated slots, passed
+ * from the server thread to the reader through one lock-free ring
+ * buffer and handed back through another, so nothing is allocated or
+ * freed per message once the pool has warmed up. The
+ * messagesAvailable signal is emitted only when messages arrive at a
+ * queue that has not been read since the last emission, so a burst of
+ * messages results in one signal which the reader answers by draining
+ * them all with readMessages().
+ */
 class OSCQueue : public QObject
 {
     Q_OBJECT
@@ -45,6 +61,14 @@ public:
     int getMessagesAvailable() const;
     OSCMessage readMessage();
 
+    /**
+     * Read up to max of the available messages in one go, replacing
+     * the contents of the given vector with them, and return the
+     * number read. Pass the same vector each time to avoid
+     * reallocating its messages' storage.
+     */
+    int readMessages(std::vector<OSCMessage> &messages, int max);
+
     QString getOSCURL() const;
 
 signals:
@@ -59,10 +83,15 @@ protected:
                                  int, lo_message, void *);
 #endif
 
-    void postMessage(OSCMessage);
+    void postMessage(const OSCMessage &);
     bool parseOSCPath(QString path, int &target, int &targetData, QString &method);
 
-    RingBuffer<OSCMessage *> m_buffer;
+    OSCMessage m_incoming; // used only by the server thread
+    RingBuffer<OSCMessage *> m_buffer; // posted messages
+    RingBuffer<OSCMessage *> m_free; // slots returned by the reader
+    std::atomic<bool> m_signalPending;
+
+    void release(OSCMessage *);
 };
 
 #endif
@@ -12,6 +12,7 @@ SVCORE_HEADERS = \
            base/HitCount.h \
            base/LogRange.h \
            base/MagnitudeRange.h \
+           base/Metrics.h \
            base/Pitch.h \
            base/Playable.h \
            base/PlayParameterRepository.h \
@@ -70,6 +71,7 @@ SVCORE_HEADERS = \
            data/midi/rtmidi/RtMidi.h \
            data/model/AggregateWaveModel.h \
            data/model/AlignmentModel.h \
+           data/model/ChunkedColumnStore.h \
            data/model/Dense3DModelPeakCache.h \
            data/model/DenseThreeDimensionalModel.h \
            data/model/DenseTimeValueModel.h \
@@ -79,6 +81,7 @@ SVCORE_HEADERS = \
            data/model/IntervalModel.h \
            data/model/Labeller.h \
            data/model/Model.h \
+           data/model/ModelChangeHub.h \
            data/model/ModelDataTableModel.h \
            data/model/NoteModel.h \
            data/model/FlexiNoteModel.h \
@@ -94,6 +97,7 @@ SVCORE_HEADERS = \
            data/model/TabularModel.h \
            data/model/TextModel.h \
            data/model/WaveFileModel.h \
+           data/model/WaveRangeCache.h \
            data/model/ReadOnlyWaveFileModel.h \
            data/model/WritableWaveFileModel.h \
            data/osc/OSCMessage.h \
@@ -124,6 +128,7 @@ SVCORE_HEADERS = \
            rdf/RDFExporter.h \
            rdf/RDFFeatureWriter.h \
            rdf/RDFImporter.h \
+           rdf/RDFStreamReader.h \
            rdf/RDFTransformFactory.h \
 	   system/Init.h \
            system/System.h \
@@ -131,6 +136,7 @@ SVCORE_HEADERS = \
            transform/FeatureExtractionModelTransformer.h \
            transform/FeatureWriter.h \
            transform/FileFeatureWriter.h \
+           transform/RealTimeEffectModel.h \
            transform/RealTimeEffectModelTransformer.h \
            transform/Transform.h \
            transform/TransformDescription.h \
@@ -147,6 +153,7 @@ SVCORE_SOURCES = \
            base/Exceptions.cpp \
            base/HelperExecPath.cpp \
            base/LogRange.cpp \
+           base/Metrics.cpp \
            base/Pitch.cpp \
            base/PlayParameterRepository.cpp \
            base/PlayParameters.cpp \
@@ -196,16 +203,19 @@ SVCORE_SOURCES = \
            data/midi/rtmidi/RtMidi.cpp \
            data/model/AggregateWaveModel.cpp \
            data/model/AlignmentModel.cpp \
+           data/model/ChunkedColumnStore.cpp \
            data/model/Dense3DModelPeakCache.cpp \
            data/model/DenseTimeValueModel.cpp \
            data/model/EditableDenseThreeDimensionalModel.cpp \
            data/model/FFTModel.cpp \
            data/model/Model.cpp \
+           data/model/ModelChangeHub.cpp \
            data/model/ModelDataTableModel.cpp \
            data/model/PowerOfSqrtTwoZoomConstraint.cpp \
            data/model/PowerOfTwoZoomConstraint.cpp \
            data/model/RangeSummarisableTimeValueModel.cpp \
            data/model/WaveFileModel.cpp \
+           data/model/WaveRangeCache.cpp \
            data/model/ReadOnlyWaveFileModel.cpp \
            data/model/WritableWaveFileModel.cpp \
            data/osc/OSCMessage.cpp \
@@ -228,12 +238,14 @@ SVCORE_SOURCES = \
            rdf/RDFExporter.cpp \
            rdf/RDFFeatureWriter.cpp \
            rdf/RDFImporter.cpp \
+           rdf/RDFStreamReader.cpp \
            rdf/RDFTransformFactory.cpp \
 	   system/Init.cpp \
            system/System.cpp \
 	   transform/CSVFeatureWriter.cpp \
            transform/FeatureExtractionModelTransformer.cpp \
            transform/FileFeatureWriter.cpp \
+           transform/RealTimeEffectModel.cpp \
            transform/RealTimeEffectModelTransformer.cpp \
            transform/Transform.cpp \
            transform/TransformFactory.cpp \
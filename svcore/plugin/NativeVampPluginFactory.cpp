@@ -45,6 +45,7 @@ public:
                                 NativeVampPluginFactory *factory) :
         PluginWrapper(plugin), m_factory(factory) { }
     virtual ~PluginDeletionNotifyAdapter();
+    Vamp::Plugin *getWrappedPlugin() const { return m_plugin; }
 protected:
     NativeVampPluginFactory *m_factory;
 };
@@ -60,6 +61,15 @@ PluginDeletionNotifyAdapter::~PluginDeletionNotifyAdapter()
     if (m_factory) m_factory->pluginDeleted(p);
 }
 
+Vamp::PluginHostAdapter *
+NativeVampPluginFactory::getHostAdapter(Vamp::Plugin *plugin)
+{
+    PluginDeletionNotifyAdapter *adapter =
+        dynamic_cast<PluginDeletionNotifyAdapter *>(plugin);
+    if (!adapter) return 0;
+    return dynamic_cast<Vamp::PluginHostAdapter *>(adapter->getWrappedPlugin());
+}
+
 vector<QString>
 NativeVampPluginFactory::getPluginPath()
 {
@@ -23,6 +23,8 @@
 
 #include "base/Debug.h"
 
+#include <vamp-hostsdk/PluginHostAdapter.h>
+
 #include <QMutex>
 
 /**
@@ -49,6 +51,14 @@ public:
      */
     virtual QString getPluginCategory(QString identifier) override;
 
+    /**
+     * If the given plugin was returned by instantiatePlugin on this
+     * factory, return the PluginHostAdapter it wraps, through which
+     * features can be retrieved into reusable storage (see
+     * PluginHostAdapter::processInto). Otherwise return 0.
+     */
+    static Vamp::PluginHostAdapter *getHostAdapter(Vamp::Plugin *plugin);
+
 protected:
     QMutex m_mutex;
     std::vector<QString> m_pluginPath;
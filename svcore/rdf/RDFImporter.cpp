@@ -14,6 +14,7 @@
 */
 
 #include "RDFImporter.h"
+#include "RDFStreamReader.h"
 
 #include <map>
 #include <vector>
@@ -50,7 +51,8 @@ using Dataquay::PropertyObject;
 class RDFImporterImpl
 {
 public:
-    RDFImporterImpl(QString url, sv_samplerate_t sampleRate);
+    RDFImporterImpl(QString url, sv_samplerate_t sampleRate,
+                    RDFImporter::ReadMode mode);
     virtual ~RDFImporterImpl();
 
     void setSampleRate(sv_samplerate_t sampleRate) { m_sampleRate = sampleRate; }
@@ -64,6 +66,12 @@ protected:
     BasicStore *m_store;
     Uri expand(QString s) { return m_store->expand(s); }
 
+    // If the document is a local Turtle file, we read only the
+    // statements we need using a streaming parser, and m_store is
+    // not used. Otherwise (or if the streaming parse fails) we fall
+    // back to loading the whole document into m_store.
+    RDFStreamReader *m_stream;
+
     QString m_uristring;
     QString m_errorString;
     std::map<QString, Model *> m_audioModelMap;
@@ -71,28 +79,84 @@ protected:
 
     std::map<Model *, std::map<QString, float> > m_labelValueMap;
 
+    // Points produced by fillModel are held here until the whole
+    // document has been read, and then added to each model in a
+    // single batch
+    struct PendingPoints {
+        PendingPoints() : valueMaximum(0.f), haveExtents(false) { }
+        SparseOneDimensionalModel::PointVector sodm;
+        TextModel::PointVector tm;
+        SparseTimeValueModel::PointVector stvm;
+        NoteModel::PointVector nm;
+        RegionModel::PointVector rm;
+        float valueMaximum; // of region points, for label values
+        bool haveExtents;
+    };
+    std::map<Model *, PendingPoints> m_pending;
+
+    // Map from timeline uri to event type to dimensionality to
+    // presence of duration to model ptr.  Whee!
+    typedef std::map<QString, std::map<QString, std::map<int, std::map<bool, Model *> > > > SparseModelMap;
+
     void getDataModelsAudio(std::vector<Model *> &, ProgressReporter *);
     void getDataModelsSparse(std::vector<Model *> &, ProgressReporter *);
     void getDataModelsDense(std::vector<Model *> &, ProgressReporter *);
 
-    void getDenseModelTitle(Model *, QString, QString);
+    void getStreamedModelsAudio(std::vector<Model *> &, ProgressReporter *);
+    void getStreamedModelsSparse(std::vector<Model *> &, ProgressReporter *);
+    void getStreamedModelsDense(std::vector<Model *> &, ProgressReporter *);
+
+    void loadAudioModel(std::vector<Model *> &, QString signal, QString source,
+                        ProgressReporter *);
+
+    QString getDenseModelTitle(QString, QString);
 
     void getDenseFeatureProperties(QString featureUri,
                                    sv_samplerate_t &sampleRate, int &windowLength,
                                    int &hopSize, int &width, int &height);
 
+    void getStreamedDenseFeatureProperties(RDFStreamReader::NodeId feature,
+                                           sv_samplerate_t &sampleRate, int &windowLength,
+                                           int &hopSize, int &width, int &height);
+
+    void makeDenseModel(std::vector<Model *> &, QString type, QString value,
+                        QString title, sv_samplerate_t sampleRate, int hopSize,
+                        int height);
+
+    Model *getSparseModel(SparseModelMap &, std::vector<Model *> &,
+                          QString source, QString timeline, QString type,
+                          int dimensions, bool haveDuration,
+                          bool text, bool note, bool &created);
+    
     void fillModel(Model *, sv_frame_t, sv_frame_t,
                    bool, std::vector<float> &, QString);
+    void flushPendingPoints();
 };
 
+static std::vector<float>
+parseValues(QString valuestring)
+{
+    std::vector<float> values;
+    if (valuestring != "") {
+        QStringList vsl = valuestring.split(" ", QString::SkipEmptyParts);
+        for (int j = 0; j < vsl.size(); ++j) {
+            bool success = false;
+            float v = vsl[j].toFloat(&success);
+            if (success) values.push_back(v);
+        }
+    }
+    return values;
+}
+
 QString
 RDFImporter::getKnownExtensions()
 {
     return "*.rdf *.n3 *.ttl";
 }
 
-RDFImporter::RDFImporter(QString url, sv_samplerate_t sampleRate) :
-    m_d(new RDFImporterImpl(url, sampleRate)) 
+RDFImporter::RDFImporter(QString url, sv_samplerate_t sampleRate,
+                         ReadMode mode) :
+    m_d(new RDFImporterImpl(url, sampleRate, mode)) 
 {
 }
 
@@ -125,13 +189,33 @@ RDFImporter::getDataModels(ProgressReporter *r)
     return m_d->getDataModels(r);
 }
 
-RDFImporterImpl::RDFImporterImpl(QString uri, sv_samplerate_t sampleRate) :
-    m_store(new BasicStore),
+RDFImporterImpl::RDFImporterImpl(QString uri, sv_samplerate_t sampleRate,
+                                 RDFImporter::ReadMode mode) :
+    m_store(0),
+    m_stream(0),
     m_uristring(uri),
     m_sampleRate(sampleRate)
 {
     //!!! retrieve data if remote... then
 
+    if (mode == RDFImporter::ReadStreamingWherePossible &&
+        RDFStreamReader::canRead(uri)) {
+        m_stream = new RDFStreamReader;
+        if (m_stream->read(uri)) {
+            SVDEBUG << "RDFImporterImpl: Streamed " << m_stream->getStatementCount()
+                    << " of " << m_stream->getParsedStatementCount()
+                    << " statements from " << uri << endl;
+            return;
+        }
+        SVDEBUG << "RDFImporterImpl: Streaming read failed ("
+                << m_stream->getErrorString()
+                << "), falling back to triple store" << endl;
+        delete m_stream;
+        m_stream = 0;
+    }
+
+    m_store = new BasicStore;
+    
     m_store->addPrefix("mo", Uri("http://purl.org/ontology/mo/"));
     m_store->addPrefix("af", Uri("http://purl.org/ontology/af/"));
     m_store->addPrefix("dc", Uri("http://purl.org/dc/elements/1.1/"));
@@ -154,6 +238,7 @@ RDFImporterImpl::RDFImporterImpl(QString uri, sv_samplerate_t sampleRate) :
 
 RDFImporterImpl::~RDFImporterImpl()
 {
+    delete m_stream;
     delete m_store;
 }
 
@@ -209,6 +294,11 @@ void
 RDFImporterImpl::getDataModelsAudio(std::vector<Model *> &models,
                                     ProgressReporter *reporter)
 {
+    if (m_stream) {
+        getStreamedModelsAudio(models, reporter);
+        return;
+    }
+    
     Nodes sigs = m_store->match
         (Triple(Node(), Uri("a"), expand("mo:Signal"))).subjects();
 
@@ -223,73 +313,112 @@ RDFImporterImpl::getDataModelsAudio(std::vector<Model *> &models,
             continue;
         }
 
-        QString signal = sig.value;
-        QString source = file.value;
+        loadAudioModel(models, sig.value, file.value, reporter);
+    }
+}
 
-        SVDEBUG << "NOTE: Seeking signal source \"" << source
-                << "\"..." << endl;
+void
+RDFImporterImpl::getStreamedModelsAudio(std::vector<Model *> &models,
+                                        ProgressReporter *reporter)
+{
+    const RDFStreamReader &rs = *m_stream;
 
-        FileSource *fs = new FileSource(source, reporter);
-        if (fs->isAvailable()) {
-            SVDEBUG << "NOTE: Source is available: Local filename is \""
-                    << fs->getLocalFilename()
-                    << "\"..." << endl;
+    std::vector<RDFStreamReader::NodeId> sigs = rs.getSubjects
+        (RDFStreamReader::Type, rs.lookup("http://purl.org/ontology/mo/Signal"));
+
+    for (RDFStreamReader::NodeId sig: sigs) {
+
+        std::vector<RDFStreamReader::NodeId> files =
+            rs.getSubjects(RDFStreamReader::Encodes, sig);
+        RDFStreamReader::NodeId file = RDFStreamReader::NoNode;
+        if (!files.empty()) {
+            file = files[0];
+        } else {
+            file = rs.complete(sig, RDFStreamReader::AvailableAs);
         }
-            
-#ifdef NO_SV_GUI
-        if (!fs->isAvailable()) {
-            m_errorString = QString("Signal source \"%1\" is not available").arg(source);
-            delete fs;
+        if (file == RDFStreamReader::NoNode) {
+            cerr << "RDFImporterImpl::getStreamedModelsAudio: ERROR: No source for signal " << rs.getValue(sig) << endl;
             continue;
         }
+
+        loadAudioModel(models, rs.getValue(sig), rs.getValue(file), reporter);
+    }
+}
+
+void
+RDFImporterImpl::loadAudioModel(std::vector<Model *> &models,
+                                QString signal,
+                                QString source,
+                                ProgressReporter *reporter)
+{
+    SVDEBUG << "NOTE: Seeking signal source \"" << source
+            << "\"..." << endl;
+
+    FileSource *fs = new FileSource(source, reporter);
+    if (fs->isAvailable()) {
+        SVDEBUG << "NOTE: Source is available: Local filename is \""
+                << fs->getLocalFilename()
+                << "\"..." << endl;
+    }
+        
+#ifdef NO_SV_GUI
+    if (!fs->isAvailable()) {
+        m_errorString = QString("Signal source \"%1\" is not available").arg(source);
+        delete fs;
+        return;
+    }
 #else
-        if (!fs->isAvailable()) {
-            SVDEBUG << "NOTE: Signal source \"" << source
-                    << "\" is not available, using file finder..." << endl;
-            FileFinder *ff = FileFinder::getInstance();
-            if (ff) {
-                QString path = ff->find(FileFinder::AudioFile,
-                                        fs->getLocation(),
-                                        m_uristring);
-                if (path != "") {
-                    cerr << "File finder returns: \"" << path
-                              << "\"" << endl;
+    if (!fs->isAvailable()) {
+        SVDEBUG << "NOTE: Signal source \"" << source
+                << "\" is not available, using file finder..." << endl;
+        FileFinder *ff = FileFinder::getInstance();
+        if (ff) {
+            QString path = ff->find(FileFinder::AudioFile,
+                                    fs->getLocation(),
+                                    m_uristring);
+            if (path != "") {
+                cerr << "File finder returns: \"" << path
+                          << "\"" << endl;
+                delete fs;
+                fs = new FileSource(path, reporter);
+                if (!fs->isAvailable()) {
                     delete fs;
-                    fs = new FileSource(path, reporter);
-                    if (!fs->isAvailable()) {
-                        delete fs;
-                        m_errorString = QString("Signal source \"%1\" is not available").arg(source);
-                        continue;
-                    }
+                    m_errorString = QString("Signal source \"%1\" is not available").arg(source);
+                    return;
                 }
             }
         }
+    }
 #endif
 
-        if (reporter) {
-            reporter->setMessage(RDFImporter::tr("Importing audio referenced in RDF..."));
-        }
-        fs->waitForData();
-        ReadOnlyWaveFileModel *newModel = new ReadOnlyWaveFileModel(*fs, m_sampleRate);
-        if (newModel->isOK()) {
-            cerr << "Successfully created wave file model from source at \"" << source << "\"" << endl;
-            models.push_back(newModel);
-            m_audioModelMap[signal] = newModel;
-            if (m_sampleRate == 0) {
-                m_sampleRate = newModel->getSampleRate();
-            }
-        } else {
-            m_errorString = QString("Failed to create wave file model from source at \"%1\"").arg(source);
-            delete newModel;
+    if (reporter) {
+        reporter->setMessage(RDFImporter::tr("Importing audio referenced in RDF..."));
+    }
+    fs->waitForData();
+    ReadOnlyWaveFileModel *newModel = new ReadOnlyWaveFileModel(*fs, m_sampleRate);
+    if (newModel->isOK()) {
+        cerr << "Successfully created wave file model from source at \"" << source << "\"" << endl;
+        models.push_back(newModel);
+        m_audioModelMap[signal] = newModel;
+        if (m_sampleRate == 0) {
+            m_sampleRate = newModel->getSampleRate();
         }
-        delete fs;
+    } else {
+        m_errorString = QString("Failed to create wave file model from source at \"%1\"").arg(source);
+        delete newModel;
     }
+    delete fs;
 }
 
 void
 RDFImporterImpl::getDataModelsDense(std::vector<Model *> &models,
                                     ProgressReporter *reporter)
 {
+    if (m_stream) {
+        getStreamedModelsDense(models, reporter);
+        return;
+    }
+    
     if (reporter) {
         reporter->setMessage(RDFImporter::tr("Importing dense signal data from RDF..."));
     }
@@ -318,80 +447,140 @@ RDFImporterImpl::getDataModelsDense(std::vector<Model *> &models,
         getDenseFeatureProperties
             (feature, sampleRate, windowLength, hopSize, width, height);
 
-        if (sampleRate != 0 && sampleRate != m_sampleRate) {
-            cerr << "WARNING: Sample rate in dense feature description does not match our underlying rate -- using rate from feature description" << endl;
-        }
-        if (sampleRate == 0) sampleRate = m_sampleRate;
+        makeDenseModel(models, type, value,
+                       getDenseModelTitle(feature, type),
+                       sampleRate, hopSize, height);
+    }
+}
 
-        if (hopSize == 0) {
-            cerr << "WARNING: Dense feature description does not specify a hop size -- assuming 1" << endl;
-            hopSize = 1;
-        }
+void
+RDFImporterImpl::getStreamedModelsDense(std::vector<Model *> &models,
+                                        ProgressReporter *reporter)
+{
+    if (reporter) {
+        reporter->setMessage(RDFImporter::tr("Importing dense signal data from RDF..."));
+    }
 
-        if (height == 0) {
-            cerr << "WARNING: Dense feature description does not specify feature signal dimensions -- assuming one-dimensional (height = 1)" << endl;
-            height = 1;
-        }
+    const RDFStreamReader &rs = *m_stream;
 
-        QStringList values = value.split(' ', QString::SkipEmptyParts);
+    std::vector<RDFStreamReader::NodeId> sigFeatures =
+        rs.getObjects(RDFStreamReader::SignalFeature);
 
-        if (values.empty()) {
-            cerr << "WARNING: Dense feature description does not specify any values!" << endl;
-            continue;
+    for (RDFStreamReader::NodeId sf: sigFeatures) {
+
+        if (!rs.isResource(sf)) continue;
+
+        RDFStreamReader::NodeId t = rs.complete(sf, RDFStreamReader::Type);
+        
+        QString type = rs.getValue(t);
+        QString value = rs.getValue(rs.complete(sf, RDFStreamReader::Value));
+        
+        if (type == "" || value == "") continue;
+
+        sv_samplerate_t sampleRate = 0;
+        int windowLength = 0;
+        int hopSize = 0;
+        int width = 0;
+        int height = 0;
+        getStreamedDenseFeatureProperties
+            (sf, sampleRate, windowLength, hopSize, width, height);
+
+        // Title from the feature itself, or failing that from its type
+        RDFStreamReader::NodeId n = rs.complete(sf, RDFStreamReader::Title);
+        if (!rs.isLiteral(n) || rs.getValue(n) == "") {
+            n = rs.complete(t, RDFStreamReader::Title);
         }
+        QString title;
+        if (rs.isLiteral(n)) title = rs.getValue(n);
 
-        if (height == 1) {
+        makeDenseModel(models, type, value, title,
+                       sampleRate, hopSize, height);
+    }
+}
 
-            SparseTimeValueModel *m = new SparseTimeValueModel
-                (sampleRate, hopSize, false);
+void
+RDFImporterImpl::makeDenseModel(std::vector<Model *> &models,
+                                QString type,
+                                QString value,
+                                QString title,
+                                sv_samplerate_t sampleRate,
+                                int hopSize,
+                                int height)
+{
+    if (sampleRate != 0 && sampleRate != m_sampleRate) {
+        cerr << "WARNING: Sample rate in dense feature description does not match our underlying rate -- using rate from feature description" << endl;
+    }
+    if (sampleRate == 0) sampleRate = m_sampleRate;
 
-            for (int j = 0; j < values.size(); ++j) {
-                float f = values[j].toFloat();
-                SparseTimeValueModel::Point point(j * hopSize, f, "");
-                m->addPoint(point);
-            }
+    if (hopSize == 0) {
+        cerr << "WARNING: Dense feature description does not specify a hop size -- assuming 1" << endl;
+        hopSize = 1;
+    }
 
-            getDenseModelTitle(m, feature, type);
-        
-            m->setRDFTypeURI(type);
+    if (height == 0) {
+        cerr << "WARNING: Dense feature description does not specify feature signal dimensions -- assuming one-dimensional (height = 1)" << endl;
+        height = 1;
+    }
 
-            models.push_back(m);
+    QStringList values = value.split(' ', QString::SkipEmptyParts);
 
-        } else {
+    if (values.empty()) {
+        cerr << "WARNING: Dense feature description does not specify any values!" << endl;
+        return;
+    }
 
-            EditableDenseThreeDimensionalModel *m =
-                new EditableDenseThreeDimensionalModel
-                (sampleRate, hopSize, height, 
-                 EditableDenseThreeDimensionalModel::NoCompression, false);
-            
-            EditableDenseThreeDimensionalModel::Column column;
+    if (height == 1) {
 
-            int x = 0;
+        SparseTimeValueModel *m = new SparseTimeValueModel
+            (sampleRate, hopSize, false);
 
-            for (int j = 0; j < values.size(); ++j) {
-                if (j % height == 0 && !column.empty()) {
-                    m->setColumn(x++, column);
-                    column.clear();
-                }
-                column.push_back(values[j].toFloat());
-            }
+        SparseTimeValueModel::PointVector points;
+        points.reserve(values.size());
+        for (int j = 0; j < values.size(); ++j) {
+            float f = values[j].toFloat();
+            points.push_back(SparseTimeValueModel::Point(j * hopSize, f, ""));
+        }
+        m->addPoints(points);
 
-            if (!column.empty()) {
-                m->setColumn(x++, column);
-            }
+        if (title != "") m->setObjectName(title);
+    
+        m->setRDFTypeURI(type);
+
+        models.push_back(m);
+
+    } else {
 
-            getDenseModelTitle(m, feature, type);
+        EditableDenseThreeDimensionalModel *m =
+            new EditableDenseThreeDimensionalModel
+            (sampleRate, hopSize, height, 
+             EditableDenseThreeDimensionalModel::NoCompression, false);
         
-            m->setRDFTypeURI(type);
+        EditableDenseThreeDimensionalModel::Column column;
+
+        int x = 0;
+
+        for (int j = 0; j < values.size(); ++j) {
+            if (j % height == 0 && !column.empty()) {
+                m->setColumn(x++, column);
+                column.clear();
+            }
+            column.push_back(values[j].toFloat());
+        }
 
-            models.push_back(m);
+        if (!column.empty()) {
+            m->setColumn(x++, column);
         }
+
+        if (title != "") m->setObjectName(title);
+    
+        m->setRDFTypeURI(type);
+
+        models.push_back(m);
     }
 }
 
-void
-RDFImporterImpl::getDenseModelTitle(Model *m,
-                                    QString featureUri,
+QString
+RDFImporterImpl::getDenseModelTitle(QString featureUri,
                                     QString featureTypeUri)
 {
     Node n = m_store->complete
@@ -399,8 +588,7 @@ RDFImporterImpl::getDenseModelTitle(Model *m,
 
     if (n.type == Node::Literal && n.value != "") {
         SVDEBUG << "RDFImporterImpl::getDenseModelTitle: Title (from signal) \"" << n.value << "\"" << endl;
-        m->setObjectName(n.value);
-        return;
+        return n.value;
     }
 
     n = m_store->complete
@@ -408,11 +596,11 @@ RDFImporterImpl::getDenseModelTitle(Model *m,
 
     if (n.type == Node::Literal && n.value != "") {
         SVDEBUG << "RDFImporterImpl::getDenseModelTitle: Title (from signal type) \"" << n.value << "\"" << endl;
-        m->setObjectName(n.value);
-        return;
+        return n.value;
     }
 
     SVDEBUG << "RDFImporterImpl::getDenseModelTitle: No title available for feature <" << featureUri << ">" << endl;
+    return "";
 }
 
 void
@@ -480,10 +668,75 @@ RDFImporterImpl::getDenseFeatureProperties(QString featureUri,
     cerr << "sr = " << sampleRate << ", hop = " << hopSize << ", win = " << windowLength << endl;
 }
 
+void
+RDFImporterImpl::getStreamedDenseFeatureProperties(RDFStreamReader::NodeId feature,
+                                                   sv_samplerate_t &sampleRate, int &windowLength,
+                                                   int &hopSize, int &width, int &height)
+{
+    // As getDenseFeatureProperties, but against the streamed statements
+
+    const RDFStreamReader &rs = *m_stream;
+
+    RDFStreamReader::NodeId dim = rs.complete(feature, RDFStreamReader::Dimensions);
+    QString dimValue = rs.getValue(dim);
+
+    if (rs.isLiteral(dim) && dimValue != "") {
+        QStringList dl = dimValue.split(" ");
+        if (dl.empty()) dl.push_back(dimValue);
+        if (dl.size() > 0) height = dl[0].toInt();
+        if (dl.size() > 1) width = dl[1].toInt();
+    }
+
+    RDFStreamReader::NodeId interval = rs.complete(feature, RDFStreamReader::Time);
+
+    if (!rs.contains(interval, RDFStreamReader::Type,
+                     rs.lookup("http://purl.org/NET/c4dm/timeline.owl#Interval"))) {
+        cerr << "RDFImporterImpl::getStreamedDenseFeatureProperties: Feature time node "
+             << rs.getValue(interval) << " is not a tl:Interval" << endl;
+        return;
+    }
+
+    RDFStreamReader::NodeId tl = rs.complete(interval, RDFStreamReader::OnTimeLine);
+
+    if (tl == RDFStreamReader::NoNode) {
+        cerr << "RDFImporterImpl::getStreamedDenseFeatureProperties: Interval node "
+             << rs.getValue(interval) << " lacks tl:onTimeLine property" << endl;
+        return;
+    }
+
+    std::vector<RDFStreamReader::NodeId> maps =
+        rs.getSubjects(RDFStreamReader::RangeTimeLine, tl);
+
+    if (maps.empty()) {
+        cerr << "RDFImporterImpl::getStreamedDenseFeatureProperties: No map for "
+             << "timeline node " << rs.getValue(tl) << endl;
+        return;
+    }
+
+    RDFStreamReader::NodeId map = maps[0];
+    RDFStreamReader::NodeId n;
+
+    n = rs.complete(map, RDFStreamReader::SampleRate);
+    if (n != RDFStreamReader::NoNode) sampleRate = rs.getValue(n).toDouble();
+
+    n = rs.complete(map, RDFStreamReader::HopSize);
+    if (n != RDFStreamReader::NoNode) hopSize = rs.getValue(n).toInt();
+
+    n = rs.complete(map, RDFStreamReader::WindowLength);
+    if (n != RDFStreamReader::NoNode) windowLength = rs.getValue(n).toInt();
+
+    cerr << "sr = " << sampleRate << ", hop = " << hopSize << ", win = " << windowLength << endl;
+}
+
 void
 RDFImporterImpl::getDataModelsSparse(std::vector<Model *> &models,
                                      ProgressReporter *reporter)
 {
+    if (m_stream) {
+        getStreamedModelsSparse(models, reporter);
+        return;
+    }
+    
     if (reporter) {
         reporter->setMessage(RDFImporter::tr("Importing event data from RDF..."));
     }
@@ -509,10 +762,7 @@ RDFImporterImpl::getDataModelsSparse(std::vector<Model *> &models,
     Nodes sigs = m_store->match
         (Triple(Node(), expand("a"), expand("mo:Signal"))).subjects();
 
-    // Map from timeline uri to event type to dimensionality to
-    // presence of duration to model ptr.  Whee!
-    std::map<QString, std::map<QString, std::map<int, std::map<bool, Model *> > > >
-        modelMap;
+    SparseModelMap modelMap;
 
     foreach (Node sig, sigs) {
         
@@ -601,99 +851,226 @@ RDFImporterImpl::getDataModelsSparse(std::vector<Model *> &models,
                     }
                 }
 
-                QString valuestring = valu.value;
-                std::vector<float> values;
-
-                if (valuestring != "") {
-                    QStringList vsl = valuestring.split(" ", QString::SkipEmptyParts);
-                    for (int j = 0; j < vsl.size(); ++j) {
-                        bool success = false;
-                        float v = vsl[j].toFloat(&success);
-                        if (success) values.push_back(v);
-                    }
-                }
+                std::vector<float> values = parseValues(valu.value);
                 
                 int dimensions = 1;
                 if (values.size() == 1) dimensions = 2;
                 else if (values.size() > 1) dimensions = 3;
 
-                Model *model = 0;
+                bool created = false;
+                Model *model = getSparseModel(modelMap, models,
+                                              source, timeline, type,
+                                              dimensions, haveDuration,
+                                              text, note, created);
 
-                if (modelMap[timeline][type][dimensions].find(haveDuration) ==
-                    modelMap[timeline][type][dimensions].end()) {
+                if (created) {
+                    QString title = m_store->complete
+                        (Triple(typ, expand("dc:title"), Node())).value;
+                    if (title != "") model->setObjectName(title);
+                }
 
-/*
-            SVDEBUG << "Creating new model: source = " << source                      << ", type = " << type << ", dimensions = "
-                      << dimensions << ", haveDuration = " << haveDuration
-                      << ", time = " << time << ", duration = " << duration
-                      << endl;
-*/
-            
-                    if (!haveDuration) {
-
-                        if (dimensions == 1) {
-                            if (text) {
-                                model = new TextModel(m_sampleRate, 1, false);
-                            } else {
-                                model = new SparseOneDimensionalModel(m_sampleRate, 1, false);
-                            }
-                        } else if (dimensions == 2) {
-                            if (text) {
-                                model = new TextModel(m_sampleRate, 1, false);
-                            } else {
-                                model = new SparseTimeValueModel(m_sampleRate, 1, false);
-                            }
-                        } else {
-                            // We don't have a three-dimensional sparse model,
-                            // so use a note model.  We do have some logic (in
-                            // extractStructure below) for guessing whether
-                            // this should after all have been a dense model,
-                            // but it's hard to apply it because we don't have
-                            // all the necessary timing data yet... hmm
-                            model = new NoteModel(m_sampleRate, 1, false);
-                        }
-
-                    } else { // haveDuration
-
-                        if (note || (dimensions > 2)) {
-                            model = new NoteModel(m_sampleRate, 1, false);
-                        } else {
-                            // If our units are frequency or midi pitch, we
-                            // should be using a note model... hm
-                            model = new RegionModel(m_sampleRate, 1, false);
-                        }
-                    }
+                if (model) {
+                    sv_frame_t ftime = RealTime::realTime2Frame(time, m_sampleRate);
+                    sv_frame_t fduration = RealTime::realTime2Frame(duration, m_sampleRate);
+                    fillModel(model, ftime, fduration, haveDuration, values, label);
+                }
+            }
+        }
+    }
 
-                    model->setRDFTypeURI(type);
+    flushPendingPoints();
+}
 
-                    if (m_audioModelMap.find(source) != m_audioModelMap.end()) {
-                        cerr << "source model for " << model << " is " << m_audioModelMap[source] << endl;
-                        model->setSourceModel(m_audioModelMap[source]);
-                    }
+void
+RDFImporterImpl::getStreamedModelsSparse(std::vector<Model *> &models,
+                                         ProgressReporter *reporter)
+{
+    if (reporter) {
+        reporter->setMessage(RDFImporter::tr("Importing event data from RDF..."));
+    }
 
-                    QString title = m_store->complete
-                        (Triple(typ, expand("dc:title"), Node())).value;
-                    if (title == "") {
-                        // take it from the end of the event type
-                        title = type;
-                        title.replace(QRegExp("^.*[/#]"), "");
-                    }
-                    model->setObjectName(title);
+    // The same traversal as getDataModelsSparse, but against the
+    // streamed statements
+
+    typedef RDFStreamReader::NodeId NodeId;
+    const RDFStreamReader &rs = *m_stream;
+
+    std::vector<NodeId> sigs = rs.getSubjects
+        (RDFStreamReader::Type, rs.lookup("http://purl.org/ontology/mo/Signal"));
+
+    SparseModelMap modelMap;
+
+    for (NodeId sig: sigs) {
 
-                    modelMap[timeline][type][dimensions][haveDuration] = model;
-                    models.push_back(model);
+        NodeId interval = rs.complete(sig, RDFStreamReader::Time);
+        if (interval == RDFStreamReader::NoNode) continue;
+
+        NodeId tl = rs.complete(interval, RDFStreamReader::OnTimeLine);
+        if (tl == RDFStreamReader::NoNode) continue;
+
+        QString source = rs.getValue(sig);
+        QString timeline = rs.getValue(tl);
+
+        std::vector<NodeId> times = rs.getSubjects(RDFStreamReader::OnTimeLine, tl);
+
+        for (NodeId tn: times) {
+
+            std::vector<NodeId> timedThings =
+                rs.getSubjects(RDFStreamReader::EventTime, tn);
+
+            if (timedThings.empty()) continue;
+
+            RealTime time;
+            RealTime duration;
+            bool haveDuration = false;
+
+            NodeId at = rs.complete(tn, RDFStreamReader::At);
+
+            if (at != RDFStreamReader::NoNode) {
+                time = RealTime::fromXsdDuration(rs.getValue(at).toStdString());
+            } else {
+                NodeId start = rs.complete(tn, RDFStreamReader::BeginsAt);
+                NodeId dur = rs.complete(tn, RDFStreamReader::Duration);
+                if (start != RDFStreamReader::NoNode &&
+                    dur != RDFStreamReader::NoNode) {
+                    time = RealTime::fromXsdDuration
+                        (rs.getValue(start).toStdString());
+                    duration = RealTime::fromXsdDuration
+                        (rs.getValue(dur).toStdString());
+                }
+            }
+
+            sv_frame_t ftime = RealTime::realTime2Frame(time, m_sampleRate);
+            sv_frame_t fduration = RealTime::realTime2Frame(duration, m_sampleRate);
+
+            for (NodeId thing: timedThings) {
+
+                NodeId typ = rs.complete(thing, RDFStreamReader::Type);
+                if (typ == RDFStreamReader::NoNode) continue;
+
+                QString type = rs.getValue(typ);
+
+                QString label = "";
+                bool text = (type.contains("Text") || type.contains("text"));
+                bool note = (type.contains("Note") || type.contains("note"));
+
+                if (text) {
+                    label = rs.getValue(rs.complete(thing, RDFStreamReader::Text));
                 }
 
-                model = modelMap[timeline][type][dimensions][haveDuration];
+                if (label == "") {
+                    label = rs.getValue(rs.complete(thing, RDFStreamReader::Label));
+                }
+
+                std::vector<float> values = parseValues
+                    (rs.getValue(rs.complete(thing, RDFStreamReader::Feature)));
+
+                int dimensions = 1;
+                if (values.size() == 1) dimensions = 2;
+                else if (values.size() > 1) dimensions = 3;
+
+                bool created = false;
+                Model *model = getSparseModel(modelMap, models,
+                                              source, timeline, type,
+                                              dimensions, haveDuration,
+                                              text, note, created);
+
+                if (created) {
+                    QString title = rs.getValue
+                        (rs.complete(typ, RDFStreamReader::Title));
+                    if (title != "") model->setObjectName(title);
+                }
 
                 if (model) {
-                    sv_frame_t ftime = RealTime::realTime2Frame(time, m_sampleRate);
-                    sv_frame_t fduration = RealTime::realTime2Frame(duration, m_sampleRate);
                     fillModel(model, ftime, fduration, haveDuration, values, label);
                 }
             }
         }
     }
+
+    flushPendingPoints();
+}
+
+Model *
+RDFImporterImpl::getSparseModel(SparseModelMap &modelMap,
+                                std::vector<Model *> &models,
+                                QString source,
+                                QString timeline,
+                                QString type,
+                                int dimensions,
+                                bool haveDuration,
+                                bool text,
+                                bool note,
+                                bool &created)
+{
+    created = false;
+    
+    if (modelMap[timeline][type][dimensions].find(haveDuration) !=
+        modelMap[timeline][type][dimensions].end()) {
+        return modelMap[timeline][type][dimensions][haveDuration];
+    }
+
+/*
+    SVDEBUG << "Creating new model: source = " << source                      << ", type = " << type << ", dimensions = "
+              << dimensions << ", haveDuration = " << haveDuration
+              << endl;
+*/
+
+    Model *model = 0;
+    
+    if (!haveDuration) {
+
+        if (dimensions == 1) {
+            if (text) {
+                model = new TextModel(m_sampleRate, 1, false);
+            } else {
+                model = new SparseOneDimensionalModel(m_sampleRate, 1, false);
+            }
+        } else if (dimensions == 2) {
+            if (text) {
+                model = new TextModel(m_sampleRate, 1, false);
+            } else {
+                model = new SparseTimeValueModel(m_sampleRate, 1, false);
+            }
+        } else {
+            // We don't have a three-dimensional sparse model,
+            // so use a note model.  We do have some logic (in
+            // extractStructure below) for guessing whether
+            // this should after all have been a dense model,
+            // but it's hard to apply it because we don't have
+            // all the necessary timing data yet... hmm
+            model = new NoteModel(m_sampleRate, 1, false);
+        }
+
+    } else { // haveDuration
+
+        if (note || (dimensions > 2)) {
+            model = new NoteModel(m_sampleRate, 1, false);
+        } else {
+            // If our units are frequency or midi pitch, we
+            // should be using a note model... hm
+            model = new RegionModel(m_sampleRate, 1, false);
+        }
+    }
+
+    model->setRDFTypeURI(type);
+
+    if (m_audioModelMap.find(source) != m_audioModelMap.end()) {
+        cerr << "source model for " << model << " is " << m_audioModelMap[source] << endl;
+        model->setSourceModel(m_audioModelMap[source]);
+    }
+
+    // The caller may override this from a dc:title for the type;
+    // otherwise take it from the end of the event type
+    QString title = type;
+    title.replace(QRegExp("^.*[/#]"), "");
+    model->setObjectName(title);
+
+    modelMap[timeline][type][dimensions][haveDuration] = model;
+    models.push_back(model);
+
+    created = true;
+    return model;
 }
 
 void
@@ -706,11 +1083,13 @@ RDFImporterImpl::fillModel(Model *model,
 {
 //    SVDEBUG << "RDFImporterImpl::fillModel: adding point at frame " << ftime << endl;
 
+    PendingPoints &pending = m_pending[model];
+
     SparseOneDimensionalModel *sodm =
         dynamic_cast<SparseOneDimensionalModel *>(model);
     if (sodm) {
         SparseOneDimensionalModel::Point point(ftime, label);
-        sodm->addPoint(point);
+        pending.sodm.push_back(point);
         return;
     }
 
@@ -721,7 +1100,7 @@ RDFImporterImpl::fillModel(Model *model,
             (ftime,
              values.empty() ? 0.5f : values[0] < 0.f ? 0.f : values[0] > 1.f ? 1.f : values[0], // I was young and feckless once too
              label);
-        tm->addPoint(point);
+        pending.tm.push_back(point);
         return;
     }
 
@@ -730,7 +1109,7 @@ RDFImporterImpl::fillModel(Model *model,
     if (stvm) {
         SparseTimeValueModel::Point point
             (ftime, values.empty() ? 0.f : values[0], label);
-        stvm->addPoint(point);
+        pending.stvm.push_back(point);
         return;
     }
 
@@ -746,7 +1125,7 @@ RDFImporterImpl::fillModel(Model *model,
                 }
             }
             NoteModel::Point point(ftime, value, fduration, level, label);
-            nm->addPoint(point);
+            pending.nm.push_back(point);
         } else {
             float value = 0.f, duration = 1.f, level = 1.f;
             if (!values.empty()) {
@@ -760,7 +1139,7 @@ RDFImporterImpl::fillModel(Model *model,
             }
             NoteModel::Point point(ftime, value, sv_frame_t(lrintf(duration)),
                                    level, label);
-            nm->addPoint(point);
+            pending.nm.push_back(point);
         }
         return;
     }
@@ -768,11 +1147,15 @@ RDFImporterImpl::fillModel(Model *model,
     RegionModel *rm = 
         dynamic_cast<RegionModel *>(model);
     if (rm) {
+        if (pending.rm.empty()) {
+            pending.valueMaximum = rm->getValueMaximum();
+            pending.haveExtents = !rm->isEmpty();
+        }
         float value = 0.f;
         if (values.empty()) {
             // no values? map each unique label to a distinct value
             if (m_labelValueMap[model].find(label) == m_labelValueMap[model].end()) {
-                m_labelValueMap[model][label] = rm->getValueMaximum() + 1.f;
+                m_labelValueMap[model][label] = pending.valueMaximum + 1.f;
             }
             value = m_labelValueMap[model][label];
         } else {
@@ -780,7 +1163,7 @@ RDFImporterImpl::fillModel(Model *model,
         }
         if (haveDuration) {
             RegionModel::Point point(ftime, value, fduration, label);
-            rm->addPoint(point);
+            pending.rm.push_back(point);
         } else {
             // This won't actually happen -- we only create region models
             // if we do have duration -- but just for completeness
@@ -793,7 +1176,12 @@ RDFImporterImpl::fillModel(Model *model,
             }
             RegionModel::Point point(ftime, value,
                                      sv_frame_t(lrintf(duration)), label);
-            rm->addPoint(point);
+            pending.rm.push_back(point);
+        }
+        // track the maximum as the model itself would have done
+        if (!pending.haveExtents || value > pending.valueMaximum) {
+            pending.valueMaximum = value;
+            pending.haveExtents = true;
         }
         return;
     }
@@ -802,6 +1190,51 @@ RDFImporterImpl::fillModel(Model *model,
     return;
 }
 
+void
+RDFImporterImpl::flushPendingPoints()
+{
+    for (std::map<Model *, PendingPoints>::iterator i = m_pending.begin();
+         i != m_pending.end(); ++i) {
+
+        Model *model = i->first;
+        const PendingPoints &pending = i->second;
+
+        if (SparseOneDimensionalModel *sodm =
+            dynamic_cast<SparseOneDimensionalModel *>(model)) {
+            sodm->addPoints(pending.sodm);
+        } else if (TextModel *tm = dynamic_cast<TextModel *>(model)) {
+            tm->addPoints(pending.tm);
+        } else if (SparseTimeValueModel *stvm =
+                   dynamic_cast<SparseTimeValueModel *>(model)) {
+            stvm->addPoints(pending.stvm);
+        } else if (NoteModel *nm = dynamic_cast<NoteModel *>(model)) {
+            nm->addPoints(pending.nm);
+        } else if (RegionModel *rm = dynamic_cast<RegionModel *>(model)) {
+            rm->addPoints(pending.rm);
+        }
+    }
+
+    m_pending.clear();
+}
+
+static RDFImporter::RDFDocumentType
+documentTypeFor(bool haveAudio, bool haveAnnotations)
+{
+    if (haveAudio) {
+        if (haveAnnotations) {
+            return RDFImporter::AudioRefAndAnnotations;
+        } else {
+            return RDFImporter::AudioRef;
+        }
+    } else {
+        if (haveAnnotations) {
+            return RDFImporter::Annotations;
+        } else {
+            return RDFImporter::OtherRDFDocument;
+        }
+    }
+}
+
 RDFImporter::RDFDocumentType
 RDFImporter::identifyDocumentType(QString url)
 {
@@ -809,6 +1242,50 @@ RDFImporter::identifyDocumentType(QString url)
     bool haveAnnotations = false;
     bool haveRDF = false;
 
+    // Local Turtle documents can be scanned without building a store
+    
+    RDFStreamReader rs;
+    
+    if (RDFStreamReader::canRead(url) && rs.read(url)) {
+
+        if (rs.getParsedStatementCount() == 0) {
+            return NotRDF;
+        }
+
+        std::vector<RDFStreamReader::NodeId> files = rs.getSubjects
+            (RDFStreamReader::Type,
+             rs.lookup("http://purl.org/ontology/mo/AudioFile"));
+        for (RDFStreamReader::NodeId f: files) {
+            if (rs.isURI(f)) {
+                haveAudio = true;
+                break;
+            }
+        }
+
+        if (!haveAudio) {
+            std::vector<RDFStreamReader::NodeId> sigs = rs.getSubjects
+                (RDFStreamReader::Type,
+                 rs.lookup("http://purl.org/ontology/mo/Signal"));
+            for (RDFStreamReader::NodeId sig: sigs) {
+                if (rs.complete(sig, RDFStreamReader::AvailableAs) !=
+                    RDFStreamReader::NoNode) {
+                    haveAudio = true;
+                    break;
+                }
+            }
+        }
+
+        haveAnnotations =
+            !rs.getObjects(RDFStreamReader::EventTime).empty() ||
+            !rs.getObjects(RDFStreamReader::SignalFeature).empty();
+
+        SVDEBUG << "NOTE: RDFImporter::identifyDocumentType: (streamed) haveAudio = "
+                << haveAudio << ", haveAnnotations = " << haveAnnotations
+                << endl;
+
+        return documentTypeFor(haveAudio, haveAnnotations);
+    }
+
     BasicStore *store = 0;
 
     // This is not expected to return anything useful, but if it does
@@ -876,20 +1353,6 @@ RDFImporter::identifyDocumentType(QString url)
 
     delete store;
 
-    if (haveAudio) {
-        if (haveAnnotations) {
-            return AudioRefAndAnnotations;
-        } else {
-            return AudioRef;
-        }
-    } else {
-        if (haveAnnotations) {
-            return Annotations;
-        } else {
-            return OtherRDFDocument;
-        }
-    }
-
-    return OtherRDFDocument;
+    return documentTypeFor(haveAudio, haveAnnotations);
 }
 
@@ -39,7 +39,21 @@ public:
      */
     static QString getKnownExtensions();
 
-    RDFImporter(QString url, sv_samplerate_t sampleRate = 0);
+    /**
+     * How to read the document. By default a local Turtle or
+     * N-Triples file is read with a streaming parser that keeps only
+     * the statements the importer needs, and anything else is loaded
+     * into a triple store. ReadIntoStore always uses the triple
+     * store, which is slower and uses more memory but gives the same
+     * models; it exists mostly so that the two can be compared.
+     */
+    enum ReadMode {
+        ReadStreamingWherePossible,
+        ReadIntoStore
+    };
+
+    RDFImporter(QString url, sv_samplerate_t sampleRate = 0,
+                ReadMode mode = ReadStreamingWherePossible);
     virtual ~RDFImporter();
 
     void setSampleRate(sv_samplerate_t sampleRate);
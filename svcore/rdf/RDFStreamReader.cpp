@@ -0,0 +1,488 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RDFStreamReader.h"
+
+#include "base/Debug.h"
+
+#include <serd/serd.h>
+
+#include <QUrl>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdarg>
+
+//#define DEBUG_RDF_STREAM_READER 1
+
+const RDFStreamReader::NodeId RDFStreamReader::NoNode = -1;
+
+namespace {
+
+struct PropertyUri {
+    RDFStreamReader::Property property;
+    const char *uri;
+};
+
+const PropertyUri propertyUris[] = {
+    { RDFStreamReader::Type, "http://www.w3.org/1999/02/22-rdf-syntax-ns#type" },
+    { RDFStreamReader::Encodes, "http://purl.org/ontology/mo/encodes" },
+    { RDFStreamReader::AvailableAs, "http://purl.org/ontology/mo/available_as" },
+    { RDFStreamReader::Time, "http://purl.org/ontology/mo/time" },
+    { RDFStreamReader::EventTime, "http://purl.org/NET/c4dm/event.owl#time" },
+    { RDFStreamReader::OnTimeLine, "http://purl.org/NET/c4dm/timeline.owl#onTimeLine" },
+    { RDFStreamReader::RangeTimeLine, "http://purl.org/NET/c4dm/timeline.owl#rangeTimeLine" },
+    { RDFStreamReader::At, "http://purl.org/NET/c4dm/timeline.owl#at" },
+    { RDFStreamReader::BeginsAt, "http://purl.org/NET/c4dm/timeline.owl#beginsAt" },
+    { RDFStreamReader::Duration, "http://purl.org/NET/c4dm/timeline.owl#duration" },
+    { RDFStreamReader::SampleRate, "http://purl.org/NET/c4dm/timeline.owl#sampleRate" },
+    { RDFStreamReader::HopSize, "http://purl.org/NET/c4dm/timeline.owl#hopSize" },
+    { RDFStreamReader::WindowLength, "http://purl.org/NET/c4dm/timeline.owl#windowLength" },
+    { RDFStreamReader::Feature, "http://purl.org/ontology/af/feature" },
+    { RDFStreamReader::SignalFeature, "http://purl.org/ontology/af/signal_feature" },
+    { RDFStreamReader::Value, "http://purl.org/ontology/af/value" },
+    { RDFStreamReader::Dimensions, "http://purl.org/ontology/af/dimensions" },
+    { RDFStreamReader::Text, "http://purl.org/ontology/af/text" },
+    { RDFStreamReader::Label, "http://www.w3.org/2000/01/rdf-schema#label" },
+    { RDFStreamReader::Title, "http://purl.org/dc/elements/1.1/title" },
+};
+
+bool
+hasScheme(const QByteArray &uri)
+{
+    // scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ) ":"
+    int n = uri.size();
+    if (n == 0) return false;
+    char c = uri[0];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) return false;
+    for (int i = 1; i < n; ++i) {
+        c = uri[i];
+        if (c == ':') return true;
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.')) {
+            return false;
+        }
+    }
+    return false;
+}
+
+QByteArray
+nodeBytes(const SerdNode *n)
+{
+    return QByteArray(reinterpret_cast<const char *>(n->buf), int(n->n_bytes));
+}
+
+}
+
+struct RDFStreamReader::ParseState
+{
+    ParseState(RDFStreamReader *r) :
+        reader(r), env(0), seen(0) {
+        for (const PropertyUri &p: propertyUris) {
+            properties[QByteArray(p.uri)] = p.property;
+        }
+    }
+
+    RDFStreamReader *reader;
+    SerdEnv *env;
+    SerdURI baseUri;
+    int seen;
+    QString error;
+    
+    QHash<QByteArray, int> properties;  // full URI -> property
+    QHash<QByteArray, int> predicates;  // as written -> property or -1
+
+    QByteArray resolve(const QByteArray &uri) {
+        if (hasScheme(uri)) return uri;
+        SerdNode abs = serd_node_new_uri_from_string
+            (reinterpret_cast<const uint8_t *>(uri.constData()), &baseUri, 0);
+        QByteArray result = nodeBytes(&abs);
+        serd_node_free(&abs);
+        return result;
+    }
+
+    bool expand(const SerdNode *n, QByteArray &result) {
+        if (n->type == SERD_URI) {
+            result = resolve(nodeBytes(n));
+            return true;
+        }
+        if (n->type == SERD_CURIE) {
+            SerdChunk prefix, suffix;
+            if (serd_env_expand(env, n, &prefix, &suffix) != SERD_SUCCESS) {
+                return false;
+            }
+            QByteArray uri(reinterpret_cast<const char *>(prefix.buf),
+                           int(prefix.len));
+            uri.append(reinterpret_cast<const char *>(suffix.buf),
+                       int(suffix.len));
+            result = resolve(uri);
+            return true;
+        }
+        return false;
+    }
+
+    int property(const SerdNode *n) {
+        QByteArray key = nodeBytes(n);
+        if (n->type == SERD_CURIE) key.prepend('c');
+        else key.prepend('u');
+        QHash<QByteArray, int>::const_iterator i = predicates.constFind(key);
+        if (i != predicates.constEnd()) return i.value();
+        int p = -1;
+        QByteArray uri;
+        if (expand(n, uri)) {
+            p = properties.value(uri, -1);
+        }
+        predicates[key] = p;
+        return p;
+    }
+
+    NodeId resource(const SerdNode *n) {
+        if (n->type == SERD_BLANK) {
+            return reader->internResource("_:" + nodeBytes(n), BlankNode);
+        }
+        QByteArray uri;
+        if (!expand(n, uri)) return NoNode;
+        return reader->internResource(uri, URINode);
+    }
+
+    static SerdStatus onBase(void *handle, const SerdNode *uri) {
+        ParseState *ps = static_cast<ParseState *>(handle);
+        SerdStatus st = serd_env_set_base_uri(ps->env, uri);
+        serd_env_get_base_uri(ps->env, &ps->baseUri);
+        ps->predicates.clear();
+        return st;
+    }
+
+    static SerdStatus onPrefix(void *handle, const SerdNode *name,
+                               const SerdNode *uri) {
+        ParseState *ps = static_cast<ParseState *>(handle);
+        ps->predicates.clear();
+        return serd_env_set_prefix(ps->env, name, uri);
+    }
+
+    static SerdStatus onStatement(void *handle,
+                                  SerdStatementFlags,
+                                  const SerdNode *,
+                                  const SerdNode *subject,
+                                  const SerdNode *predicate,
+                                  const SerdNode *object,
+                                  const SerdNode *,
+                                  const SerdNode *) {
+
+        ParseState *ps = static_cast<ParseState *>(handle);
+
+        ++ps->seen;
+
+        int p = ps->property(predicate);
+        if (p < 0) return SERD_SUCCESS;
+
+        NodeId s = ps->resource(subject);
+        if (s == NoNode) return SERD_SUCCESS;
+
+        NodeId o = NoNode;
+        if (object->type == SERD_LITERAL) {
+            o = ps->reader->addLiteral(nodeBytes(object));
+        } else {
+            o = ps->resource(object);
+        }
+        if (o == NoNode) return SERD_SUCCESS;
+
+        Statement st;
+        st.subject = s;
+        st.object = o;
+        st.property = p;
+        st.seq = int(ps->reader->m_statements.size());
+        ps->reader->m_statements.push_back(st);
+        
+        return SERD_SUCCESS;
+    }
+
+    static SerdStatus onError(void *handle, const SerdError *e) {
+        ParseState *ps = static_cast<ParseState *>(handle);
+        char buf[512];
+        va_list args;
+        va_copy(args, *e->args);
+        vsnprintf(buf, sizeof(buf), e->fmt, args);
+        va_end(args);
+        if (ps->error == "") {
+            ps->error = QString("Parse error at line %1, column %2: %3")
+                .arg(e->line).arg(e->col).arg(QString::fromUtf8(buf).trimmed());
+        }
+        return SERD_SUCCESS;
+    }
+};
+
+RDFStreamReader::RDFStreamReader() :
+    m_parsedCount(0)
+{
+}
+
+RDFStreamReader::~RDFStreamReader()
+{
+}
+
+static QString
+localPathFor(QString url)
+{
+    if (url.startsWith("file:")) return QUrl(url).toLocalFile();
+    if (url.contains("://")) return "";
+    return url;
+}
+
+bool
+RDFStreamReader::canRead(QString url)
+{
+    QString path = localPathFor(url);
+    if (path == "") return false;
+    QFileInfo fi(path);
+    if (!fi.exists()) return false;
+    QString ext = fi.suffix().toLower();
+    return (ext == "ttl" || ext == "n3" || ext == "nt");
+}
+
+bool
+RDFStreamReader::read(QString url)
+{
+    QString path = localPathFor(url);
+    if (path == "") {
+        m_errorString = QString("Not a local file: %1").arg(url);
+        return false;
+    }
+
+    FILE *file = fopen(QFile::encodeName(path).constData(), "rb");
+    if (!file) {
+        m_errorString = QString("Failed to open file %1").arg(path);
+        return false;
+    }
+
+    QByteArray base = QUrl::fromLocalFile(QFileInfo(path).absoluteFilePath())
+        .toEncoded();
+    SerdNode baseNode = serd_node_from_string
+        (SERD_URI, reinterpret_cast<const uint8_t *>(base.constData()));
+    
+    ParseState ps(this);
+    ps.env = serd_env_new(&baseNode);
+    serd_env_get_base_uri(ps.env, &ps.baseUri);
+
+    SerdReader *reader = serd_reader_new
+        (SERD_TURTLE, &ps, 0,
+         &ParseState::onBase,
+         &ParseState::onPrefix,
+         &ParseState::onStatement,
+         0);
+    serd_reader_set_error_sink(reader, &ParseState::onError, &ps);
+
+    // This reads the file a page at a time, calling back for each
+    // statement as it goes
+    SerdStatus status = serd_reader_read_file_handle
+        (reader, file, reinterpret_cast<const uint8_t *>(base.constData()));
+
+    serd_reader_free(reader);
+    serd_env_free(ps.env);
+    fclose(file);
+
+    if (status != SERD_SUCCESS) {
+        m_errorString = ps.error;
+        if (m_errorString == "") {
+            m_errorString = QString("Failed to parse %1 as Turtle").arg(path);
+        }
+    }
+
+    if (m_errorString != "") {
+        m_statements.clear();
+        m_values.clear();
+        m_kinds.clear();
+        m_resources.clear();
+        return false;
+    }
+
+    m_parsedCount = ps.seen;
+
+    buildIndexes();
+
+#ifdef DEBUG_RDF_STREAM_READER
+    SVDEBUG << "RDFStreamReader::read: retained " << m_statements.size()
+            << " of " << ps.seen << " statements, with " << m_values.size()
+            << " nodes" << endl;
+#endif
+    
+    return true;
+}
+
+RDFStreamReader::NodeId
+RDFStreamReader::internResource(const QByteArray &key, NodeKind kind)
+{
+    QHash<QByteArray, NodeId>::const_iterator i = m_resources.constFind(key);
+    if (i != m_resources.constEnd()) return i.value();
+    NodeId id = NodeId(m_values.size());
+    m_values.push_back(key);
+    m_kinds.push_back(char(kind));
+    m_resources.insert(key, id);
+    return id;
+}
+
+RDFStreamReader::NodeId
+RDFStreamReader::addLiteral(const QByteArray &value)
+{
+    // Literals are not interned: they are mostly distinct (times,
+    // labels and values) and some of them are very long
+    NodeId id = NodeId(m_values.size());
+    m_values.push_back(value);
+    m_kinds.push_back(char(LiteralNode));
+    return id;
+}
+
+void
+RDFStreamReader::buildIndexes()
+{
+    m_byObject = m_statements;
+
+    std::stable_sort(m_statements.begin(), m_statements.end(),
+                     [](const Statement &a, const Statement &b) {
+                         if (a.subject != b.subject) return a.subject < b.subject;
+                         return a.property < b.property;
+                     });
+
+    std::stable_sort(m_byObject.begin(), m_byObject.end(),
+                     [](const Statement &a, const Statement &b) {
+                         if (a.property != b.property) return a.property < b.property;
+                         return a.object < b.object;
+                     });
+}
+
+RDFStreamReader::NodeId
+RDFStreamReader::lookup(QString uri) const
+{
+    return m_resources.value(uri.toUtf8(), NoNode);
+}
+
+bool
+RDFStreamReader::isLiteral(NodeId n) const
+{
+    return n >= 0 && n < NodeId(m_kinds.size()) && m_kinds[n] == LiteralNode;
+}
+
+bool
+RDFStreamReader::isResource(NodeId n) const
+{
+    return n >= 0 && n < NodeId(m_kinds.size()) && m_kinds[n] != LiteralNode;
+}
+
+bool
+RDFStreamReader::isURI(NodeId n) const
+{
+    return n >= 0 && n < NodeId(m_kinds.size()) && m_kinds[n] == URINode;
+}
+
+QString
+RDFStreamReader::getValue(NodeId n) const
+{
+    if (n < 0 || n >= NodeId(m_values.size())) return "";
+    return QString::fromUtf8(m_values[n]);
+}
+
+RDFStreamReader::NodeId
+RDFStreamReader::complete(NodeId subject, Property p) const
+{
+    if (subject == NoNode) return NoNode;
+    
+    Statement key;
+    key.subject = subject;
+    key.property = p;
+
+    std::vector<Statement>::const_iterator i = std::lower_bound
+        (m_statements.begin(), m_statements.end(), key,
+         [](const Statement &a, const Statement &b) {
+             if (a.subject != b.subject) return a.subject < b.subject;
+             return a.property < b.property;
+         });
+
+    if (i != m_statements.end() && i->subject == subject && i->property == p) {
+        return i->object;
+    }
+    return NoNode;
+}
+
+bool
+RDFStreamReader::contains(NodeId subject, Property p, NodeId object) const
+{
+    if (subject == NoNode || object == NoNode) return false;
+    
+    Statement key;
+    key.subject = subject;
+    key.property = p;
+
+    std::vector<Statement>::const_iterator i = std::lower_bound
+        (m_statements.begin(), m_statements.end(), key,
+         [](const Statement &a, const Statement &b) {
+             if (a.subject != b.subject) return a.subject < b.subject;
+             return a.property < b.property;
+         });
+
+    while (i != m_statements.end() && i->subject == subject && i->property == p) {
+        if (i->object == object) return true;
+        ++i;
+    }
+    return false;
+}
+
+std::vector<RDFStreamReader::NodeId>
+RDFStreamReader::getSubjects(Property p, NodeId object) const
+{
+    std::vector<NodeId> subjects;
+    if (object == NoNode) return subjects;
+    
+    Statement key;
+    key.property = p;
+    key.object = object;
+
+    std::pair<std::vector<Statement>::const_iterator,
+              std::vector<Statement>::const_iterator> range = std::equal_range
+        (m_byObject.begin(), m_byObject.end(), key,
+         [](const Statement &a, const Statement &b) {
+             if (a.property != b.property) return a.property < b.property;
+             return a.object < b.object;
+         });
+
+    for (std::vector<Statement>::const_iterator i = range.first;
+         i != range.second; ++i) {
+        subjects.push_back(i->subject);
+    }
+    return subjects;
+}
+
+std::vector<RDFStreamReader::NodeId>
+RDFStreamReader::getObjects(Property p) const
+{
+    std::vector<Statement> found;
+
+    for (const Statement &st: m_byObject) {
+        if (st.property == p) found.push_back(st);
+        else if (st.property > p) break;
+    }
+
+    std::sort(found.begin(), found.end(),
+              [](const Statement &a, const Statement &b) {
+                  return a.seq < b.seq;
+              });
+
+    std::vector<NodeId> objects;
+    for (const Statement &st: found) {
+        objects.push_back(st.object);
+    }
+    return objects;
+}
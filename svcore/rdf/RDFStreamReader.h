@@ -0,0 +1,172 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    This file copyright 2017 QMUL.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_RDF_STREAM_READER_H
+#define SV_RDF_STREAM_READER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+
+#include <vector>
+
+/**
+ * Streaming reader for Turtle (or N-Triples) documents containing
+ * audio features described using the Music, Timeline, Event and Audio
+ * Features ontologies, as written by Sonic Annotator and Sonic
+ * Visualiser.
+ *
+ * The document is parsed with serd, one page at a time, and only
+ * statements whose predicates belong to the small set used by
+ * RDFImporter are kept, in a compact table indexed by integer node
+ * ids.  This avoids loading the whole document into a general triple
+ * store, which for large feature files was both slow and very
+ * memory-hungry.
+ *
+ * Node ids are non-negative; NoNode (-1) indicates absence.  URIs are
+ * held fully expanded and resolved against the document location.
+ */
+class RDFStreamReader
+{
+public:
+    typedef int NodeId;
+    static const NodeId NoNode;
+
+    enum Property {
+        Type,           // rdf:type
+        Encodes,        // mo:encodes
+        AvailableAs,    // mo:available_as
+        Time,           // mo:time
+        EventTime,      // event:time
+        OnTimeLine,     // tl:onTimeLine
+        RangeTimeLine,  // tl:rangeTimeLine
+        At,             // tl:at
+        BeginsAt,       // tl:beginsAt
+        Duration,       // tl:duration
+        SampleRate,     // tl:sampleRate
+        HopSize,        // tl:hopSize
+        WindowLength,   // tl:windowLength
+        Feature,        // af:feature
+        SignalFeature,  // af:signal_feature
+        Value,          // af:value
+        Dimensions,     // af:dimensions
+        Text,           // af:text
+        Label,          // rdfs:label
+        Title,          // dc:title
+        PropertyCount
+    };
+
+    RDFStreamReader();
+    ~RDFStreamReader();
+
+    /**
+     * Return true if the given URL looks like a document this class
+     * may be able to read, i.e. a local file with a Turtle or
+     * N-Triples extension.  It may still fail to parse.
+     */
+    static bool canRead(QString url);
+    
+    /**
+     * Parse the document at the given file URL or local path.
+     * Return false and set an error string if the document cannot be
+     * parsed as Turtle.
+     */
+    bool read(QString url);
+
+    QString getErrorString() const { return m_errorString; }
+
+    /**
+     * Look up the node for the given URI, returning NoNode if it
+     * does not appear in any retained statement.
+     */
+    NodeId lookup(QString uri) const;
+
+    bool isLiteral(NodeId n) const;
+    bool isResource(NodeId n) const; // URI or blank node
+    bool isURI(NodeId n) const;
+    
+    /**
+     * Return the URI or literal value of a node.  Blank nodes have
+     * their (document-specific) labels prefixed with "_:".
+     */
+    QString getValue(NodeId n) const;
+
+    /**
+     * Return the object of the first statement with the given
+     * subject and property, or NoNode if there is none.
+     */
+    NodeId complete(NodeId subject, Property p) const;
+
+    /**
+     * Return true if a statement with the given subject, property
+     * and object exists.
+     */
+    bool contains(NodeId subject, Property p, NodeId object) const;
+
+    /**
+     * Return the subjects of all statements with the given property
+     * and object, in document order.
+     */
+    std::vector<NodeId> getSubjects(Property p, NodeId object) const;
+    
+    /**
+     * Return the objects of all statements with the given property,
+     * in document order.
+     */
+    std::vector<NodeId> getObjects(Property p) const;
+
+    /**
+     * Return the number of statements retained.
+     */
+    int getStatementCount() const { return int(m_statements.size()); }
+
+    /**
+     * Return the number of statements found in the document,
+     * including those not retained.
+     */
+    int getParsedStatementCount() const { return m_parsedCount; }
+    
+private:
+    struct Statement {
+        NodeId subject;
+        NodeId object;
+        int property;
+        int seq;
+    };
+
+    enum NodeKind { URINode, BlankNode, LiteralNode };
+    
+    std::vector<QByteArray> m_values;
+    std::vector<char> m_kinds;
+    QHash<QByteArray, NodeId> m_resources;
+
+    std::vector<Statement> m_statements;       // sorted by subject, property
+    std::vector<Statement> m_byObject;         // sorted by property, object
+    
+    int m_parsedCount;
+    QString m_errorString;
+    
+    struct ParseState;
+    friend struct ParseState;
+
+    NodeId internResource(const QByteArray &key, NodeKind kind);
+    NodeId addLiteral(const QByteArray &value);
+    void buildIndexes();
+
+    RDFStreamReader(const RDFStreamReader &); // not provided
+    RDFStreamReader &operator=(const RDFStreamReader &); // not provided
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include "FeatureExtractionModelTransformer.h"
 
 #include "plugin/FeatureExtractionPluginFactory.h"
+#include "plugin/NativeVampPluginFactory.h"
 
 #include "plugin/PluginXml.h"
 #include <vamp-hostsdk/Plugin.h>
@@ -23,6 +24,8 @@
 #include "data/model/Model.h"
 #include "base/Window.h"
 #include "base/Exceptions.h"
+#include "base/StorageAdviser.h"
+#include "base/Metrics.h"
 #include "data/model/SparseOneDimensionalModel.h"
 #include "data/model/SparseTimeValueModel.h"
 #include "data/model/EditableDenseThreeDimensionalModel.h"
@@ -37,6 +40,8 @@
 #include "TransformFactory.h"
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 
 #include <QSettings>
 
@@ -516,6 +521,30 @@ FeatureExtractionModelTransformer::createOutputModels(int n)
              EditableDenseThreeDimensionalModel::BasicMultirateCompression,
              false);
 
+        // If the full-precision output looks like being too large to
+        // hold comfortably, store it quantised to 16 bits
+
+        size_t columns = size_t(input->getEndFrame() - input->getStartFrame())
+            / std::max(modelResolution, 1) + 1;
+        size_t kb = (columns * size_t(std::max(binCount, 1)) * sizeof(float))
+            / 1024;
+        try {
+            StorageAdviser::Recommendation rec =
+                StorageAdviser::recommend
+                (StorageAdviser::Criteria
+                 (StorageAdviser::LongRetentionLikely |
+                  StorageAdviser::FrequentLookupLikely),
+                 kb / 2, kb);
+            if ((rec & StorageAdviser::ConserveSpace) ||
+                (rec & StorageAdviser::UseDisc)) {
+                SVDEBUG << "FeatureExtractionModelTransformer: Storing "
+                        << kb << "K dense output at 16-bit precision" << endl;
+                model->setQuantisation(ChunkedColumnStore::Quantise16Bit);
+            }
+        } catch (const InsufficientDiscSpace &) {
+            model->setQuantisation(ChunkedColumnStore::Quantise16Bit);
+        }
+
 	if (!m_descriptors[n]->binNames.empty()) {
 	    std::vector<QString> names;
 	    for (int i = 0; i < (int)m_descriptors[n]->binNames.size(); ++i) {
@@ -628,6 +657,15 @@ FeatureExtractionModelTransformer::getConformingInput()
     return dtvm;
 }
 
+struct FeatureExtractionModelTransformer::PendingPoints
+{
+    SparseOneDimensionalModel::PointVector sodm;
+    std::map<SparseTimeValueModel *, SparseTimeValueModel::PointVector> stvm;
+    FlexiNoteModel::PointVector fnm;
+    NoteModel::PointVector nm;
+    RegionModel::PointVector rm;
+};
+
 void
 FeatureExtractionModelTransformer::run()
 {
@@ -743,6 +781,31 @@ FeatureExtractionModelTransformer::run()
 
     QString error = "";
 
+    // The feature set and pending point vectors are reused for every
+    // block, so that once they have grown to their working size we
+    // are not allocating on each process call. Plugins hosted
+    // in-process can write their features straight into the
+    // existing feature set; others return a new one each time.
+
+    Vamp::PluginHostAdapter *hostAdapter =
+        NativeVampPluginFactory::getHostAdapter(m_plugin);
+    
+    Vamp::Plugin::FeatureSet features;
+    PendingPoints pending;
+
+    static MetricsRegistry::Counter &blockCount =
+        MetricsRegistry::getInstance()->getCounter
+        ("FeatureExtractionModelTransformer: blocks processed");
+    static MetricsRegistry::Histogram &processTime =
+        MetricsRegistry::getInstance()->getHistogram
+        ("FeatureExtractionModelTransformer: process time (us)");
+    static MetricsRegistry::Gauge &blockRate =
+        MetricsRegistry::getInstance()->getGauge
+        ("FeatureExtractionModelTransformer: blocks per second");
+
+    auto runStart = std::chrono::steady_clock::now();
+    int64_t runBlocks = 0;
+
     try {
         while (!m_abandoned) {
 
@@ -792,16 +855,27 @@ FeatureExtractionModelTransformer::run()
 
             if (m_abandoned) break;
 
-            Vamp::Plugin::FeatureSet features = m_plugin->process
-                (buffers, RealTime::frame2RealTime(blockFrame, sampleRate).toVampRealTime());
+            Vamp::RealTime timestamp =
+                RealTime::frame2RealTime(blockFrame, sampleRate).toVampRealTime();
+
+            auto processStart = std::chrono::steady_clock::now();
+
+            if (hostAdapter) {
+                hostAdapter->processInto(buffers, timestamp, features);
+            } else {
+                features = m_plugin->process(buffers, timestamp);
+            }
+
+            processTime.add(std::chrono::duration_cast<std::chrono::microseconds>
+                            (std::chrono::steady_clock::now() - processStart)
+                            .count());
+            blockCount.add();
+            ++runBlocks;
 
             if (m_abandoned) break;
 
             for (int j = 0; j < (int)m_outputNos.size(); ++j) {
-                for (int fi = 0; fi < (int)features[m_outputNos[j]].size(); ++fi) {
-                    Vamp::Plugin::Feature feature = features[m_outputNos[j]][fi];
-                    addFeature(j, blockFrame, feature);
-                }
+                addFeatures(j, blockFrame, features[m_outputNos[j]], pending);
             }
 
             if (blockFrame == contextStart || completion > prevCompletion) {
@@ -816,13 +890,14 @@ FeatureExtractionModelTransformer::run()
         }
 
         if (!m_abandoned) {
-            Vamp::Plugin::FeatureSet features = m_plugin->getRemainingFeatures();
+            if (hostAdapter) {
+                hostAdapter->getRemainingFeaturesInto(features);
+            } else {
+                features = m_plugin->getRemainingFeatures();
+            }
 
             for (int j = 0; j < (int)m_outputNos.size(); ++j) {
-                for (int fi = 0; fi < (int)features[m_outputNos[j]].size(); ++fi) {
-                    Vamp::Plugin::Feature feature = features[m_outputNos[j]][fi];
-                    addFeature(j, blockFrame, feature);
-                }
+                addFeatures(j, blockFrame, features[m_outputNos[j]], pending);
             }
         }
     } catch (const std::exception &e) {
@@ -836,6 +911,12 @@ FeatureExtractionModelTransformer::run()
         setCompletion(j, 100);
     }
 
+    double runSeconds = std::chrono::duration<double>
+        (std::chrono::steady_clock::now() - runStart).count();
+    if (runBlocks > 0 && runSeconds > 0.0) {
+        blockRate.set(double(runBlocks) / runSeconds);
+    }
+
     if (frequencyDomain) {
         for (int ch = 0; ch < channelCount; ++ch) {
             delete fftModels[ch];
@@ -911,10 +992,67 @@ FeatureExtractionModelTransformer::getFrames(int channelCount,
     }
 }
 
+void
+FeatureExtractionModelTransformer::addFeatures(int n,
+                                               sv_frame_t blockFrame,
+                                               const Vamp::Plugin::FeatureList &features,
+                                               PendingPoints &pending)
+{
+    if (features.empty()) return;
+    
+    for (int fi = 0; fi < (int)features.size(); ++fi) {
+        addFeature(n, blockFrame, features[fi], pending);
+    }
+
+    flushPendingPoints(n, pending);
+}
+
+void
+FeatureExtractionModelTransformer::flushPendingPoints(int n,
+                                                      PendingPoints &pending)
+{
+    // Vectors are cleared rather than discarded after flushing, so
+    // that their capacity is kept for the next block
+
+    if (!pending.sodm.empty()) {
+        SparseOneDimensionalModel *model =
+            getConformingOutput<SparseOneDimensionalModel>(n);
+        if (model) model->addPoints(pending.sodm);
+        pending.sodm.clear();
+    }
+
+    for (std::map<SparseTimeValueModel *,
+             SparseTimeValueModel::PointVector>::iterator i =
+             pending.stvm.begin(); i != pending.stvm.end(); ++i) {
+        if (i->second.empty()) continue;
+        i->first->addPoints(i->second);
+        i->second.clear();
+    }
+
+    if (!pending.fnm.empty()) {
+        FlexiNoteModel *model = getConformingOutput<FlexiNoteModel>(n);
+        if (model) model->addPoints(pending.fnm);
+        pending.fnm.clear();
+    }
+
+    if (!pending.nm.empty()) {
+        NoteModel *model = getConformingOutput<NoteModel>(n);
+        if (model) model->addPoints(pending.nm);
+        pending.nm.clear();
+    }
+
+    if (!pending.rm.empty()) {
+        RegionModel *model = getConformingOutput<RegionModel>(n);
+        if (model) model->addPoints(pending.rm);
+        pending.rm.clear();
+    }
+}
+
 void
 FeatureExtractionModelTransformer::addFeature(int n,
                                               sv_frame_t blockFrame,
-                                              const Vamp::Plugin::Feature &feature)
+                                              const Vamp::Plugin::Feature &feature,
+                                              PendingPoints &pending)
 {
     sv_samplerate_t inputRate = m_input.getModel()->getSampleRate();
 
@@ -986,8 +1124,8 @@ FeatureExtractionModelTransformer::addFeature(int n,
             getConformingOutput<SparseOneDimensionalModel>(n);
 	if (!model) return;
 
-        model->addPoint(SparseOneDimensionalModel::Point
-                       (frame, feature.label.c_str()));
+        pending.sodm.push_back(SparseOneDimensionalModel::Point
+                               (frame, feature.label.c_str()));
 	
     } else if (isOutput<SparseTimeValueModel>(n)) {
 
@@ -1013,7 +1151,7 @@ FeatureExtractionModelTransformer::addFeature(int n,
 //                          << " for output " << n << " bin " << i << std::endl;
             }
 
-            targetModel->addPoint
+            pending.stvm[targetModel].push_back
                 (SparseTimeValueModel::Point(frame, value, label));
         }
 
@@ -1046,11 +1184,11 @@ FeatureExtractionModelTransformer::addFeature(int n,
 
             FlexiNoteModel *model = getConformingOutput<FlexiNoteModel>(n);
             if (!model) return;
-            model->addPoint(FlexiNoteModel::Point(frame,
-                                                  value, // value is pitch
-                                                  duration,
-                                                  velocity / 127.f,
-                                                  feature.label.c_str()));
+            pending.fnm.push_back(FlexiNoteModel::Point(frame,
+                                                        value, // value is pitch
+                                                        duration,
+                                                        velocity / 127.f,
+                                                        feature.label.c_str()));
 			// GF: end -- added for flexi note model
         } else  if (isOutput<NoteModel>(n)) {
 
@@ -1063,10 +1201,10 @@ FeatureExtractionModelTransformer::addFeature(int n,
 
             NoteModel *model = getConformingOutput<NoteModel>(n);
             if (!model) return;
-            model->addPoint(NoteModel::Point(frame, value, // value is pitch
-                                             duration,
-                                             velocity / 127.f,
-                                             feature.label.c_str()));
+            pending.nm.push_back(NoteModel::Point(frame, value, // value is pitch
+                                                  duration,
+                                                  velocity / 127.f,
+                                                  feature.label.c_str()));
         } else {
 
             RegionModel *model = getConformingOutput<RegionModel>(n);
@@ -1083,24 +1221,22 @@ FeatureExtractionModelTransformer::addFeature(int n,
                         label = QString("[%1] %2").arg(i+1).arg(label);
                     }
 
-                    model->addPoint(RegionModel::Point(frame,
-                                                       value,
-                                                       duration,
-                                                       label));
+                    pending.rm.push_back(RegionModel::Point(frame,
+                                                            value,
+                                                            duration,
+                                                            label));
                 }
             } else {
             
-                model->addPoint(RegionModel::Point(frame,
-                                                   value,
-                                                   duration,
-                                                   feature.label.c_str()));
+                pending.rm.push_back(RegionModel::Point(frame,
+                                                        value,
+                                                        duration,
+                                                        feature.label.c_str()));
             }
         }
 	
     } else if (isOutput<EditableDenseThreeDimensionalModel>(n)) {
 	
-	DenseThreeDimensionalModel::Column values = feature.values;
-	
 	EditableDenseThreeDimensionalModel *model =
             getConformingOutput<EditableDenseThreeDimensionalModel>(n);
 	if (!model) return;
@@ -1109,9 +1245,9 @@ FeatureExtractionModelTransformer::addFeature(int n,
 //             << endl;
 
         if (!feature.hasTimestamp && m_fixedRateFeatureNos[n] >= 0) {
-            model->setColumn(m_fixedRateFeatureNos[n], values);
+            model->setColumn(m_fixedRateFeatureNos[n], feature.values);
         } else {
-            model->setColumn(int(frame / model->getResolution()), values);
+            model->setColumn(int(frame / model->getResolution()), feature.values);
         }
 
     } else {
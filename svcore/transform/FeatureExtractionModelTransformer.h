@@ -68,9 +68,21 @@ protected:
     AdditionalModelMap m_additionalModels;
     SparseTimeValueModel *getAdditionalModel(int transformNo, int binNo);
 
+    // Points made from a list of features, waiting to be added to
+    // the output models in one go
+    struct PendingPoints;
+
+    void addFeatures(int n,
+                     sv_frame_t blockFrame,
+                     const Vamp::Plugin::FeatureList &features,
+                     PendingPoints &pending);
+
     void addFeature(int n,
                     sv_frame_t blockFrame,
-		    const Vamp::Plugin::Feature &feature);
+		    const Vamp::Plugin::Feature &feature,
+                    PendingPoints &pending);
+
+    void flushPendingPoints(int n, PendingPoints &pending);
 
     void setCompletion(int, int);
 
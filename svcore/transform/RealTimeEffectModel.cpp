@@ -0,0 +1,776 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RealTimeEffectModel.h"
+
+#include "plugin/RealTimePluginInstance.h"
+#include "data/model/DenseTimeValueModel.h"
+#include "base/Profiler.h"
+#include "base/Metrics.h"
+#include "base/Debug.h"
+
+#include <QMutexLocker>
+
+#include <cmath>
+#include <algorithm>
+
+//#define DEBUG_REAL_TIME_EFFECT_MODEL 1
+
+using std::vector;
+
+// Output frames per chunk. Must be a multiple of SummaryBlockSize.
+static const sv_frame_t ChunkSize = 65536;
+
+// Frames per range in the coarse summary that is kept for every
+// chunk rendered, even after the chunk's samples are dropped
+static const int SummaryBlockSize = 4096;
+
+// Number of chunks whose samples are kept in memory
+static const int MaxChunks = 64;
+
+// Frames of preceding input run through the plugin, after silencing
+// it, before rendering a chunk that does not follow on from the last
+static const sv_frame_t WarmUpFrames = ChunkSize;
+
+RealTimeEffectModel::RealTimeEffectModel(DenseTimeValueModel *input,
+                                         int inputChannel,
+                                         RealTimePluginInstance *plugin,
+                                         RealTimePluginInstance *sequentialPlugin) :
+    m_input(input),
+    m_inputChannel(inputChannel),
+    m_inputChannels(input ? input->getChannelCount() : 0),
+    m_sampleRate(input ? input->getSampleRate() : 0),
+    m_channels(0),
+    m_inputStart(0),
+    m_duration(0),
+    m_startFrame(0),
+    m_latency(0),
+    m_haveExtent(false),
+    m_renderer(plugin),
+    m_sequential(sequentialPlugin),
+    m_useCounter(0),
+    m_lastRendered(-1),
+    m_exiting(false),
+    m_thread(0)
+{
+    if (!m_input || !plugin) return;
+
+    // As the original full render, which wrote no more channels than
+    // the input has
+    m_channels = int(plugin->getAudioOutputCount());
+    if (m_channels > m_inputChannels) m_channels = m_inputChannels;
+
+    // Read only the selected input channel, if one was given
+    if (m_inputChannel != -1) m_inputChannels = 1;
+
+    m_latency = plugin->getLatency();
+    m_renderer.output.resize(m_channels);
+
+    if (m_sequential.plugin &&
+        (int(m_sequential.plugin->getAudioOutputCount()) < m_channels ||
+         m_sequential.plugin->getLatency() != m_latency)) {
+        SVCERR << "WARNING: RealTimeEffectModel: Second plugin instance "
+               << "does not match the first, not using it" << endl;
+        delete m_sequential.plugin;
+        m_sequential.plugin = 0;
+    }
+    m_sequential.output.resize(m_channels);
+
+    connect(m_input, SIGNAL(aboutToBeDeleted()),
+            this, SLOT(inputModelAboutToBeDeleted()));
+
+    m_thread = new RenderThread(this);
+    m_thread->start();
+}
+
+RealTimeEffectModel::~RealTimeEffectModel()
+{
+    if (m_thread) {
+        m_mutex.lock();
+        m_exiting = true;
+        m_condition.wakeAll();
+        m_mutex.unlock();
+        m_thread->wait();
+        delete m_thread;
+    }
+
+    delete m_renderer.plugin;
+    delete m_sequential.plugin;
+}
+
+bool
+RealTimeEffectModel::isOK() const
+{
+    return m_renderer.plugin && m_channels > 0;
+}
+
+bool
+RealTimeEffectModel::isReady(int *completion) const
+{
+    // The output is rendered on demand, so we are ready as soon as
+    // the input is
+
+    QMutexLocker locker(&m_mutex);
+    if (m_haveExtent || !m_input) {
+        if (completion) *completion = 100;
+        return isOK();
+    }
+    m_input->isReady(completion);
+    if (completion && *completion > 99) *completion = 99;
+    return false;
+}
+
+void
+RealTimeEffectModel::setExtent(sv_frame_t startFrame, sv_frame_t duration)
+{
+    {
+        QMutexLocker sequentialLocker(&m_sequentialMutex);
+        QMutexLocker renderLocker(&m_renderMutex);
+        QMutexLocker locker(&m_mutex);
+        m_inputStart = startFrame;
+        m_startFrame = startFrame;
+        m_duration = duration;
+        m_haveExtent = true;
+    }
+
+    emit modelChanged();
+    emit ready();
+}
+
+void
+RealTimeEffectModel::setStartFrame(sv_frame_t startFrame)
+{
+    m_startFrame = startFrame;
+}
+
+void
+RealTimeEffectModel::inputModelAboutToBeDeleted()
+{
+    // Wait for any render in progress, after which we read silence
+    QMutexLocker sequentialLocker(&m_sequentialMutex);
+    QMutexLocker renderLocker(&m_renderMutex);
+    QMutexLocker locker(&m_mutex);
+    m_input = 0;
+}
+
+int
+RealTimeEffectModel::getChunkCount() const
+{
+    return int((m_duration + ChunkSize - 1) / ChunkSize);
+}
+
+void
+RealTimeEffectModel::prefetch(sv_frame_t frame)
+{
+    int chunk = int((frame - m_startFrame) / ChunkSize);
+    vector<int> chunks;
+    chunks.push_back(chunk);
+    chunks.push_back(chunk + 1);
+    request(chunks);
+}
+
+void
+RealTimeEffectModel::request(const vector<int> &chunks) const
+{
+    // Put these at the front of the queue, in order, so that the most
+    // recently wanted region is rendered first
+
+    QMutexLocker locker(&m_mutex);
+
+    int n = getChunkCount();
+    bool added = false;
+
+    for (int i = int(chunks.size()) - 1; i >= 0; --i) {
+        int c = chunks[i];
+        if (c < 0 || c >= n) continue;
+        if (m_chunks.find(c) != m_chunks.end()) continue;
+        if (m_requested.find(c) != m_requested.end()) {
+            for (auto j = m_requests.begin(); j != m_requests.end(); ++j) {
+                if (*j == c) { m_requests.erase(j); break; }
+            }
+        }
+        m_requests.push_front(c);
+        m_requested.insert(c);
+        added = true;
+    }
+
+    if (added) m_condition.wakeAll();
+}
+
+void
+RealTimeEffectModel::RenderThread::run()
+{
+    RealTimeEffectModel *m = m_model;
+
+    while (true) {
+
+        int chunk = -1;
+
+        m->m_mutex.lock();
+        while (!m->m_exiting && m->m_requests.empty()) {
+            m->m_condition.wait(&m->m_mutex);
+        }
+        if (m->m_exiting) {
+            m->m_mutex.unlock();
+            return;
+        }
+
+        // Prefer the chunk that follows on from the last one, as
+        // that needs no warm-up and gives an exact result
+        for (auto i = m->m_requests.begin(); i != m->m_requests.end(); ++i) {
+            if (*i == m->m_lastRendered + 1) {
+                chunk = *i;
+                m->m_requests.erase(i);
+                break;
+            }
+        }
+        if (chunk < 0) {
+            chunk = m->m_requests.front();
+            m->m_requests.pop_front();
+        }
+        m->m_requested.erase(chunk);
+        m->m_mutex.unlock();
+
+        m->renderChunk(chunk);
+    }
+}
+
+void
+RealTimeEffectModel::readInputBlock(RealTimePluginInstance *plugin,
+                                    sv_frame_t offset, sv_frame_t count,
+                                    float **inbufs) const
+{
+    // Called with the mutex for the plugin's renderer held. Fill the
+    // plugin's input buffers for one block, in the same way as the
+    // original full render in RealTimeEffectModelTransformer
+
+    int pluginChannels = int(plugin->getAudioInputCount());
+    int channels = std::min(m_inputChannels, pluginChannels);
+    if (channels < 1) return;
+
+    sv_frame_t got = 0;
+    sv_frame_t frame = m_inputStart + offset;
+
+    if (m_input && frame + count > 0) {
+
+        // Input before frame 0 is silence
+        sv_frame_t skip = (frame < 0 ? -frame : 0);
+        for (int ch = 0; ch < channels; ++ch) {
+            for (sv_frame_t i = 0; i < skip; ++i) inbufs[ch][i] = 0.f;
+        }
+
+        if (channels == 1) {
+            auto data = m_input->getData(m_inputChannel, frame + skip,
+                                         count - skip);
+            got = data.size();
+            for (sv_frame_t i = 0; i < got; ++i) {
+                inbufs[0][skip + i] = data[i];
+            }
+        } else {
+            auto data = m_input->getMultiChannelData
+                (0, channels - 1, frame + skip, count - skip);
+            if (!data.empty()) got = data[0].size();
+            for (int ch = 0; ch < channels; ++ch) {
+                for (sv_frame_t i = 0; i < got; ++i) {
+                    inbufs[ch][skip + i] = data[ch][i];
+                }
+            }
+        }
+
+        got += skip;
+    }
+
+    for (int ch = 0; ch < channels; ++ch) {
+        for (sv_frame_t i = got; i < count; ++i) {
+            inbufs[ch][i] = 0.f;
+        }
+    }
+
+    for (int ch = channels; ch < pluginChannels; ++ch) {
+        for (sv_frame_t i = 0; i < count; ++i) {
+            inbufs[ch][i] = inbufs[ch % channels][i];
+        }
+    }
+}
+
+void
+RealTimeEffectModel::renderChunk(int chunk)
+{
+    Profiler profiler("RealTimeEffectModel::renderChunk");
+
+    QMutexLocker renderLocker(&m_renderMutex);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_chunks.find(chunk) != m_chunks.end()) return; // done meanwhile
+    }
+
+    static MetricsRegistry::Counter &rendered =
+        MetricsRegistry::getInstance()->getCounter
+        ("RealTimeEffectModel: chunks rendered");
+    static MetricsRegistry::Counter &warmUps =
+        MetricsRegistry::getInstance()->getCounter
+        ("RealTimeEffectModel: chunks rendered with warm-up");
+    rendered.add();
+
+    sv_frame_t outStart = chunk * ChunkSize;
+    sv_frame_t outEnd = outStart + ChunkSize;
+    if (outEnd > m_duration) outEnd = m_duration;
+    sv_frame_t outCount = outEnd - outStart;
+
+    if (m_renderer.outputStart != outStart) {
+
+        // Not following on from the last chunk: start the plugin
+        // afresh somewhat before the chunk, and discard everything it
+        // produces before the chunk begins
+
+#ifdef DEBUG_REAL_TIME_EFFECT_MODEL
+        SVDEBUG << "RealTimeEffectModel::renderChunk(" << chunk
+                << "): warming up from scratch" << endl;
+#endif
+
+        warmUps.add();
+
+        sv_frame_t warmUpStart = outStart - WarmUpFrames;
+        if (warmUpStart < 0) warmUpStart = 0;
+        restart(m_renderer, warmUpStart, outStart);
+    }
+
+    renderUntil(m_renderer, outEnd);
+
+    Chunk c;
+    take(m_renderer, 0, m_channels - 1, outStart, outEnd, c.samples);
+    discard(m_renderer, outEnd);
+
+    // Coarse summary, interleaved by channel as in the wave file
+    // models' caches
+
+    RangeBlock summary;
+    sv_frame_t blocks = (outCount + SummaryBlockSize - 1) / SummaryBlockSize;
+    summary.reserve(blocks * m_channels);
+
+    for (sv_frame_t b = 0; b < blocks; ++b) {
+        sv_frame_t i0 = b * SummaryBlockSize;
+        sv_frame_t i1 = std::min(i0 + SummaryBlockSize, outCount);
+        for (int ch = 0; ch < m_channels; ++ch) {
+            Range range;
+            float total = 0.f;
+            for (sv_frame_t i = i0; i < i1; ++i) {
+                float s = c.samples[ch][i];
+                range.sample(s);
+                total += fabsf(s);
+            }
+            range.setAbsmean(total / float(i1 - i0));
+            summary.push_back(range);
+        }
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        c.lastUsed = ++m_useCounter;
+        m_chunks[chunk] = c;
+        m_summaries[chunk] = summary;
+        m_lastRendered = chunk;
+
+        while (int(m_chunks.size()) > MaxChunks) {
+            auto oldest = m_chunks.begin();
+            for (auto i = m_chunks.begin(); i != m_chunks.end(); ++i) {
+                if (i->second.lastUsed < oldest->second.lastUsed) oldest = i;
+            }
+            m_chunks.erase(oldest);
+        }
+    }
+
+    renderLocker.unlock();
+
+    notifyChangedWithin(m_startFrame + outStart, m_startFrame + outEnd);
+}
+
+void
+RealTimeEffectModel::restart(Renderer &r, sv_frame_t inputOffset,
+                             sv_frame_t outputOffset) const
+{
+    r.plugin->silence();
+    r.nextInput = inputOffset;
+    r.outputStart = outputOffset;
+    for (int ch = 0; ch < m_channels; ++ch) r.output[ch].clear();
+}
+
+bool
+RealTimeEffectModel::renderUntil(Renderer &r, sv_frame_t end) const
+{
+    // Run the plugin until its output reaches the given offset. Output
+    // for offsets before the end of what it already has -- the
+    // plugin's latency, or anything before the offset it was
+    // restarted for -- is discarded
+
+    sv_frame_t blockSize = r.plugin->getBufferSize();
+    float **inbufs = r.plugin->getAudioInputBuffers();
+    if (!inbufs || blockSize < 1) return false;
+
+    while (r.getOutputEnd() < end) {
+
+        readInputBlock(r.plugin, r.nextInput, blockSize, inbufs);
+
+        r.plugin->run(RealTime::frame2RealTime
+                      (m_inputStart + r.nextInput, m_sampleRate));
+
+        float **outbufs = r.plugin->getAudioOutputBuffers();
+        if (!outbufs) return false;
+
+        // This block's output is for offsets blockOut onwards
+        sv_frame_t blockOut = r.nextInput - m_latency;
+        r.nextInput += blockSize;
+
+        sv_frame_t have = r.getOutputEnd();
+
+        for (sv_frame_t i = 0; i < blockSize; ++i) {
+            if (blockOut + i < have) continue;
+            for (int ch = 0; ch < m_channels; ++ch) {
+                r.output[ch].push_back(outbufs[ch][i]);
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+RealTimeEffectModel::take(const Renderer &r, int fromchannel, int tochannel,
+                          sv_frame_t start, sv_frame_t end,
+                          vector<floatvec_t> &result) const
+{
+    // Append the renderer's output for the given offsets to result,
+    // which has one vector per channel, padding with silence wherever
+    // it has none
+
+    result.resize(tochannel - fromchannel + 1);
+
+    sv_frame_t from = std::max(start, r.outputStart);
+    sv_frame_t to = std::max(from, std::min(end, r.getOutputEnd()));
+
+    for (int ch = fromchannel; ch <= tochannel; ++ch) {
+        floatvec_t &out = result[ch - fromchannel];
+        const floatvec_t &in = r.output[ch];
+        out.insert(out.end(), from - start, 0.f);
+        out.insert(out.end(),
+                   in.begin() + (from - r.outputStart),
+                   in.begin() + (to - r.outputStart));
+        out.insert(out.end(), end - to, 0.f);
+    }
+}
+
+void
+RealTimeEffectModel::discard(Renderer &r, sv_frame_t end) const
+{
+    // Drop the renderer's output before the given offset
+
+    if (end <= r.outputStart) return;
+    sv_frame_t n = std::min(end, r.getOutputEnd()) - r.outputStart;
+    for (int ch = 0; ch < m_channels; ++ch) {
+        r.output[ch].erase(r.output[ch].begin(), r.output[ch].begin() + n);
+    }
+    r.outputStart = end;
+}
+
+bool
+RealTimeEffectModel::readSequential(int fromchannel, int tochannel,
+                                    sv_frame_t start, sv_frame_t count,
+                                    vector<floatvec_t> &result) const
+{
+    // Serve the read from the in-order renderer, if there is one and
+    // the read starts at the beginning or within what it has already
+    // rendered and not yet discarded. Return false if the read must
+    // come from the cache instead
+
+    if (!m_sequential.plugin) return false;
+
+    Profiler profiler("RealTimeEffectModel::readSequential");
+
+    QMutexLocker locker(&m_sequentialMutex);
+
+    if (start < m_sequential.outputStart ||
+        start > m_sequential.getOutputEnd()) {
+        if (start != 0) return false;
+        restart(m_sequential, 0, 0);
+    }
+
+    renderUntil(m_sequential, start + count);
+    take(m_sequential, fromchannel, tochannel, start, start + count, result);
+
+    // Keep from the start of this read, so that the other channels
+    // of the same range can be read separately afterwards
+    discard(m_sequential, start);
+
+    return true;
+}
+
+void
+RealTimeEffectModel::readChannels(int fromchannel, int tochannel,
+                                  sv_frame_t start, sv_frame_t count,
+                                  vector<floatvec_t> &result) const
+{
+    // Read the given offsets (not frames) into result, which has one
+    // vector per channel, rendering any chunks that are missing
+
+    result = vector<floatvec_t>(tochannel - fromchannel + 1);
+
+    if (start < 0) {
+        if (count <= -start) return;
+        count += start;
+        start = 0;
+    }
+    if (start + count > m_duration) count = m_duration - start;
+    if (count <= 0) return;
+
+    if (readSequential(fromchannel, tochannel, start, count, result)) {
+        return;
+    }
+
+    for (int ch = fromchannel; ch <= tochannel; ++ch) {
+        result[ch - fromchannel].reserve(count);
+    }
+
+    sv_frame_t end = start + count;
+    int lastChunk = -1;
+
+    for (sv_frame_t f = start; f < end; ) {
+
+        int chunk = int(f / ChunkSize);
+        sv_frame_t chunkStart = chunk * ChunkSize;
+        sv_frame_t n = std::min(end, chunkStart + ChunkSize) - f;
+
+        bool have = false;
+
+        while (!have) {
+            {
+                QMutexLocker locker(&m_mutex);
+                auto i = m_chunks.find(chunk);
+                if (i != m_chunks.end()) {
+                    i->second.lastUsed = ++m_useCounter;
+                    for (int ch = fromchannel; ch <= tochannel; ++ch) {
+                        const floatvec_t &s = i->second.samples[ch];
+                        result[ch - fromchannel].insert
+                            (result[ch - fromchannel].end(),
+                             s.begin() + (f - chunkStart),
+                             s.begin() + (f - chunkStart + n));
+                    }
+                    have = true;
+                }
+            }
+            if (!have) {
+                const_cast<RealTimeEffectModel *>(this)->renderChunk(chunk);
+            }
+        }
+
+        lastChunk = chunk;
+        f += n;
+    }
+
+    // Read-ahead for playback
+    vector<int> next;
+    next.push_back(lastChunk + 1);
+    request(next);
+}
+
+floatvec_t
+RealTimeEffectModel::getData(int channel, sv_frame_t start, sv_frame_t count) const
+{
+    if (!isOK() || channel >= m_channels) return {};
+
+    vector<floatvec_t> data;
+
+    if (channel == -1) {
+        // mix down all channels
+        readChannels(0, m_channels - 1, start - m_startFrame, count, data);
+        if (m_channels == 1) return data[0];
+        floatvec_t result(data[0].size(), 0.f);
+        for (int ch = 0; ch < m_channels; ++ch) {
+            for (size_t i = 0; i < result.size(); ++i) {
+                result[i] += data[ch][i];
+            }
+        }
+        return result;
+    }
+
+    readChannels(channel, channel, start - m_startFrame, count, data);
+    return data[0];
+}
+
+vector<floatvec_t>
+RealTimeEffectModel::getMultiChannelData(int fromchannel, int tochannel,
+                                         sv_frame_t start, sv_frame_t count) const
+{
+    if (!isOK() || fromchannel < 0 || fromchannel > tochannel ||
+        tochannel >= m_channels) {
+        cerr << "ERROR: RealTimeEffectModel::getMultiChannelData: channel range ("
+             << fromchannel << " to " << tochannel << ") invalid for "
+             << m_channels << " channels" << endl;
+        return {};
+    }
+
+    vector<floatvec_t> data;
+    readChannels(fromchannel, tochannel, start - m_startFrame, count, data);
+    return data;
+}
+
+int
+RealTimeEffectModel::getSummaryBlockSize(int desired) const
+{
+    // Coarse block sizes come from the retained summaries, so must be
+    // a multiple of their block size; fine ones are read directly
+    if (desired >= SummaryBlockSize) {
+        return (desired / SummaryBlockSize) * SummaryBlockSize;
+    } else {
+        return desired;
+    }
+}
+
+void
+RealTimeEffectModel::getSummaries(int channel, sv_frame_t start, sv_frame_t count,
+                                  RangeBlock &ranges, int &blockSize) const
+{
+    Profiler profiler("RealTimeEffectModel::getSummaries");
+
+    ranges.clear();
+    if (!isOK() || channel < 0 || channel >= m_channels) return;
+
+    blockSize = getSummaryBlockSize(blockSize);
+    if (blockSize < 1) blockSize = 1;
+
+    start -= m_startFrame;
+    if (start < 0) {
+        if (count <= -start) return;
+        count += start;
+        start = 0;
+    }
+    if (start + count > m_duration) count = m_duration - start;
+    if (count <= 0) return;
+
+    ranges.reserve((count / blockSize) + 1);
+
+    vector<int> missing;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        float max = 0.0, min = 0.0, total = 0.0;
+        sv_frame_t got = 0;
+        int lastMissing = -1;
+
+        if (blockSize >= SummaryBlockSize) {
+
+            // From the coarse summaries, which are never discarded
+
+            sv_frame_t div = blockSize / SummaryBlockSize;
+            sv_frame_t perChunk = ChunkSize / SummaryBlockSize;
+            sv_frame_t startIndex = start / SummaryBlockSize;
+            sv_frame_t endIndex = (start + count - 1) / SummaryBlockSize;
+
+            for (sv_frame_t index = startIndex; index <= endIndex; ++index) {
+
+                int chunk = int(index / perChunk);
+                sv_frame_t within = (index % perChunk) * m_channels + channel;
+
+                auto i = m_summaries.find(chunk);
+                // Anything not yet rendered reads as silence
+                Range range;
+                if (i != m_summaries.end() && in_range_for(i->second, within)) {
+                    range = i->second[within];
+                } else if (chunk != lastMissing) {
+                    missing.push_back(chunk);
+                    lastMissing = chunk;
+                }
+
+                if (range.max() > max || got == 0) max = range.max();
+                if (range.min() < min || got == 0) min = range.min();
+                total += range.absmean();
+
+                if (++got == div) {
+                    ranges.push_back(Range(min, max, total / float(got)));
+                    min = max = total = 0.0f;
+                    got = 0;
+                }
+            }
+
+        } else {
+
+            // From the samples of whichever chunks are in memory
+
+            const floatvec_t *samples = 0;
+            int current = -1;
+
+            for (sv_frame_t f = start; f < start + count; ++f) {
+
+                int chunk = int(f / ChunkSize);
+                if (chunk != current) {
+                    current = chunk;
+                    auto i = m_chunks.find(chunk);
+                    if (i != m_chunks.end()) {
+                        samples = &i->second.samples[channel];
+                        i->second.lastUsed = ++m_useCounter;
+                    } else {
+                        samples = 0;
+                        missing.push_back(chunk);
+                    }
+                }
+
+                float sample = 0.f;
+                if (samples) sample = (*samples)[f - chunk * ChunkSize];
+
+                if (sample > max || got == 0) max = sample;
+                if (sample < min || got == 0) min = sample;
+                total += fabsf(sample);
+
+                if (++got == blockSize) {
+                    ranges.push_back(Range(min, max, total / float(got)));
+                    min = max = total = 0.0f;
+                    got = 0;
+                }
+            }
+        }
+
+        if (got > 0) {
+            ranges.push_back(Range(min, max, total / float(got)));
+        }
+    }
+
+    if (!missing.empty()) request(missing);
+}
+
+RealTimeEffectModel::Range
+RealTimeEffectModel::getSummary(int channel, sv_frame_t start, sv_frame_t count) const
+{
+    Range range;
+
+    int blockSize = int(count);
+    if (sv_frame_t(blockSize) != count || blockSize < 1) return range;
+
+    RangeBlock ranges;
+    getSummaries(channel, start, count, ranges, blockSize);
+
+    bool first = true;
+    float total = 0.f;
+
+    for (int i = 0; i < int(ranges.size()); ++i) {
+        if (first || ranges[i].min() < range.min()) range.setMin(ranges[i].min());
+        if (first || ranges[i].max() > range.max()) range.setMax(ranges[i].max());
+        total += ranges[i].absmean();
+        first = false;
+    }
+
+    if (!ranges.empty()) range.setAbsmean(total / float(ranges.size()));
+    return range;
+}
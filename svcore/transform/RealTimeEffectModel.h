@@ -0,0 +1,231 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_REAL_TIME_EFFECT_MODEL_H
+#define SV_REAL_TIME_EFFECT_MODEL_H
+
+#include "data/model/WaveFileModel.h"
+#include "base/Thread.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <map>
+#include <set>
+#include <deque>
+
+class RealTimePluginInstance;
+class DenseTimeValueModel;
+
+/**
+ * A wave model presenting the output of a real-time effect plugin
+ * applied to an input model, rendered lazily rather than all at
+ * once.
+ *
+ * The output is rendered in fixed-size chunks, only when something
+ * asks for it. A call to getData() or getMultiChannelData() renders
+ * any missing chunks straight away in the calling thread, and queues
+ * the following chunk to be rendered in the background so that
+ * playback stays ahead. A call to getSummaries() never waits: chunks
+ * that have not been rendered yet are queued for a background thread
+ * and summarised as silence for the moment, and the change is
+ * reported through notifyChangedWithin() when each one becomes
+ * available.
+ *
+ * Rendered chunks are cached, up to a fixed limit of recently used
+ * ones, together with a coarse summary of every chunk rendered so
+ * far which is kept for the lifetime of the model.
+ *
+ * Effects have state, so a chunk is only identical to the same part
+ * of a full render if the plugin has just rendered the chunk before
+ * it. When a chunk is wanted out of order, the plugin is silenced
+ * and run over a stretch of preceding input first to warm it up,
+ * which is enough for effects whose memory is shorter than the
+ * warm-up period but is not exact for the rest. Since chunks are
+ * rendered in whatever order they are wanted, by both the caller and
+ * the background thread, cached chunks are not guaranteed to match
+ * a full render.
+ *
+ * Exact output is available from a second instance of the plugin, if
+ * one is supplied. That instance only ever runs forward through the
+ * input from the beginning and bypasses the cache, serving reads
+ * that start at the beginning of the output and carry on in order
+ * from there, as when exporting it. Its output is identical to a
+ * full render however the cache has been used meanwhile.
+ */
+class RealTimeEffectModel : public WaveFileModel
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Create a model for the output of the given plugin applied to
+     * the input model. inputChannel is the channel to read, or -1
+     * for all channels. The plugin should have been instantiated with
+     * the input's sample rate and the desired block size; the model
+     * takes ownership of it.
+     *
+     * sequentialPlugin, if given, is a second instance of the same
+     * plugin with the same parameters, used only for reads that
+     * proceed in order from the start. The model takes ownership of
+     * that too. Without it, those reads come from the cache as well.
+     *
+     * The model is empty, and not ready, until setExtent() is called.
+     */
+    RealTimeEffectModel(DenseTimeValueModel *input,
+                        int inputChannel,
+                        RealTimePluginInstance *plugin,
+                        RealTimePluginInstance *sequentialPlugin = 0);
+    ~RealTimeEffectModel();
+
+    /**
+     * Set the part of the input to render, starting at frame
+     * startFrame for duration frames. Call this once, when the input
+     * model is ready and its length is known.
+     */
+    void setExtent(sv_frame_t startFrame, sv_frame_t duration);
+
+    /**
+     * Queue the chunk containing the given frame, and the one after
+     * it, to be rendered in the background.
+     */
+    void prefetch(sv_frame_t frame);
+
+    bool isOK() const;
+    bool isReady(int *) const;
+
+    sv_frame_t getFrameCount() const { return m_duration; }
+    int getChannelCount() const { return m_channels; }
+    sv_samplerate_t getSampleRate() const { return m_sampleRate; }
+    sv_samplerate_t getNativeRate() const { return m_sampleRate; }
+
+    QString getTitle() const { return objectName(); }
+    QString getMaker() const { return ""; }
+    QString getLocation() const { return ""; }
+
+    float getValueMinimum() const { return -1.0f; }
+    float getValueMaximum() const { return  1.0f; }
+
+    virtual sv_frame_t getStartFrame() const { return m_startFrame; }
+    virtual sv_frame_t getEndFrame() const { return m_startFrame + m_duration; }
+
+    void setStartFrame(sv_frame_t startFrame);
+
+    virtual floatvec_t getData(int channel, sv_frame_t start, sv_frame_t count) const;
+
+    virtual std::vector<floatvec_t> getMultiChannelData(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count) const;
+
+    virtual int getSummaryBlockSize(int desired) const;
+
+    virtual void getSummaries(int channel, sv_frame_t start, sv_frame_t count,
+                              RangeBlock &ranges, int &blockSize) const;
+
+    virtual Range getSummary(int channel, sv_frame_t start, sv_frame_t count) const;
+
+    QString getTypeName() const { return tr("Real-Time Effect Output"); }
+
+protected slots:
+    void inputModelAboutToBeDeleted();
+
+protected:
+    class RenderThread : public Thread
+    {
+    public:
+        RenderThread(RealTimeEffectModel *model) : m_model(model) { }
+        virtual void run();
+
+    private:
+        RealTimeEffectModel *m_model;
+    };
+
+    struct Chunk {
+        std::vector<floatvec_t> samples; // per channel
+        int lastUsed;
+    };
+
+    // One plugin instance and the state of its progress through the
+    // input: the offset (from m_inputStart) of the next input block,
+    // and the output produced but not yet taken, per channel, for
+    // offsets from outputStart onwards
+    struct Renderer {
+        Renderer(RealTimePluginInstance *p) :
+            plugin(p), nextInput(0), outputStart(0) { }
+        RealTimePluginInstance *plugin;
+        sv_frame_t nextInput;
+        sv_frame_t outputStart;
+        std::vector<floatvec_t> output;
+        sv_frame_t getOutputEnd() const {
+            return outputStart +
+                (output.empty() ? 0 : sv_frame_t(output[0].size()));
+        }
+    };
+
+    DenseTimeValueModel *m_input;
+    int m_inputChannel;
+    int m_inputChannels;
+    sv_samplerate_t m_sampleRate;
+    int m_channels;
+    sv_frame_t m_inputStart;
+    sv_frame_t m_duration;
+    sv_frame_t m_startFrame;
+    sv_frame_t m_latency;
+    bool m_haveExtent;
+
+    // Renders chunks for the cache, in whatever order they are
+    // wanted. Protected by m_renderMutex, which is held throughout
+    // each chunk render.
+    Renderer m_renderer;
+    mutable QMutex m_renderMutex;
+
+    // Renders in order from the start only, for exact reads.
+    // Protected by m_sequentialMutex, which is never held at the same
+    // time as m_renderMutex except in the order sequential, render.
+    mutable Renderer m_sequential;
+    mutable QMutex m_sequentialMutex;
+
+    // Cache and request queue, protected by m_mutex
+    mutable std::map<int, Chunk> m_chunks;
+    std::map<int, RangeBlock> m_summaries;
+    mutable std::deque<int> m_requests;
+    mutable std::set<int> m_requested;
+    mutable int m_useCounter;
+    int m_lastRendered;
+    bool m_exiting;
+    mutable QMutex m_mutex;
+    mutable QWaitCondition m_condition;
+
+    RenderThread *m_thread;
+
+    int getChunkCount() const;
+    void request(const std::vector<int> &chunks) const;
+    void renderChunk(int chunk);
+    void restart(Renderer &r, sv_frame_t inputOffset,
+                 sv_frame_t outputOffset) const;
+    bool renderUntil(Renderer &r, sv_frame_t end) const;
+    void take(const Renderer &r, int fromchannel, int tochannel,
+              sv_frame_t start, sv_frame_t end,
+              std::vector<floatvec_t> &result) const;
+    void discard(Renderer &r, sv_frame_t end) const;
+    void readInputBlock(RealTimePluginInstance *plugin,
+                        sv_frame_t offset, sv_frame_t count,
+                        float **buffers) const;
+    bool readSequential(int fromchannel, int tochannel,
+                        sv_frame_t start, sv_frame_t count,
+                        std::vector<floatvec_t> &result) const;
+    void readChannels(int fromchannel, int tochannel,
+                      sv_frame_t start, sv_frame_t count,
+                      std::vector<floatvec_t> &result) const;
+};
+
+#endif
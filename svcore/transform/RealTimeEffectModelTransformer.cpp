@@ -22,10 +22,10 @@
 #include "data/model/Model.h"
 #include "data/model/SparseTimeValueModel.h"
 #include "data/model/DenseTimeValueModel.h"
-#include "data/model/WritableWaveFileModel.h"
 #include "data/model/WaveFileModel.h"
 
 #include "TransformFactory.h"
+#include "RealTimeEffectModel.h"
 
 #include <iostream>
 
@@ -82,13 +82,25 @@ RealTimeEffectModelTransformer::RealTimeEffectModelTransformer(Input in,
 
     if (m_outputNo == -1) {
 
-        int outputChannels = (int)m_plugin->getAudioOutputCount();
-        if (outputChannels > input->getChannelCount()) {
-            outputChannels = input->getChannelCount();
+        // Audio output is rendered lazily by the model itself, which
+        // takes over the plugin. We only set its extent, in run(),
+        // once the input is ready. It also takes a second instance,
+        // set up identically, to render exactly in order from the
+        // start when exporting
+
+        RealTimePluginInstance *sequential =
+            factory->instantiatePlugin(pluginId, 0, 0,
+                                       input->getSampleRate(),
+                                       transform.getBlockSize(),
+                                       input->getChannelCount());
+        if (sequential) {
+            TransformFactory::getInstance()->setPluginParameters
+                (transform, sequential);
         }
 
-        WritableWaveFileModel *model = new WritableWaveFileModel
-            (input->getSampleRate(), outputChannels);
+        RealTimeEffectModel *model = new RealTimeEffectModel
+            (input, m_input.getChannel(), m_plugin, sequential);
+        m_plugin = 0;
 
         m_outputs.push_back(model);
 
@@ -132,19 +144,10 @@ RealTimeEffectModelTransformer::run()
     if (m_abandoned) return;
 
     SparseTimeValueModel *stvm = dynamic_cast<SparseTimeValueModel *>(m_outputs[0]);
-    WritableWaveFileModel *wwfm = dynamic_cast<WritableWaveFileModel *>(m_outputs[0]);
-    if (!stvm && !wwfm) return;
-
-    if (stvm && (m_outputNo >= int(m_plugin->getControlOutputCount()))) return;
+    RealTimeEffectModel *rtem = dynamic_cast<RealTimeEffectModel *>(m_outputs[0]);
+    if (!stvm && !rtem) return;
 
     sv_samplerate_t sampleRate = input->getSampleRate();
-    int channelCount = input->getChannelCount();
-    if (!wwfm && m_input.getChannel() != -1) channelCount = 1;
-
-    sv_frame_t blockSize = m_plugin->getBufferSize();
-
-    float **inbufs = m_plugin->getAudioInputBuffers();
-
     sv_frame_t startFrame = m_input.getModel()->getStartFrame();
     sv_frame_t endFrame = m_input.getModel()->getEndFrame();
 
@@ -170,10 +173,23 @@ RealTimeEffectModelTransformer::run()
         contextDuration = endFrame - contextStart;
     }
 
-    if (wwfm) {
-        wwfm->setStartFrame(contextStart);
+    if (rtem) {
+        // Nothing is rendered until it is wanted; start on the
+        // beginning, which is where playback usually starts
+        rtem->setExtent(contextStart, contextDuration);
+        rtem->prefetch(contextStart);
+        return;
     }
 
+    if (m_outputNo >= int(m_plugin->getControlOutputCount())) return;
+
+    int channelCount = input->getChannelCount();
+    if (m_input.getChannel() != -1) channelCount = 1;
+
+    sv_frame_t blockSize = m_plugin->getBufferSize();
+
+    float **inbufs = m_plugin->getAudioInputBuffers();
+
     sv_frame_t blockFrame = contextStart;
 
     int prevCompletion = 0;
@@ -246,46 +262,17 @@ RealTimeEffectModelTransformer::run()
 
         m_plugin->run(RealTime::frame2RealTime(blockFrame, sampleRate));
 
-        if (stvm) {
-
-            float value = m_plugin->getControlOutputValue(m_outputNo);
-
-            sv_frame_t pointFrame = blockFrame;
-            if (pointFrame > latency) pointFrame -= latency;
-            else pointFrame = 0;
-
-            stvm->addPoint(SparseTimeValueModel::Point
-                           (pointFrame, value, ""));
+        float value = m_plugin->getControlOutputValue(m_outputNo);
 
-        } else if (wwfm) {
+        sv_frame_t pointFrame = blockFrame;
+        if (pointFrame > latency) pointFrame -= latency;
+        else pointFrame = 0;
 
-            float **outbufs = m_plugin->getAudioOutputBuffers();
-
-            if (outbufs) {
-
-                if (blockFrame >= latency) {
-                    sv_frame_t writeSize = std::min
-                        (blockSize,
-                         contextStart + contextDuration + latency - blockFrame);
-                    wwfm->addSamples(outbufs, writeSize);
-                } else if (blockFrame + blockSize >= latency) {
-                    sv_frame_t offset = latency - blockFrame;
-                    sv_frame_t count = blockSize - offset;
-                    float **tmp = new float *[channelCount];
-                    for (int c = 0; c < channelCount; ++c) {
-                        tmp[c] = outbufs[c] + offset;
-                    }
-                    wwfm->addSamples(tmp, count);
-                    delete[] tmp;
-                }
-            }
-        }
+        stvm->addPoint(SparseTimeValueModel::Point
+                       (pointFrame, value, ""));
 
 	if (blockFrame == contextStart || completion > prevCompletion) {
-            // This setCompletion is probably misusing the completion
-            // terminology, just as it was for WritableWaveFileModel
-	    if (stvm) stvm->setCompletion(completion);
-	    if (wwfm) wwfm->setWriteProportion(completion);
+	    stvm->setCompletion(completion);
 	    prevCompletion = completion;
 	}
         
@@ -294,7 +281,6 @@ RealTimeEffectModelTransformer::run()
 
     if (m_abandoned) return;
     
-    if (stvm) stvm->setCompletion(100);
-    if (wwfm) wwfm->writeComplete();
+    stvm->setCompletion(100);
 }
 
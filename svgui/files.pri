@@ -35,6 +35,8 @@ SVGUI_HEADERS += \
            layer/VerticalScaleLayer.h \
            layer/WaveformLayer.h \
 	   view/AlignmentView.h \
+           view/HeadlessRenderer.h \
+           view/OffscreenGeometryProvider.h \
            view/Overview.h \
            view/Pane.h \
            view/PaneStack.h \
@@ -118,6 +120,8 @@ SVGUI_SOURCES += \
            layer/TimeValueLayer.cpp \
            layer/WaveformLayer.cpp \
 	   view/AlignmentView.cpp \
+           view/HeadlessRenderer.cpp \
+           view/OffscreenGeometryProvider.cpp \
            view/Overview.cpp \
            view/Pane.cpp \
            view/PaneStack.cpp \
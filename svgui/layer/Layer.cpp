@@ -173,8 +173,10 @@ Layer::alignToReference(LayerGeometryProvider *v, sv_frame_t frame) const
     SVDEBUG << "Layer::alignToReference(" << frame << "): model = " << m << ", alignment reference = " << (m ? m->getAlignmentReference() : 0) << endl;
     if (m && m->getAlignmentReference()) {
         return m->alignToReference(frame);
-    } else {
+    } else if (v->getView()) {
         return v->getView()->alignToReference(frame);
+    } else {
+        return frame;
     }
 }
 
@@ -185,8 +187,10 @@ Layer::alignFromReference(LayerGeometryProvider *v, sv_frame_t frame) const
     SVDEBUG << "Layer::alignFromReference(" << frame << "): model = " << m << ", alignment reference = " << (m ? m->getAlignmentReference() : 0) << endl;
     if (m && m->getAlignmentReference()) {
         return m->alignFromReference(frame);
-    } else {
+    } else if (v->getView()) {
         return v->getView()->alignFromReference(frame);
+    } else {
+        return frame;
     }
 }
 
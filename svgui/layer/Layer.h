@@ -293,6 +293,16 @@ public:
      */
     virtual bool isLayerScrollable(const LayerGeometryProvider *) const { return true; }
 
+    /**
+     * This should return true if a change to the layer's model within
+     * a range of frames can only alter the pixel columns covering
+     * that range, so that a view caching the layer's rendering may
+     * redraw just those columns instead of the whole cache.  Layers
+     * that draw connecting lines, labels or anything else extending
+     * beyond the data they belong to should return false.
+     */
+    virtual bool isLayerChangeLocal() const { return false; }
+
     /**
      * This should return true if the layer completely obscures any
      * underlying layers.  It's used to determine whether the view can
@@ -943,7 +943,7 @@ RegionLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
 	if (w < 1) w = 1;
 
 	if (m_plotStyle == PlotSegmentation) {
-            paint.setPen(getForegroundQColor(v->getView()));
+            paint.setPen(getForegroundQColor(v));
             paint.setBrush(getColourForValue(v, p.value));
         } else {
             paint.setPen(getBaseQColor());
@@ -959,12 +959,12 @@ RegionLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) const
                 RegionModel::Point::Comparator()(illuminatePoint, p) ||
                 RegionModel::Point::Comparator()(p, illuminatePoint)) {
 
-                paint.setPen(QPen(getForegroundQColor(v->getView()), 1));
+                paint.setPen(QPen(getForegroundQColor(v), 1));
                 paint.drawLine(x, 0, x, v->getPaintHeight());
                 paint.setPen(Qt::NoPen);
 
             } else {
-                paint.setPen(QPen(getForegroundQColor(v->getView()), 2));
+                paint.setPen(QPen(getForegroundQColor(v), 2));
             }
 
 	    paint.drawRect(x, -1, ex - x, v->getPaintHeight() + 2);
@@ -405,7 +405,7 @@ TimeInstantLayer::paint(LayerGeometryProvider *v, QPainter &paint, QRect rect) c
 	}
 		
 	if (p.frame == illuminateFrame) {
-	    paint.setPen(getForegroundQColor(v->getView()));
+	    paint.setPen(getForegroundQColor(v));
 	} else {
 	    paint.setPen(brushColour);
 	}
@@ -25,7 +25,6 @@
 #include "PaintAssistant.h"
 
 #include <QPainter>
-#include <QPixmap>
 #include <QTextStream>
 
 #include <iostream>
@@ -33,8 +32,19 @@
 
 //#define DEBUG_WAVEFORM_PAINT 1
 
+// Width in pixel columns of each cached tile
+static const int TILE_WIDTH = 256;
 
+// Upper limit on the memory used by cached tiles in each layer
+static const sv_frame_t MAX_TILE_BYTES = 32 * 1024 * 1024;
 
+// Memory used by a tile image. (QImage::sizeInBytes would do, but is
+// not available in the older Qt versions we still build with)
+static sv_frame_t
+imageBytes(const QImage &image)
+{
+    return sv_frame_t(image.bytesPerLine()) * image.height();
+}
 
 WaveformLayer::WaveformLayer() :
     SingleColourLayer(),
@@ -48,16 +58,13 @@ WaveformLayer::WaveformLayer() :
     m_scale(LinearScale),
     m_middleLineHeight(0.5),
     m_aggressive(false),
-    m_cache(0),
-    m_cacheValid(false),
-    m_cacheZoomLevel(0)
+    m_tileBytes(0)
 {
 
 }
 
 WaveformLayer::~WaveformLayer()
 {
-    delete m_cache;
 }
 
 void
@@ -78,11 +85,15 @@ WaveformLayer::setModel(const RangeSummarisableTimeValueModel *model)
     }
 
     m_model = model;
-    m_cacheValid = false;
+    clearTiles();
     if (!m_model || !m_model->isOK()) return;
 
     connectSignals(m_model);
 
+    connect(m_model, SIGNAL(modelChanged()), this, SLOT(cacheInvalid()));
+    connect(m_model, SIGNAL(modelChangedWithin(sv_frame_t, sv_frame_t)),
+            this, SLOT(cacheInvalid(sv_frame_t, sv_frame_t)));
+
     emit modelReplaced();
 
     if (channelsChanged) emit layerParametersChanged();
@@ -259,7 +270,6 @@ WaveformLayer::setGain(float gain)
 {
     if (m_gain == gain) return;
     m_gain = gain;
-    m_cacheValid = false;
     emit layerParametersChanged();
     emit verticalZoomChanged();
 }
@@ -269,7 +279,6 @@ WaveformLayer::setAutoNormalize(bool autoNormalize)
 {
     if (m_autoNormalize == autoNormalize) return;
     m_autoNormalize = autoNormalize;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -278,7 +287,7 @@ WaveformLayer::setShowMeans(bool showMeans)
 {
     if (m_showMeans == showMeans) return;
     m_showMeans = showMeans;
-    m_cacheValid = false;
+    clearTiles();
     emit layerParametersChanged();
 }
 
@@ -287,7 +296,7 @@ WaveformLayer::setUseGreyscale(bool useGreyscale)
 {
     if (m_greyscale == useGreyscale) return;
     m_greyscale = useGreyscale;
-    m_cacheValid = false;
+    clearTiles();
     emit layerParametersChanged();
 }
 
@@ -296,7 +305,6 @@ WaveformLayer::setChannelMode(ChannelMode channelMode)
 {
     if (m_channelMode == channelMode) return;
     m_channelMode = channelMode;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -307,7 +315,6 @@ WaveformLayer::setChannel(int channel)
 
     if (m_channel == channel) return;
     m_channel = channel;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -316,7 +323,6 @@ WaveformLayer::setScale(Scale scale)
 {
     if (m_scale == scale) return;
     m_scale = scale;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -325,7 +331,6 @@ WaveformLayer::setMiddleLineHeight(double height)
 {
     if (m_middleLineHeight == height) return;
     m_middleLineHeight = height;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -334,7 +339,6 @@ WaveformLayer::setAggressiveCacheing(bool aggressive)
 {
     if (m_aggressive == aggressive) return;
     m_aggressive = aggressive;
-    m_cacheValid = false;
     emit layerParametersChanged();
 }
 
@@ -424,7 +428,18 @@ bool
 WaveformLayer::getSourceFramesForX(LayerGeometryProvider *v, int x, int modelZoomLevel,
                                    sv_frame_t &f0, sv_frame_t &f1) const
 {
-    sv_frame_t viewFrame = v->getFrameForX(x);
+    return getSourceFramesForViewFrames(v->getFrameForX(x),
+                                        v->getFrameForX(x + 1),
+                                        modelZoomLevel, f0, f1);
+}
+
+bool
+WaveformLayer::getSourceFramesForViewFrames(sv_frame_t viewFrame0,
+                                            sv_frame_t viewFrame1,
+                                            int modelZoomLevel,
+                                            sv_frame_t &f0, sv_frame_t &f1) const
+{
+    sv_frame_t viewFrame = viewFrame0;
     if (viewFrame < 0) {
         f0 = 0;
         f1 = 0;
@@ -436,7 +451,7 @@ WaveformLayer::getSourceFramesForX(LayerGeometryProvider *v, int x, int modelZoo
     f0 = f0 / modelZoomLevel;
     f0 = f0 * modelZoomLevel;
 
-    viewFrame = v->getFrameForX(x + 1);
+    viewFrame = viewFrame1;
 
     f1 = viewFrame;
     f1 = f1 / modelZoomLevel;
@@ -485,19 +500,108 @@ WaveformLayer::getNormalizeGain(LayerGeometryProvider *v, int channel) const
     return float(1.0 / std::max(fabs(range.max()), fabs(range.min())));
 }
 
+bool
+WaveformLayer::TileKey::operator<(const TileKey &k) const
+{
+    if (zoomLevel != k.zoomLevel) return zoomLevel < k.zoomLevel;
+    if (height != k.height) return height < k.height;
+    if (channelMode != k.channelMode) return channelMode < k.channelMode;
+    if (channel != k.channel) return channel < k.channel;
+    if (scale != k.scale) return scale < k.scale;
+    if (gain != k.gain) return gain < k.gain;
+    if (lightBackground != k.lightBackground) return !lightBackground;
+    if (scaleGuides != k.scaleGuides) return !scaleGuides;
+    return index < k.index;
+}
+
+void
+WaveformLayer::clearTiles() const
+{
+    m_tiles.clear();
+    m_tileLru.clear();
+    m_tileBytes = 0;
+}
+
+void
+WaveformLayer::cacheInvalid()
+{
+    clearTiles();
+}
+
+void
+WaveformLayer::cacheInvalid(sv_frame_t startFrame, sv_frame_t endFrame)
+{
+    // A tile also depends on the column just before it, where the
+    // waveform is joined up across the tile boundary
+
+    TileMap::iterator i = m_tiles.begin();
+    while (i != m_tiles.end()) {
+        const TileKey &key = i->first;
+        sv_frame_t tileStart = (key.index * TILE_WIDTH - 1) * key.zoomLevel;
+        sv_frame_t tileEnd = (key.index + 1) * TILE_WIDTH * key.zoomLevel;
+        if (tileStart < endFrame && tileEnd > startFrame) {
+            m_tileBytes -= imageBytes(i->second.image);
+            m_tileLru.erase(i->second.lruPosition);
+            m_tiles.erase(i++);
+        } else {
+            ++i;
+        }
+    }
+}
+
+const QImage &
+WaveformLayer::getTile(LayerGeometryProvider *v, const TileKey &key) const
+{
+    TileMap::iterator i = m_tiles.find(key);
+
+    if (i != m_tiles.end()) {
+        m_tileLru.splice(m_tileLru.begin(), m_tileLru, i->second.lruPosition);
+        return i->second.image;
+    }
+
+#ifdef DEBUG_WAVEFORM_PAINT
+    cerr << "WaveformLayer::getTile: rendering tile " << key.index
+         << " at zoom " << key.zoomLevel << endl;
+#endif
+
+    std::vector<sv_frame_t> viewFrames(TILE_WIDTH + 2);
+    for (int j = 0; j < TILE_WIDTH + 2; ++j) {
+        viewFrames[j] = (key.index * TILE_WIDTH + j - 1) * key.zoomLevel;
+    }
+
+    Tile tile;
+    tile.image = QImage(TILE_WIDTH, key.height,
+                        QImage::Format_ARGB32_Premultiplied);
+    renderColumns(v, tile.image, viewFrames, key.zoomLevel, true);
+
+    m_tileBytes += imageBytes(tile.image);
+
+    while (m_tileBytes > MAX_TILE_BYTES && !m_tileLru.empty()) {
+        TileMap::iterator oldest = m_tiles.find(m_tileLru.back());
+        m_tileBytes -= imageBytes(oldest->second.image);
+        m_tiles.erase(oldest);
+        m_tileLru.pop_back();
+    }
+
+    m_tileLru.push_front(key);
+    tile.lruPosition = m_tileLru.begin();
+
+    return m_tiles.insert(TileMap::value_type(key, tile)).first->second.image;
+}
+
 void
 WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect) const
 {
     if (!m_model || !m_model->isOK()) {
-    return;
+        return;
     }
-
+  
     int zoomLevel = v->getZoomLevel();
 
 #ifdef DEBUG_WAVEFORM_PAINT
     Profiler profiler("WaveformLayer::paint", true);
     cerr << "WaveformLayer::paint (" << rect.x() << "," << rect.y()
-          << ") [" << rect.width() << "x" << rect.height() << "]: zoom " << zoomLevel << endl;
+              << ") [" << rect.width() << "x" << rect.height() << "]: zoom " << zoomLevel << endl;
 #endif
 
     int channels = 0, minChannel = 0, maxChannel = 0;
@@ -511,68 +615,173 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
     int h = v->getPaintHeight();
 
     bool ready = m_model->isReady();
-    QPainter *paint;
+
+    while ((int)m_effectiveGains.size() <= maxChannel) {
+        m_effectiveGains.push_back(m_gain);
+    }
+
+    for (int ch = minChannel; ch <= maxChannel; ++ch) {
+        m_effectiveGains[ch] = m_gain;
+        if (m_autoNormalize) {
+            m_effectiveGains[ch] = getNormalizeGain(v, ch);
+        }
+    }
+
+    viewPainter.save();
+
+    viewPainter.setClipRect(rect, viewPainter.hasClipping() ?
+                            Qt::IntersectClip : Qt::ReplaceClip);
 
     if (m_aggressive) {
+        viewPainter.setPen(Qt::NoPen);
+        viewPainter.setBrush(getBackgroundQColor(v));
+        viewPainter.drawRect(rect);
+    }
 
-#ifdef DEBUG_WAVEFORM_PAINT
-        cerr << "WaveformLayer::paint: aggressive is true" << endl;
-#endif
+    viewPainter.setRenderHint(QPainter::Antialiasing, false);
 
-    if (m_cacheValid && (zoomLevel != m_cacheZoomLevel)) {
-        m_cacheValid = false;
+    if (m_middleLineHeight != 0.5) {
+        double space = m_middleLineHeight * 2;
+        if (space > 1.0) space = 2.0 - space;
+        double yt = h * (m_middleLineHeight - space/2);
+        viewPainter.translate(QPointF(0, yt));
+        viewPainter.scale(1.0, space);
     }
 
-    if (!m_cache || m_cache->width() != w || m_cache->height() != h) {
+    int x0 = rect.left();
+    int x1 = rect.right();
+
+    // Tiles can only be shared between paints if each pixel column
+    // starts at a multiple of the zoom level and covers exactly that
+    // many frames, which is the case unless we are being painted
+    // through a scaling proxy. They also can't be kept if the model
+    // is incomplete or the gain depends on the visible extent.
+
+    sv_frame_t startFrame = v->getFrameForX(0);
+    bool regular = (startFrame % zoomLevel == 0 &&
+                    v->getFrameForX(w) == startFrame + sv_frame_t(w) * zoomLevel);
+
+    if (ready && regular && !m_autoNormalize) {
+
+        TileKey key;
+        key.zoomLevel = zoomLevel;
+        key.height = h;
+        key.channelMode = int(m_channelMode);
+        key.channel = m_channel;
+        key.scale = int(m_scale);
+        key.gain = m_gain;
+        key.lightBackground = v->hasLightBackground();
+        key.scaleGuides = (v->getViewManager() &&
+                           v->getViewManager()->shouldShowScaleGuides());
+
+        sv_frame_t startColumn = startFrame / zoomLevel;
+        sv_frame_t c0 = startColumn + x0, c1 = startColumn + x1;
+        sv_frame_t firstTile = (c0 >= 0 ? c0 : c0 - TILE_WIDTH + 1) / TILE_WIDTH;
+        sv_frame_t lastTile = (c1 >= 0 ? c1 : c1 - TILE_WIDTH + 1) / TILE_WIDTH;
+
+        for (sv_frame_t index = firstTile; index <= lastTile; ++index) {
+            key.index = index;
+            viewPainter.drawImage(int(index * TILE_WIDTH - startColumn), 0,
+                                  getTile(v, key));
+        }
+
+    } else {
+
 #ifdef DEBUG_WAVEFORM_PAINT
-            if (m_cache) {
-                cerr << "WaveformLayer::paint: cache size " << m_cache->width() << "x" << m_cache->height() << " differs from view size " << w << "x" << h << ": regenerating aggressive cache" << endl;
-            }
+        cerr << "WaveformLayer::paint: not using tile cache" << endl;
 #endif
-        delete m_cache;
-        m_cache = new QPixmap(w, h);
-            m_cacheValid = false;
-    }
 
-    if (m_cacheValid) {
-        viewPainter.drawPixmap(rect, *m_cache, rect);
-        return;
+        std::vector<sv_frame_t> viewFrames(x1 - x0 + 3);
+        for (int j = 0; j < x1 - x0 + 3; ++j) {
+            viewFrames[j] = v->getFrameForX(x0 + j - 1);
+        }
+
+        QImage image(x1 - x0 + 1, h, QImage::Format_ARGB32_Premultiplied);
+        renderColumns(v, image, viewFrames, zoomLevel, ready);
+        viewPainter.drawImage(x0, 0, image);
     }
 
-    paint = new QPainter(m_cache);
+    viewPainter.restore();
+}
 
-    paint->setPen(Qt::NoPen);
-    paint->setBrush(getBackgroundQColor(v));
-    paint->drawRect(rect);
+namespace {
 
-    paint->setPen(getForegroundQColor(v));
-    paint->setBrush(Qt::NoBrush);
+/**
+ * Minimal pixel plotter writing straight into the scanlines of a
+ * 32-bit image, clipping to its bounds.
+ */
+class ScanlineWriter
+{
+public:
+    ScanlineWriter(QImage &image) :
+        m_bits(image.bits()),
+        m_bpl(image.bytesPerLine()),
+        m_w(image.width()),
+        m_h(image.height()) { }
+
+    void point(int x, int y, QRgb c) {
+        if (x < 0 || x >= m_w || y < 0 || y >= m_h) return;
+        reinterpret_cast<QRgb *>(m_bits + y * m_bpl)[x] = c;
+    }
 
-    } else {
-    paint = &viewPainter;
+    void vline(int x, int ya, int yb, QRgb c) {
+        if (x < 0 || x >= m_w) return;
+        if (ya > yb) std::swap(ya, yb);
+        if (ya < 0) ya = 0;
+        if (yb >= m_h) yb = m_h - 1;
+        for (int y = ya; y <= yb; ++y) {
+            reinterpret_cast<QRgb *>(m_bits + y * m_bpl)[x] = c;
+        }
     }
 
-    paint->setRenderHint(QPainter::Antialiasing, false);
+    void hline(int y, QRgb c) {
+        if (y < 0 || y >= m_h) return;
+        QRgb *row = reinterpret_cast<QRgb *>(m_bits + y * m_bpl);
+        for (int x = 0; x < m_w; ++x) row[x] = c;
+    }
 
-    if (m_middleLineHeight != 0.5) {
-        paint->save();
-        double space = m_middleLineHeight * 2;
-        if (space > 1.0) space = 2.0 - space;
-        double yt = h * (m_middleLineHeight - space/2);
-        paint->translate(QPointF(0, yt));
-        paint->scale(1.0, space);
+    void line(int xa, int ya, int xb, int yb, QRgb c) {
+        // Bresenham
+        int dx = abs(xb - xa), sx = (xa < xb ? 1 : -1);
+        int dy = -abs(yb - ya), sy = (ya < yb ? 1 : -1);
+        int err = dx + dy;
+        while (true) {
+            point(xa, ya, c);
+            if (xa == xb && ya == yb) break;
+            int e2 = 2 * err;
+            if (e2 >= dy) { err += dy; xa += sx; }
+            if (e2 <= dx) { err += dx; ya += sy; }
+        }
     }
 
-    int x0 = 0, x1 = w - 1;
-    int y0 = 0, y1 = h - 1;
+private:
+    uchar *m_bits;
+    int m_bpl;
+    int m_w;
+    int m_h;
+};
+
+}
+
+void
+WaveformLayer::renderColumns(LayerGeometryProvider *v, QImage &image,
+                             const std::vector<sv_frame_t> &viewFrames,
+                             int zoomLevel, bool ready) const
+{
+    image.fill(0);
+
+    int channels = 0, minChannel = 0, maxChannel = 0;
+    bool mergingChannels = false, mixingChannels = false;
+
+    channels = getChannelArrangement(minChannel, maxChannel,
+                                     mergingChannels, mixingChannels);
+    if (channels == 0) return;
 
-    x0 = rect.left();
-    x1 = rect.right();
-    y0 = rect.top();
-    y1 = rect.bottom();
+    int h = image.height();
+    int x0 = -1;
+    int x1 = image.width() - 1;
 
-    if (x0 > 0) --x0;
-    if (x1 < w) ++x1;
+    ScanlineWriter writer(image);
 
     // Our zoom level may differ from that at which the underlying
     // model has its blocks.
@@ -582,84 +791,77 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
     // the range being drawn is.  And that set of underlying frames
     // must remain the same when we scroll one or more pixels left or
     // right.
-
+            
     int modelZoomLevel = m_model->getSummaryBlockSize(zoomLevel);
 
     sv_frame_t frame0;
     sv_frame_t frame1;
     sv_frame_t spare;
 
-    getSourceFramesForX(v, x0, modelZoomLevel, frame0, spare);
-    getSourceFramesForX(v, x1, modelZoomLevel, spare, frame1);
-
+    getSourceFramesForViewFrames(viewFrames[0], viewFrames[1],
+                                 modelZoomLevel, frame0, spare);
+    getSourceFramesForViewFrames(viewFrames[x1 + 1], viewFrames[x1 + 2],
+                                 modelZoomLevel, spare, frame1);
+    
 #ifdef DEBUG_WAVEFORM_PAINT
     cerr << "Painting waveform from " << frame0 << " to " << frame1 << " (" << (x1-x0+1) << " pixels at zoom " << zoomLevel << " and model zoom " << modelZoomLevel << ")" <<  endl;
 #endif
 
-    RangeSummarisableTimeValueModel::RangeBlock *ranges =
+    RangeSummarisableTimeValueModel::RangeBlock *ranges = 
         new RangeSummarisableTimeValueModel::RangeBlock;
 
     RangeSummarisableTimeValueModel::RangeBlock *otherChannelRanges = 0;
     RangeSummarisableTimeValueModel::Range range;
-
+    
     QColor baseColour = getBaseQColor();
     std::vector<QColor> greys = getPartialShades(v);
-
+        
     QColor midColour = baseColour;
     if (midColour == Qt::black) {
-    midColour = Qt::gray;
+        midColour = Qt::gray;
     } else if (v->hasLightBackground()) {
-    midColour = midColour.light(150);
+        midColour = midColour.light(150);
     } else {
-    midColour = midColour.light(50);
+        midColour = midColour.light(50);
     }
 
-    while ((int)m_effectiveGains.size() <= maxChannel) {
-        m_effectiveGains.push_back(m_gain);
-    }
+    QRgb base = baseColour.rgba();
+    QRgb mid = midColour.rgba();
+    QRgb clip = QColor(Qt::red).rgba(); //!!! getContrastingColour
 
     for (int ch = minChannel; ch <= maxChannel; ++ch) {
 
-    int prevRangeBottom = -1, prevRangeTop = -1;
-    QColor prevRangeBottomColour = baseColour, prevRangeTopColour = baseColour;
-
-        m_effectiveGains[ch] = m_gain;
-
-        if (m_autoNormalize) {
-            m_effectiveGains[ch] = getNormalizeGain(v, ch);
-        }
+        int prevRangeBottom = -1, prevRangeTop = -1;
+        QRgb prevRangeBottomColour = base, prevRangeTopColour = base;
 
         double gain = m_effectiveGains[ch];
 
-    int m = (h / channels) / 2;
-    int my = m + (((ch - minChannel) * h) / channels);
+        int m = (h / channels) / 2;
+        int my = m + (((ch - minChannel) * h) / channels);
 
-#ifdef DEBUG_WAVEFORM_PAINT
-    cerr << "ch = " << ch << ", channels = " << channels << ", m = " << m << ", my = " << my << ", h = " << h << endl;
+#ifdef DEBUG_WAVEFORM_PAINT     
+        cerr << "ch = " << ch << ", channels = " << channels << ", m = " << m << ", my = " << my << ", h = " << h << endl;
 #endif
 
-    if (my - m > y1 || my + m < y0) continue;
-
         if ((m_scale == dBScale || m_scale == MeterScale) &&
             m_channelMode != MergeChannels) {
             m = (h / channels);
             my = m + (((ch - minChannel) * h) / channels);
         }
 
-    paint->setPen(greys[1]);
-    paint->drawLine(x0, my, x1, my);
+        writer.hline(my, greys[1].rgba());
 
         int n = 10;
         int py = -1;
-
+        
         if (v->hasLightBackground() &&
             v->getViewManager() &&
             v->getViewManager()->shouldShowScaleGuides()) {
 
-            paint->setPen(QColor(240, 240, 240));
+            QRgb guide = qRgb(240, 240, 240);
 
             for (int i = 1; i < n; ++i) {
-
+                
                 double val = 0.0, nval = 0.0;
 
                 switch (m_scale) {
@@ -690,13 +892,13 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                     ny = getYForValue(v, nval, ch);
                 }
 
-                paint->drawLine(x0, y, x1, y);
+                writer.hline(y, guide);
                 if (ny != y) {
-                    paint->drawLine(x0, ny, x1, ny);
+                    writer.hline(ny, guide);
                 }
             }
         }
-
+  
         m_model->getSummaries(ch, frame0, frame1 - frame0,
                               *ranges, modelZoomLevel);
 
@@ -704,7 +906,7 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
         cerr << "channel " << ch << ": " << ranges->size() << " ranges from " << frame0 << " to " << frame1 << " at zoom level " << modelZoomLevel << endl;
 #endif
 
-    if (mergingChannels || mixingChannels) {
+        if (mergingChannels || mixingChannels) {
             if (m_model->getChannelCount() > 1) {
                 if (!otherChannelRanges) {
                     otherChannelRanges =
@@ -717,14 +919,18 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                 if (otherChannelRanges != ranges) delete otherChannelRanges;
                 otherChannelRanges = ranges;
             }
-    }
+        }
 
-    for (int x = x0; x <= x1; ++x) {
+        for (int x = x0; x <= x1; ++x) {
 
-        range = RangeSummarisableTimeValueModel::Range();
+            range = RangeSummarisableTimeValueModel::Range();
 
             sv_frame_t f0, f1;
-            if (!getSourceFramesForX(v, x, modelZoomLevel, f0, f1)) continue;
+            if (!getSourceFramesForViewFrames(viewFrames[x + 1],
+                                              viewFrames[x + 2],
+                                              modelZoomLevel, f0, f1)) {
+                continue;
+            }
             f1 = f1 - 1;
 
             if (f0 < frame0) {
@@ -743,50 +949,50 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                 cerr << "WaveformLayer::paint: ERROR: i1 " << i1 << " > i0 " << i0 << " plus one (zoom = " << zoomLevel << ", model zoom = " << modelZoomLevel << ")" << endl;
             }
 
-        if (ranges && i0 < (sv_frame_t)ranges->size()) {
+            if (ranges && i0 < (sv_frame_t)ranges->size()) {
 
-        range = (*ranges)[size_t(i0)];
+                range = (*ranges)[size_t(i0)];
 
-        if (i1 > i0 && i1 < (int)ranges->size()) {
-            range.setMax(std::max(range.max(),
+                if (i1 > i0 && i1 < (int)ranges->size()) {
+                    range.setMax(std::max(range.max(),
                                           (*ranges)[size_t(i1)].max()));
-            range.setMin(std::min(range.min(),
+                    range.setMin(std::min(range.min(),
                                           (*ranges)[size_t(i1)].min()));
-            range.setAbsmean((range.absmean()
+                    range.setAbsmean((range.absmean()
                                       + (*ranges)[size_t(i1)].absmean()) / 2);
-        }
+                }
 
-        } else {
+            } else {
 #ifdef DEBUG_WAVEFORM_PAINT
                 cerr << "No (or not enough) ranges for i0 = " << i0 << endl;
 #endif
-        continue;
-        }
+                continue;
+            }
 
-        int rangeBottom = 0, rangeTop = 0, meanBottom = 0, meanTop = 0;
+            int rangeBottom = 0, rangeTop = 0, meanBottom = 0, meanTop = 0;
 
-        if (mergingChannels) {
+            if (mergingChannels) {
 
-        if (otherChannelRanges && i0 < (sv_frame_t)otherChannelRanges->size()) {
+                if (otherChannelRanges && i0 < (sv_frame_t)otherChannelRanges->size()) {
 
-            range.setMax(fabsf(range.max()));
-            range.setMin(-fabsf((*otherChannelRanges)[size_t(i0)].max()));
-            range.setAbsmean
+                    range.setMax(fabsf(range.max()));
+                    range.setMin(-fabsf((*otherChannelRanges)[size_t(i0)].max()));
+                    range.setAbsmean
                         ((range.absmean() +
                           (*otherChannelRanges)[size_t(i0)].absmean()) / 2);
 
-            if (i1 > i0 && i1 < (sv_frame_t)otherChannelRanges->size()) {
-            // let's not concern ourselves about the mean
-            range.setMin
+                    if (i1 > i0 && i1 < (sv_frame_t)otherChannelRanges->size()) {
+                        // let's not concern ourselves about the mean
+                        range.setMin
                             (std::min
                              (range.min(),
                               -fabsf((*otherChannelRanges)[size_t(i1)].max())));
-            }
-        }
+                    }
+                }
 
-        } else if (mixingChannels) {
+            } else if (mixingChannels) {
 
-        if (otherChannelRanges && i0 < (sv_frame_t)otherChannelRanges->size()) {
+                if (otherChannelRanges && i0 < (sv_frame_t)otherChannelRanges->size()) {
 
                     range.setMax((range.max()
                                   + (*otherChannelRanges)[size_t(i0)].max()) / 2);
@@ -797,19 +1003,19 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                 }
             }
 
-        int greyLevels = 1;
-        if (m_greyscale && (m_scale == LinearScale)) greyLevels = 4;
+            int greyLevels = 1;
+            if (m_greyscale && (m_scale == LinearScale)) greyLevels = 4;
 
-        switch (m_scale) {
+            switch (m_scale) {
 
-        case LinearScale:
-        rangeBottom = int(double(m * greyLevels) * range.min() * gain);
-        rangeTop    = int(double(m * greyLevels) * range.max() * gain);
-        meanBottom  = int(double(-m) * range.absmean() * gain);
-        meanTop     = int(double(m) * range.absmean() * gain);
-        break;
+            case LinearScale:
+                rangeBottom = int(double(m * greyLevels) * range.min() * gain);
+                rangeTop    = int(double(m * greyLevels) * range.max() * gain);
+                meanBottom  = int(double(-m) * range.absmean() * gain);
+                meanTop     = int(double(m) * range.absmean() * gain);
+                break;
 
-        case dBScale:
+            case dBScale:
                 if (!mergingChannels) {
                     int db0 = dBscale(range.min() * gain, m);
                     int db1 = dBscale(range.max() * gain, m);
@@ -824,9 +1030,9 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                     meanBottom  = -dBscale(range.absmean() * gain, m);
                     meanTop     =  dBscale(range.absmean() * gain, m);
                 }
-        break;
+                break;
 
-        case MeterScale:
+            case MeterScale:
                 if (!mergingChannels) {
                     int r0 = abs(AudioLevel::multiplier_to_preview(range.min() * gain, m));
                     int r1 = abs(AudioLevel::multiplier_to_preview(range.max() * gain, m));
@@ -842,129 +1048,100 @@ WaveformLayer::paint(LayerGeometryProvider *v, QPainter &viewPainter, QRect rect
                     meanTop     =  AudioLevel::multiplier_to_preview(range.absmean() * gain, m);
                 }
                 break;
-        }
-
-        rangeBottom = my * greyLevels - rangeBottom;
-        rangeTop    = my * greyLevels - rangeTop;
-        meanBottom  = my - meanBottom;
-        meanTop     = my - meanTop;
+            }
 
-        int topFill = (rangeTop % greyLevels);
-        if (topFill > 0) topFill = greyLevels - topFill;
+            rangeBottom = my * greyLevels - rangeBottom;
+            rangeTop    = my * greyLevels - rangeTop;
+            meanBottom  = my - meanBottom;
+            meanTop     = my - meanTop;
 
-        int bottomFill = (rangeBottom % greyLevels);
+            int topFill = (rangeTop % greyLevels);
+            if (topFill > 0) topFill = greyLevels - topFill;
 
-        rangeTop = rangeTop / greyLevels;
-        rangeBottom = rangeBottom / greyLevels;
+            int bottomFill = (rangeBottom % greyLevels);
 
-        bool clipped = false;
+            rangeTop = rangeTop / greyLevels;
+            rangeBottom = rangeBottom / greyLevels;
 
-        if (rangeTop < my - m) { rangeTop = my - m; }
-        if (rangeTop > my + m) { rangeTop = my + m; }
-        if (rangeBottom < my - m) { rangeBottom = my - m; }
-        if (rangeBottom > my + m) { rangeBottom = my + m; }
+            bool clipped = false;
 
-        if (range.max() <= -1.0 ||
-        range.max() >= 1.0) clipped = true;
+            if (rangeTop < my - m) { rangeTop = my - m; }
+            if (rangeTop > my + m) { rangeTop = my + m; }
+            if (rangeBottom < my - m) { rangeBottom = my - m; }
+            if (rangeBottom > my + m) { rangeBottom = my + m; }
 
-        if (meanBottom > rangeBottom) meanBottom = rangeBottom;
-        if (meanTop < rangeTop) meanTop = rangeTop;
+            if (range.max() <= -1.0 ||
+                range.max() >= 1.0) clipped = true;
+            
+            if (meanBottom > rangeBottom) meanBottom = rangeBottom;
+            if (meanTop < rangeTop) meanTop = rangeTop;
 
-        bool drawMean = m_showMeans;
-        if (meanTop == rangeTop) {
-        if (meanTop < meanBottom) ++meanTop;
-        else drawMean = false;
-        }
-        if (meanBottom == rangeBottom && m_scale == LinearScale) {
-        if (meanBottom > meanTop) --meanBottom;
-        else drawMean = false;
-        }
+            bool drawMean = m_showMeans;
+            if (meanTop == rangeTop) {
+                if (meanTop < meanBottom) ++meanTop;
+                else drawMean = false;
+            }
+            if (meanBottom == rangeBottom && m_scale == LinearScale) {
+                if (meanBottom > meanTop) --meanBottom;
+                else drawMean = false;
+            }
 
-        if (x != x0 && prevRangeBottom != -1) {
-        if (prevRangeBottom > rangeBottom + 1 &&
-            prevRangeTop    > rangeBottom + 1) {
-//		    paint->setPen(midColour);
-            paint->setPen(baseColour);
-            paint->drawLine(x-1, prevRangeTop, x, rangeBottom + 1);
-            paint->setPen(prevRangeTopColour);
-            paint->drawPoint(x-1, prevRangeTop);
-        } else if (prevRangeBottom < rangeTop - 1 &&
-               prevRangeTop    < rangeTop - 1) {
-//		    paint->setPen(midColour);
-            paint->setPen(baseColour);
-            paint->drawLine(x-1, prevRangeBottom, x, rangeTop - 1);
-            paint->setPen(prevRangeBottomColour);
-            paint->drawPoint(x-1, prevRangeBottom);
-        }
-        }
+            if (x != x0 && prevRangeBottom != -1) {
+                if (prevRangeBottom > rangeBottom + 1 &&
+                    prevRangeTop    > rangeBottom + 1) {
+                    writer.line(x-1, prevRangeTop, x, rangeBottom + 1, base);
+                    writer.point(x-1, prevRangeTop, prevRangeTopColour);
+                } else if (prevRangeBottom < rangeTop - 1 &&
+                           prevRangeTop    < rangeTop - 1) {
+                    writer.line(x-1, prevRangeBottom, x, rangeTop - 1, base);
+                    writer.point(x-1, prevRangeBottom, prevRangeBottomColour);
+                }
+            }
 
-        if (ready) {
-        if (clipped /*!!! ||
-            range.min() * gain <= -1.0 ||
-            range.max() * gain >=  1.0 */) {
-            paint->setPen(Qt::red); //!!! getContrastingColour
-        } else {
-            paint->setPen(baseColour);
-        }
-        } else {
-        paint->setPen(midColour);
-        }
+            QRgb rangeColour = mid;
+            if (ready) {
+                if (clipped /*!!! ||
+                    range.min() * gain <= -1.0 ||
+                    range.max() * gain >=  1.0 */) {
+                    rangeColour = clip;
+                } else {
+                    rangeColour = base;
+                }
+            }
 
 #ifdef DEBUG_WAVEFORM_PAINT
             cerr << "range " << rangeBottom << " -> " << rangeTop << ", means " << meanBottom << " -> " << meanTop << ", raw range " << range.min() << " -> " << range.max() << endl;
 #endif
 
-            if (rangeTop == rangeBottom) {
-                paint->drawPoint(x, rangeTop);
-            } else {
-                paint->drawLine(x, rangeBottom, x, rangeTop);
-            }
-
-        prevRangeTopColour = baseColour;
-        prevRangeBottomColour = baseColour;
-
-        if (m_greyscale && (m_scale == LinearScale) && ready) {
-        if (!clipped) {
-            if (rangeTop < rangeBottom) {
-            if (topFill > 0 &&
-                (!drawMean || (rangeTop < meanTop - 1))) {
-                paint->setPen(greys[topFill - 1]);
-                paint->drawPoint(x, rangeTop);
-                prevRangeTopColour = greys[topFill - 1];
-            }
-            if (bottomFill > 0 &&
-                (!drawMean || (rangeBottom > meanBottom + 1))) {
-                paint->setPen(greys[bottomFill - 1]);
-                paint->drawPoint(x, rangeBottom);
-                prevRangeBottomColour = greys[bottomFill - 1];
+            writer.vline(x, rangeBottom, rangeTop, rangeColour);
+
+            prevRangeTopColour = base;
+            prevRangeBottomColour = base;
+
+            if (m_greyscale && (m_scale == LinearScale) && ready) {
+                if (!clipped) {
+                    if (rangeTop < rangeBottom) {
+                        if (topFill > 0 &&
+                            (!drawMean || (rangeTop < meanTop - 1))) {
+                            prevRangeTopColour = greys[topFill - 1].rgba();
+                            writer.point(x, rangeTop, prevRangeTopColour);
+                        }
+                        if (bottomFill > 0 && 
+                            (!drawMean || (rangeBottom > meanBottom + 1))) {
+                            prevRangeBottomColour = greys[bottomFill - 1].rgba();
+                            writer.point(x, rangeBottom, prevRangeBottomColour);
+                        }
+                    }
+                }
             }
+            
+            if (drawMean) {
+                writer.vline(x, meanBottom, meanTop, mid);
             }
+        
+            prevRangeBottom = rangeBottom;
+            prevRangeTop = rangeTop;
         }
-        }
-
-        if (drawMean) {
-        paint->setPen(midColour);
-        paint->drawLine(x, meanBottom, x, meanTop);
-        }
-
-        prevRangeBottom = rangeBottom;
-        prevRangeTop = rangeTop;
-    }
-    }
-
-    if (m_middleLineHeight != 0.5) {
-        paint->restore();
-    }
-
-    if (m_aggressive) {
-
-    if (ready && rect == v->getPaintRect()) {
-        m_cacheValid = true;
-        m_cacheZoomLevel = zoomLevel;
-    }
-    paint->end();
-    delete paint;
-    viewPainter.drawPixmap(rect, *m_cache, rect);
     }
 
     if (otherChannelRanges != ranges) delete otherChannelRanges;
@@ -17,14 +17,18 @@
 #define _WAVEFORM_LAYER_H_
 
 #include <QRect>
+#include <QImage>
 
 #include "SingleColourLayer.h"
 
 #include "data/model/RangeSummarisableTimeValueModel.h"
 
+#include <map>
+#include <list>
+#include <vector>
+
 class View;
 class QPainter;
-class QPixmap;
 
 class WaveformLayer : public SingleColourLayer
 {
@@ -160,14 +164,12 @@ public:
     double getMiddleLineHeight() const { return m_middleLineHeight; }
 
     /**
-     * Enable or disable aggressive pixmap cacheing.  If enabled,
-     * waveforms will be rendered to an off-screen pixmap and
-     * refreshed from there instead of being redrawn from the peak
-     * data each time.  This may be faster if the data and zoom level
-     * do not change often, but it may be slower for frequently zoomed
-     * data and it will only work if the waveform is the "bottom"
-     * layer on the displayed widget, as each refresh will erase
-     * anything beneath the waveform.
+     * Enable or disable aggressive cacheing.  If enabled, each
+     * refresh fills the background before drawing the waveform from
+     * the tile cache, so the waveform never needs to be composited
+     * with anything painted beneath it.  This will only work if the
+     * waveform is the "bottom" layer on the displayed widget, as each
+     * refresh will erase anything beneath the waveform.
      *
      * This is intended specifically for a panner widget display in
      * which the waveform never moves, zooms, or changes, but some
@@ -182,6 +184,8 @@ public:
 
     virtual bool isLayerScrollable(const LayerGeometryProvider *) const;
 
+    virtual bool isLayerChangeLocal() const { return true; }
+
     virtual int getCompletion(LayerGeometryProvider *) const;
 
     virtual bool getValueExtents(double &min, double &max,
@@ -204,6 +208,10 @@ public:
 
     virtual bool canExistWithoutModel() const { return true; }
 
+protected slots:
+    void cacheInvalid();
+    void cacheInvalid(sv_frame_t startFrame, sv_frame_t endFrame);
+
 protected:
     int dBscale(double sample, int m) const;
 
@@ -220,9 +228,14 @@ protected:
     bool getSourceFramesForX(LayerGeometryProvider *v, int x, int modelZoomLevel,
                              sv_frame_t &f0, sv_frame_t &f1) const;
 
+    bool getSourceFramesForViewFrames(sv_frame_t viewFrame0,
+                                      sv_frame_t viewFrame1,
+                                      int modelZoomLevel,
+                                      sv_frame_t &f0, sv_frame_t &f1) const;
+
     float getNormalizeGain(LayerGeometryProvider *v, int channel) const;
 
-    virtual void flagBaseColourChanged() { m_cacheValid = false; }
+    virtual void flagBaseColourChanged() { clearTiles(); }
 
     float        m_gain;
     bool         m_autoNormalize;
@@ -236,9 +249,52 @@ protected:
 
     mutable std::vector<float> m_effectiveGains;
 
-    mutable QPixmap *m_cache;
-    mutable bool m_cacheValid;
-    mutable int m_cacheZoomLevel;
+    /**
+     * Render the waveform into image, one pixel column at a time,
+     * writing directly into its scanlines. viewFrames must contain
+     * image.width() + 2 frames: the left edge of a column just before
+     * the image (which is used only to join up with the first column)
+     * followed by the left edge of each image column and then the
+     * right edge of the last one.
+     */
+    void renderColumns(LayerGeometryProvider *v, QImage &image,
+                       const std::vector<sv_frame_t> &viewFrames,
+                       int zoomLevel, bool ready) const;
+
+    /**
+     * The waveform is cached in tiles of a fixed number of pixel
+     * columns, numbered from frame zero at the tile's zoom level.
+     * Properties that are commonly toggled back and forth are part of
+     * the key, so that returning to an earlier setting finds its
+     * tiles still present; changing any other property clears the
+     * cache.
+     */
+    struct TileKey {
+        int zoomLevel;
+        int height;
+        int channelMode;
+        int channel;
+        int scale;
+        float gain;
+        bool lightBackground;
+        bool scaleGuides;
+        sv_frame_t index;
+        bool operator<(const TileKey &) const;
+    };
+
+    struct Tile {
+        QImage image;
+        std::list<TileKey>::iterator lruPosition;
+    };
+
+    typedef std::map<TileKey, Tile> TileMap;
+
+    mutable TileMap m_tiles;
+    mutable std::list<TileKey> m_tileLru; // most recently used first
+    mutable sv_frame_t m_tileBytes;
+
+    const QImage &getTile(LayerGeometryProvider *v, const TileKey &key) const;
+    void clearTiles() const;
 };
 
 #endif
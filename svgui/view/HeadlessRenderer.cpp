@@ -0,0 +1,450 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "HeadlessRenderer.h"
+
+#include "OffscreenGeometryProvider.h"
+#include "ViewManager.h"
+
+#include "layer/Layer.h"
+#include "layer/LayerFactory.h"
+#include "data/model/Model.h"
+#include "base/Profiler.h"
+#include "base/Debug.h"
+#include "system/System.h"
+
+#include <QCoreApplication>
+#include <QPainter>
+#include <QFileInfo>
+#include <QDir>
+#include <QDomDocument>
+#include <QXmlAttributes>
+
+//#define DEBUG_HEADLESS_RENDERER 1
+
+HeadlessRenderer::HeadlessRenderer(ViewManager *manager,
+                                   const std::vector<Layer *> &layers,
+                                   int zoomLevel,
+                                   int height) :
+    m_manager(manager),
+    m_layers(layers),
+    m_zoomLevel(zoomLevel < 1 ? 1 : zoomLevel),
+    m_height(height),
+    m_stripWidth(1024),
+    m_threadCount(QThread::idealThreadCount()),
+    m_x0(0),
+    m_stripCount(0),
+    m_nextStrip(0),
+    m_deliveredStrips(0),
+    m_abandoned(false)
+{
+    if (m_threadCount < 1) m_threadCount = 1;
+}
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+}
+
+void
+HeadlessRenderer::setStripWidth(int width)
+{
+    m_stripWidth = (width < 1 ? 1 : width);
+}
+
+void
+HeadlessRenderer::setThreadCount(int threads)
+{
+    m_threadCount = (threads < 1 ? 1 : threads);
+}
+
+sv_frame_t
+HeadlessRenderer::getModelsStartFrame() const
+{
+    OffscreenGeometryProvider provider(m_manager, m_layers, m_zoomLevel,
+                                       QSize(m_stripWidth, m_height));
+    return provider.getModelsStartFrame();
+}
+
+sv_frame_t
+HeadlessRenderer::getModelsEndFrame() const
+{
+    OffscreenGeometryProvider provider(m_manager, m_layers, m_zoomLevel,
+                                       QSize(m_stripWidth, m_height));
+    return provider.getModelsEndFrame();
+}
+
+QSize
+HeadlessRenderer::getRenderedImageSize() const
+{
+    return getRenderedPartImageSize(getModelsStartFrame(),
+                                    getModelsEndFrame());
+}
+
+QSize
+HeadlessRenderer::getRenderedPartImageSize(sv_frame_t f0, sv_frame_t f1) const
+{
+    int x0 = int(f0 / m_zoomLevel);
+    int x1 = int(f1 / m_zoomLevel);
+
+    return QSize(x1 - x0, m_height);
+}
+
+Layer *
+HeadlessRenderer::copyLayer(const Layer *layer) const
+{
+    // Make a new layer of the same type with the same model, and copy
+    // the properties across through the layer's XML attributes, as
+    // LayerFactory::setLayerDefaultProperties does
+
+    LayerFactory *factory = LayerFactory::getInstance();
+
+    Layer *copy = factory->createLayer(factory->getLayerType(layer));
+    if (!copy) return 0;
+
+    QDomDocument doc;
+    if (doc.setContent(layer->toXmlString(), false)) {
+        QXmlAttributes attrs;
+        QDomElement layerElt = doc.firstChildElement("layer");
+        QDomNamedNodeMap attrNodes = layerElt.attributes();
+        for (int i = 0; i < attrNodes.length(); ++i) {
+            QDomAttr attr = attrNodes.item(i).toAttr();
+            if (attr.isNull()) continue;
+            attrs.append(attr.name(), "", "", attr.value());
+        }
+        copy->setProperties(attrs);
+    }
+
+    factory->setModel(copy, const_cast<Model *>(layer->getModel()));
+    copy->setSynchronousPainting(true);
+
+    return copy;
+}
+
+bool
+HeadlessRenderer::waitForLayers()
+{
+    OffscreenGeometryProvider provider(m_manager, m_layers, m_zoomLevel,
+                                       QSize(m_stripWidth, m_height));
+
+    while (true) {
+
+        bool complete = true;
+
+        for (int i = 0; i < int(m_layers.size()); ++i) {
+            const Model *model = m_layers[i]->getModel();
+            if (!model) continue;
+            if (!model->isOK()) {
+                SVCERR << "HeadlessRenderer: model for layer " << i
+                       << " is not OK, cannot render" << endl;
+                return false;
+            }
+            if (!model->isReady() ||
+                m_layers[i]->getCompletion(&provider) < 100) {
+                complete = false;
+            }
+        }
+
+        if (complete) return true;
+
+        // Models are often filled by background threads that report
+        // back through queued signals, so keep events moving
+        QCoreApplication::processEvents();
+        usleep(50000);
+    }
+}
+
+bool
+HeadlessRenderer::render(sv_frame_t f0, sv_frame_t f1, StripHandler *handler)
+{
+    Profiler profiler("HeadlessRenderer::render");
+
+    if (!waitForLayers()) return false;
+
+    int w = getRenderedPartImageSize(f0, f1).width();
+    if (w <= 0 || m_height <= 0) return false;
+
+    m_x0 = f0 / m_zoomLevel;
+    m_stripCount = (w + m_stripWidth - 1) / m_stripWidth;
+    m_nextStrip = 0;
+    m_deliveredStrips = 0;
+    m_abandoned = false;
+    m_completed.clear();
+
+    int threadCount = m_threadCount;
+    if (threadCount > m_stripCount) threadCount = m_stripCount;
+
+    std::vector<StripThread *> threads;
+
+    for (int t = 0; t < threadCount; ++t) {
+        std::vector<Layer *> copies;
+        for (int i = 0; i < int(m_layers.size()); ++i) {
+            Layer *copy = copyLayer(m_layers[i]);
+            if (copy) copies.push_back(copy);
+        }
+        threads.push_back(new StripThread(this, copies));
+    }
+
+#ifdef DEBUG_HEADLESS_RENDERER
+    SVDEBUG << "HeadlessRenderer::render: " << w << "x" << m_height
+            << " pixels in " << m_stripCount << " strips on "
+            << threadCount << " threads" << endl;
+#endif
+
+    for (int t = 0; t < int(threads.size()); ++t) {
+        threads[t]->start();
+    }
+
+    bool ok = true;
+
+    while (m_deliveredStrips < m_stripCount) {
+
+        QImage strip;
+
+        m_mutex.lock();
+        while (m_completed.find(m_deliveredStrips) == m_completed.end()) {
+            m_condition.wait(&m_mutex);
+        }
+        strip = m_completed[m_deliveredStrips];
+        m_completed.erase(m_deliveredStrips);
+        m_mutex.unlock();
+
+        int x = m_deliveredStrips * m_stripWidth;
+        if (x + strip.width() > w) {
+            strip = strip.copy(0, 0, w - x, m_height);
+        }
+
+        ok = handler->stripRendered(x, strip);
+
+        m_mutex.lock();
+        ++m_deliveredStrips;
+        if (!ok) m_abandoned = true;
+        m_condition.wakeAll();
+        m_mutex.unlock();
+
+        if (!ok) break;
+    }
+
+    for (int t = 0; t < int(threads.size()); ++t) {
+        threads[t]->wait();
+        delete threads[t];
+    }
+
+    m_completed.clear();
+    return ok;
+}
+
+HeadlessRenderer::StripThread::StripThread(HeadlessRenderer *renderer,
+                                           const std::vector<Layer *> &layers) :
+    m_renderer(renderer),
+    m_layers(layers)
+{
+    m_provider = new OffscreenGeometryProvider
+        (renderer->m_manager, m_layers, renderer->m_zoomLevel,
+         QSize(renderer->m_stripWidth, renderer->m_height));
+}
+
+HeadlessRenderer::StripThread::~StripThread()
+{
+    delete m_provider;
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        delete m_layers[i];
+    }
+}
+
+void
+HeadlessRenderer::StripThread::run()
+{
+    HeadlessRenderer *r = m_renderer;
+
+    // Don't run too far ahead of the strips that have been handed
+    // back, so as to bound the number held in memory
+    int window = r->m_threadCount * 2;
+
+    while (true) {
+
+        int index;
+
+        r->m_mutex.lock();
+        while (!r->m_abandoned &&
+               r->m_nextStrip < r->m_stripCount &&
+               r->m_nextStrip >= r->m_deliveredStrips + window) {
+            r->m_condition.wait(&r->m_mutex);
+        }
+        if (r->m_abandoned || r->m_nextStrip >= r->m_stripCount) {
+            r->m_mutex.unlock();
+            return;
+        }
+        index = r->m_nextStrip++;
+        r->m_mutex.unlock();
+
+        QImage strip = renderStrip(index);
+
+        r->m_mutex.lock();
+        r->m_completed[index] = strip;
+        r->m_condition.wakeAll();
+        r->m_mutex.unlock();
+    }
+}
+
+QImage
+HeadlessRenderer::StripThread::renderStrip(int index)
+{
+    Profiler profiler("HeadlessRenderer::StripThread::renderStrip");
+
+    int width = m_renderer->m_stripWidth;
+    int height = m_renderer->m_height;
+    sv_frame_t zoom = m_renderer->m_zoomLevel;
+
+    m_provider->setStartFrame((m_renderer->m_x0 + sv_frame_t(index) * width)
+                              * zoom);
+
+    QImage image(width, height, QImage::Format_RGB32);
+    QPainter paint(&image);
+
+    QRect rect(0, 0, width, height);
+
+    paint.setPen(m_provider->getBackground());
+    paint.setBrush(m_provider->getBackground());
+    paint.drawRect(rect);
+
+    paint.setPen(m_provider->getForeground());
+    paint.setBrush(Qt::NoBrush);
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        if (m_layers[i]->isLayerDormant(m_provider)) continue;
+        paint.setRenderHint(QPainter::Antialiasing, false);
+        paint.save();
+        m_layers[i]->paint(m_provider, paint, rect);
+        paint.restore();
+    }
+
+    paint.end();
+    return image;
+}
+
+QImage *
+HeadlessRenderer::renderToNewImage()
+{
+    return renderPartToNewImage(getModelsStartFrame(), getModelsEndFrame());
+}
+
+namespace {
+
+class ImageAssembler : public HeadlessRenderer::StripHandler
+{
+public:
+    ImageAssembler(QImage *image) : m_paint(image) { }
+
+    virtual bool stripRendered(int x, const QImage &strip) {
+        m_paint.drawImage(x, 0, strip);
+        return true;
+    }
+
+private:
+    QPainter m_paint;
+};
+
+class StripFileWriter : public HeadlessRenderer::StripHandler
+{
+public:
+    StripFileWriter(QString filename) : m_index(0) {
+        QFileInfo fi(filename);
+        m_stem = fi.dir().filePath(fi.completeBaseName());
+        m_suffix = fi.suffix();
+        if (m_suffix == "") m_suffix = "png";
+    }
+
+    virtual bool stripRendered(int, const QImage &strip) {
+        QString filename = QString("%1-%2.%3")
+            .arg(m_stem).arg(m_index, 4, 10, QChar('0')).arg(m_suffix);
+        ++m_index;
+        if (!strip.save(filename)) {
+            SVCERR << "HeadlessRenderer: failed to write image file \""
+                   << filename << "\"" << endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    QString m_stem;
+    QString m_suffix;
+    int m_index;
+};
+
+}
+
+QImage *
+HeadlessRenderer::renderPartToNewImage(sv_frame_t f0, sv_frame_t f1)
+{
+    QSize size = getRenderedPartImageSize(f0, f1);
+    if (size.width() <= 0 || size.height() <= 0) return 0;
+
+    QImage *image = new QImage(size, QImage::Format_RGB32);
+    if (image->isNull()) { // too large to allocate
+        delete image;
+        return 0;
+    }
+
+    bool ok;
+    {
+        ImageAssembler assembler(image);
+        ok = render(f0, f1, &assembler);
+    }
+
+    if (!ok) {
+        delete image;
+        return 0;
+    }
+    return image;
+}
+
+bool
+HeadlessRenderer::renderToImageFile(QString filename)
+{
+    return renderPartToImageFile(filename,
+                                 getModelsStartFrame(), getModelsEndFrame());
+}
+
+bool
+HeadlessRenderer::renderPartToImageFile(QString filename,
+                                        sv_frame_t f0, sv_frame_t f1)
+{
+    QImage *image = renderPartToNewImage(f0, f1);
+    if (!image) return false;
+
+    bool ok = image->save(filename);
+    if (!ok) {
+        SVCERR << "HeadlessRenderer: failed to write image file \""
+               << filename << "\"" << endl;
+    }
+
+    delete image;
+    return ok;
+}
+
+bool
+HeadlessRenderer::renderToStripFiles(QString filename)
+{
+    return renderPartToStripFiles(filename,
+                                  getModelsStartFrame(), getModelsEndFrame());
+}
+
+bool
+HeadlessRenderer::renderPartToStripFiles(QString filename,
+                                         sv_frame_t f0, sv_frame_t f1)
+{
+    StripFileWriter writer(filename);
+    return render(f0, f1, &writer);
+}
@@ -0,0 +1,174 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef HEADLESS_RENDERER_H
+#define HEADLESS_RENDERER_H
+
+#include "base/BaseTypes.h"
+#include "base/Thread.h"
+
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+
+#include <vector>
+#include <map>
+
+class Layer;
+class ViewManager;
+class OffscreenGeometryProvider;
+
+/**
+ * Render a stack of layers to an image without a View, for export
+ * from batch or command-line tools. This does the same job as
+ * View::renderPartToNewImage, but it does not need a widget or the
+ * GUI thread, and it renders the image in vertical strips on several
+ * threads at once.
+ *
+ * Layers cache per-view state while painting and are not safe to
+ * paint from more than one thread, so each rendering thread paints
+ * its own copies of the layers (made through LayerFactory, with the
+ * same model and properties) against its own
+ * OffscreenGeometryProvider. The layers passed in are never painted
+ * and may continue to be used elsewhere, but their models must not
+ * be deleted while rendering is going on.
+ *
+ * Strips are handed back in left-to-right order as they complete,
+ * and only a few more strips than there are threads are held in
+ * memory at once, so very wide images can be written to disc strip
+ * by strip without ever being assembled in full.
+ *
+ * The render functions must be called from the thread that owns the
+ * layers and models (normally the main thread) with a
+ * QApplication in existence, as they process events while waiting
+ * for models to finish loading. A display is not needed: the
+ * "offscreen" Qt platform plugin will do.
+ */
+class HeadlessRenderer
+{
+public:
+    /**
+     * Create a renderer for the given layers, bottom layer first, at
+     * the given zoom level (frames per pixel) and image height.
+     */
+    HeadlessRenderer(ViewManager *manager,
+                     const std::vector<Layer *> &layers,
+                     int zoomLevel,
+                     int height);
+    virtual ~HeadlessRenderer();
+
+    /**
+     * Set the width in pixels of each strip. The default is 1024.
+     */
+    void setStripWidth(int width);
+
+    /**
+     * Set the number of rendering threads. The default is the ideal
+     * thread count reported by Qt.
+     */
+    void setThreadCount(int threads);
+
+    class StripHandler
+    {
+    public:
+        virtual ~StripHandler() { }
+
+        /**
+         * Called once for each strip of the image, in left-to-right
+         * order, from the thread that called render(). x is the
+         * strip's left edge within the full image. Return false to
+         * abandon rendering.
+         */
+        virtual bool stripRendered(int x, const QImage &strip) = 0;
+    };
+
+    /**
+     * Render the part of the layers between frames f0 and f1,
+     * passing each strip to the given handler. Return false if any
+     * of the layers is unusable or the handler abandoned rendering.
+     */
+    bool render(sv_frame_t f0, sv_frame_t f1, StripHandler *handler);
+
+    QSize getRenderedImageSize() const;
+    QSize getRenderedPartImageSize(sv_frame_t f0, sv_frame_t f1) const;
+
+    /**
+     * Render the whole extent of the layers' models into a single new
+     * image. Caller takes ownership. Return 0 on failure.
+     */
+    QImage *renderToNewImage();
+    QImage *renderPartToNewImage(sv_frame_t f0, sv_frame_t f1);
+
+    /**
+     * Render the whole extent of the layers' models into a single
+     * image file, whose format is taken from the file extension.
+     */
+    bool renderToImageFile(QString filename);
+    bool renderPartToImageFile(QString filename, sv_frame_t f0, sv_frame_t f1);
+
+    /**
+     * Render the whole extent of the layers' models into a series of
+     * image files, one per strip, written as each strip completes.
+     * The strip number is inserted before the extension of the given
+     * filename, e.g. "out.png" becomes "out-0000.png", "out-0001.png"
+     * and so on. Use this for images too wide to hold in memory at
+     * once.
+     */
+    bool renderToStripFiles(QString filename);
+    bool renderPartToStripFiles(QString filename, sv_frame_t f0, sv_frame_t f1);
+
+    sv_frame_t getModelsStartFrame() const;
+    sv_frame_t getModelsEndFrame() const;
+
+private:
+    class StripThread : public Thread
+    {
+    public:
+        StripThread(HeadlessRenderer *renderer,
+                    const std::vector<Layer *> &layers);
+        virtual ~StripThread();
+
+        virtual void run();
+
+    private:
+        HeadlessRenderer *m_renderer;
+        std::vector<Layer *> m_layers; // our own copies
+        OffscreenGeometryProvider *m_provider;
+
+        QImage renderStrip(int index);
+    };
+
+    ViewManager *m_manager;
+    std::vector<Layer *> m_layers;
+    int m_zoomLevel;
+    int m_height;
+    int m_stripWidth;
+    int m_threadCount;
+
+    // State shared with the strip threads during render()
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    sv_frame_t m_x0;
+    int m_stripCount;
+    int m_nextStrip;
+    int m_deliveredStrips;
+    bool m_abandoned;
+    std::map<int, QImage> m_completed;
+
+    bool waitForLayers();
+    Layer *copyLayer(const Layer *layer) const;
+};
+
+#endif
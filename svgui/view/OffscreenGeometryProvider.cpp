@@ -0,0 +1,262 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "OffscreenGeometryProvider.h"
+
+#include "ViewManager.h"
+#include "layer/Layer.h"
+#include "data/model/Model.h"
+
+#include <cmath>
+
+OffscreenGeometryProvider::OffscreenGeometryProvider(ViewManager *manager,
+                                                     const std::vector<Layer *> &layers,
+                                                     int zoomLevel,
+                                                     QSize size) :
+    m_id(getNextId()),
+    m_manager(manager),
+    m_layers(layers),
+    m_zoomLevel(zoomLevel < 1 ? 1 : zoomLevel),
+    m_size(size),
+    m_startFrame(0)
+{
+}
+
+OffscreenGeometryProvider::~OffscreenGeometryProvider()
+{
+}
+
+void
+OffscreenGeometryProvider::setStartFrame(sv_frame_t frame)
+{
+    sv_frame_t z = m_zoomLevel;
+    m_startFrame = (frame / z) * z;
+}
+
+sv_frame_t
+OffscreenGeometryProvider::getCentreFrame() const
+{
+    return getFrameForX(m_size.width() / 2);
+}
+
+sv_frame_t
+OffscreenGeometryProvider::getEndFrame() const
+{
+    return getFrameForX(m_size.width()) - 1;
+}
+
+int
+OffscreenGeometryProvider::getXForFrame(sv_frame_t frame) const
+{
+    return int((frame - m_startFrame) / m_zoomLevel);
+}
+
+sv_frame_t
+OffscreenGeometryProvider::getFrameForX(int x) const
+{
+    sv_frame_t z = m_zoomLevel; // nb not just int, or multiplication may overflow
+    return m_startFrame + x * z;
+}
+
+sv_frame_t
+OffscreenGeometryProvider::getModelsStartFrame() const
+{
+    bool first = true;
+    sv_frame_t startFrame = 0;
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        Layer *layer = m_layers[i];
+        const Model *model = layer->getModel();
+        if (!model || !model->isOK()) continue;
+        if (first || model->getStartFrame() < startFrame) {
+            startFrame = model->getStartFrame();
+        }
+        first = false;
+    }
+
+    return startFrame;
+}
+
+sv_frame_t
+OffscreenGeometryProvider::getModelsEndFrame() const
+{
+    bool first = true;
+    sv_frame_t endFrame = 0;
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        Layer *layer = m_layers[i];
+        const Model *model = layer->getModel();
+        if (!model || !model->isOK()) continue;
+        if (first || model->getEndFrame() > endFrame) {
+            endFrame = model->getEndFrame();
+        }
+        first = false;
+    }
+
+    if (first) return getModelsStartFrame();
+    return endFrame;
+}
+
+double
+OffscreenGeometryProvider::getYForFrequency(double frequency,
+                                            double minf,
+                                            double maxf,
+                                            bool logarithmic) const
+{
+    // As View::getYForFrequency, but without the static log caches
+    // that make that one unsafe to call from more than one thread
+
+    double h = m_size.height();
+
+    if (logarithmic) {
+        if (minf <= 0.0) minf = 1.0;
+        if (maxf < minf) maxf = minf;
+        double logminf = log10(minf), logmaxf = log10(maxf);
+        if (logminf == logmaxf) return 0;
+        return h - (h * (log10(frequency) - logminf)) / (logmaxf - logminf);
+    } else {
+        if (minf == maxf) return 0;
+        return h - (h * (frequency - minf)) / (maxf - minf);
+    }
+}
+
+double
+OffscreenGeometryProvider::getFrequencyForY(double y,
+                                            double minf,
+                                            double maxf,
+                                            bool logarithmic) const
+{
+    double h = m_size.height();
+
+    if (logarithmic) {
+        if (minf <= 0.0) minf = 1.0;
+        if (maxf < minf) maxf = minf;
+        double logminf = log10(minf), logmaxf = log10(maxf);
+        if (logminf == logmaxf) return 0;
+        return pow(10.0, logminf + ((logmaxf - logminf) * (h - y)) / h);
+    } else {
+        if (minf == maxf) return 0;
+        return minf + ((h - y) * (maxf - minf)) / h;
+    }
+}
+
+int
+OffscreenGeometryProvider::getTextLabelHeight(const Layer *layer,
+                                              QPainter &paint) const
+{
+    // View orders these by export id, which for a stack of layers
+    // created together is the same as stack order
+
+    int y = 15 + paint.fontMetrics().ascent();
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        Layer *l = m_layers[i];
+        if (!l->needsTextLabelHeight()) continue;
+        if (l == layer) return y;
+        y += paint.fontMetrics().height();
+    }
+
+    return y;
+}
+
+bool
+OffscreenGeometryProvider::getValueExtents(QString unit,
+                                           double &min, double &max,
+                                           bool &log) const
+{
+    bool have = false;
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        Layer *layer = m_layers[i];
+
+        QString layerUnit;
+        double layerMin = 0.0, layerMax = 0.0;
+        double displayMin = 0.0, displayMax = 0.0;
+        bool layerLog = false;
+
+        if (layer->getValueExtents(layerMin, layerMax, layerLog, layerUnit) &&
+            layerUnit.toLower() == unit.toLower()) {
+
+            if (layer->getDisplayExtents(displayMin, displayMax)) {
+
+                min = displayMin;
+                max = displayMax;
+                log = layerLog;
+                have = true;
+                break;
+
+            } else {
+
+                if (!have || layerMin < min) min = layerMin;
+                if (!have || layerMax > max) max = layerMax;
+                if (layerLog) log = true;
+                have = true;
+            }
+        }
+    }
+
+    return have;
+}
+
+bool
+OffscreenGeometryProvider::hasLightBackground() const
+{
+    bool darkPalette = false;
+    if (m_manager) darkPalette = m_manager->getGlobalDarkBackground();
+
+    Layer::ColourSignificance maxSignificance = Layer::ColourAbsent;
+    bool mostSignificantHasDarkBackground = false;
+
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        Layer *layer = m_layers[i];
+
+        Layer::ColourSignificance s = layer->getLayerColourSignificance();
+        bool light = layer->hasLightBackground();
+
+        if (int(s) > int(maxSignificance)) {
+            maxSignificance = s;
+            mostSignificantHasDarkBackground = !light;
+        } else if (s == maxSignificance && !light) {
+            mostSignificantHasDarkBackground = true;
+        }
+    }
+
+    if (int(maxSignificance) >= int(Layer::ColourAndBackgroundSignificant)) {
+        return !mostSignificantHasDarkBackground;
+    } else {
+        return !darkPalette;
+    }
+}
+
+QColor
+OffscreenGeometryProvider::getForeground() const
+{
+    // There is no widget palette to consult, so use plain black or
+    // white as View does when the palette doesn't match the layers
+    if (hasLightBackground()) return Qt::black;
+    else return Qt::white;
+}
+
+QColor
+OffscreenGeometryProvider::getBackground() const
+{
+    if (hasLightBackground()) return Qt::white;
+    else return Qt::black;
+}
+
+bool
+OffscreenGeometryProvider::shouldShowFeatureLabels() const
+{
+    return m_manager && m_manager->shouldShowFeatureLabels();
+}
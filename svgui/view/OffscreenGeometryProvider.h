@@ -0,0 +1,106 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef OFFSCREEN_GEOMETRY_PROVIDER_H
+#define OFFSCREEN_GEOMETRY_PROVIDER_H
+
+#include "layer/LayerGeometryProvider.h"
+
+#include <vector>
+
+/**
+ * A LayerGeometryProvider that is not backed by any widget, for
+ * painting layers into an image away from the GUI. It describes a
+ * surface of fixed size whose left edge is at a given start frame,
+ * and takes its value extents, background colour and text label
+ * positions from the stack of layers passed to it, in the same way
+ * as View does.
+ *
+ * Unlike View, this has no dependency on the GUI thread, and it may
+ * be used from any thread provided that no other thread is using the
+ * same provider (or painting the same layers) at the same time.
+ * getView() returns 0.
+ */
+class OffscreenGeometryProvider : public LayerGeometryProvider
+{
+public:
+    OffscreenGeometryProvider(ViewManager *manager,
+                              const std::vector<Layer *> &layers,
+                              int zoomLevel,
+                              QSize size);
+    virtual ~OffscreenGeometryProvider();
+
+    /**
+     * Set the frame at the left edge of the paint surface. This is
+     * rounded down to a multiple of the zoom level, as View does with
+     * its start frame.
+     */
+    void setStartFrame(sv_frame_t frame);
+
+    virtual int getId() const { return m_id; }
+
+    virtual sv_frame_t getStartFrame() const { return m_startFrame; }
+    virtual sv_frame_t getCentreFrame() const;
+    virtual sv_frame_t getEndFrame() const;
+    virtual int getXForFrame(sv_frame_t frame) const;
+    virtual sv_frame_t getFrameForX(int x) const;
+    virtual sv_frame_t getModelsStartFrame() const;
+    virtual sv_frame_t getModelsEndFrame() const;
+
+    virtual int getXForViewX(int viewx) const { return viewx; }
+    virtual int getViewXForX(int x) const { return x; }
+
+    virtual double getYForFrequency(double frequency,
+                                    double minFreq, double maxFreq,
+                                    bool logarithmic) const;
+    virtual double getFrequencyForY(double y,
+                                    double minFreq, double maxFreq,
+                                    bool logarithmic) const;
+
+    virtual int getTextLabelHeight(const Layer *layer, QPainter &) const;
+    virtual bool getValueExtents(QString unit, double &min, double &max,
+                                 bool &log) const;
+
+    virtual int getZoomLevel() const { return m_zoomLevel; }
+    virtual QRect getPaintRect() const { return QRect(QPoint(0, 0), m_size); }
+
+    virtual bool hasLightBackground() const;
+    virtual QColor getForeground() const;
+    virtual QColor getBackground() const;
+
+    virtual ViewManager *getViewManager() const { return m_manager; }
+
+    virtual bool shouldIlluminateLocalFeatures(const Layer *, QPoint &) const {
+        return false;
+    }
+    virtual bool shouldShowFeatureLabels() const;
+
+    virtual void drawMeasurementRect(QPainter &, const Layer *,
+                                     QRect, bool) const { }
+
+    virtual void updatePaintRect(QRect) { }
+
+    virtual View *getView() { return 0; }
+    virtual const View *getView() const { return 0; }
+
+private:
+    int m_id;
+    ViewManager *m_manager;
+    std::vector<Layer *> m_layers;
+    int m_zoomLevel;
+    QSize m_size;
+    sv_frame_t m_startFrame;
+};
+
+#endif
@@ -50,6 +50,9 @@
 //#define DEBUG_VIEW 1
 //#define DEBUG_VIEW_WIDGET_PAINT 1
 
+// Minimum interval in ms between repaints prompted by model changes
+static const int MODEL_UPDATE_INTERVAL = 50;
+
 View::View(QWidget *w, bool showProgress) :
     QFrame(w),
     m_id(getNextId()),
@@ -66,12 +69,23 @@ View::View(QWidget *w, bool showProgress) :
     m_cacheCentreFrame(0),
     m_cacheZoomLevel(1024),
     m_selectionCached(false),
+    m_cacheDamaged(false),
+    m_cacheDamageStart(0),
+    m_cacheDamageEnd(0),
+    m_modelUpdateTimer(0),
+    m_modelUpdatePending(false),
     m_deleting(false),
     m_haveSelectedLayer(false),
     m_manager(0),
     m_propertyContainer(new ViewPropertyContainer(this))
 {
 //    cerr << "View::View(" << this << ")" << endl;
+
+    m_modelUpdateTimer = new QTimer(this);
+    m_modelUpdateTimer->setSingleShot(true);
+    m_modelUpdateTimer->setInterval(MODEL_UPDATE_INTERVAL);
+    connect(m_modelUpdateTimer, SIGNAL(timeout()),
+            this, SLOT(modelUpdateTimerElapsed()));
 }
 
 View::~View()
@@ -887,32 +901,78 @@ View::modelChangedWithin(sv_frame_t startFrame, sv_frame_t endFrame)
     return;
     }
 
+    if (startFrame < myStartFrame) startFrame = myStartFrame;
+    if (endFrame > myEndFrame) endFrame = myEndFrame;
+
     // If the model that has changed is not used by any of the cached
-    // layers, we won't need to recreate the cache
+    // layers, we won't need to recreate the cache. If it is, but the
+    // layers using it can redraw just the changed columns, then we
+    // only need to redraw that strip of the cache
 
     bool recreate = false;
+    bool damaged = false;
 
     bool discard;
     LayerList scrollables = getScrollableBackLayers(false, discard);
     for (LayerList::const_iterator i = scrollables.begin();
      i != scrollables.end(); ++i) {
     if (*i == obj || (*i)->getModel() == obj) {
-        recreate = true;
-        break;
+            if ((*i)->isLayerChangeLocal()) {
+                damaged = true;
+            } else {
+                recreate = true;
+                break;
+            }
     }
     }
 
     if (recreate) {
     delete m_cache;
     m_cache = 0;
+    } else if (damaged) {
+        addCacheDamage(startFrame, endFrame);
     }
 
-    if (startFrame < myStartFrame) startFrame = myStartFrame;
-    if (endFrame > myEndFrame) endFrame = myEndFrame;
-
     checkProgress(obj);
 
+    scheduleModelUpdate();
+}
+
+void
+View::addCacheDamage(sv_frame_t startFrame, sv_frame_t endFrame)
+{
+    if (!m_cache) return;
+
+    if (!m_cacheDamaged) {
+        m_cacheDamageStart = startFrame;
+        m_cacheDamageEnd = endFrame;
+        m_cacheDamaged = true;
+    } else {
+        m_cacheDamageStart = std::min(m_cacheDamageStart, startFrame);
+        m_cacheDamageEnd = std::max(m_cacheDamageEnd, endFrame);
+    }
+}
+
+void
+View::scheduleModelUpdate()
+{
+    if (m_modelUpdateTimer->isActive()) {
+        m_modelUpdatePending = true;
+        return;
+    }
+
     update();
+    m_modelUpdateTimer->start();
+}
+
+void
+View::modelUpdateTimerElapsed()
+{
+    if (m_modelUpdatePending) {
+        m_modelUpdatePending = false;
+        update();
+        m_modelUpdateTimer->start();
+    }
 }
 
 void
@@ -1757,6 +1817,18 @@ View::paintEvent(QPaintEvent *e)
     m_selectionCached = false;
     }
 
+    // Columns of the cache that have changed since it was drawn, in
+    // current view coordinates (so valid once the cache has been
+    // scrolled to the current centre frame)
+
+    QRect damageRect;
+    if (m_cacheDamaged) {
+        int dx0 = getXForFrame(m_cacheDamageStart) - 1;
+        int dx1 = getXForFrame(m_cacheDamageEnd) + 1;
+        damageRect = QRect(dx0, 0, dx1 - dx0 + 1, height()) & rect();
+        m_cacheDamaged = false;
+    }
+
     QSize scaledCacheSize(scaledSize(size(), dpratio));
     QRect scaledCacheRect(scaledRect(cacheRect, dpratio));
 
@@ -1826,8 +1898,19 @@ View::paintEvent(QPaintEvent *e)
         cerr << "View(" << this << ")::paintEvent: scrolling too far" << endl;
 #endif
         }
+            if (!damageRect.isEmpty()) {
+                cacheRect |= damageRect;
+            }
         repaintCache = true;
 
+        } else if (!damageRect.isEmpty()) {
+
+            cacheRect = damageRect;
+#ifdef DEBUG_VIEW_WIDGET_PAINT
+            cerr << "View(" << this << ")::paintEvent: redrawing damaged columns " << damageRect.left() << " to " << damageRect.right() << endl;
+#endif
+            repaintCache = true;
+
     } else {
 #ifdef DEBUG_VIEW_WIDGET_PAINT
         cerr << "View(" << this << ")::paintEvent: cache is good" << endl;
@@ -1841,6 +1924,12 @@ View::paintEvent(QPaintEvent *e)
 
     m_cacheCentreFrame = m_centreFrame;
     m_cacheZoomLevel = m_zoomLevel;
+
+        if (repaintCache) {
+            // The region of the cache to redraw may differ from the
+            // region we were asked to paint
+            scaledCacheRect = scaledRect(cacheRect, dpratio);
+        }
     }
 
 #ifdef DEBUG_VIEW_WIDGET_PAINT
@@ -1934,6 +2023,12 @@ View::paintEvent(QPaintEvent *e)
     paint.drawPixmap(finalPaintRect, *m_buffer, scaledRect(finalPaintRect, dpratio));
     paint.end();
 
+    if (!damageRect.isEmpty() && !finalPaintRect.contains(damageRect)) {
+        // We have redrawn changed columns of the cache that we were
+        // not asked to paint, so they still need to reach the screen
+        update(damageRect);
+    }
+
     paint.begin(this);
     setPaintFont(paint);
     if (e) paint.setClipRect(e->rect());
@@ -435,6 +435,8 @@ public slots:
 
     virtual void progressCheckStalledTimerElapsed();
 
+    virtual void modelUpdateTimerElapsed();
+
 protected:
     View(QWidget *, bool showProgress);
 
@@ -484,6 +486,14 @@ protected:
 
     int effectiveDevicePixelRatio() const;
 
+    // Record that the given frame range of the cached layers needs to
+    // be redrawn into m_cache at the next paint
+    void addCacheDamage(sv_frame_t startFrame, sv_frame_t endFrame);
+
+    // Call update(), or arrange to do so shortly if we have just done
+    // so, so that rapid model changes don't repaint us flat out
+    void scheduleModelUpdate();
+
     sv_frame_t          m_centreFrame;
     int                 m_zoomLevel;
     bool                m_followPan;
@@ -500,6 +510,13 @@ protected:
     int                 m_cacheZoomLevel;
     bool                m_selectionCached;
 
+    bool                m_cacheDamaged;
+    sv_frame_t          m_cacheDamageStart;
+    sv_frame_t          m_cacheDamageEnd;
+
+    QTimer             *m_modelUpdateTimer;
+    bool                m_modelUpdatePending;
+
     bool                m_deleting;
 
     LayerList           m_layerStack; // I don't own these, but see dtor note above
@@ -0,0 +1,41 @@
+
+TEMPLATE = app
+
+exists(config.pri) {
+    include(config.pri)
+}
+
+!exists(config.pri) {
+    include(noconfig.pri)
+}
+
+include(base.pri)
+
+CONFIG += console
+QT += network xml gui widgets svg testlib
+
+win32-x-g++:QMAKE_LFLAGS += -Wl,-subsystem,console
+macx*: CONFIG -= app_bundle
+
+TARGET = test-svapp-audio
+
+OBJECTS_DIR = o
+MOC_DIR = o
+
+include(svgui/files.pri)
+include(svapp/files.pri)
+
+for (file, SVGUI_SOURCES)    { SOURCES += $$sprintf("svgui/%1",    $$file) }
+for (file, SVAPP_SOURCES)    { SOURCES += $$sprintf("svapp/%1",    $$file) }
+
+for (file, SVGUI_HEADERS)    { HEADERS += $$sprintf("svgui/%1",    $$file) }
+for (file, SVAPP_HEADERS)    { HEADERS += $$sprintf("svapp/%1",    $$file) }
+
+include(svapp/audio/test/files.pri)
+
+for (file, TEST_SOURCES) { SOURCES += $$sprintf("svapp/audio/test/%1", $$file) }
+for (file, TEST_HEADERS) { HEADERS += $$sprintf("svapp/audio/test/%1", $$file) }
+
+!win32* {
+    QMAKE_POST_LINK = ./$${TARGET}
+}
@@ -405,6 +405,41 @@ PluginHostAdapter::getRemainingFeatures()
     return fs;
 }
 
+void
+PluginHostAdapter::processInto(const float *const *inputBuffers,
+                               RealTime timestamp,
+                               FeatureSet &fs)
+{
+    if (!m_handle) {
+        convertFeaturesInPlace(0, fs);
+        return;
+    }
+
+    int sec = timestamp.sec;
+    int nsec = timestamp.nsec;
+    
+    VampFeatureList *features = m_descriptor->process(m_handle,
+                                                      inputBuffers,
+                                                      sec, nsec);
+    
+    convertFeaturesInPlace(features, fs);
+    m_descriptor->releaseFeatureSet(features);
+}
+
+void
+PluginHostAdapter::getRemainingFeaturesInto(FeatureSet &fs)
+{
+    if (!m_handle) {
+        convertFeaturesInPlace(0, fs);
+        return;
+    }
+    
+    VampFeatureList *features = m_descriptor->getRemainingFeatures(m_handle); 
+
+    convertFeaturesInPlace(features, fs);
+    m_descriptor->releaseFeatureSet(features);
+}
+
 void
 PluginHostAdapter::convertFeatures(VampFeatureList *features,
                                    FeatureSet &fs)
@@ -458,6 +493,63 @@ PluginHostAdapter::convertFeatures(VampFeatureList *features,
     }
 }
 
+void
+PluginHostAdapter::convertFeaturesInPlace(VampFeatureList *features,
+                                          FeatureSet &fs)
+{
+    // As convertFeatures, but overwriting whatever is already in fs.
+    // Lists are resized rather than cleared and refilled, so that
+    // the existing features' value and label storage is reused.
+
+    unsigned int outputs = 0;
+    if (features) outputs = m_descriptor->getOutputCount(m_handle);
+
+    for (FeatureSet::iterator i = fs.begin(); i != fs.end(); ++i) {
+        if (i->first < 0 || (unsigned int)i->first >= outputs) {
+            i->second.clear();
+        }
+    }
+
+    for (unsigned int i = 0; i < outputs; ++i) {
+        
+        VampFeatureList &list = features[i];
+
+        if (list.featureCount == 0) {
+            FeatureSet::iterator fi = fs.find(i);
+            if (fi != fs.end()) fi->second.clear();
+            continue;
+        }
+
+        FeatureList &target = fs[i];
+        target.resize(list.featureCount);
+
+        for (unsigned int j = 0; j < list.featureCount; ++j) {
+
+            Feature &feature = target[j];
+            const VampFeature &v1 = list.features[j].v1;
+
+            feature.hasTimestamp = v1.hasTimestamp;
+            feature.timestamp = RealTime(v1.sec, v1.nsec);
+            feature.hasDuration = false;
+            feature.duration = RealTime();
+
+            if (m_descriptor->vampApiVersion >= 2) {
+                const VampFeatureV2 &v2 = list.features[j + list.featureCount].v2;
+                feature.hasDuration = v2.hasDuration;
+                feature.duration = RealTime(v2.durationSec, v2.durationNsec);
+            }
+
+            feature.values.assign(v1.values, v1.values + v1.valueCount);
+
+            if (v1.label) {
+                feature.label.assign(v1.label);
+            } else {
+                feature.label.clear();
+            }
+        }
+    }
+}
+
 }
 
 _VAMP_SDK_HOSTSPACE_END(PluginHostAdapter.cpp)
@@ -37,9 +37,11 @@
 #include <vamp-hostsdk/PluginSummarisingAdapter.h>
 
 #include <map>
+#include <vector>
 #include <algorithm>
 #include <cmath>
 #include <climits>
+#include <sstream>
 
 using namespace std;
 
@@ -52,6 +54,267 @@ namespace Vamp {
 
 namespace HostExt {
 
+static double toSec(const RealTime &r)
+{
+    return r.sec + double(r.nsec) / 1000000000.0;
+}
+
+/**
+ * A mergeable summary of the distribution of a weighted series of
+ * values, from which quantiles can be estimated in bounded memory.
+ * This is a simple form of the t-digest: values are gathered into
+ * centroids whose permitted weight is smallest near the extremes of
+ * the distribution, where quantiles need the most precision. Equal
+ * values are always merged, so a series with few distinct values is
+ * represented exactly.
+ */
+class QuantileSketch
+{
+public:
+    QuantileSketch() : m_weight(0), m_min(0), m_max(0) { }
+
+    void add(double value, double weight) {
+        if (!(weight > 0)) return;
+        if (m_weight == 0) {
+            m_min = m_max = value;
+        } else {
+            if (value < m_min) m_min = value;
+            if (value > m_max) m_max = value;
+        }
+        m_buffer.push_back(Centroid(value, weight));
+        m_weight += weight;
+        if (m_buffer.size() >= bufferSize) compress();
+    }
+
+    void merge(const QuantileSketch &other) {
+        if (other.m_weight == 0) return;
+        if (m_weight == 0) {
+            m_min = other.m_min;
+            m_max = other.m_max;
+        } else {
+            if (other.m_min < m_min) m_min = other.m_min;
+            if (other.m_max > m_max) m_max = other.m_max;
+        }
+        m_buffer.insert(m_buffer.end(),
+                        other.m_centroids.begin(), other.m_centroids.end());
+        m_buffer.insert(m_buffer.end(),
+                        other.m_buffer.begin(), other.m_buffer.end());
+        m_weight += other.m_weight;
+        compress();
+    }
+
+    double getTotalWeight() const {
+        return m_weight;
+    }
+
+    /**
+     * Return the first value at which the cumulative weight of the
+     * values in ascending order exceeds the given weight, or the
+     * maximum value if it never does.
+     */
+    double getValueAtWeight(double target) {
+        compress();
+        double acc = 0.0;
+        for (size_t i = 0; i < m_centroids.size(); ++i) {
+            acc += m_centroids[i].weight;
+            if (acc > target) {
+                if (i == 0) return m_min;
+                if (i + 1 == m_centroids.size()) return m_max;
+                return m_centroids[i].mean;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+        Centroid(double m, double w) : mean(m), weight(w) { }
+        bool operator<(const Centroid &c) const { return mean < c.mean; }
+    };
+
+    static const size_t compression = 50;
+    static const size_t bufferSize = compression * 4;
+
+    void compress() {
+
+        if (m_buffer.empty()) return;
+
+        m_buffer.insert(m_buffer.end(),
+                        m_centroids.begin(), m_centroids.end());
+        sort(m_buffer.begin(), m_buffer.end());
+        m_centroids.clear();
+
+        double before = 0.0;
+        Centroid current = m_buffer[0];
+
+        for (size_t i = 1; i < m_buffer.size(); ++i) {
+
+            const Centroid &c = m_buffer[i];
+            double proposed = current.weight + c.weight;
+            bool merge = (c.mean == current.mean);
+
+            if (!merge) {
+                double q0 = before / m_weight;
+                double q2 = (before + proposed) / m_weight;
+                double limit = 4.0 * m_weight *
+                    min(q0 * (1.0 - q0), q2 * (1.0 - q2)) / compression;
+                merge = (proposed <= limit);
+            }
+
+            if (merge) {
+                current.mean += (c.mean - current.mean) * c.weight / proposed;
+                current.weight = proposed;
+            } else {
+                before += current.weight;
+                m_centroids.push_back(current);
+                current = c;
+            }
+        }
+
+        m_centroids.push_back(current);
+        m_buffer.clear();
+    }
+
+    vector<Centroid> m_centroids;
+    vector<Centroid> m_buffer;
+    double m_weight;
+    double m_min;
+    double m_max;
+};
+
+/**
+ * A mergeable table of the total weights of the most frequent values
+ * in a series, for finding the mode in bounded memory. This is exact
+ * as long as there are no more than a fixed number of distinct
+ * values; beyond that, the least frequent value is replaced by each
+ * new one ("space-saving"), which keeps the heaviest values with
+ * weights overestimated by at most the weight of the one replaced.
+ */
+class ValueFrequencies
+{
+public:
+    void add(float value, double weight) {
+        if (!(weight > 0)) return;
+        map<float, double>::iterator i = m_weights.find(value);
+        if (i != m_weights.end()) {
+            i->second += weight;
+            return;
+        }
+        if (m_weights.size() >= capacity) {
+            map<float, double>::iterator least = m_weights.begin();
+            for (i = m_weights.begin(); i != m_weights.end(); ++i) {
+                if (i->second < least->second) least = i;
+            }
+            weight += least->second;
+            m_weights.erase(least);
+        }
+        m_weights[value] = weight;
+    }
+
+    void merge(const ValueFrequencies &other) {
+        for (map<float, double>::const_iterator i = other.m_weights.begin();
+             i != other.m_weights.end(); ++i) {
+            add(i->first, i->second);
+        }
+    }
+
+    /**
+     * Return the value with the greatest weight, the lowest such
+     * value if more than one, or zero if there are none.
+     */
+    float getMode() const {
+        float mode = 0.f;
+        double weight = 0.0;
+        for (map<float, double>::const_iterator i = m_weights.begin();
+             i != m_weights.end(); ++i) {
+            if (i->second > weight) {
+                weight = i->second;
+                mode = i->first;
+            }
+        }
+        return mode;
+    }
+
+private:
+    static const size_t capacity = 64;
+    map<float, double> m_weights;
+};
+
+/**
+ * Running statistics for the values of a single bin, both unweighted
+ * and weighted by duration, with mergeable exact moments.
+ */
+struct BinStatistics
+{
+    int count;
+    double minimum;
+    double maximum;
+    double sum;
+    double mean;        // running mean
+    double m2;          // sum of squared differences from running mean
+    double duration;    // total duration
+    double mean_d;      // duration-weighted running mean
+    double m2_d;        // and weighted sum of squared differences
+    QuantileSketch quantiles;
+    QuantileSketch quantiles_d;
+    ValueFrequencies frequencies;
+    ValueFrequencies frequencies_d;
+
+    BinStatistics() :
+        count(0), minimum(0), maximum(0), sum(0), mean(0), m2(0),
+        duration(0), mean_d(0), m2_d(0) { }
+
+    // Add n results of the given value, with the given total duration
+    void add(float value, double dur, int n = 1) {
+        if (n <= 0) return;
+        if (count == 0 || value < minimum) minimum = value;
+        if (count == 0 || value > maximum) maximum = value;
+        double total = double(count) + n;
+        double delta = value - mean;
+        mean += delta * n / total;
+        m2 += delta * delta * double(count) * n / total;
+        count += n;
+        sum += double(value) * n;
+        if (dur > 0) {
+            double wtotal = duration + dur;
+            double wdelta = value - mean_d;
+            mean_d += wdelta * dur / wtotal;
+            m2_d += wdelta * wdelta * duration * dur / wtotal;
+            duration = wtotal;
+        }
+        quantiles.add(value, n);
+        quantiles_d.add(value, dur);
+        frequencies.add(value, n);
+        frequencies_d.add(value, dur);
+    }
+
+    void merge(const BinStatistics &other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.minimum < minimum) minimum = other.minimum;
+        if (count == 0 || other.maximum > maximum) maximum = other.maximum;
+        double total = double(count) + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * double(count) * other.count / total;
+        count += other.count;
+        sum += other.sum;
+        if (other.duration > 0) {
+            double wtotal = duration + other.duration;
+            double wdelta = other.mean_d - mean_d;
+            mean_d += wdelta * other.duration / wtotal;
+            m2_d += other.m2_d +
+                wdelta * wdelta * duration * other.duration / wtotal;
+            duration = wtotal;
+        }
+        quantiles.merge(other.quantiles);
+        quantiles_d.merge(other.quantiles_d);
+        frequencies.merge(other.frequencies);
+        frequencies_d.merge(other.frequencies_d);
+    }
+};
+
 class PluginSummarisingAdapter::Impl
 {
 public:
@@ -74,6 +337,14 @@ public:
     FeatureSet getSummaryForAllOutputs(SummaryType type,
                                        AveragingMethod avg);
 
+    void setAccumulationMode(AccumulationMode mode);
+
+    FeatureList getPercentileForOutput(int output,
+                                       float percentile,
+                                       AveragingMethod avg);
+
+    bool mergeSummaries(Impl &other);
+
 protected:
     Plugin *m_plugin;
     float m_inputSampleRate;
@@ -136,15 +407,43 @@ protected:
 
     OutputSummarySegmentMap m_summaries;
 
+    // Running statistics for all results in a segment. In streaming
+    // mode these are updated as results arrive and used to calculate
+    // the summaries; in either mode they provide percentiles, but in
+    // AccumulateAll mode they are only built when first asked for
+    struct SegmentStatistics {
+        int count;
+        double duration;        // total duration of results
+        RealTime end;           // end time of latest result
+        vector<BinStatistics> bins;
+        SegmentStatistics() : count(0), duration(0) { }
+        void setBinCount(int n);
+        void add(const Result &result);
+        void merge(const SegmentStatistics &other);
+    };
+
+    typedef map<RealTime, SegmentStatistics> SegmentStatisticsMap;
+    typedef map<int, SegmentStatisticsMap> OutputSegmentStatisticsMap;
+    OutputSegmentStatisticsMap m_statistics; // output -> segmented
+
+    AccumulationMode m_mode;
     bool m_reduced;
     RealTime m_endTime;
 
+    typedef vector<pair<RealTime, Result> > SegmentChunkList;
+
     void accumulate(const FeatureSet &fs, RealTime, bool final);
     void accumulate(int output, const Feature &f, RealTime, bool final);
     void accumulateFinalDurations();
     void findSegmentBounds(RealTime t, RealTime &start, RealTime &end);
+    void segmentResult(const Result &result, SegmentChunkList &chunks);
     void segment();
     void reduce();
+    void streamResults(int output, bool final);
+    void finishStreaming();
+    void reduceStatistics();
+    void buildStatistics(int output);
+    void summarise();
 
     string getSummaryLabel(SummaryType type, AveragingMethod avg);
 };
@@ -210,9 +509,30 @@ PluginSummarisingAdapter::getSummaryForAllOutputs(SummaryType type,
     return m_impl->getSummaryForAllOutputs(type, avg);
 }
 
+void
+PluginSummarisingAdapter::setAccumulationMode(AccumulationMode mode)
+{
+    m_impl->setAccumulationMode(mode);
+}
+
+Plugin::FeatureList
+PluginSummarisingAdapter::getPercentileForOutput(int output,
+                                                 float percentile,
+                                                 AveragingMethod avg)
+{
+    return m_impl->getPercentileForOutput(output, percentile, avg);
+}
+
+bool
+PluginSummarisingAdapter::mergeSummaries(PluginSummarisingAdapter &other)
+{
+    return m_impl->mergeSummaries(*other.m_impl);
+}
+
 PluginSummarisingAdapter::Impl::Impl(Plugin *plugin, float inputSampleRate) :
     m_plugin(plugin),
     m_inputSampleRate(inputSampleRate),
+    m_mode(AccumulateAll),
     m_reduced(false)
 {
 }
@@ -237,6 +557,7 @@ PluginSummarisingAdapter::Impl::reset()
     m_prevTimestamps.clear();
     m_prevDurations.clear();
     m_summaries.clear();
+    m_statistics.clear();
     m_reduced = false;
     m_endTime = RealTime();
     m_plugin->reset();
@@ -274,6 +595,9 @@ PluginSummarisingAdapter::Impl::getRemainingFeatures()
 void
 PluginSummarisingAdapter::Impl::setSummarySegmentBoundaries(const SegmentBoundaries &b)
 {
+    if (m_mode == AccumulateStreaming && !m_statistics.empty()) {
+        cerr << "WARNING: PluginSummarisingAdapter::setSummarySegmentBoundaries() called after features have been accumulated in streaming mode; earlier features will not be re-segmented" << endl;
+    }
     m_boundaries = b;
 #ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER
     cerr << "PluginSummarisingAdapter::setSummarySegmentBoundaries: boundaries are:" << endl;
@@ -290,12 +614,7 @@ PluginSummarisingAdapter::Impl::getSummaryForOutput(int output,
                                                     SummaryType type,
                                                     AveragingMethod avg)
 {
-    if (!m_reduced) {
-        accumulateFinalDurations();
-        segment();
-        reduce();
-        m_reduced = true;
-    }
+    summarise();
 
     bool continuous = (avg == ContinuousTimeAverage);
 
@@ -393,12 +712,7 @@ Plugin::FeatureSet
 PluginSummarisingAdapter::Impl::getSummaryForAllOutputs(SummaryType type,
                                                         AveragingMethod avg)
 {
-    if (!m_reduced) {
-        accumulateFinalDurations();
-        segment();
-        reduce();
-        m_reduced = true;
-    }
+    summarise();
 
     FeatureSet fs;
     for (OutputSummarySegmentMap::const_iterator i = m_summaries.begin();
@@ -408,6 +722,158 @@ PluginSummarisingAdapter::Impl::getSummaryForAllOutputs(SummaryType type,
     return fs;
 }
 
+void
+PluginSummarisingAdapter::Impl::setAccumulationMode(AccumulationMode mode)
+{
+    m_mode = mode;
+}
+
+Plugin::FeatureList
+PluginSummarisingAdapter::Impl::getPercentileForOutput(int output,
+                                                       float percentile,
+                                                       AveragingMethod avg)
+{
+    summarise();
+
+    if (m_mode != AccumulateStreaming) {
+        buildStatistics(output);
+    }
+
+    bool continuous = (avg == ContinuousTimeAverage);
+    double proportion = percentile / 100.0;
+    if (proportion < 0.0) proportion = 0.0;
+    if (proportion > 1.0) proportion = 1.0;
+
+    ostringstream label;
+    label << "(" << percentile << "th percentile"
+          << (continuous ? ", continuous-time average" : ", sample average")
+          << ")";
+
+    FeatureList fl;
+    SegmentStatisticsMap &segments = m_statistics[output];
+
+    for (SegmentStatisticsMap::iterator i = segments.begin();
+         i != segments.end(); ++i) {
+
+        Feature f;
+
+        f.hasTimestamp = true;
+        f.timestamp = i->first;
+
+        f.hasDuration = true;
+        SegmentStatisticsMap::iterator ii = i;
+        if (++ii == segments.end()) {
+            f.duration = m_endTime - f.timestamp;
+        } else {
+            f.duration = ii->first - f.timestamp;
+        }
+
+        f.label = label.str();
+
+        SegmentStatistics &stats = i->second;
+
+        // As for the median summary, the continuous-time percentile
+        // is taken over the whole span of the segment up to the end
+        // of its last result
+
+        double totalDuration = toSec(stats.end - i->first);
+
+        for (int bin = 0; bin < int(stats.bins.size()); ++bin) {
+            double result;
+            if (continuous) {
+                result = stats.bins[bin].quantiles_d.getValueAtWeight
+                    (proportion * totalDuration);
+            } else {
+                result = stats.bins[bin].quantiles.getValueAtWeight
+                    (proportion * stats.count);
+            }
+            f.values.push_back(float(result));
+        }
+
+        fl.push_back(f);
+    }
+
+    return fl;
+}
+
+bool
+PluginSummarisingAdapter::Impl::mergeSummaries(Impl &other)
+{
+    if (m_mode != AccumulateStreaming ||
+        other.m_mode != AccumulateStreaming) {
+        cerr << "WARNING: PluginSummarisingAdapter::mergeSummaries() requires both adapters to be in streaming mode" << endl;
+        return false;
+    }
+
+    if (m_reduced || other.m_reduced) {
+        cerr << "WARNING: Cannot call PluginSummarisingAdapter::mergeSummaries() after one of the getSummary methods" << endl;
+        return false;
+    }
+
+    // Close off both adapters' final results before the end time
+    // changes, as their durations may depend on it
+
+    finishStreaming();
+    other.finishStreaming();
+
+    for (OutputAccumulatorMap::iterator i = other.m_accumulators.begin();
+         i != other.m_accumulators.end(); ++i) {
+        if (i->second.bins > m_accumulators[i->first].bins) {
+            m_accumulators[i->first].bins = i->second.bins;
+        }
+    }
+
+    for (OutputSegmentStatisticsMap::iterator i = other.m_statistics.begin();
+         i != other.m_statistics.end(); ++i) {
+        for (SegmentStatisticsMap::iterator j = i->second.begin();
+             j != i->second.end(); ++j) {
+            m_statistics[i->first][j->first].merge(j->second);
+        }
+    }
+
+    other.m_statistics.clear();
+
+    if (other.m_endTime > m_endTime) {
+        m_endTime = other.m_endTime;
+    }
+
+    return true;
+}
+
+void
+PluginSummarisingAdapter::Impl::summarise()
+{
+    if (!m_reduced) {
+        if (m_mode == AccumulateStreaming) {
+            finishStreaming();
+            reduceStatistics();
+        } else {
+            accumulateFinalDurations();
+            segment();
+            reduce();
+        }
+        m_reduced = true;
+    }
+}
+
+void
+PluginSummarisingAdapter::Impl::finishStreaming()
+{
+    // Assign durations to the last result on each output and fold
+    // everything still pending into the statistics. Any subsequent
+    // feature starts a new series rather than closing an old result
+
+    accumulateFinalDurations();
+
+    for (OutputAccumulatorMap::iterator i = m_accumulators.begin();
+         i != m_accumulators.end(); ++i) {
+        streamResults(i->first, true);
+    }
+
+    m_prevTimestamps.clear();
+    m_prevDurations.clear();
+}
+
 void
 PluginSummarisingAdapter::Impl::accumulate(const FeatureSet &fs,
                                            RealTime timestamp, 
@@ -535,6 +1001,13 @@ PluginSummarisingAdapter::Impl::accumulate(int output,
         m_accumulators[output].results
             [m_accumulators[output].results.size() - 1]
             .duration = prevDuration;
+
+        // In streaming mode, the previous result is now complete and
+        // can be disposed of into the running statistics
+
+        if (m_mode == AccumulateStreaming) {
+            streamResults(output, false);
+        }
     }
 
     if (f.hasDuration) m_prevDurations[output] = f.duration;
@@ -638,6 +1111,63 @@ PluginSummarisingAdapter::Impl::findSegmentBounds(RealTime t,
 #endif
 }
 
+void
+PluginSummarisingAdapter::Impl::segmentResult(const Result &result,
+                                              SegmentChunkList &chunks)
+{
+    // This result spans result.time to result.time + result.duration.
+    // We need to dispose it into segments appropriately
+
+    RealTime resultStart = result.time;
+    RealTime resultEnd = resultStart + result.duration;
+
+#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
+    cerr << "result start = " << resultStart << ", end = " << resultEnd << endl;
+#endif
+
+    RealTime segmentStart = RealTime::zeroTime;
+    RealTime segmentEnd = resultEnd - RealTime(1, 0);
+            
+    RealTime prevSegmentStart = segmentStart - RealTime(1, 0);
+
+    while (segmentEnd < resultEnd) {
+
+#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
+        cerr << "segment end " << segmentEnd << " < result end "
+                  << resultEnd << " (with result start " << resultStart << ")" <<  endl;
+#endif
+
+        findSegmentBounds(resultStart, segmentStart, segmentEnd);
+
+        if (segmentStart == prevSegmentStart) {
+            // This can happen when we reach the end of the
+            // input, if a feature's end time overruns the
+            // input audio end time
+            break;
+        }
+        prevSegmentStart = segmentStart;
+                
+        RealTime chunkStart = resultStart;
+        if (chunkStart < segmentStart) chunkStart = segmentStart;
+
+        RealTime chunkEnd = resultEnd;
+        if (chunkEnd > segmentEnd) chunkEnd = segmentEnd;
+                
+        Result chunk;
+        chunk.time = chunkStart;
+        chunk.duration = chunkEnd - chunkStart;
+        chunk.values = result.values;
+
+#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
+        cerr << "chunk for segment " << segmentStart << ": from " << chunk.time << ", duration " << chunk.duration << endl;
+#endif
+
+        chunks.push_back(pair<RealTime, Result>(segmentStart, chunk));
+
+        resultStart = chunkEnd;
+    }
+}
+
 void
 PluginSummarisingAdapter::Impl::segment()
 {
@@ -662,64 +1192,106 @@ PluginSummarisingAdapter::Impl::segment()
         // ask for segmentation (or any summary at all) in that case
 
         for (int n = 0; n < int(source.results.size()); ++n) {
-            
-            // This result spans source.results[n].time to
-            // source.results[n].time + source.results[n].duration.
-            // We need to dispose it into segments appropriately
 
-            RealTime resultStart = source.results[n].time;
-            RealTime resultEnd = resultStart + source.results[n].duration;
+            SegmentChunkList chunks;
+            segmentResult(source.results[n], chunks);
 
-#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
-            cerr << "output: " << output << ", result start = " << resultStart << ", end = " << resultEnd << endl;
-#endif
+            for (int c = 0; c < int(chunks.size()); ++c) {
+                OutputAccumulator &target =
+                    m_segmentedAccumulators[output][chunks[c].first];
+                target.bins = source.bins;
+                target.results.push_back(chunks[c].second);
+            }
+        }
+    }
+}
 
-            RealTime segmentStart = RealTime::zeroTime;
-            RealTime segmentEnd = resultEnd - RealTime(1, 0);
-            
-            RealTime prevSegmentStart = segmentStart - RealTime(1, 0);
+void
+PluginSummarisingAdapter::Impl::streamResults(int output, bool final)
+{
+    // Fold complete results for this output into the running
+    // statistics and discard them, in order. Until the final call, a
+    // result is only complete once its duration is known and it ends
+    // before the current end time: the final segment extends to the
+    // end time, so anything overrunning it would be truncated early
 
-            while (segmentEnd < resultEnd) {
+    OutputAccumulator &source = m_accumulators[output];
 
-#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
-                cerr << "segment end " << segmentEnd << " < result end "
-                          << resultEnd << " (with result start " << resultStart << ")" <<  endl;
-#endif
+    int n = 0;
 
-                findSegmentBounds(resultStart, segmentStart, segmentEnd);
+    for (n = 0; n < int(source.results.size()); ++n) {
 
-                if (segmentStart == prevSegmentStart) {
-                    // This can happen when we reach the end of the
-                    // input, if a feature's end time overruns the
-                    // input audio end time
-                    break;
-                }
-                prevSegmentStart = segmentStart;
-                
-                RealTime chunkStart = resultStart;
-                if (chunkStart < segmentStart) chunkStart = segmentStart;
+        const Result &result = source.results[n];
 
-                RealTime chunkEnd = resultEnd;
-                if (chunkEnd > segmentEnd) chunkEnd = segmentEnd;
-                
-                m_segmentedAccumulators[output][segmentStart].bins = source.bins;
+        if (!final) {
+            if (result.duration == INVALID_DURATION ||
+                result.time + result.duration > m_endTime) {
+                break;
+            }
+        }
 
-                Result chunk;
-                chunk.time = chunkStart;
-                chunk.duration = chunkEnd - chunkStart;
-                chunk.values = source.results[n].values;
+        SegmentChunkList chunks;
+        segmentResult(result, chunks);
 
-#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER_SEGMENT
-                cerr << "chunk for segment " << segmentStart << ": from " << chunk.time << ", duration " << chunk.duration << endl;
-#endif
+        for (int c = 0; c < int(chunks.size()); ++c) {
+            SegmentStatistics &target = m_statistics[output][chunks[c].first];
+            target.setBinCount(source.bins);
+            target.add(chunks[c].second);
+        }
+    }
 
-                m_segmentedAccumulators[output][segmentStart].results
-                    .push_back(chunk);
+    source.results.erase(source.results.begin(), source.results.begin() + n);
+}
 
-                resultStart = chunkEnd;
-            }
+void
+PluginSummarisingAdapter::Impl::SegmentStatistics::setBinCount(int n)
+{
+    // Results with fewer values than there are bins count as zero in
+    // the missing bins (see reduce())
+
+    while (int(bins.size()) < n) {
+        bins.push_back(BinStatistics());
+        bins[bins.size()-1].add(0.f, duration, count);
+    }
+}
+
+void
+PluginSummarisingAdapter::Impl::SegmentStatistics::add(const Result &result)
+{
+    double dur = toSec(result.duration);
+
+    setBinCount(int(result.values.size()));
+
+    for (int bin = 0; bin < int(bins.size()); ++bin) {
+        float value = 0.f;
+        if (bin < int(result.values.size())) value = result.values[bin];
+        bins[bin].add(value, dur);
+    }
+
+    ++count;
+    duration += dur;
+    end = result.time + result.duration;
+}
+
+void
+PluginSummarisingAdapter::Impl::SegmentStatistics::merge
+(const SegmentStatistics &other)
+{
+    if (other.count == 0) return;
+
+    setBinCount(int(other.bins.size()));
+
+    for (int bin = 0; bin < int(bins.size()); ++bin) {
+        if (bin < int(other.bins.size())) {
+            bins[bin].merge(other.bins[bin]);
+        } else {
+            bins[bin].add(0.f, other.duration, other.count);
         }
     }
+
+    if (count == 0 || other.end > end) end = other.end;
+    count += other.count;
+    duration += other.duration;
 }
 
 struct ValueDurationFloatPair
@@ -739,11 +1311,6 @@ struct ValueDurationFloatPair
     }
 };
 
-static double toSec(const RealTime &r)
-{
-    return r.sec + double(r.nsec) / 1000000000.0;
-}
-
 void
 PluginSummarisingAdapter::Impl::reduce()
 {
@@ -976,7 +1543,113 @@ PluginSummarisingAdapter::Impl::reduce()
         }
     }
 
-    m_segmentedAccumulators.clear();
+    // The segmented results are kept until a percentile is requested
+    // for their output, when they go into the statistics instead (see
+    // buildStatistics())
+
+    m_accumulators.clear();
+}
+
+void
+PluginSummarisingAdapter::Impl::buildStatistics(int output)
+{
+    // In AccumulateAll mode the running statistics are needed only
+    // for percentiles, so rather than keep them for every output as
+    // the results arrive, we build them from the retained results
+    // the first time a percentile is requested for each output
+
+    OutputSegmentAccumulatorMap::iterator i =
+        m_segmentedAccumulators.find(output);
+
+    if (i == m_segmentedAccumulators.end()) return;
+
+    SegmentAccumulatorMap &segments = i->second;
+
+    for (SegmentAccumulatorMap::iterator j = segments.begin();
+         j != segments.end(); ++j) {
+
+        OutputAccumulator &accumulator = j->second;
+        SegmentStatistics &stats = m_statistics[output][j->first];
+
+        stats.setBinCount(accumulator.bins);
+        for (int k = 0; k < int(accumulator.results.size()); ++k) {
+            stats.add(accumulator.results[k]);
+        }
+    }
+
+    m_segmentedAccumulators.erase(i);
+}
+
+void
+PluginSummarisingAdapter::Impl::reduceStatistics()
+{
+    // The streaming equivalent of reduce(). Count, minimum, maximum,
+    // sum and the means and variances are exact (to rounding); the
+    // medians and modes are estimated from the sketches, and are
+    // exact for series with few distinct values
+
+    for (OutputSegmentStatisticsMap::iterator i = m_statistics.begin();
+         i != m_statistics.end(); ++i) {
+
+        int output = i->first;
+        SegmentStatisticsMap &segments = i->second;
+
+        for (SegmentStatisticsMap::iterator j = segments.begin();
+             j != segments.end(); ++j) {
+
+            RealTime segmentStart = j->first;
+            SegmentStatistics &stats = j->second;
+
+            if (stats.count == 0) continue;
+
+            stats.setBinCount(m_accumulators[output].bins);
+
+            double totalDuration = toSec(stats.end - segmentStart);
+
+#ifdef DEBUG_PLUGIN_SUMMARISING_ADAPTER
+            cerr << "reduceStatistics: segment starting at " << segmentStart
+                 << " on output " << output << " has " << stats.count
+                 << " result(s), total duration " << totalDuration << endl;
+#endif
+
+            for (int bin = 0; bin < int(stats.bins.size()); ++bin) {
+
+                BinStatistics &b = stats.bins[bin];
+
+                OutputBinSummary summary;
+
+                summary.count = stats.count;
+
+                summary.minimum = b.minimum;
+                summary.maximum = b.maximum;
+                summary.sum = b.sum;
+
+                summary.median =
+                    b.quantiles.getValueAtWeight(stats.count / 2.0);
+                summary.median_c =
+                    b.quantiles_d.getValueAtWeight(totalDuration / 2.0);
+
+                summary.mode = b.frequencies.getMode();
+                summary.mode_c = b.frequencies_d.getMode();
+
+                summary.mean_c = 0.f;
+                summary.variance_c = 0.f;
+
+                if (totalDuration > 0.0) {
+                    double mean_c = (b.mean_d * b.duration) / totalDuration;
+                    double offset = b.mean_d - mean_c;
+                    summary.mean_c = mean_c;
+                    summary.variance_c =
+                        (b.m2_d + b.duration * offset * offset) / totalDuration;
+                }
+
+                summary.variance = b.m2 / stats.count;
+
+                m_summaries[output][segmentStart][bin] = summary;
+            }
+        }
+    }
+
     m_accumulators.clear();
 }
 
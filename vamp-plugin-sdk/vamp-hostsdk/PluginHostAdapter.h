@@ -107,8 +107,27 @@ public:
 
     FeatureSet getRemainingFeatures();
 
+    /**
+     * Equivalents of process() and getRemainingFeatures() that write
+     * the returned features into an existing FeatureSet rather than
+     * constructing a new one. Any features already in the set are
+     * replaced, and the storage of their value vectors and labels is
+     * reused where possible, so that a host calling these repeatedly
+     * with the same FeatureSet does not need to allocate memory on
+     * every process call once the set has reached its working size.
+     *
+     * These are not part of the Vamp::Plugin interface, and so are
+     * only available to hosts that have direct access to a
+     * PluginHostAdapter rather than to a wrapper around one.
+     */
+    void processInto(const float *const *inputBuffers, RealTime timestamp,
+                     FeatureSet &features);
+
+    void getRemainingFeaturesInto(FeatureSet &features);
+
 protected:
     void convertFeatures(VampFeatureList *, FeatureSet &);
+    void convertFeaturesInPlace(VampFeatureList *, FeatureSet &);
 
     const VampPluginDescriptor *m_descriptor;
     VampPluginHandle m_handle;
@@ -118,6 +118,37 @@ public:
      */
     void setSummarySegmentBoundaries(const SegmentBoundaries &);
 
+    /**
+     * AccumulationMode indicates how the adapter should retain the
+     * features returned by the plugin until they are summarised.
+     *
+     * If AccumulateAll is specified (the default), every feature is
+     * retained until the first call to one of the getSummary
+     * functions, and all summaries are calculated exactly from them.
+     * Memory use grows with the number of features returned.
+     *
+     * If AccumulateStreaming is specified, each feature is folded
+     * into running statistics as soon as its duration is known, and
+     * then discarded, so that memory use is constant for each output
+     * bin and summary segment however long the input. The minimum,
+     * maximum, sum, count, mean and variance are still exact. The
+     * median and other percentiles are estimated from a compact
+     * quantile sketch, and the mode from a bounded table of the most
+     * frequent values: these are exact for features with few
+     * distinct values, and close approximations otherwise.
+     *
+     * The mode must be set before the plugin is run, and in
+     * streaming mode any segment boundaries must also be set before
+     * the plugin is run, as features are assigned to segments as
+     * they arrive.
+     */
+    enum AccumulationMode {
+        AccumulateAll       = 0,
+        AccumulateStreaming = 1
+    };
+
+    void setAccumulationMode(AccumulationMode mode);
+
     enum SummaryType {
         Minimum            = 0,
         Maximum            = 1,
@@ -183,6 +214,43 @@ public:
     FeatureSet getSummaryForAllOutputs(SummaryType type,
                                        AveragingMethod method = SampleAverage);
 
+    /**
+     * Return the given percentile (between 0 and 100) of the features
+     * that were returned on the given output, using the given
+     * AveragingMethod. The 50th percentile is the median.
+     *
+     * Percentiles are estimated from a quantile sketch in either
+     * accumulation mode, and so may differ slightly from the exact
+     * Median summary obtained in AccumulateAll mode. In AccumulateAll
+     * mode the sketches for an output are built from its retained
+     * features on the first call for that output, and the features
+     * are then released; until then they are kept, even after the
+     * other summaries have been calculated.
+     *
+     * The plugin must have been fully run (process() and
+     * getRemainingFeatures() calls all made as appropriate) before
+     * this function is called.
+     */
+    FeatureList getPercentileForOutput(int output,
+                                       float percentile,
+                                       AveragingMethod method = SampleAverage);
+
+    /**
+     * Merge the features accumulated by another adapter into this
+     * one, so that the summaries returned by this adapter describe
+     * the inputs of both. This allows a long input to be divided into
+     * consecutive chunks of time, each run through a separate
+     * instance of the same plugin (perhaps in parallel) with correct
+     * timestamps, and the results summarised as a whole.
+     *
+     * Both adapters must be in AccumulateStreaming mode with the same
+     * segment boundaries, and both plugins must have been fully run.
+     * The other adapter should not be used for summaries afterwards.
+     * Returns false if the adapters were not in streaming mode or
+     * summaries have already been calculated.
+     */
+    bool mergeSummaries(PluginSummarisingAdapter &other);
+
 protected:
     class Impl;
     Impl *m_impl;